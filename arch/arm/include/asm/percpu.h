@@ -3,4 +3,56 @@
 
 #include <asm-generic/percpu.h>
 
+#ifndef CONFIG_GENERIC_ATOMIC64
+/*
+ * Double word cmpxchg on a pair of adjacent per cpu words using
+ * ldrexd/strexd.  The exclusive monitor is cleared on every exception
+ * return, so an interrupt hitting between the load and the store makes
+ * the store fail and the sequence is retried: this is irq safe without
+ * having to disable interrupts.  Only the local cpu ever updates the
+ * words, so no barriers are needed.
+ */
+static inline int __arm_cpu_cmpxchg_double(u32 *ptr, u32 o1, u32 o2,
+					   u32 n1, u32 n2)
+{
+	union { u64 v; u32 w[2]; } old, new, cur;
+	unsigned long res;
+
+	/* w[0] always ends up in the first register of the ldrexd pair */
+	old.w[0] = o1;
+	old.w[1] = o2;
+	new.w[0] = n1;
+	new.w[1] = n2;
+
+	do {
+		__asm__ __volatile__("@ cpu_cmpxchg_double\n"
+		"ldrexd		%1, %H1, [%3]\n"
+		"mov		%0, #0\n"
+		"teq		%1, %4\n"
+		"teqeq		%H1, %H4\n"
+		"strexdeq	%0, %5, %H5, [%3]"
+		: "=&r" (res), "=&r" (cur.v), "+Qo" (*(u64 *)ptr)
+		: "r" (ptr), "r" (old.v), "r" (new.v)
+		: "cc");
+	} while (res);
+
+	return cur.v == old.v;
+}
+
+#define arm_cpu_cmpxchg_double(pcp1, o1, o2, n1, n2)			\
+({									\
+	int __ret;							\
+	preempt_disable();						\
+	__ret = __arm_cpu_cmpxchg_double((u32 *)__this_cpu_ptr(&(pcp1)), \
+			(u32)(unsigned long)(o1), (u32)(unsigned long)(o2), \
+			(u32)(unsigned long)(n1), (u32)(unsigned long)(n2)); \
+	preempt_enable();						\
+	__ret;								\
+})
+
+#define __this_cpu_cmpxchg_double_4(pcp1, pcp2, o1, o2, n1, n2)		arm_cpu_cmpxchg_double(pcp1, o1, o2, n1, n2)
+#define this_cpu_cmpxchg_double_4(pcp1, pcp2, o1, o2, n1, n2)		arm_cpu_cmpxchg_double(pcp1, o1, o2, n1, n2)
+#define irqsafe_cpu_cmpxchg_double_4(pcp1, pcp2, o1, o2, n1, n2)	arm_cpu_cmpxchg_double(pcp1, o1, o2, n1, n2)
+#endif /* !CONFIG_GENERIC_ATOMIC64 */
+
 #endif
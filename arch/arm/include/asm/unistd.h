@@ -403,6 +403,13 @@
 #define __NR_sendmmsg			(__NR_SYSCALL_BASE+374)
 #define __NR_setns			(__NR_SYSCALL_BASE+375)
 
+/*
+ * Not in mainline: numbered well above its range, so that the syscalls
+ * mainline keeps adding after 375 never land in these.
+ */
+#define __NR_io_ring_setup		(__NR_SYSCALL_BASE+1000)
+#define __NR_io_ring_enter		(__NR_SYSCALL_BASE+1001)
+
 /*
  * The following SWIs are ARM private.
  */
@@ -352,10 +352,13 @@
 #define __NR_syncfs             344
 #define __NR_sendmmsg		345
 #define __NR_setns		346
+/* Not in mainline, numbered well above its range */
+#define __NR_io_ring_setup	1000
+#define __NR_io_ring_enter	1001
 
 #ifdef __KERNEL__
 
-#define NR_syscalls 347
+#define NR_syscalls 1002
 
 #define __ARCH_WANT_IPC_PARSE_VERSION
 #define __ARCH_WANT_OLD_READDIR
@@ -681,6 +681,11 @@ __SYSCALL(__NR_syncfs, sys_syncfs)
 __SYSCALL(__NR_sendmmsg, sys_sendmmsg)
 #define __NR_setns				308
 __SYSCALL(__NR_setns, sys_setns)
+/* Not in mainline, numbered well above its range */
+#define __NR_io_ring_setup			1000
+__SYSCALL(__NR_io_ring_setup, sys_io_ring_setup)
+#define __NR_io_ring_enter			1001
+__SYSCALL(__NR_io_ring_enter, sys_io_ring_enter)
 
 #ifndef __NO_STUBS
 #define __ARCH_WANT_OLD_READDIR
@@ -35,6 +35,8 @@
 #include <linux/eventfd.h>
 #include <linux/blkdev.h>
 #include <linux/compat.h>
+#include <linux/poll.h>
+#include <linux/socket.h>
 
 #include <asm/kmap_types.h>
 #include <asm/uaccess.h>
@@ -102,6 +104,14 @@ static void aio_free_ring(struct kioctx *ctx)
 		kfree(info->ring_pages);
 	info->ring_pages = NULL;
 	info->nr = 0;
+
+	if (ctx->sq_mmap_size) {
+		down_write(&ctx->mm->mmap_sem);
+		do_munmap(ctx->mm, (unsigned long)ctx->sq_ring,
+			  ctx->sq_mmap_size);
+		up_write(&ctx->mm->mmap_sem);
+		ctx->sq_mmap_size = 0;
+	}
 }
 
 static int aio_setup_ring(struct kioctx *ctx)
@@ -277,6 +287,7 @@ static struct kioctx *ioctx_alloc(unsigned nr_events)
 	spin_lock_init(&ctx->ctx_lock);
 	spin_lock_init(&ctx->ring_info.ring_lock);
 	init_waitqueue_head(&ctx->wait);
+	mutex_init(&ctx->sq_lock);
 
 	INIT_LIST_HEAD(&ctx->active_reqs);
 	INIT_LIST_HEAD(&ctx->run_list);
@@ -437,6 +448,9 @@ void exit_aio(struct mm_struct *mm)
  * This prevents races between the aio code path referencing the
  * req (after submitting it) and aio_complete() freeing the req.
  */
+static int aio_wake_function(wait_queue_t *wait, unsigned mode,
+			     int sync, void *key);
+
 static struct kiocb *__aio_get_req(struct kioctx *ctx)
 {
 	struct kiocb *req = NULL;
@@ -458,6 +472,9 @@ static struct kiocb *__aio_get_req(struct kioctx *ctx)
 	req->ki_iovec = NULL;
 	INIT_LIST_HEAD(&req->ki_run_list);
 	req->ki_eventfd = NULL;
+	req->ki_cred = NULL;
+	init_waitqueue_func_entry(&req->ki_wait.wait, aio_wake_function);
+	INIT_LIST_HEAD(&req->ki_wait.wait.task_list);
 
 	/* Check if the completion queue has enough free space to
 	 * accept an event from this io.
@@ -501,6 +518,8 @@ static inline void really_put_req(struct kioctx *ctx, struct kiocb *req)
 
 	if (req->ki_eventfd != NULL)
 		eventfd_ctx_put(req->ki_eventfd);
+	if (req->ki_cred)
+		put_cred(req->ki_cred);
 	if (req->ki_dtor)
 		req->ki_dtor(req);
 	if (req->ki_iovec != &req->ki_inline_vec)
@@ -789,14 +808,17 @@ static void aio_queue_work(struct kioctx * ctx)
 {
 	unsigned long timeout;
 	/*
-	 * if someone is waiting, get the work started right
-	 * away, otherwise, use a longer delay
+	 * if someone is waiting in io_getevents, let them run the
+	 * retries in their own context and only have the work queue
+	 * pick up what they leave behind, otherwise get the work
+	 * started right away
 	 */
 	smp_mb();
-	if (waitqueue_active(&ctx->wait))
-		timeout = 1;
-	else
+	if (waitqueue_active(&ctx->wait)) {
+		wake_up(&ctx->wait);
 		timeout = HZ/10;
+	} else
+		timeout = 1;
 	queue_delayed_work(aio_wq, &ctx->wq, timeout);
 }
 
@@ -889,6 +911,29 @@ void kick_iocb(struct kiocb *iocb)
 }
 EXPORT_SYMBOL(kick_iocb);
 
+/*
+ * aio_wake_function:
+ *	Wake function of kiocb->ki_wait, queued on a page waitqueue
+ *	by an async buffered read that found the page locked for I/O.
+ *	Kicks the iocb once the page is unlocked.
+ */
+static int aio_wake_function(wait_queue_t *wait, unsigned mode,
+			     int sync, void *arg)
+{
+	struct wait_bit_queue *wait_bit
+		= container_of(wait, struct wait_bit_queue, wait);
+	struct wait_bit_key *key = arg;
+
+	if (wait_bit->key.flags != key->flags ||
+	    wait_bit->key.bit_nr != key->bit_nr ||
+	    test_bit(key->bit_nr, key->flags))
+		return 0;
+
+	list_del_init(&wait->task_list);
+	kick_iocb(container_of(wait_bit, struct kiocb, ki_wait));
+	return 1;
+}
+
 /* aio_complete
  *	Called when the io request on the given iocb is complete.
  *	Returns true if this is the last user of the request.  The 
@@ -1154,6 +1199,12 @@ retry:
 			}
 			if (to.timed_out)	/* Only check after read evt */
 				break;
+			/* Run kicked retries here rather than in aio_wq */
+			if (!list_empty(&ctx->run_list)) {
+				set_task_state(tsk, TASK_RUNNING);
+				aio_run_all_iocbs(ctx);
+				continue;
+			}
 			/* Try to only show up in io wait if there are ops
 			 *  in flight */
 			if (ctx->reqs_active)
@@ -1378,6 +1429,208 @@ static ssize_t aio_fsync(struct kiocb *iocb)
 	return ret;
 }
 
+struct aio_poll_table {
+	poll_table		pt;
+	struct kiocb		*iocb;
+	int			error;
+};
+
+/*
+ * aio_poll_wake:
+ *	Wake function of kiocb->ki_wait while it is queued on the
+ *	waitqueue of a polled file.  Kicks the iocb when one of the
+ *	events it waits for shows up.
+ */
+static int aio_poll_wake(wait_queue_t *wait, unsigned mode, int sync,
+			 void *key)
+{
+	struct kiocb *iocb = container_of(wait, struct kiocb, ki_wait.wait);
+
+	if (key && !((unsigned long)key & iocb->ki_events))
+		return 0;
+
+	list_del_init(&wait->task_list);
+	kick_iocb(iocb);
+	return 1;
+}
+
+static void aio_poll_queue_proc(struct file *file, wait_queue_head_t *head,
+				poll_table *pt)
+{
+	struct aio_poll_table *apt = container_of(pt, struct aio_poll_table, pt);
+	struct kiocb *iocb = apt->iocb;
+
+	/* ki_wait can only be on one waitqueue */
+	if (unlikely(iocb->private)) {
+		apt->error = -EOPNOTSUPP;
+		return;
+	}
+	iocb->private = head;
+	add_wait_queue(head, &iocb->ki_wait.wait);
+}
+
+static void aio_poll_check_proc(struct file *file, wait_queue_head_t *head,
+				poll_table *pt)
+{
+	struct aio_poll_table *apt = container_of(pt, struct aio_poll_table, pt);
+
+	if (apt->iocb->private)
+		apt->error = -EOPNOTSUPP;
+	apt->iocb->private = head;
+}
+
+/*
+ * aio_poll_check:
+ *	Polls the file once without queueing ki_wait to see how many
+ *	waitqueues it uses.  ki_wait can only wait on one, so files
+ *	that poll on several are refused at submit time rather than
+ *	failing the first time the iocb would have to wait.
+ */
+static int aio_poll_check(struct kiocb *iocb)
+{
+	struct file *file = iocb->ki_filp;
+	struct aio_poll_table apt;
+
+	init_poll_funcptr(&apt.pt, aio_poll_check_proc);
+	apt.pt.key = iocb->ki_events;
+	apt.iocb = iocb;
+	apt.error = 0;
+	iocb->private = NULL;
+
+	file->f_op->poll(file, &apt.pt);
+	iocb->private = NULL;
+	return apt.error;
+}
+
+/*
+ * Take ki_wait off the polled waitqueue.  Returns 0 if a wakeup already
+ * did, in which case the iocb has been kicked.
+ */
+static int aio_poll_disarm(struct kiocb *iocb)
+{
+	wait_queue_head_t *head = iocb->private;
+	unsigned long flags;
+	int queued = 0;
+
+	if (!head)
+		return 0;
+
+	spin_lock_irqsave(&head->lock, flags);
+	if (!list_empty(&iocb->ki_wait.wait.task_list)) {
+		list_del_init(&iocb->ki_wait.wait.task_list);
+		queued = 1;
+	}
+	spin_unlock_irqrestore(&head->lock, flags);
+	return queued;
+}
+
+/*
+ * aio_poll_arm:
+ *	Polls the file of the iocb for ki_events.  Returns the events
+ *	that are there already, or -EIOCBRETRY with ki_wait left on the
+ *	file's waitqueue to kick the iocb once they show up.
+ */
+static long aio_poll_arm(struct kiocb *iocb)
+{
+	struct file *file = iocb->ki_filp;
+	struct aio_poll_table apt;
+	unsigned int mask;
+
+	init_poll_funcptr(&apt.pt, aio_poll_queue_proc);
+	apt.pt.key = iocb->ki_events;
+	apt.iocb = iocb;
+	apt.error = 0;
+	iocb->private = NULL;
+	init_waitqueue_func_entry(&iocb->ki_wait.wait, aio_poll_wake);
+
+	mask = file->f_op->poll(file, &apt.pt);
+	mask &= iocb->ki_events | POLLERR | POLLHUP;
+	if (!mask && !apt.error) {
+		if (unlikely(!iocb->private))
+			return -EINVAL;		/* nothing would kick us */
+
+		/* Pairs with kiocbSetCancelled() before ki_cancel is called */
+		smp_mb();
+		if (!kiocbIsCancelled(iocb))
+			return -EIOCBRETRY;
+		apt.error = -EINTR;
+	}
+
+	/*
+	 * If a wakeup got to ki_wait first it has kicked us already, and
+	 * aio_run_iocb() ignores the kick once we are done.
+	 */
+	aio_poll_disarm(iocb);
+	return apt.error ? apt.error : mask;
+}
+
+static int aio_poll_cancel(struct kiocb *iocb, struct io_event *res)
+{
+	/*
+	 * Either way the retry sees the cancel and completes the iocb
+	 * without an event, so the event is handed back here.
+	 */
+	if (aio_poll_disarm(iocb))
+		kick_iocb(iocb);
+
+	res->res = -EINTR;
+	aio_put_req(iocb);
+	return 0;
+}
+
+static ssize_t aio_poll(struct kiocb *iocb)
+{
+	return aio_poll_arm(iocb);
+}
+
+#ifdef CONFIG_NET
+/*
+ * Socket sends and receives never block, they wait for the socket to
+ * poll ready and are retried.  The retries run from the aio workqueue,
+ * so they are done with the submitter's credentials for the LSM and
+ * SCM_CREDENTIALS checks.
+ */
+static ssize_t aio_sendmsg(struct kiocb *iocb)
+{
+	struct msghdr __user *msg = (struct msghdr __user *)iocb->ki_buf;
+	const struct cred *old_cred;
+	ssize_t ret;
+
+	old_cred = override_creds(iocb->ki_cred);
+	for (;;) {
+		ret = file_sendmsg(iocb->ki_filp, msg,
+				   iocb->ki_nbytes | MSG_DONTWAIT);
+		if (ret != -EAGAIN)
+			break;
+		ret = aio_poll_arm(iocb);
+		if (ret < 0)
+			break;
+	}
+	revert_creds(old_cred);
+	return ret;
+}
+
+static ssize_t aio_recvmsg(struct kiocb *iocb)
+{
+	struct msghdr __user *msg = (struct msghdr __user *)iocb->ki_buf;
+	const struct cred *old_cred;
+	ssize_t ret;
+
+	old_cred = override_creds(iocb->ki_cred);
+	for (;;) {
+		ret = file_recvmsg(iocb->ki_filp, msg,
+				   iocb->ki_nbytes | MSG_DONTWAIT);
+		if (ret != -EAGAIN)
+			break;
+		ret = aio_poll_arm(iocb);
+		if (ret < 0)
+			break;
+	}
+	revert_creds(old_cred);
+	return ret;
+}
+#endif
+
 static ssize_t aio_setup_vectored_rw(int type, struct kiocb *kiocb, bool compat)
 {
 	ssize_t ret;
@@ -1503,6 +1756,43 @@ static ssize_t aio_setup_iocb(struct kiocb *kiocb, bool compat)
 		if (file->f_op->aio_fsync)
 			kiocb->ki_retry = aio_fsync;
 		break;
+	case IOCB_CMD_POLL:
+		ret = -EINVAL;
+		if (!file->f_op->poll)
+			break;
+		kiocb->ki_events = (unsigned long)kiocb->ki_buf;
+		ret = aio_poll_check(kiocb);
+		if (ret)
+			break;
+		kiocb->ki_cancel = aio_poll_cancel;
+		kiocb->ki_retry = aio_poll;
+		break;
+#ifdef CONFIG_NET
+	case IOCB_CMD_SENDMSG:
+	case IOCB_CMD_RECVMSG:
+		ret = -EINVAL;
+		if (kiocb->ki_nbytes & MSG_CMSG_COMPAT)
+			break;
+		ret = -ENOTSOCK;
+		if (!file->f_op->poll)
+			break;
+		if (kiocb->ki_opcode == IOCB_CMD_SENDMSG)
+			kiocb->ki_events = POLLOUT | POLLWRNORM;
+		else
+			kiocb->ki_events = POLLIN | POLLRDNORM;
+		ret = aio_poll_check(kiocb);
+		if (ret)
+			break;
+		if (compat)
+			kiocb->ki_nbytes |= MSG_CMSG_COMPAT;
+		kiocb->ki_cred = get_current_cred();
+		kiocb->ki_cancel = aio_poll_cancel;
+		if (kiocb->ki_opcode == IOCB_CMD_SENDMSG)
+			kiocb->ki_retry = aio_sendmsg;
+		else
+			kiocb->ki_retry = aio_recvmsg;
+		break;
+#endif
 	default:
 		dprintk("EINVAL: io_submit: no operation provided\n");
 		ret = -EINVAL;
@@ -1797,3 +2087,211 @@ SYSCALL_DEFINE5(io_getevents, aio_context_t, ctx_id,
 	asmlinkage_protect(5, ret, ctx_id, min_nr, nr, events, timeout);
 	return ret;
 }
+
+/* aio_setup_sq:
+ *	Maps the submission ring of io_ring_setup() with room for nr
+ *	iocbs into the context's address space.
+ */
+static int aio_setup_sq(struct kioctx *ctx, unsigned nr)
+{
+	struct aio_sq_ring __user *sq;
+	unsigned long size, addr;
+
+	size = PAGE_ALIGN(sizeof(*sq) + nr * sizeof(struct iocb));
+	down_write(&ctx->mm->mmap_sem);
+	addr = do_mmap(NULL, 0, size, PROT_READ|PROT_WRITE,
+		       MAP_ANONYMOUS|MAP_PRIVATE, 0);
+	up_write(&ctx->mm->mmap_sem);
+	if (IS_ERR((void *)addr))
+		return -EAGAIN;
+
+	sq = (struct aio_sq_ring __user *)addr;
+	ctx->sq_ring = sq;
+	ctx->sq_mmap_size = size;
+	ctx->sq_nr = nr;
+	ctx->sq_head = 0;
+
+	/* head and tail start out zeroed */
+	if (put_user(nr, &sq->nr) ||
+	    put_user(sizeof(*sq), &sq->header_length))
+		return -EFAULT;
+	return 0;
+}
+
+/* aio_submit_sq:
+ *	Submits up to to_submit iocbs queued on the submission ring.
+ *	Returns the number submitted, or the error of the first one.  An
+ *	iocb that fails to submit is left at the head of the ring.
+ */
+static int aio_submit_sq(struct kioctx *ctx, unsigned to_submit)
+{
+	struct aio_sq_ring __user *sq = ctx->sq_ring;
+	struct blk_plug plug;
+	unsigned tail;
+	int i = 0, ret = 0;
+
+	mutex_lock(&ctx->sq_lock);
+	if (unlikely(get_user(tail, &sq->tail))) {
+		ret = -EFAULT;
+		goto out;
+	}
+	smp_rmb();	/* read the tail before the iocbs it covers */
+
+	to_submit = min(to_submit, tail - ctx->sq_head);
+	to_submit = min(to_submit, ctx->sq_nr);
+
+	blk_start_plug(&plug);
+	for (i = 0; i < to_submit; i++) {
+		struct iocb __user *user_iocb;
+		struct iocb tmp;
+
+		user_iocb = &sq->iocbs[ctx->sq_head % ctx->sq_nr];
+		if (unlikely(copy_from_user(&tmp, user_iocb, sizeof(tmp)))) {
+			ret = -EFAULT;
+			break;
+		}
+
+		ret = io_submit_one(ctx, user_iocb, &tmp, false);
+		if (ret)
+			break;
+		ctx->sq_head++;
+	}
+	blk_finish_plug(&plug);
+
+	/* Hand the consumed slots back to the application */
+	if (i && unlikely(put_user(ctx->sq_head, &sq->head)))
+		ret = -EFAULT;
+out:
+	mutex_unlock(&ctx->sq_lock);
+	return i ? i : ret;
+}
+
+/* Events in the completion ring that userland hasn't reaped yet */
+static unsigned aio_ring_events(struct kioctx *ctx)
+{
+	struct aio_ring_info *info = &ctx->ring_info;
+	struct aio_ring *ring;
+	unsigned head;
+
+	ring = kmap_atomic(info->ring_pages[0], KM_USER0);
+	head = ACCESS_ONCE(ring->head) % info->nr;
+	kunmap_atomic(ring, KM_USER0);
+
+	return (ACCESS_ONCE(info->tail) + info->nr - head) % info->nr;
+}
+
+/* aio_ring_wait:
+ *	Waits until the completion ring holds min_complete events,
+ *	running kicked retries in the meantime.
+ */
+static int aio_ring_wait(struct kioctx *ctx, unsigned min_complete)
+{
+	struct task_struct *tsk = current;
+	DECLARE_WAITQUEUE(wait, tsk);
+	int ret = 0;
+
+	add_wait_queue_exclusive(&ctx->wait, &wait);
+	for (;;) {
+		set_task_state(tsk, TASK_INTERRUPTIBLE);
+		if (aio_ring_events(ctx) >= min_complete)
+			break;
+		if (unlikely(ctx->dead)) {
+			ret = -EINVAL;
+			break;
+		}
+		if (!list_empty(&ctx->run_list)) {
+			set_task_state(tsk, TASK_RUNNING);
+			aio_run_all_iocbs(ctx);
+			continue;
+		}
+		if (signal_pending(tsk)) {
+			ret = -EINTR;
+			break;
+		}
+		io_schedule();
+	}
+	set_task_state(tsk, TASK_RUNNING);
+	remove_wait_queue(&ctx->wait, &wait);
+
+	return ret;
+}
+
+/* sys_io_ring_setup:
+ *	Create an aio_context like io_setup, plus a submission ring of
+ *	nr_events iocbs mapped into the caller's address space.  The
+ *	addresses of the submission ring and of the completion ring,
+ *	which is also the context id, are returned in params.  Fails
+ *	like io_setup, or with -EFAULT if params is invalid.
+ */
+SYSCALL_DEFINE2(io_ring_setup, unsigned, nr_events,
+		struct io_ring_params __user *, params)
+{
+	struct io_ring_params p;
+	struct kioctx *ioctx;
+	long ret;
+
+	if (unlikely(nr_events == 0))
+		return -EINVAL;
+
+	ioctx = ioctx_alloc(nr_events);
+	if (IS_ERR(ioctx))
+		return PTR_ERR(ioctx);
+
+	ret = aio_setup_sq(ioctx, nr_events);
+	if (!ret) {
+		memset(&p, 0, sizeof(p));
+		p.sq_entries = ioctx->sq_nr;
+		p.cq_entries = ioctx->ring_info.nr;
+		p.sq_ring = (unsigned long)ioctx->sq_ring;
+		p.ctx = ioctx->user_id;
+		ret = -EFAULT;
+		if (!copy_to_user(params, &p, sizeof(p)))
+			return 0;
+	}
+
+	get_ioctx(ioctx); /* io_destroy() expects us to hold a ref */
+	io_destroy(ioctx);
+	return ret;
+}
+
+/* sys_io_ring_enter:
+ *	Submits up to to_submit iocbs queued on the submission ring of
+ *	an io_ring_setup() context, then waits until at least
+ *	min_complete events are in its completion ring.  The events are
+ *	left there for userland to reap.  Returns the number of iocbs
+ *	submitted.  May fail like io_submit, with -EINVAL if the context
+ *	has no submission ring or flags are set, or with -EINTR if a
+ *	signal arrived before anything was submitted.
+ */
+SYSCALL_DEFINE4(io_ring_enter, aio_context_t, ctx_id, unsigned, to_submit,
+		unsigned, min_complete, unsigned, flags)
+{
+	struct kioctx *ctx;
+	long ret = 0, err;
+
+	if (unlikely(flags))
+		return -EINVAL;
+
+	ctx = lookup_ioctx(ctx_id);
+	if (unlikely(!ctx))
+		return -EINVAL;
+
+	if (to_submit) {
+		ret = -EINVAL;
+		if (unlikely(!ctx->sq_ring))
+			goto out;
+		ret = aio_submit_sq(ctx, to_submit);
+		if (ret < 0)
+			goto out;
+	}
+
+	if (min_complete) {
+		min_complete = min(min_complete, ctx->ring_info.nr - 1);
+		err = aio_ring_wait(ctx, min_complete);
+		if (err && !ret)
+			ret = err;
+	}
+out:
+	put_ioctx(ctx);
+	return ret;
+}
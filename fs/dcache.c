@@ -36,6 +36,9 @@
 #include <linux/bit_spinlock.h>
 #include <linux/rculist_bl.h>
 #include <linux/prefetch.h>
+#include <linux/percpu_counter.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
 #include "internal.h"
 
 /*
@@ -75,6 +78,11 @@
  * if (dentry1 < dentry2)
  *   dentry1->d_lock
  *     dentry2->d_lock
+ *
+ * Hash table resize:
+ * rename_lock
+ *   dcache_hash_bucket lock (old table)
+ *     dcache_hash_bucket lock (new table)
  */
 int sysctl_vfs_cache_pressure __read_mostly = 100;
 EXPORT_SYMBOL_GPL(sysctl_vfs_cache_pressure);
@@ -93,23 +101,247 @@ static struct kmem_cache *dentry_cache __read_mostly;
  *
  * This hash-function tries to avoid losing too many bits of hash
  * information, yet avoid using a prime hash-size or similar.
+ *
+ * The table starts out at the boot-time size and is resized from a
+ * workqueue as the number of hashed dentries grows and shrinks.  While
+ * a resize is in progress d_hash_old points at the table being drained:
+ * buckets of the old table below d_hash_progress have been moved over
+ * to d_hash_cur, the rest still live in the old table.  d_hash_progress
+ * only advances under the old bucket lock, so a writer holding the old
+ * bucket lock sees a stable answer.  Entries are moved under rename_lock,
+ * so a lookup racing with a resize may miss, just like with a racing
+ * rename, and d_lookup() retries.
  */
-#define D_HASHBITS     d_hash_shift
-#define D_HASHMASK     d_hash_mask
+struct dentry_hash {
+	struct hlist_bl_head	*table;
+	unsigned int		shift;
+	unsigned int		mask;
+};
 
-static unsigned int d_hash_mask __read_mostly;
+/* Upper bound for the resizer: 4M buckets */
+#define D_HASH_MAX_SHIFT	22
+/* Buckets moved per rename_lock hold while resizing */
+#define D_HASH_MOVE_BATCH	64
+
+static struct dentry_hash d_hash_boot __read_mostly;
+static struct dentry_hash __rcu *d_hash_cur __read_mostly = &d_hash_boot;
+static struct dentry_hash __rcu *d_hash_old __read_mostly;
+static unsigned int d_hash_progress;
 static unsigned int d_hash_shift __read_mostly;
 
-static struct hlist_bl_head *dentry_hashtable __read_mostly;
+static struct percpu_counter nr_dentry_hashed;
+static bool d_hash_resize_ready __read_mostly;
+static DEFINE_MUTEX(d_hash_resize_mutex);
+static void d_hash_resize(struct work_struct *work);
+static DECLARE_WORK(d_hash_resize_work, d_hash_resize);
 
-static inline struct hlist_bl_head *d_hash(struct dentry *parent,
+static inline unsigned int d_hash_index(struct dentry_hash *dh,
+					struct dentry *parent,
 					unsigned long hash)
 {
 	hash += ((unsigned long) parent ^ GOLDEN_RATIO_PRIME) / L1_CACHE_BYTES;
-	hash = hash ^ ((hash ^ GOLDEN_RATIO_PRIME) >> D_HASHBITS);
-	return dentry_hashtable + (hash & D_HASHMASK);
+	hash = hash ^ ((hash ^ GOLDEN_RATIO_PRIME) >> dh->shift);
+	return hash & dh->mask;
+}
+
+/*
+ * Find the bucket for a lookup.  Must be called under rcu_read_lock().
+ */
+static inline struct hlist_bl_head *d_hash(struct dentry *parent,
+					unsigned long hash)
+{
+	struct dentry_hash *dh = rcu_dereference(d_hash_cur);
+	struct dentry_hash *old;
+
+	smp_rmb();
+	old = rcu_dereference(d_hash_old);
+	if (unlikely(old)) {
+		unsigned int idx = d_hash_index(old, parent, hash);
+
+		if (idx >= ACCESS_ONCE(d_hash_progress))
+			return old->table + idx;
+	}
+	return dh->table + d_hash_index(dh, parent, hash);
+}
+
+/*
+ * Find and lock the bucket a dentry with this parent and hash lives in
+ * (or is to be added to).  The RCU read lock is held until d_hash_unlock()
+ * so that a resize cannot start draining the table under us.
+ */
+static struct hlist_bl_head *d_hash_lock(struct dentry *parent,
+					unsigned long hash)
+{
+	struct dentry_hash *dh, *old;
+	struct hlist_bl_head *b;
+
+	rcu_read_lock();
+	dh = rcu_dereference(d_hash_cur);
+	smp_rmb();
+	old = rcu_dereference(d_hash_old);
+	if (unlikely(old)) {
+		unsigned int idx = d_hash_index(old, parent, hash);
+
+		b = old->table + idx;
+		hlist_bl_lock(b);
+		if (idx >= d_hash_progress)
+			return b;
+		hlist_bl_unlock(b);
+	}
+	b = dh->table + d_hash_index(dh, parent, hash);
+	hlist_bl_lock(b);
+	return b;
+}
+
+static void d_hash_unlock(struct hlist_bl_head *b)
+{
+	hlist_bl_unlock(b);
+	rcu_read_unlock();
+}
+
+static unsigned int d_hash_target_shift(void)
+{
+	s64 nr = percpu_counter_sum_positive(&nr_dentry_hashed);
+	unsigned int shift = fls_long(nr);
+
+	return clamp_t(unsigned int, shift, d_hash_boot.shift,
+		       max_t(unsigned int, d_hash_boot.shift, D_HASH_MAX_SHIFT));
+}
+
+/*
+ * Kick the resizer when the load factor leaves [1/8, 2].  Only the
+ * approximate per-cpu count is looked at here; d_hash_resize() works
+ * out the exact size.
+ */
+static inline void d_hash_check_resize(void)
+{
+	s64 nr = percpu_counter_read_positive(&nr_dentry_hashed);
+	unsigned int shift = ACCESS_ONCE(d_hash_shift);
+
+	if (unlikely(!d_hash_resize_ready))
+		return;
+	if (unlikely(nr > (2LL << shift) && shift < D_HASH_MAX_SHIFT) ||
+	    unlikely(nr < (1LL << shift) / 8 && shift > d_hash_boot.shift))
+		schedule_work(&d_hash_resize_work);
+}
+
+static struct dentry_hash *d_hash_alloc(unsigned int shift)
+{
+	struct dentry_hash *dh;
+
+	/* The boot table can't be freed, so it is reused when shrinking */
+	if (shift == d_hash_boot.shift)
+		return &d_hash_boot;
+
+	dh = kmalloc(sizeof(*dh), GFP_KERNEL);
+	if (!dh)
+		return NULL;
+	dh->table = vzalloc(sizeof(struct hlist_bl_head) << shift);
+	if (!dh->table) {
+		kfree(dh);
+		return NULL;
+	}
+	dh->shift = shift;
+	dh->mask = (1U << shift) - 1;
+	return dh;
+}
+
+static void d_hash_free(struct dentry_hash *dh)
+{
+	if (dh == &d_hash_boot)
+		return;
+	vfree(dh->table);
+	kfree(dh);
 }
 
+/*
+ * Move every dentry from @old to @new.  rename_lock keeps d_move() and
+ * friends from changing d_parent and d_name under us, and tells d_lookup()
+ * to retry if it raced with us.
+ */
+static void d_hash_move(struct dentry_hash *old, struct dentry_hash *new)
+{
+	unsigned int i = 0, size = old->mask + 1;
+
+	while (i < size) {
+		unsigned int end = min(i + D_HASH_MOVE_BATCH, size);
+
+		write_seqlock(&rename_lock);
+		for (; i < end; i++) {
+			struct hlist_bl_head *b = old->table + i;
+
+			hlist_bl_lock(b);
+			while (!hlist_bl_empty(b)) {
+				struct dentry *dentry;
+				struct hlist_bl_head *nb;
+
+				dentry = hlist_bl_entry(hlist_bl_first(b),
+						struct dentry, d_hash);
+				__hlist_bl_del(&dentry->d_hash);
+				nb = new->table + d_hash_index(new,
+						dentry->d_parent,
+						dentry->d_name.hash);
+				hlist_bl_lock(nb);
+				hlist_bl_add_head_rcu(&dentry->d_hash, nb);
+				hlist_bl_unlock(nb);
+			}
+			d_hash_progress = i + 1;
+			hlist_bl_unlock(b);
+		}
+		write_sequnlock(&rename_lock);
+		cond_resched();
+	}
+}
+
+static void d_hash_resize(struct work_struct *work)
+{
+	struct dentry_hash *cur, *new;
+	unsigned int shift;
+
+	mutex_lock(&d_hash_resize_mutex);
+	cur = rcu_dereference_protected(d_hash_cur,
+			lockdep_is_held(&d_hash_resize_mutex));
+	shift = d_hash_target_shift();
+	if (shift == cur->shift)
+		goto out;
+	new = d_hash_alloc(shift);
+	if (!new)
+		goto out;
+
+	d_hash_progress = 0;
+	smp_wmb();
+	rcu_assign_pointer(d_hash_old, cur);
+	rcu_assign_pointer(d_hash_cur, new);
+	ACCESS_ONCE(d_hash_shift) = shift;
+	/* Wait for writers that still see cur as the only table */
+	synchronize_rcu();
+
+	d_hash_move(cur, new);
+
+	rcu_assign_pointer(d_hash_old, NULL);
+	synchronize_rcu();
+	d_hash_free(cur);
+out:
+	mutex_unlock(&d_hash_resize_mutex);
+}
+
+static int __init d_hash_resize_init(void)
+{
+	d_hash_resize_ready = true;
+	return 0;
+}
+core_initcall(d_hash_resize_init);
+
+/*
+ * Negative dentries beyond this many unused ones per superblock are
+ * trimmed from the LRU in the background.  0 means no limit.
+ */
+int sysctl_dentry_negative_limit __read_mostly;
+EXPORT_SYMBOL_GPL(sysctl_dentry_negative_limit);
+
+static void dentry_trim_negative(struct work_struct *work);
+static DECLARE_WORK(dentry_trim_work, dentry_trim_negative);
+
 /* Statistics gathering. */
 struct dentry_stat_t dentry_stat = {
 	.age_limit = 45,
@@ -127,10 +359,46 @@ static int get_nr_dentry(void)
 	return sum < 0 ? 0 : sum;
 }
 
+/*
+ * dentry-state is world readable, so don't walk the whole table on every
+ * read: look at D_HASH_SAMPLE buckets spread evenly over it, from an
+ * offset that moves on with every read, for the longest chain.
+ */
+#define D_HASH_SAMPLE	1024
+
+static int get_max_chain(int *nr_buckets)
+{
+	static unsigned int offset;
+	struct dentry_hash *dh;
+	unsigned int i, stride;
+	int max = 0;
+
+	rcu_read_lock();
+	dh = rcu_dereference(d_hash_cur);
+	stride = max_t(unsigned int, (dh->mask + 1) / D_HASH_SAMPLE, 1);
+	offset++;
+	for (i = offset % stride; i <= dh->mask; i += stride) {
+		struct hlist_bl_node *node;
+		struct dentry *dentry;
+		int len = 0;
+
+		hlist_bl_for_each_entry_rcu(dentry, node, &dh->table[i], d_hash)
+			len++;
+		if (len > max)
+			max = len;
+	}
+	*nr_buckets = dh->mask + 1;
+	rcu_read_unlock();
+	return max;
+}
+
 int proc_nr_dentry(ctl_table *table, int write, void __user *buffer,
 		   size_t *lenp, loff_t *ppos)
 {
 	dentry_stat.nr_dentry = get_nr_dentry();
+	dentry_stat.max_chain = get_max_chain(&dentry_stat.nr_buckets);
+	dentry_stat.nr_hashed =
+		percpu_counter_sum_positive(&nr_dentry_hashed);
 	return proc_dointvec(table, write, buffer, lenp, ppos);
 }
 #endif
@@ -227,14 +495,44 @@ static void dentry_unlink_inode(struct dentry * dentry)
 /*
  * dentry_lru_(add|del|move_tail) must be called with d_lock held.
  */
+/*
+ * Account a dentry going onto the LRU.  Negative dentries are counted
+ * separately so that they can be held to sysctl_dentry_negative_limit.
+ * Returns true if the superblock is now over that limit.
+ */
+static bool __dentry_lru_count(struct dentry *dentry)
+{
+	struct super_block *sb = dentry->d_sb;
+	int limit = sysctl_dentry_negative_limit;
+
+	sb->s_nr_dentry_unused++;
+	dentry_stat.nr_unused++;
+	if (dentry->d_inode)
+		return false;
+	dentry->d_flags |= DCACHE_LRU_NEGATIVE;
+	sb->s_nr_dentry_negative++;
+	dentry_stat.nr_negative++;
+	return limit && sb->s_nr_dentry_negative > limit;
+}
+
+static void __dentry_lru_uncount_negative(struct dentry *dentry)
+{
+	dentry->d_flags &= ~DCACHE_LRU_NEGATIVE;
+	dentry->d_sb->s_nr_dentry_negative--;
+	dentry_stat.nr_negative--;
+}
+
 static void dentry_lru_add(struct dentry *dentry)
 {
 	if (list_empty(&dentry->d_lru)) {
+		bool trim;
+
 		spin_lock(&dcache_lru_lock);
 		list_add(&dentry->d_lru, &dentry->d_sb->s_dentry_lru);
-		dentry->d_sb->s_nr_dentry_unused++;
-		dentry_stat.nr_unused++;
+		trim = __dentry_lru_count(dentry);
 		spin_unlock(&dcache_lru_lock);
+		if (trim)
+			schedule_work(&dentry_trim_work);
 	}
 }
 
@@ -243,6 +541,8 @@ static void __dentry_lru_del(struct dentry *dentry)
 	list_del_init(&dentry->d_lru);
 	dentry->d_sb->s_nr_dentry_unused--;
 	dentry_stat.nr_unused--;
+	if (dentry->d_flags & DCACHE_LRU_NEGATIVE)
+		__dentry_lru_uncount_negative(dentry);
 }
 
 static void dentry_lru_del(struct dentry *dentry)
@@ -259,8 +559,7 @@ static void dentry_lru_move_tail(struct dentry *dentry)
 	spin_lock(&dcache_lru_lock);
 	if (list_empty(&dentry->d_lru)) {
 		list_add_tail(&dentry->d_lru, &dentry->d_sb->s_dentry_lru);
-		dentry->d_sb->s_nr_dentry_unused++;
-		dentry_stat.nr_unused++;
+		__dentry_lru_count(dentry);
 	} else {
 		list_move_tail(&dentry->d_lru, &dentry->d_sb->s_dentry_lru);
 	}
@@ -320,15 +619,20 @@ void __d_drop(struct dentry *dentry)
 {
 	if (!d_unhashed(dentry)) {
 		struct hlist_bl_head *b;
-		if (unlikely(dentry->d_flags & DCACHE_DISCONNECTED))
+		if (unlikely(dentry->d_flags & DCACHE_DISCONNECTED)) {
 			b = &dentry->d_sb->s_anon;
-		else
-			b = d_hash(dentry->d_parent, dentry->d_name.hash);
-
-		hlist_bl_lock(b);
-		__hlist_bl_del(&dentry->d_hash);
-		dentry->d_hash.pprev = NULL;
-		hlist_bl_unlock(b);
+			hlist_bl_lock(b);
+			__hlist_bl_del(&dentry->d_hash);
+			dentry->d_hash.pprev = NULL;
+			hlist_bl_unlock(b);
+		} else {
+			b = d_hash_lock(dentry->d_parent, dentry->d_name.hash);
+			__hlist_bl_del(&dentry->d_hash);
+			dentry->d_hash.pprev = NULL;
+			d_hash_unlock(b);
+			percpu_counter_dec(&nr_dentry_hashed);
+			d_hash_check_resize();
+		}
 
 		dentry_rcuwalk_barrier(dentry);
 	}
@@ -843,6 +1147,87 @@ static void prune_dcache(int count)
 	spin_unlock(&sb_lock);
 }
 
+/*
+ * Free up to @count unused negative dentries from the cold end of the
+ * LRU of @sb.  Positive dentries are passed over and keep their place.
+ */
+static void __shrink_dcache_sb_negative(struct super_block *sb, int count)
+{
+	struct dentry *dentry;
+	LIST_HEAD(skipped);
+	LIST_HEAD(tmp);
+
+relock:
+	spin_lock(&dcache_lru_lock);
+	while (count > 0 && !list_empty(&sb->s_dentry_lru)) {
+		dentry = list_entry(sb->s_dentry_lru.prev,
+				struct dentry, d_lru);
+		BUG_ON(dentry->d_sb != sb);
+
+		if (!spin_trylock(&dentry->d_lock)) {
+			spin_unlock(&dcache_lru_lock);
+			cpu_relax();
+			goto relock;
+		}
+
+		if (!dentry->d_inode) {
+			list_move_tail(&dentry->d_lru, &tmp);
+			count--;
+		} else {
+			/* instantiated after it went on the LRU */
+			if (dentry->d_flags & DCACHE_LRU_NEGATIVE)
+				__dentry_lru_uncount_negative(dentry);
+			list_move(&dentry->d_lru, &skipped);
+		}
+		spin_unlock(&dentry->d_lock);
+		cond_resched_lock(&dcache_lru_lock);
+	}
+	if (!list_empty(&skipped))
+		list_splice_tail(&skipped, &sb->s_dentry_lru);
+	spin_unlock(&dcache_lru_lock);
+
+	shrink_dentry_list(&tmp);
+}
+
+/*
+ * Bring every superblock back under sysctl_dentry_negative_limit.
+ * Scheduled from dentry_lru_add() when a superblock goes over.
+ */
+static void dentry_trim_negative(struct work_struct *work)
+{
+	struct super_block *sb, *p = NULL;
+	int limit = sysctl_dentry_negative_limit;
+
+	if (!limit)
+		return;
+
+	spin_lock(&sb_lock);
+	list_for_each_entry(sb, &super_blocks, s_list) {
+		int excess;
+
+		if (list_empty(&sb->s_instances))
+			continue;
+		excess = sb->s_nr_dentry_negative - limit;
+		if (excess <= 0)
+			continue;
+		sb->s_count++;
+		spin_unlock(&sb_lock);
+		/* see prune_dcache() for why we need s_umount here */
+		if (down_read_trylock(&sb->s_umount)) {
+			if (sb->s_root != NULL)
+				__shrink_dcache_sb_negative(sb, excess);
+			up_read(&sb->s_umount);
+		}
+		spin_lock(&sb_lock);
+		if (p)
+			__put_super(p);
+		p = sb;
+	}
+	if (p)
+		__put_super(p);
+	spin_unlock(&sb_lock);
+}
+
 /**
  * shrink_dcache_sb - shrink dcache for a superblock
  * @sb: superblock
@@ -1374,6 +1759,11 @@ static void __d_instantiate(struct dentry *dentry, struct inode *inode)
 		if (unlikely(IS_AUTOMOUNT(inode)))
 			dentry->d_flags |= DCACHE_NEED_AUTOMOUNT;
 		list_add(&dentry->d_alias, &inode->i_dentry);
+		if (unlikely(dentry->d_flags & DCACHE_LRU_NEGATIVE)) {
+			spin_lock(&dcache_lru_lock);
+			__dentry_lru_uncount_negative(dentry);
+			spin_unlock(&dcache_lru_lock);
+		}
 	}
 	dentry->d_inode = inode;
 	dentry_rcuwalk_barrier(dentry);
@@ -1791,7 +2181,7 @@ struct dentry *__d_lookup_rcu(struct dentry *parent, struct qstr *name,
 	 * It is possible that concurrent renames can mess up our list
 	 * walk here and result in missing our dentry, resulting in the
 	 * false-negative result. d_lookup() protects against concurrent
-	 * renames using rename_lock seqlock.
+	 * renames and hash table resizes using rename_lock seqlock.
 	 *
 	 * See Documentation/filesystems/path-lookup.txt for more details.
 	 */
@@ -1888,7 +2278,7 @@ struct dentry *__d_lookup(struct dentry *parent, struct qstr *name)
 	unsigned int len = name->len;
 	unsigned int hash = name->hash;
 	const unsigned char *str = name->name;
-	struct hlist_bl_head *b = d_hash(parent, hash);
+	struct hlist_bl_head *b;
 	struct hlist_bl_node *node;
 	struct dentry *found = NULL;
 	struct dentry *dentry;
@@ -1909,12 +2299,13 @@ struct dentry *__d_lookup(struct dentry *parent, struct qstr *name)
 	 * It is possible that concurrent renames can mess up our list
 	 * walk here and result in missing our dentry, resulting in the
 	 * false-negative result. d_lookup() protects against concurrent
-	 * renames using rename_lock seqlock.
+	 * renames and hash table resizes using rename_lock seqlock.
 	 *
 	 * See Documentation/filesystems/path-lookup.txt for more details.
 	 */
 	rcu_read_lock();
-	
+	b = d_hash(parent, hash);
+
 	hlist_bl_for_each_entry_rcu(dentry, node, b, d_hash) {
 		const char *tname;
 		int tlen;
@@ -2066,18 +2457,23 @@ again:
 }
 EXPORT_SYMBOL(d_delete);
 
-static void __d_rehash(struct dentry * entry, struct hlist_bl_head *b)
+static void __d_rehash(struct dentry * entry, struct dentry *parent,
+			unsigned int hash)
 {
+	struct hlist_bl_head *b;
+
 	BUG_ON(!d_unhashed(entry));
-	hlist_bl_lock(b);
+	b = d_hash_lock(parent, hash);
 	entry->d_flags |= DCACHE_RCUACCESS;
 	hlist_bl_add_head_rcu(&entry->d_hash, b);
-	hlist_bl_unlock(b);
+	d_hash_unlock(b);
+	percpu_counter_inc(&nr_dentry_hashed);
+	d_hash_check_resize();
 }
 
 static void _d_rehash(struct dentry * entry)
 {
-	__d_rehash(entry, d_hash(entry->d_parent, entry->d_name.hash));
+	__d_rehash(entry, entry->d_parent, entry->d_name.hash);
 }
 
 /**
@@ -2239,7 +2635,7 @@ static void __d_move(struct dentry * dentry, struct dentry * target)
 	 * for the same hash queue because of how unlikely it is.
 	 */
 	__d_drop(dentry);
-	__d_rehash(dentry, d_hash(target->d_parent, target->d_name.hash));
+	__d_rehash(dentry, target->d_parent, target->d_name.hash);
 
 	/* Unhash the target: dput() will then get rid of it */
 	__d_drop(target);
@@ -3020,18 +3416,19 @@ static void __init dcache_init_early(void)
 	if (hashdist)
 		return;
 
-	dentry_hashtable =
+	d_hash_boot.table =
 		alloc_large_system_hash("Dentry cache",
 					sizeof(struct hlist_bl_head),
 					dhash_entries,
 					13,
 					HASH_EARLY,
-					&d_hash_shift,
-					&d_hash_mask,
+					&d_hash_boot.shift,
+					&d_hash_boot.mask,
 					0);
 
-	for (loop = 0; loop < (1 << d_hash_shift); loop++)
-		INIT_HLIST_BL_HEAD(dentry_hashtable + loop);
+	for (loop = 0; loop < (1 << d_hash_boot.shift); loop++)
+		INIT_HLIST_BL_HEAD(d_hash_boot.table + loop);
+	d_hash_shift = d_hash_boot.shift;
 }
 
 static void __init dcache_init(void)
@@ -3045,6 +3442,8 @@ static void __init dcache_init(void)
 	 */
 	dentry_cache = KMEM_CACHE(dentry,
 		SLAB_RECLAIM_ACCOUNT|SLAB_PANIC|SLAB_MEM_SPREAD);
+	if (percpu_counter_init(&nr_dentry_hashed, 0))
+		panic("Failed to allocate dentry hash counter");
 	
 	register_shrinker(&dcache_shrinker);
 
@@ -3052,18 +3451,19 @@ static void __init dcache_init(void)
 	if (!hashdist)
 		return;
 
-	dentry_hashtable =
+	d_hash_boot.table =
 		alloc_large_system_hash("Dentry cache",
 					sizeof(struct hlist_bl_head),
 					dhash_entries,
 					13,
 					0,
-					&d_hash_shift,
-					&d_hash_mask,
+					&d_hash_boot.shift,
+					&d_hash_boot.mask,
 					0);
 
-	for (loop = 0; loop < (1 << d_hash_shift); loop++)
-		INIT_HLIST_BL_HEAD(dentry_hashtable + loop);
+	for (loop = 0; loop < (1 << d_hash_boot.shift); loop++)
+		INIT_HLIST_BL_HEAD(d_hash_boot.table + loop);
+	d_hash_shift = d_hash_boot.shift;
 }
 
 /* SLAB cache for __getname() consumers */
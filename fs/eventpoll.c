@@ -45,14 +45,19 @@
  *
  * 1) epmutex (mutex)
  * 2) ep->mtx (mutex)
- * 3) ep->lock (spinlock)
+ * 3) ep->lock (rwlock)
  *
  * The acquire order is the one listed above, from 1 to 3.
- * We need a spinlock (ep->lock) because we manipulate objects
+ * We need a spinning lock (ep->lock) because we manipulate objects
  * from inside the poll callback, that might be triggered from
  * a wake_up() that in turn might be called from IRQ context.
  * So we can't sleep inside the poll callback and hence we need
- * a spinlock. During the event transfer loop (from kernel to
+ * a spinning lock. The poll callback only takes it for read and
+ * queues items with atomic operations (see list_add_tail_lockless()),
+ * so that wakeups on many CPUs don't serialize on it; everything
+ * else that touches the ready list takes it for write.
+ * ep->wq is protected by its own lock, always taken after ep->lock.
+ * During the event transfer loop (from kernel to
  * user space) we could end up sleeping due a copy_to_user(), so
  * we need a lock that will allow us to sleep. This lock is a
  * mutex (ep->mtx). It is acquired during the event transfer loop,
@@ -79,7 +84,13 @@
  */
 
 /* Epoll private bits inside the event mask */
-#define EP_PRIVATE_BITS (EPOLLONESHOT | EPOLLET)
+#define EP_PRIVATE_BITS (EPOLLONESHOT | EPOLLET | EPOLLEXCLUSIVE)
+
+#define EPOLLINOUT_BITS (POLLIN | POLLOUT)
+
+/* The only events that can be asked for together with EPOLLEXCLUSIVE */
+#define EPOLLEXCLUSIVE_OK_BITS (EPOLLINOUT_BITS | POLLERR | POLLHUP | \
+				EPOLLET | EPOLLEXCLUSIVE)
 
 /* Maximum number of nesting allowed inside epoll sets */
 #define EP_MAX_NESTS 4
@@ -90,6 +101,9 @@
 
 #define EP_ITEM_COST (sizeof(struct epitem) + sizeof(struct eppoll_entry))
 
+/* Number of events copied to userspace at once by ep_send_events_proc() */
+#define EP_SEND_BATCH 16
+
 struct epoll_filefd {
 	struct file *file;
 	int fd;
@@ -156,8 +170,11 @@ struct epitem {
  * interface.
  */
 struct eventpoll {
-	/* Protect the access to this structure */
-	spinlock_t lock;
+	/*
+	 * Protect the access to this structure. Taken for read by the poll
+	 * callback only.
+	 */
+	rwlock_t lock;
 
 	/*
 	 * This mutex is used to ensure that files are not removed
@@ -322,10 +339,67 @@ static void ep_nested_calls_init(struct nested_calls *ncalls)
  *
  * Returns: Returns a value different than zero if ready events are available,
  *          or zero otherwise.
+ *
+ * Can be called without ep->lock, the poll callback may be adding to the
+ * ready list at the same time.
  */
 static inline int ep_events_available(struct eventpoll *ep)
 {
-	return !list_empty(&ep->rdllist) || ep->ovflist != EP_UNACTIVE_PTR;
+	return !list_empty_careful(&ep->rdllist) ||
+		ACCESS_ONCE(ep->ovflist) != EP_UNACTIVE_PTR;
+}
+
+/*
+ * Add @new to the tail of @head with only ep->lock held for read, racing
+ * against other poll callbacks doing the same. Returns false if @new was
+ * already linked, or has just been linked from another CPU.
+ */
+static inline bool list_add_tail_lockless(struct list_head *new,
+					  struct list_head *head)
+{
+	struct list_head *prev;
+
+	/*
+	 * This is "new->next = head", done with cmpxchg() so that only one
+	 * of the CPUs adding the same item wins: the others see that
+	 * new->next is no longer new.
+	 */
+	if (cmpxchg(&new->next, new, head) != new)
+		return false;
+
+	/*
+	 * xchg() is a full barrier, so new->next is set before new becomes
+	 * the tail, and the tail is swapped before prev->next is set.
+	 */
+	prev = xchg(&head->prev, new);
+
+	/* Only the tail is ever added to, so prev and new are ours now */
+	prev->next = new;
+	new->prev = prev;
+
+	return true;
+}
+
+/*
+ * Chain @epi to ep->ovflist with only ep->lock held for read. Returns
+ * false if it is already chained.
+ */
+static inline bool chain_epi_lockless(struct epitem *epi)
+{
+	struct eventpoll *ep = epi->ep;
+
+	/* Fast preliminary check */
+	if (epi->next != EP_UNACTIVE_PTR)
+		return false;
+
+	/* Check that the same epi has not been just chained from another CPU */
+	if (cmpxchg(&epi->next, EP_UNACTIVE_PTR, NULL) != EP_UNACTIVE_PTR)
+		return false;
+
+	/* Atomically exchange the head */
+	epi->next = xchg(&ep->ovflist, epi);
+
+	return true;
 }
 
 /**
@@ -491,17 +565,17 @@ static int ep_scan_ready_list(struct eventpoll *ep,
 	 * because we want the "sproc" callback to be able to do it
 	 * in a lockless way.
 	 */
-	spin_lock_irqsave(&ep->lock, flags);
+	write_lock_irqsave(&ep->lock, flags);
 	list_splice_init(&ep->rdllist, &txlist);
 	ep->ovflist = NULL;
-	spin_unlock_irqrestore(&ep->lock, flags);
+	write_unlock_irqrestore(&ep->lock, flags);
 
 	/*
 	 * Now call the callback function.
 	 */
 	error = (*sproc)(ep, &txlist, priv);
 
-	spin_lock_irqsave(&ep->lock, flags);
+	write_lock_irqsave(&ep->lock, flags);
 	/*
 	 * During the time we spent inside the "sproc" callback, some
 	 * other events might have been queued by the poll callback.
@@ -536,11 +610,11 @@ static int ep_scan_ready_list(struct eventpoll *ep,
 		 * the ->poll() wait list (delayed after we release the lock).
 		 */
 		if (waitqueue_active(&ep->wq))
-			wake_up_locked(&ep->wq);
+			wake_up(&ep->wq);
 		if (waitqueue_active(&ep->poll_wait))
 			pwake++;
 	}
-	spin_unlock_irqrestore(&ep->lock, flags);
+	write_unlock_irqrestore(&ep->lock, flags);
 
 	mutex_unlock(&ep->mtx);
 
@@ -578,10 +652,10 @@ static int ep_remove(struct eventpoll *ep, struct epitem *epi)
 
 	rb_erase(&epi->rbn, &ep->rbr);
 
-	spin_lock_irqsave(&ep->lock, flags);
+	write_lock_irqsave(&ep->lock, flags);
 	if (ep_is_linked(&epi->rdllink))
 		list_del_init(&epi->rdllink);
-	spin_unlock_irqrestore(&ep->lock, flags);
+	write_unlock_irqrestore(&ep->lock, flags);
 
 	/* At this point it is safe to free the eventpoll item */
 	kmem_cache_free(epi_cache, epi);
@@ -757,7 +831,7 @@ static int ep_alloc(struct eventpoll **pep)
 	if (unlikely(!ep))
 		goto free_uid;
 
-	spin_lock_init(&ep->lock);
+	rwlock_init(&ep->lock);
 	mutex_init(&ep->mtx);
 	init_waitqueue_head(&ep->wq);
 	init_waitqueue_head(&ep->poll_wait);
@@ -812,11 +886,25 @@ static struct epitem *ep_find(struct eventpoll *ep, struct file *file, int fd)
 static int ep_poll_callback(wait_queue_t *wait, unsigned mode, int sync, void *key)
 {
 	int pwake = 0;
+	int ewake = 0;
 	unsigned long flags;
 	struct epitem *epi = ep_item_from_wait(wait);
 	struct eventpoll *ep = epi->ep;
 
-	spin_lock_irqsave(&ep->lock, flags);
+	/*
+	 * Only the poll callback takes ep->lock for read, so callbacks for
+	 * different items can run on several CPUs at once. The lists are
+	 * updated with atomic operations.
+	 */
+	read_lock_irqsave(&ep->lock, flags);
+
+	/*
+	 * Exclusive items are on their wait queue with WQ_FLAG_EXCLUSIVE.
+	 * Returning zero lets the wakeup go on to the next epoll set, so
+	 * only say we took it when one of our waiters is woken.
+	 */
+	if (!(epi->event.events & EPOLLEXCLUSIVE))
+		ewake = 1;
 
 	/*
 	 * If the event mask does not contain any poll(2) event, we consider the
@@ -842,35 +930,53 @@ static int ep_poll_callback(wait_queue_t *wait, unsigned mode, int sync, void *k
 	 * semantics). All the events that happen during that period of time are
 	 * chained in ep->ovflist and requeued later on.
 	 */
-	if (unlikely(ep->ovflist != EP_UNACTIVE_PTR)) {
-		if (epi->next == EP_UNACTIVE_PTR) {
-			epi->next = ep->ovflist;
-			ep->ovflist = epi;
-		}
+	if (unlikely(ACCESS_ONCE(ep->ovflist) != EP_UNACTIVE_PTR)) {
+		chain_epi_lockless(epi);
 		goto out_unlock;
 	}
 
 	/* If this file is already in the ready list we exit soon */
 	if (!ep_is_linked(&epi->rdllink))
-		list_add_tail(&epi->rdllink, &ep->rdllist);
+		list_add_tail_lockless(&epi->rdllink, &ep->rdllist);
 
 	/*
 	 * Wake up ( if active ) both the eventpoll wait list and the ->poll()
 	 * wait list.
 	 */
-	if (waitqueue_active(&ep->wq))
-		wake_up_locked(&ep->wq);
+	if (waitqueue_active(&ep->wq)) {
+		if (epi->event.events & EPOLLEXCLUSIVE) {
+			/*
+			 * A waiter here only takes the wakeup away from the
+			 * other sets if it is going to get the event it
+			 * was for.
+			 */
+			switch ((unsigned long) key & EPOLLINOUT_BITS) {
+			case POLLIN:
+				if (epi->event.events & POLLIN)
+					ewake = 1;
+				break;
+			case POLLOUT:
+				if (epi->event.events & POLLOUT)
+					ewake = 1;
+				break;
+			case 0:
+				ewake = 1;
+				break;
+			}
+		}
+		wake_up(&ep->wq);
+	}
 	if (waitqueue_active(&ep->poll_wait))
 		pwake++;
 
 out_unlock:
-	spin_unlock_irqrestore(&ep->lock, flags);
+	read_unlock_irqrestore(&ep->lock, flags);
 
 	/* We have to call this outside the lock */
 	if (pwake)
 		ep_poll_safewake(&ep->poll_wait);
 
-	return 1;
+	return ewake;
 }
 
 /*
@@ -887,7 +993,10 @@ static void ep_ptable_queue_proc(struct file *file, wait_queue_head_t *whead,
 		init_waitqueue_func_entry(&pwq->wait, ep_poll_callback);
 		pwq->whead = whead;
 		pwq->base = epi;
-		add_wait_queue(whead, &pwq->wait);
+		if (epi->event.events & EPOLLEXCLUSIVE)
+			add_wait_queue_exclusive(whead, &pwq->wait);
+		else
+			add_wait_queue(whead, &pwq->wait);
 		list_add_tail(&pwq->llink, &epi->pwqlist);
 		epi->nwait++;
 	} else {
@@ -977,7 +1086,7 @@ static int ep_insert(struct eventpoll *ep, struct epoll_event *event,
 	ep_rbtree_insert(ep, epi);
 
 	/* We have to drop the new item inside our item list to keep track of it */
-	spin_lock_irqsave(&ep->lock, flags);
+	write_lock_irqsave(&ep->lock, flags);
 
 	/* If the file is already "ready" we drop it inside the ready list */
 	if ((revents & event->events) && !ep_is_linked(&epi->rdllink)) {
@@ -985,12 +1094,12 @@ static int ep_insert(struct eventpoll *ep, struct epoll_event *event,
 
 		/* Notify waiting tasks that events are available */
 		if (waitqueue_active(&ep->wq))
-			wake_up_locked(&ep->wq);
+			wake_up(&ep->wq);
 		if (waitqueue_active(&ep->poll_wait))
 			pwake++;
 	}
 
-	spin_unlock_irqrestore(&ep->lock, flags);
+	write_unlock_irqrestore(&ep->lock, flags);
 
 	atomic_long_inc(&ep->user->epoll_watches);
 
@@ -1009,10 +1118,10 @@ error_unregister:
 	 * list, since that is used/cleaned only inside a section bound by "mtx".
 	 * And ep_insert() is called with "mtx" held.
 	 */
-	spin_lock_irqsave(&ep->lock, flags);
+	write_lock_irqsave(&ep->lock, flags);
 	if (ep_is_linked(&epi->rdllink))
 		list_del_init(&epi->rdllink);
-	spin_unlock_irqrestore(&ep->lock, flags);
+	write_unlock_irqrestore(&ep->lock, flags);
 
 	kmem_cache_free(epi_cache, epi);
 
@@ -1047,17 +1156,17 @@ static int ep_modify(struct eventpoll *ep, struct epitem *epi, struct epoll_even
 	 * list, push it inside.
 	 */
 	if (revents & event->events) {
-		spin_lock_irq(&ep->lock);
+		write_lock_irq(&ep->lock);
 		if (!ep_is_linked(&epi->rdllink)) {
 			list_add_tail(&epi->rdllink, &ep->rdllist);
 
 			/* Notify waiting tasks that events are available */
 			if (waitqueue_active(&ep->wq))
-				wake_up_locked(&ep->wq);
+				wake_up(&ep->wq);
 			if (waitqueue_active(&ep->poll_wait))
 				pwake++;
 		}
-		spin_unlock_irq(&ep->lock);
+		write_unlock_irq(&ep->lock);
 	}
 
 	/* We have to call this outside the lock */
@@ -1067,22 +1176,69 @@ static int ep_modify(struct eventpoll *ep, struct epitem *epi, struct epoll_even
 	return 0;
 }
 
+/*
+ * Copy a batch of events gathered by ep_send_events_proc() to userspace,
+ * then do what delivering them means for their items. If the copy fails
+ * the items go back to the head of @head untouched.
+ */
+static int ep_send_batch(struct eventpoll *ep, struct list_head *head,
+			 struct epoll_event __user *uevent,
+			 struct epoll_event *batch, struct epitem **items,
+			 int n)
+{
+	struct epitem *epi;
+	int i;
+
+	if (__copy_to_user(uevent, batch, n * sizeof(struct epoll_event))) {
+		for (i = n - 1; i >= 0; i--)
+			list_add(&items[i]->rdllink, head);
+		return -EFAULT;
+	}
+
+	for (i = 0; i < n; i++) {
+		epi = items[i];
+		if (epi->event.events & EPOLLONESHOT)
+			epi->event.events &= EP_PRIVATE_BITS;
+		else if (!(epi->event.events & EPOLLET)) {
+			/*
+			 * If this file has been added with Level
+			 * Trigger mode, we need to insert back inside
+			 * the ready list, so that the next call to
+			 * epoll_wait() will check again the events
+			 * availability. At this point, no one can insert
+			 * into ep->rdllist besides us. The epoll_ctl()
+			 * callers are locked out by
+			 * ep_scan_ready_list() holding "mtx" and the
+			 * poll callback will queue them in ep->ovflist.
+			 */
+			list_add_tail(&epi->rdllink, &ep->rdllist);
+		}
+	}
+
+	return n;
+}
+
 static int ep_send_events_proc(struct eventpoll *ep, struct list_head *head,
 			       void *priv)
 {
 	struct ep_send_events_data *esed = priv;
-	int eventcnt;
+	int eventcnt, n = 0;
 	unsigned int revents;
 	struct epitem *epi;
 	struct epoll_event __user *uevent;
+	struct epoll_event batch[EP_SEND_BATCH];
+	struct epitem *items[EP_SEND_BATCH];
 
 	/*
 	 * We can loop without lock because we are passed a task private list.
 	 * Items cannot vanish during the loop because ep_scan_ready_list() is
 	 * holding "mtx" during this call.
+	 *
+	 * Events are gathered on the stack and copied out EP_SEND_BATCH at a
+	 * time, rather than with two __put_user() calls each.
 	 */
 	for (eventcnt = 0, uevent = esed->events;
-	     !list_empty(head) && eventcnt < esed->maxevents;) {
+	     !list_empty(head) && eventcnt + n < esed->maxevents;) {
 		epi = list_first_entry(head, struct epitem, rdllink);
 
 		list_del_init(&epi->rdllink);
@@ -1097,32 +1253,25 @@ static int ep_send_events_proc(struct eventpoll *ep, struct list_head *head,
 		 * can change the item.
 		 */
 		if (revents) {
-			if (__put_user(revents, &uevent->events) ||
-			    __put_user(epi->event.data, &uevent->data)) {
-				list_add(&epi->rdllink, head);
+			batch[n].events = revents;
+			batch[n].data = epi->event.data;
+			items[n++] = epi;
+			if (n < EP_SEND_BATCH)
+				continue;
+			if (ep_send_batch(ep, head, uevent, batch, items, n) < 0)
 				return eventcnt ? eventcnt : -EFAULT;
-			}
-			eventcnt++;
-			uevent++;
-			if (epi->event.events & EPOLLONESHOT)
-				epi->event.events &= EP_PRIVATE_BITS;
-			else if (!(epi->event.events & EPOLLET)) {
-				/*
-				 * If this file has been added with Level
-				 * Trigger mode, we need to insert back inside
-				 * the ready list, so that the next call to
-				 * epoll_wait() will check again the events
-				 * availability. At this point, no one can insert
-				 * into ep->rdllist besides us. The epoll_ctl()
-				 * callers are locked out by
-				 * ep_scan_ready_list() holding "mtx" and the
-				 * poll callback will queue them in ep->ovflist.
-				 */
-				list_add_tail(&epi->rdllink, &ep->rdllist);
-			}
+			eventcnt += n;
+			uevent += n;
+			n = 0;
 		}
 	}
 
+	if (n) {
+		if (ep_send_batch(ep, head, uevent, batch, items, n) < 0)
+			return eventcnt ? eventcnt : -EFAULT;
+		eventcnt += n;
+	}
+
 	return eventcnt;
 }
 
@@ -1186,21 +1335,23 @@ static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
 		 * caller specified a non blocking operation.
 		 */
 		timed_out = 1;
-		spin_lock_irqsave(&ep->lock, flags);
 		goto check_events;
 	}
 
 fetch_events:
-	spin_lock_irqsave(&ep->lock, flags);
-
 	if (!ep_events_available(ep)) {
 		/*
 		 * We don't have any available event to return to the caller.
 		 * We need to sleep here, and we will be wake up by
 		 * ep_poll_callback() when events will become available.
+		 * ep->lock is not needed: the callback adds to the ready list
+		 * before it looks at ep->wq, and we are on ep->wq before we
+		 * look at the ready list.
 		 */
 		init_waitqueue_entry(&wait, current);
+		spin_lock_irqsave(&ep->wq.lock, flags);
 		__add_wait_queue_exclusive(&ep->wq, &wait);
+		spin_unlock_irqrestore(&ep->wq.lock, flags);
 
 		for (;;) {
 			/*
@@ -1216,13 +1367,12 @@ fetch_events:
 				break;
 			}
 
-			spin_unlock_irqrestore(&ep->lock, flags);
 			if (!schedule_hrtimeout_range(to, slack, HRTIMER_MODE_ABS))
 				timed_out = 1;
-
-			spin_lock_irqsave(&ep->lock, flags);
 		}
+		spin_lock_irqsave(&ep->wq.lock, flags);
 		__remove_wait_queue(&ep->wq, &wait);
+		spin_unlock_irqrestore(&ep->wq.lock, flags);
 
 		set_current_state(TASK_RUNNING);
 	}
@@ -1230,8 +1380,6 @@ check_events:
 	/* Is it worth to try to dig for events ? */
 	eavail = ep_events_available(ep);
 
-	spin_unlock_irqrestore(&ep->lock, flags);
-
 	/*
 	 * Try to transfer events to user space. In case we get 0 events and
 	 * there's still timeout left over, we go trying again in search of
@@ -1400,6 +1548,19 @@ SYSCALL_DEFINE4(epoll_ctl, int, epfd, int, op, int, fd,
 	 * insert "at the same time" such that ep_loop_check passes on both
 	 * before either one does the insert, thereby creating a cycle.
 	 */
+	/*
+	 * EPOLLEXCLUSIVE is only for EPOLL_CTL_ADD, with plain events, and
+	 * can't be used on an epoll file: the wakeup would stop at the
+	 * nested set.
+	 */
+	if (ep_op_has_event(op) && (epds.events & EPOLLEXCLUSIVE)) {
+		if (op == EPOLL_CTL_MOD)
+			goto error_tgt_fput;
+		if (op == EPOLL_CTL_ADD && (is_file_epoll(tfile) ||
+				(epds.events & ~EPOLLEXCLUSIVE_OK_BITS)))
+			goto error_tgt_fput;
+	}
+
 	if (unlikely(is_file_epoll(tfile) && op == EPOLL_CTL_ADD)) {
 		mutex_lock(&epmutex);
 		did_lock_epmutex = 1;
@@ -1435,8 +1596,11 @@ SYSCALL_DEFINE4(epoll_ctl, int, epfd, int, op, int, fd,
 		break;
 	case EPOLL_CTL_MOD:
 		if (epi) {
-			epds.events |= POLLERR | POLLHUP;
-			error = ep_modify(ep, epi, &epds);
+			/* An exclusive item is on its wait queues for good */
+			if (!(epi->event.events & EPOLLEXCLUSIVE)) {
+				epds.events |= POLLERR | POLLHUP;
+				error = ep_modify(ep, epi, &epds);
+			}
 		} else
 			error = -ENOENT;
 		break;
@@ -323,6 +323,13 @@ struct flex_groups {
 #define	EXT4_TIND_BLOCK			(EXT4_DIND_BLOCK + 1)
 #define	EXT4_N_BLOCKS			(EXT4_TIND_BLOCK + 1)
 
+/*
+ * Inline data: the part kept in i_block, and the parent inode number
+ * at the start of an inline directory
+ */
+#define EXT4_MIN_INLINE_DATA_SIZE	((sizeof(__le32) * EXT4_N_BLOCKS))
+#define EXT4_INLINE_DOTDOT_SIZE		4
+
 /*
  * Inode flags
  */
@@ -350,6 +357,7 @@ struct flex_groups {
 #define EXT4_EXTENTS_FL			0x00080000 /* Inode uses extents */
 #define EXT4_EA_INODE_FL	        0x00200000 /* Inode used for large EA */
 #define EXT4_EOFBLOCKS_FL		0x00400000 /* Blocks allocated beyond EOF */
+#define EXT4_INLINE_DATA_FL		0x10000000 /* Inode has inline data */
 #define EXT4_RESERVED_FL		0x80000000 /* reserved for ext4 lib */
 
 #define EXT4_FL_USER_VISIBLE		0x004BDFFF /* User visible flags */
@@ -407,6 +415,7 @@ enum {
 	EXT4_INODE_EXTENTS	= 19,	/* Inode uses extents */
 	EXT4_INODE_EA_INODE	= 21,	/* Inode used for large EA */
 	EXT4_INODE_EOFBLOCKS	= 22,	/* Blocks allocated beyond EOF */
+	EXT4_INODE_INLINE_DATA	= 28,	/* Inode has inline data */
 	EXT4_INODE_RESERVED	= 31,	/* reserved for ext4 lib */
 };
 
@@ -453,6 +462,7 @@ static inline void ext4_check_flag_values(void)
 	CHECK_FLAG_VALUE(EXTENTS);
 	CHECK_FLAG_VALUE(EA_INODE);
 	CHECK_FLAG_VALUE(EOFBLOCKS);
+	CHECK_FLAG_VALUE(INLINE_DATA);
 	CHECK_FLAG_VALUE(RESERVED);
 }
 
@@ -866,6 +876,9 @@ struct ext4_inode_info {
 	 */
 	tid_t i_sync_tid;
 	tid_t i_datasync_tid;
+
+	/* Transaction that changed the inode in a way fast commits can't log */
+	tid_t i_fc_ineligible_tid;
 };
 
 /*
@@ -917,6 +930,9 @@ struct ext4_inode_info {
 #define EXT4_MOUNT_DISCARD		0x40000000 /* Issue DISCARD requests */
 #define EXT4_MOUNT_INIT_INODE_TABLE	0x80000000 /* Initialize uninitialized itables */
 
+#define EXT4_MOUNT2_FAST_COMMIT		0x00000001 /* Fast commits on fsync */
+#define EXT4_MOUNT2_INLINE_DATA		0x00000002 /* Create inline data */
+
 #define clear_opt(sb, opt)		EXT4_SB(sb)->s_mount_opt &= \
 						~EXT4_MOUNT_##opt
 #define set_opt(sb, opt)		EXT4_SB(sb)->s_mount_opt |= \
@@ -1076,6 +1092,32 @@ struct ext4_super_block {
 #define EXT4_MF_MNTDIR_SAMPLED	0x0001
 #define EXT4_MF_FS_ABORTED	0x0002	/* Fatal error detected */
 
+/*
+ * Why an fsync could not be done with a fast commit
+ */
+enum {
+	EXT4_FC_REASON_LAYOUT,		/* not a small extent mapped file */
+	EXT4_FC_REASON_INODE,		/* inode op that needs a full commit */
+	EXT4_FC_REASON_FS,		/* quota, flushed or aborted journal */
+	EXT4_FC_REASON_COMMITTING,	/* transaction started committing */
+	EXT4_FC_REASON_FULL,		/* fast commit area used up */
+	EXT4_FC_REASON_IO,		/* error writing the fast commit */
+	EXT4_FC_REASON_MAX,
+};
+
+/*
+ * fsync statistics by the kind of commit they needed
+ */
+struct ext4_fc_stats {
+	atomic_t fc_none;		/* nothing left to commit */
+	atomic_t fc_fast;		/* fast commits */
+	atomic_t fc_full;		/* full jbd2 commits */
+	atomic64_t fc_fast_usecs;	/* time spent in them */
+	atomic64_t fc_full_usecs;
+	atomic_t fc_reasons[EXT4_FC_REASON_MAX];
+	unsigned int fc_replayed;	/* blocks replayed at mount */
+};
+
 /*
  * fourth extended-fs super-block data in memory
  */
@@ -1191,6 +1233,17 @@ struct ext4_sb_info {
 	atomic_t s_mb_preallocated;
 	atomic_t s_mb_discarded;
 	atomic_t s_lock_busy;
+	atomic_t s_bal_groups_scanned;	/* groups examined with buddy loaded */
+	atomic_t s_bal_cr_groups[4];	/* ... per criteria */
+	atomic_t s_bal_cr_hits[4];	/* allocations done per criteria */
+	atomic_t s_bal_idx_hits;	/* group taken from the order index */
+	atomic_t s_bal_idx_misses;	/* index had no usable group */
+	atomic_t s_bal_cpu_goals;	/* per-cpu goal hits */
+	atomic_t s_bal_busy_skips;	/* locked groups skipped in the index */
+
+	/* groups by order of their largest free extent */
+	struct list_head *s_mb_largest_free_orders;
+	rwlock_t *s_mb_largest_free_orders_locks;
 
 	/* locality groups */
 	struct ext4_locality_group __percpu *s_locality_groups;
@@ -1215,6 +1268,13 @@ struct ext4_sb_info {
 
 	/* Kernel thread for multiple mount protection */
 	struct task_struct *s_mmp_tsk;
+
+	/* Fast commits, see fast_commit.c */
+	struct mutex s_fc_lock;
+	tid_t s_fc_tid;			/* transaction of the records logged */
+	unsigned int s_fc_off;		/* next free block in the area */
+	u32 s_fc_run;			/* tells this run's records from stale ones */
+	struct ext4_fc_stats s_fc_stats;
 };
 
 static inline struct ext4_sb_info *EXT4_SB(struct super_block *sb)
@@ -1254,6 +1314,7 @@ enum {
 	EXT4_STATE_DIO_UNWRITTEN,	/* need convert on dio done*/
 	EXT4_STATE_NEWENTRY,		/* File just added to dir */
 	EXT4_STATE_DELALLOC_RESERVED,	/* blks already reserved for delalloc */
+	EXT4_STATE_MAY_INLINE_DATA,	/* may get inline data */
 };
 
 #define EXT4_INODE_BIT_FNS(name, field, offset)				\
@@ -1286,6 +1347,11 @@ static inline void ext4_clear_state_flags(struct ext4_inode_info *ei)
 	/* We depend on the fact that callers will set i_flags */
 }
 #endif
+
+static inline int ext4_has_inline_data(struct inode *inode)
+{
+	return ext4_test_inode_flag(inode, EXT4_INODE_INLINE_DATA);
+}
 #else
 /* Assume that user mode programs are passing in an ext4fs superblock, not
  * a kernel struct super_block.  This will allow us to call the feature-test
@@ -1365,6 +1431,7 @@ static inline void ext4_clear_state_flags(struct ext4_inode_info *ei)
 #define EXT4_FEATURE_INCOMPAT_FLEX_BG		0x0200
 #define EXT4_FEATURE_INCOMPAT_EA_INODE		0x0400 /* EA in inode */
 #define EXT4_FEATURE_INCOMPAT_DIRDATA		0x1000 /* data in dirent */
+#define EXT4_FEATURE_INCOMPAT_INLINE_DATA	0x8000 /* data in inode */
 
 #define EXT2_FEATURE_COMPAT_SUPP	EXT4_FEATURE_COMPAT_EXT_ATTR
 #define EXT2_FEATURE_INCOMPAT_SUPP	(EXT4_FEATURE_INCOMPAT_FILETYPE| \
@@ -1388,7 +1455,8 @@ static inline void ext4_clear_state_flags(struct ext4_inode_info *ei)
 					 EXT4_FEATURE_INCOMPAT_EXTENTS| \
 					 EXT4_FEATURE_INCOMPAT_64BIT| \
 					 EXT4_FEATURE_INCOMPAT_FLEX_BG| \
-					 EXT4_FEATURE_INCOMPAT_MMP)
+					 EXT4_FEATURE_INCOMPAT_MMP| \
+					 EXT4_FEATURE_INCOMPAT_INLINE_DATA)
 #define EXT4_FEATURE_RO_COMPAT_SUPP	(EXT4_FEATURE_RO_COMPAT_SPARSE_SUPER| \
 					 EXT4_FEATURE_RO_COMPAT_LARGE_FILE| \
 					 EXT4_FEATURE_RO_COMPAT_GDT_CSUM| \
@@ -1523,6 +1591,20 @@ static inline __le16 ext4_rec_len_to_disk(unsigned len, unsigned blocksize)
 #endif
 }
 
+static inline unsigned char get_dtype(struct super_block *sb, int filetype)
+{
+	static const unsigned char ext4_filetype_table[] = {
+		DT_UNKNOWN, DT_REG, DT_DIR, DT_CHR, DT_BLK, DT_FIFO, DT_SOCK,
+		DT_LNK
+	};
+
+	if (!EXT4_HAS_INCOMPAT_FEATURE(sb, EXT4_FEATURE_INCOMPAT_FILETYPE) ||
+	    (filetype >= EXT4_FT_MAX))
+		return DT_UNKNOWN;
+
+	return (ext4_filetype_table[filetype]);
+}
+
 /*
  * Hash Tree Directory indexing
  * (c) Daniel Phillips, 2001
@@ -1749,10 +1831,11 @@ extern unsigned ext4_init_block_bitmap(struct super_block *sb,
 extern int __ext4_check_dir_entry(const char *, unsigned int, struct inode *,
 				  struct file *,
 				  struct ext4_dir_entry_2 *,
-				  struct buffer_head *, unsigned int);
-#define ext4_check_dir_entry(dir, filp, de, bh, offset)			\
+				  struct buffer_head *, char *, int,
+				  unsigned int);
+#define ext4_check_dir_entry(dir, filp, de, bh, buf, size, offset)	\
 	unlikely(__ext4_check_dir_entry(__func__, __LINE__, (dir), (filp), \
-					(de), (bh), (offset)))
+					(de), (bh), (buf), (size), (offset)))
 extern int ext4_htree_store_dirent(struct file *dir_file, __u32 hash,
 				    __u32 minor_hash,
 				    struct ext4_dir_entry_2 *dirent);
@@ -1762,6 +1845,12 @@ extern void ext4_htree_free_dir_info(struct dir_private_info *p);
 extern int ext4_sync_file(struct file *, int);
 extern int ext4_flush_completed_IO(struct inode *);
 
+/* fast_commit.c */
+extern void ext4_fc_init(struct super_block *);
+extern int ext4_fc_setup(struct super_block *);
+extern void ext4_fc_release(struct super_block *);
+extern int ext4_fc_commit(struct inode *, tid_t);
+
 /* hash.c */
 extern int ext4fs_dirhash(const char *name, int len, struct
 			  dx_hash_info *hinfo);
@@ -1835,6 +1924,8 @@ extern int ext4_page_mkwrite(struct vm_area_struct *vma, struct vm_fault *vmf);
 extern qsize_t *ext4_get_reserved_space(struct inode *inode);
 extern void ext4_da_update_reserve_space(struct inode *inode,
 					int used, int quota_claim);
+extern int ext4_convert_page_to_blocks(handle_t *handle, struct inode *inode,
+				       struct page *page, unsigned len);
 /* ioctl.c */
 extern long ext4_ioctl(struct file *, unsigned int, unsigned long);
 extern long ext4_compat_ioctl(struct file *, unsigned int, unsigned long);
@@ -1847,6 +1938,23 @@ extern int ext4_orphan_add(handle_t *, struct inode *);
 extern int ext4_orphan_del(handle_t *, struct inode *);
 extern int ext4_htree_fill_tree(struct file *dir_file, __u32 start_hash,
 				__u32 start_minor_hash, __u32 *next_hash);
+extern int search_dir(struct buffer_head *bh, char *search_buf, int buf_size,
+		      struct inode *dir, const struct qstr *d_name,
+		      unsigned int offset, struct ext4_dir_entry_2 **res_dir);
+extern int ext4_find_dest_de(struct inode *dir, struct buffer_head *bh,
+			     void *buf, int buf_size,
+			     const char *name, int namelen,
+			     struct ext4_dir_entry_2 **dest_de);
+extern void ext4_insert_dentry(struct inode *inode,
+			       struct ext4_dir_entry_2 *de,
+			       const char *name, int namelen);
+extern int ext4_generic_delete_entry(handle_t *handle, struct inode *dir,
+				     struct ext4_dir_entry_2 *de_del,
+				     struct buffer_head *bh,
+				     void *entry_buf, int buf_size);
+extern struct ext4_dir_entry_2 *ext4_init_dot_dotdot(struct inode *inode,
+				struct ext4_dir_entry_2 *de, int blocksize,
+				unsigned int parent_ino, int dotdot_real_len);
 
 /* resize.c */
 extern int ext4_group_add(struct super_block *sb,
@@ -2057,6 +2165,8 @@ struct ext4_group_info {
 	ext4_grpblk_t	bb_free;	/* total free blocks */
 	ext4_grpblk_t	bb_fragments;	/* nr of freespace fragments */
 	ext4_grpblk_t	bb_largest_free_order;/* order of largest frag in BG */
+	ext4_group_t	bb_group;	/* group number of this info */
+	struct          list_head bb_largest_free_order_node;
 	struct          list_head bb_prealloc_list;
 #ifdef DOUBLE_CHECK
 	void            *bb_bitmap;
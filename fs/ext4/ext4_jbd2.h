@@ -258,6 +258,19 @@ static inline void ext4_update_inode_fsync_trans(handle_t *handle,
 	}
 }
 
+/*
+ * The inode was changed in a way a fast commit can't replay (links,
+ * freed blocks, orphan list, xattr blocks): fsync must do a full commit
+ * of this transaction.
+ */
+static inline void ext4_fc_mark_ineligible(handle_t *handle,
+					   struct inode *inode)
+{
+	if (ext4_handle_valid(handle))
+		EXT4_I(inode)->i_fc_ineligible_tid =
+			handle->h_transaction->t_tid;
+}
+
 /* super.c */
 int ext4_force_commit(struct super_block *sb);
 
@@ -43,6 +43,7 @@
 #include <linux/fiemap.h>
 #include "ext4_jbd2.h"
 #include "ext4_extents.h"
+#include "xattr.h"
 
 #include <trace/events/ext4.h>
 
@@ -3775,6 +3776,16 @@ long ext4_fallocate(struct file *file, int mode, loff_t offset, loff_t len)
 	struct ext4_map_blocks map;
 	unsigned int credits, blkbits = inode->i_blkbits;
 
+	/* Preallocated blocks and inline data don't mix */
+	if (ext4_has_inline_data(inode) ||
+	    ext4_test_inode_state(inode, EXT4_STATE_MAY_INLINE_DATA)) {
+		mutex_lock(&inode->i_mutex);
+		ret = ext4_convert_inline_data(inode);
+		mutex_unlock(&inode->i_mutex);
+		if (ret)
+			return ret;
+	}
+
 	/*
 	 * currently supporting (pre)allocate mode for extent-based
 	 * files _only_
@@ -4330,6 +4341,16 @@ int ext4_fiemap(struct inode *inode, struct fiemap_extent_info *fieinfo,
 	ext4_lblk_t start_blk;
 	int error = 0;
 
+	if (ext4_has_inline_data(inode) &&
+	    !(fieinfo->fi_flags & FIEMAP_FLAG_XATTR)) {
+		int has_inline_data = 1;
+
+		error = ext4_inline_data_fiemap(inode, fieinfo,
+						&has_inline_data);
+		if (has_inline_data)
+			return error;
+	}
+
 	/* fallback to generic here if not in extents fmt */
 	if (!(ext4_test_inode_flag(inode, EXT4_INODE_EXTENTS)))
 		return generic_block_fiemap(inode, fieinfo, start, len,
@@ -0,0 +1,494 @@
+/*
+ *  linux/fs/ext4/fast_commit.c
+ *
+ * Fast commits: make a single inode durable on fsync without committing
+ * the running jbd2 transaction.
+ *
+ * A full commit writes a descriptor block, every metadata block changed
+ * by the transaction and a commit block, with cache flushes in between.
+ * The common fsync after appending to or overwriting a file (an SQLite
+ * journal, say) changes little more than the inode and the block
+ * bitmaps.  For such an inode we instead write one block holding an
+ * image of the on-disk inode to an area kept at the end of the journal
+ * (see jbd2_journal_set_fc_blocks()), with a single FLUSH/FUA write.
+ *
+ * The records are tagged with the running transaction.  After a crash
+ * they are replayed only if that transaction is the first one jbd2 did
+ * not recover; once it commits it holds everything they describe.
+ * Replay writes the inode image back to the inode table and marks the
+ * blocks its extents point to in use.  That is all that is needed as
+ * long as the inode's extents fit in the inode and, since the last full
+ * commit, it has not been created, linked, unlinked, put on the orphan
+ * list or had blocks freed; ext4_fc_mark_ineligible() tracks the latter.
+ * Anything else falls back to a full commit.
+ */
+
+#include <linux/fs.h>
+#include <linux/jbd2.h>
+#include <linux/blkdev.h>
+#include <linux/buffer_head.h>
+#include <linux/crc32.h>
+#include <linux/ktime.h>
+#include <linux/proc_fs.h>
+#include <linux/quotaops.h>
+#include <linux/random.h>
+#include <linux/seq_file.h>
+
+#include "ext4.h"
+#include "ext4_jbd2.h"
+#include "ext4_extents.h"
+
+/* Blocks reserved at the end of the journal for fast commits */
+#define EXT4_FC_BLOCKS		256
+
+#define EXT4_FC_MAGIC		0xEF4FC001
+
+/*
+ * Each fast commit block holds the header followed by one inode image of
+ * fb_inode_size bytes.  Blocks of one run are written in order from the
+ * start of the area; fb_seq is the block's offset in it.
+ */
+struct ext4_fc_block_header {
+	__le32	fb_magic;
+	__le32	fb_tid;		/* transaction the record belongs to */
+	__le32	fb_run;		/* same for all blocks of a run */
+	__le32	fb_seq;
+	__le32	fb_ino;
+	__le16	fb_inode_size;
+	__le16	fb_pad;
+	__le32	fb_checksum;	/* crc32 of the block, with this zeroed */
+};
+
+static const char *ext4_fc_reason_names[EXT4_FC_REASON_MAX] = {
+	[EXT4_FC_REASON_LAYOUT]		= "layout",
+	[EXT4_FC_REASON_INODE]		= "inode",
+	[EXT4_FC_REASON_FS]		= "fs",
+	[EXT4_FC_REASON_COMMITTING]	= "committing",
+	[EXT4_FC_REASON_FULL]		= "full",
+	[EXT4_FC_REASON_IO]		= "io",
+};
+
+static __u32 ext4_fc_csum(struct buffer_head *bh)
+{
+	struct ext4_fc_block_header *hdr = (void *)bh->b_data;
+	__le32 saved = hdr->fb_checksum;
+	__u32 csum;
+
+	hdr->fb_checksum = 0;
+	csum = crc32_be(~0, (void *)bh->b_data, bh->b_size);
+	hdr->fb_checksum = saved;
+	return csum;
+}
+
+static int ext4_fc_fallback(struct ext4_sb_info *sbi, int reason)
+{
+	atomic_inc(&sbi->s_fc_stats.fc_reasons[reason]);
+	return -EAGAIN;
+}
+
+/*
+ * Whether @inode, last changed in transaction @tid, can be logged with
+ * a fast commit.  Returns a fallback reason, or -1 if it can.
+ */
+static int ext4_fc_check(struct inode *inode, tid_t tid)
+{
+	struct super_block *sb = inode->i_sb;
+	journal_t *journal = EXT4_SB(sb)->s_journal;
+
+	if (!S_ISREG(inode->i_mode) ||
+	    !ext4_test_inode_flag(inode, EXT4_INODE_EXTENTS) ||
+	    ext4_should_journal_data(inode))
+		return EXT4_FC_REASON_LAYOUT;
+	if (EXT4_I(inode)->i_fc_ineligible_tid == tid)
+		return EXT4_FC_REASON_INODE;
+	/* After a flush the superblock doesn't say where the log resumes */
+	if (sb_any_quota_loaded(sb) ||
+	    journal->j_flags & (JBD2_FLUSHED | JBD2_ABORT))
+		return EXT4_FC_REASON_FS;
+	return -1;
+}
+
+static int ext4_fc_write(journal_t *journal, struct buffer_head *bh)
+{
+	int barrier = journal->j_flags & JBD2_BARRIER;
+
+	/* With an external journal the data went to another device */
+	if (barrier && journal->j_fs_dev != journal->j_dev)
+		blkdev_issue_flush(journal->j_fs_dev, GFP_KERNEL, NULL);
+
+	lock_buffer(bh);
+	clear_buffer_dirty(bh);
+	set_buffer_uptodate(bh);
+	bh->b_end_io = end_buffer_write_sync;
+	get_bh(bh);
+	submit_bh(barrier ? WRITE_FLUSH_FUA : WRITE_SYNC, bh);
+	wait_on_buffer(bh);
+	return buffer_uptodate(bh) ? 0 : -EIO;
+}
+
+/*
+ * Try to make @inode durable with a fast commit instead of committing
+ * transaction @tid, the last one that changed it.  The inode's data
+ * must already be written.  Returns 0 on success, or an error if the
+ * caller has to do a full commit.
+ */
+int ext4_fc_commit(struct inode *inode, tid_t tid)
+{
+	struct super_block *sb = inode->i_sb;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	journal_t *journal = sbi->s_journal;
+	struct ext4_fc_block_header *hdr;
+	struct ext4_extent_header *eh;
+	struct ext4_inode *raw_inode;
+	struct ext4_iloc iloc;
+	struct buffer_head *bh;
+	ktime_t start = ktime_get();
+	int reason, running, err;
+
+	reason = ext4_fc_check(inode, tid);
+	if (reason >= 0)
+		return ext4_fc_fallback(sbi, reason);
+
+	/* The records only count if everything before @tid is on disk */
+	err = jbd2_log_wait_commit(journal, tid - 1);
+	if (err)
+		return ext4_fc_fallback(sbi, EXT4_FC_REASON_FS);
+
+	err = ext4_get_inode_loc(inode, &iloc);
+	if (err)
+		return ext4_fc_fallback(sbi, EXT4_FC_REASON_IO);
+
+	mutex_lock(&sbi->s_fc_lock);
+	read_lock(&journal->j_state_lock);
+	running = journal->j_running_transaction &&
+		  journal->j_running_transaction->t_tid == tid;
+	read_unlock(&journal->j_state_lock);
+	if (!running) {
+		reason = EXT4_FC_REASON_COMMITTING;
+		goto out;
+	}
+
+	if (sbi->s_fc_tid != tid) {
+		sbi->s_fc_tid = tid;
+		sbi->s_fc_off = 0;
+		sbi->s_fc_run++;
+	}
+	bh = jbd2_journal_fc_buf(journal, sbi->s_fc_off);
+	if (!bh) {
+		reason = EXT4_FC_REASON_FULL;
+		goto out;
+	}
+
+	hdr = (void *)bh->b_data;
+	memset(bh->b_data, 0, bh->b_size);
+	hdr->fb_magic = cpu_to_le32(EXT4_FC_MAGIC);
+	hdr->fb_tid = cpu_to_le32(tid);
+	hdr->fb_run = cpu_to_le32(sbi->s_fc_run);
+	hdr->fb_seq = cpu_to_le32(sbi->s_fc_off);
+	hdr->fb_ino = cpu_to_le32(inode->i_ino);
+	hdr->fb_inode_size = cpu_to_le16(EXT4_INODE_SIZE(sb));
+	raw_inode = (struct ext4_inode *)(hdr + 1);
+	down_read(&EXT4_I(inode)->i_data_sem);
+	memcpy(raw_inode, ext4_raw_inode(&iloc), EXT4_INODE_SIZE(sb));
+	up_read(&EXT4_I(inode)->i_data_sem);
+
+	/* Replay can only restore extents that live in the inode */
+	eh = (struct ext4_extent_header *)raw_inode->i_block;
+	if (eh->eh_depth) {
+		brelse(bh);
+		reason = EXT4_FC_REASON_LAYOUT;
+		goto out;
+	}
+	hdr->fb_checksum = cpu_to_le32(ext4_fc_csum(bh));
+
+	err = ext4_fc_write(journal, bh);
+	brelse(bh);
+	if (err) {
+		/* Don't let later records follow a bad one */
+		sbi->s_fc_off = journal->j_fc_last - journal->j_last;
+		reason = EXT4_FC_REASON_IO;
+		goto out;
+	}
+	sbi->s_fc_off++;
+	reason = -1;
+out:
+	mutex_unlock(&sbi->s_fc_lock);
+	brelse(iloc.bh);
+	if (reason >= 0)
+		return ext4_fc_fallback(sbi, reason);
+
+	atomic_inc(&sbi->s_fc_stats.fc_fast);
+	atomic64_add(ktime_us_delta(ktime_get(), start),
+		     &sbi->s_fc_stats.fc_fast_usecs);
+	return 0;
+}
+
+/*
+ * Mark @len blocks from @block in use in the block bitmaps, for replay.
+ * The group descriptors are fixed up to match; the global free counts
+ * are recomputed from them later in the mount.
+ */
+static int ext4_fc_mark_blocks(struct super_block *sb, ext4_fsblk_t block,
+			       unsigned int len)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct buffer_head *bitmap_bh, *gd_bh;
+	struct ext4_group_desc *gdp;
+	ext4_grpblk_t bit;
+	ext4_group_t group;
+	unsigned int count, i, newly;
+	int err = 0;
+
+	if (block < le32_to_cpu(sbi->s_es->s_first_data_block) ||
+	    block + len > ext4_blocks_count(sbi->s_es))
+		return -EIO;
+
+	while (len && !err) {
+		ext4_get_group_no_and_offset(sb, block, &group, &bit);
+		count = min_t(unsigned int, len,
+			      EXT4_BLOCKS_PER_GROUP(sb) - bit);
+
+		gdp = ext4_get_group_desc(sb, group, &gd_bh);
+		bitmap_bh = ext4_read_block_bitmap(sb, group);
+		if (!gdp || !bitmap_bh) {
+			brelse(bitmap_bh);
+			return -EIO;
+		}
+
+		newly = 0;
+		ext4_lock_group(sb, group);
+		for (i = 0; i < count; i++)
+			if (!ext4_set_bit(bit + i, bitmap_bh->b_data))
+				newly++;
+		if (newly) {
+			ext4_free_blks_set(sb, gdp,
+				ext4_free_blks_count(sb, gdp) - newly);
+			gdp->bg_flags &= cpu_to_le16(~EXT4_BG_BLOCK_UNINIT);
+			gdp->bg_checksum = ext4_group_desc_csum(sbi, group, gdp);
+			if (sbi->s_log_groups_per_flex)
+				atomic_sub(newly, &sbi->s_flex_groups[
+					ext4_flex_group(sbi, group)].free_blocks);
+		}
+		ext4_unlock_group(sb, group);
+
+		if (newly) {
+			mark_buffer_dirty(bitmap_bh);
+			err = sync_dirty_buffer(bitmap_bh);
+			mark_buffer_dirty(gd_bh);
+			if (!err)
+				err = sync_dirty_buffer(gd_bh);
+		}
+		brelse(bitmap_bh);
+		block += count;
+		len -= count;
+	}
+	return err;
+}
+
+static int ext4_fc_replay_inode(struct super_block *sb, unsigned long ino,
+				struct ext4_inode *raw_inode)
+{
+	struct ext4_group_desc *gdp;
+	struct ext4_extent_header *eh;
+	struct ext4_extent *ex;
+	struct buffer_head *bh;
+	unsigned long offset;
+	ext4_fsblk_t block;
+	int i, err;
+
+	if (ino < EXT4_FIRST_INO(sb) ||
+	    ino > le32_to_cpu(EXT4_SB(sb)->s_es->s_inodes_count))
+		return -EIO;
+	eh = (struct ext4_extent_header *)raw_inode->i_block;
+	if (!(raw_inode->i_flags & cpu_to_le32(EXT4_EXTENTS_FL)) ||
+	    eh->eh_magic != EXT4_EXT_MAGIC || eh->eh_depth ||
+	    le16_to_cpu(eh->eh_entries) > le16_to_cpu(eh->eh_max) ||
+	    le16_to_cpu(eh->eh_max) > (sizeof(raw_inode->i_block) -
+			sizeof(*eh)) / sizeof(struct ext4_extent))
+		return -EIO;
+
+	gdp = ext4_get_group_desc(sb, (ino - 1) / EXT4_INODES_PER_GROUP(sb),
+				  NULL);
+	if (!gdp)
+		return -EIO;
+	offset = ((ino - 1) % EXT4_INODES_PER_GROUP(sb)) * EXT4_INODE_SIZE(sb);
+	block = ext4_inode_table(sb, gdp) + (offset >> EXT4_BLOCK_SIZE_BITS(sb));
+	offset &= EXT4_BLOCK_SIZE(sb) - 1;
+
+	bh = sb_bread(sb, block);
+	if (!bh)
+		return -EIO;
+	lock_buffer(bh);
+	memcpy(bh->b_data + offset, raw_inode, EXT4_INODE_SIZE(sb));
+	unlock_buffer(bh);
+	mark_buffer_dirty(bh);
+	err = sync_dirty_buffer(bh);
+	brelse(bh);
+
+	ex = EXT_FIRST_EXTENT(eh);
+	for (i = 0; !err && i < le16_to_cpu(eh->eh_entries); i++, ex++)
+		err = ext4_fc_mark_blocks(sb, ext4_ext_pblock(ex),
+					  ext4_ext_get_actual_len(ex));
+	return err;
+}
+
+/*
+ * Replay the fast commits of the first transaction jbd2 did not
+ * recover.  Called right after the journal is loaded, before anything
+ * else looks at inodes or bitmaps.
+ */
+static int ext4_fc_replay(struct super_block *sb)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	journal_t *journal = sbi->s_journal;
+	tid_t tid = journal->j_transaction_sequence;
+	struct ext4_fc_block_header *hdr;
+	struct buffer_head *bh;
+	unsigned int off;
+	u32 run = 0;
+	int err = 0;
+
+	for (off = 0; !err; off++) {
+		bh = jbd2_journal_fc_buf(journal, off);
+		if (!bh)
+			break;
+		if (!bh_uptodate_or_lock(bh) && bh_submit_read(bh)) {
+			brelse(bh);
+			err = -EIO;
+			break;
+		}
+		hdr = (void *)bh->b_data;
+		if (!off)
+			run = le32_to_cpu(hdr->fb_run);
+		if (le32_to_cpu(hdr->fb_magic) != EXT4_FC_MAGIC ||
+		    le32_to_cpu(hdr->fb_tid) != tid ||
+		    le32_to_cpu(hdr->fb_run) != run ||
+		    le32_to_cpu(hdr->fb_seq) != off ||
+		    le16_to_cpu(hdr->fb_inode_size) != EXT4_INODE_SIZE(sb) ||
+		    le32_to_cpu(hdr->fb_checksum) != ext4_fc_csum(bh)) {
+			brelse(bh);
+			break;
+		}
+		if (!off && bdev_read_only(sb->s_bdev)) {
+			ext4_msg(sb, KERN_WARNING, "fast commits not replayed, "
+				 "device is write-protected");
+			brelse(bh);
+			break;
+		}
+		err = ext4_fc_replay_inode(sb, le32_to_cpu(hdr->fb_ino),
+					   (struct ext4_inode *)(hdr + 1));
+		brelse(bh);
+		if (!err)
+			sbi->s_fc_stats.fc_replayed++;
+	}
+
+	if (err)
+		ext4_msg(sb, KERN_ERR, "error %d replaying fast commit %u",
+			 err, off - 1);
+	else if (sbi->s_fc_stats.fc_replayed)
+		ext4_msg(sb, KERN_INFO, "replayed %u fast commits",
+			 sbi->s_fc_stats.fc_replayed);
+	return err;
+}
+
+static int ext4_fc_info_show(struct seq_file *seq, void *v)
+{
+	struct super_block *sb = seq->private;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_fc_stats *stats = &sbi->s_fc_stats;
+	journal_t *journal = sbi->s_journal;
+	unsigned int fast = atomic_read(&stats->fc_fast);
+	unsigned int full = atomic_read(&stats->fc_full);
+	int i;
+
+	seq_printf(seq, "fast_commit: %s\n",
+		   test_opt2(sb, FAST_COMMIT) ? "on" : "off");
+	seq_printf(seq, "area_blocks: %lu\n",
+		   journal->j_fc_last - journal->j_last);
+	seq_printf(seq, "replayed: %u\n", stats->fc_replayed);
+	seq_printf(seq, "fsync:\n");
+	seq_printf(seq, "\tno_commit: %u\n", atomic_read(&stats->fc_none));
+	seq_printf(seq, "\tfast_commits: %u\n", fast);
+	seq_printf(seq, "\tfast_commit_avg_us: %llu\n", fast ?
+		   div_u64(atomic64_read(&stats->fc_fast_usecs), fast) : 0);
+	seq_printf(seq, "\tfull_commits: %u\n", full);
+	seq_printf(seq, "\tfull_commit_avg_us: %llu\n", full ?
+		   div_u64(atomic64_read(&stats->fc_full_usecs), full) : 0);
+	seq_printf(seq, "fallback reasons:\n");
+	for (i = 0; i < EXT4_FC_REASON_MAX; i++)
+		seq_printf(seq, "\t%s: %u\n", ext4_fc_reason_names[i],
+			   atomic_read(&stats->fc_reasons[i]));
+	return 0;
+}
+
+static int ext4_fc_info_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ext4_fc_info_show, PDE(inode)->data);
+}
+
+static const struct file_operations ext4_fc_info_fops = {
+	.owner		= THIS_MODULE,
+	.open		= ext4_fc_info_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+void ext4_fc_init(struct super_block *sb)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+
+	mutex_init(&sbi->s_fc_lock);
+	get_random_bytes(&sbi->s_fc_run, sizeof(sbi->s_fc_run));
+}
+
+/*
+ * Called once the journal is loaded: replay what the last mount left in
+ * the fast commit area, then reserve or drop the area as the mount
+ * options ask.
+ */
+int ext4_fc_setup(struct super_block *sb)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	journal_t *journal = sbi->s_journal;
+	int err;
+
+	if (sbi->s_proc)
+		proc_create_data("fc_info", S_IRUGO, sbi->s_proc,
+				 &ext4_fc_info_fops, sb);
+
+	err = ext4_fc_replay(sb);
+	if (err)
+		return err;
+
+	/*
+	 * The next transaction gets the tid of the records just replayed.
+	 * Its run starts over at the beginning of the area, and the fresh
+	 * random run id keeps the old blocks after it from being taken for
+	 * its own.
+	 */
+	sbi->s_fc_tid = journal->j_transaction_sequence;
+	sbi->s_fc_off = 0;
+
+	if (!(sb->s_flags & MS_RDONLY)) {
+		err = jbd2_journal_set_fc_blocks(journal,
+				test_opt2(sb, FAST_COMMIT) ? EXT4_FC_BLOCKS : 0);
+		if (err) {
+			ext4_msg(sb, KERN_WARNING, "can't set up fast "
+				 "commits (error %d), disabled", err);
+			err = 0;
+		}
+	}
+	if (journal->j_fc_last == journal->j_last)
+		clear_opt2(sb, FAST_COMMIT);
+	return err;
+}
+
+/* Undo ext4_fc_setup(), before the journal is destroyed */
+void ext4_fc_release(struct super_block *sb)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+
+	if (sbi->s_proc && sbi->s_journal)
+		remove_proc_entry("fc_info", sbi->s_proc);
+}
@@ -28,6 +28,7 @@
 #include <linux/writeback.h>
 #include <linux/jbd2.h>
 #include <linux/blkdev.h>
+#include <linux/ktime.h>
 
 #include "ext4.h"
 #include "ext4_jbd2.h"
@@ -170,9 +171,12 @@ int ext4_sync_file(struct file *file, int datasync)
 	struct inode *inode = file->f_mapping->host;
 	struct ext4_inode_info *ei = EXT4_I(inode);
 	journal_t *journal = EXT4_SB(inode->i_sb)->s_journal;
+	struct ext4_fc_stats *stats = &EXT4_SB(inode->i_sb)->s_fc_stats;
 	int ret;
 	tid_t commit_tid;
 	bool needs_barrier = false;
+	bool committed;
+	ktime_t start;
 
 	J_ASSERT(ext4_journal_current_handle() == NULL);
 
@@ -212,6 +216,20 @@ int ext4_sync_file(struct file *file, int datasync)
 	}
 
 	commit_tid = datasync ? ei->i_datasync_tid : ei->i_sync_tid;
+	read_lock(&journal->j_state_lock);
+	committed = tid_geq(journal->j_commit_sequence, commit_tid);
+	read_unlock(&journal->j_state_lock);
+
+	/*
+	 * Rather than committing the whole running transaction, log just
+	 * this inode if we can.  Its cache flush covers the file data the
+	 * caller has written out.
+	 */
+	if (!committed && test_opt2(inode->i_sb, FAST_COMMIT) &&
+	    !ext4_fc_commit(inode, commit_tid))
+		goto out;
+
+	start = ktime_get();
 	if (journal->j_flags & JBD2_BARRIER &&
 	    !jbd2_trans_will_send_data_barrier(journal, commit_tid))
 		needs_barrier = true;
@@ -219,6 +237,13 @@ int ext4_sync_file(struct file *file, int datasync)
 	ret = jbd2_log_wait_commit(journal, commit_tid);
 	if (needs_barrier)
 		blkdev_issue_flush(inode->i_sb->s_bdev, GFP_KERNEL, NULL);
+	if (committed) {
+		atomic_inc(&stats->fc_none);
+	} else {
+		atomic_inc(&stats->fc_full);
+		atomic64_add(ktime_us_delta(ktime_get(), start),
+			     &stats->fc_full_usecs);
+	}
  out:
 	trace_ext4_sync_file_exit(inode, ret);
 	return ret;
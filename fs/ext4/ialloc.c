@@ -1055,9 +1055,16 @@ got:
 		}
 	}
 
+	/* The first write or mkdir decides whether it really goes inline */
+	if (test_opt2(sb, INLINE_DATA) && ei->i_extra_isize &&
+	    (S_ISDIR(mode) || S_ISREG(mode)))
+		ext4_set_inode_state(inode, EXT4_STATE_MAY_INLINE_DATA);
+
 	if (ext4_handle_valid(handle)) {
 		ei->i_sync_tid = handle->h_transaction->t_tid;
 		ei->i_datasync_tid = handle->h_transaction->t_tid;
+		/* Its directory entry is in this transaction too */
+		ei->i_fc_ineligible_tid = handle->h_transaction->t_tid;
 	}
 
 	err = ext4_mark_inode_dirty(handle, inode);
@@ -0,0 +1,1185 @@
+/*
+ *  linux/fs/ext4/inline.c
+ *
+ * Inline data: small files and directories kept in the inode itself.
+ *
+ * With the inline_data mount option, new regular files and directories
+ * start out with their contents in the inode body instead of a data
+ * block.  The first EXT4_MIN_INLINE_DATA_SIZE bytes live in i_block and
+ * anything beyond that in the value of the "system.data" in-inode
+ * extended attribute, which exists (possibly empty) for as long as the
+ * inode has EXT4_INLINE_DATA_FL set.  A file or directory that outgrows
+ * the space left in the inode is moved to a block and keeps the usual
+ * extent (or indirect) layout from then on.
+ *
+ * An inline directory has no "." or ".." entries: the first four bytes
+ * of i_block hold the parent's inode number and the entries follow,
+ * filling the rest of i_block and then the xattr value.  Entries never
+ * straddle the two.  i_size of an inline directory is the size of the
+ * whole inline area.
+ *
+ * The raw inode in the inode table buffer is authoritative for inline
+ * contents; ei->i_data is kept zeroed so that nothing mapping blocks
+ * finds stale pointers there, and ext4_do_update_inode() leaves i_block
+ * alone.  Everything looking at inline data holds xattr_sem, and
+ * changes are written with ext4_mark_iloc_dirty(): ext4_mark_inode_dirty()
+ * may try to expand the inode, which takes xattr_sem itself.  Lock
+ * order is the transaction, page 0, then xattr_sem.
+ */
+
+#include <linux/fs.h>
+#include <linux/fiemap.h>
+#include <linux/pagemap.h>
+#include <linux/highmem.h>
+#include <linux/slab.h>
+
+#include "ext4_jbd2.h"
+#include "ext4.h"
+#include "ext4_extents.h"
+#include "xattr.h"
+
+#define EXT4_INLINE_DIR_BLOCK_SIZE \
+	(EXT4_MIN_INLINE_DATA_SIZE - EXT4_INLINE_DOTDOT_SIZE)
+
+static inline void *ext4_inline_iblock(struct ext4_xattr_ibody_find *is)
+{
+	return ext4_raw_inode(&is->iloc)->i_block;
+}
+
+static inline size_t ext4_inline_xattr_size(struct ext4_xattr_ibody_find *is)
+{
+	return le32_to_cpu(is->s.here->e_value_size);
+}
+
+static inline void *ext4_inline_xattr_value(struct ext4_xattr_ibody_find *is)
+{
+	return is->s.base + le16_to_cpu(is->s.here->e_value_offs);
+}
+
+static inline size_t ext4_inline_size(struct ext4_xattr_ibody_find *is)
+{
+	return EXT4_MIN_INLINE_DATA_SIZE + ext4_inline_xattr_size(is);
+}
+
+/*
+ * Look up the system.data attribute of @inode.  With a @handle, also
+ * get write access to the inode buffer, ready for changes.  The caller
+ * initializes is->s.not_found to -ENODATA and brelse()s is->iloc.bh.
+ */
+static int ext4_inline_find(handle_t *handle, struct inode *inode,
+			    struct ext4_xattr_ibody_find *is)
+{
+	struct ext4_xattr_info i = {
+		.name_index = EXT4_XATTR_INDEX_SYSTEM_DATA,
+		.name = EXT4_XATTR_SYSTEM_DATA,
+	};
+	int error;
+
+	error = ext4_get_inode_loc(inode, &is->iloc);
+	if (error)
+		return error;
+
+	if (handle) {
+		error = ext4_journal_get_write_access(handle, is->iloc.bh);
+		if (error)
+			return error;
+		if (ext4_test_inode_state(inode, EXT4_STATE_NEW)) {
+			memset(ext4_raw_inode(&is->iloc), 0,
+			       EXT4_SB(inode->i_sb)->s_inode_size);
+			ext4_clear_inode_state(inode, EXT4_STATE_NEW);
+		}
+	}
+
+	error = ext4_xattr_ibody_find(inode, &i, is);
+	if (error)
+		return error;
+	if (ext4_has_inline_data(inode) && is->s.not_found) {
+		EXT4_ERROR_INODE(inode, "inline data attribute missing");
+		return -EIO;
+	}
+	return 0;
+}
+
+/*
+ * How much data the inode could hold inline, given the other in-inode
+ * attributes; 0 if not even an empty system.data fits.
+ */
+static size_t ext4_inline_max_size(struct ext4_xattr_ibody_find *is)
+{
+	size_t name_len = EXT4_XATTR_LEN(strlen(EXT4_XATTR_SYSTEM_DATA));
+	struct ext4_xattr_entry *last;
+	size_t min_offs, free;
+
+	if (!is->s.base)
+		return 0;
+
+	min_offs = is->s.end - is->s.base;
+	for (last = is->s.first; !IS_LAST_ENTRY(last);
+	     last = EXT4_XATTR_NEXT(last)) {
+		if (!last->e_value_block && last->e_value_size) {
+			size_t offs = le16_to_cpu(last->e_value_offs);
+			if (offs < min_offs)
+				min_offs = offs;
+		}
+	}
+	free = min_offs - ((void *)last - is->s.base) - sizeof(__u32);
+
+	if (!is->s.not_found)
+		free += EXT4_XATTR_SIZE(ext4_inline_xattr_size(is));
+	else if (free < name_len)
+		return 0;
+	else
+		free -= name_len;
+
+	return EXT4_MIN_INLINE_DATA_SIZE + (free & ~EXT4_XATTR_ROUND);
+}
+
+/* Copy @len bytes at @pos of the inline data to @buf */
+static void ext4_read_inline(struct ext4_xattr_ibody_find *is, void *buf,
+			     unsigned int pos, unsigned int len)
+{
+	unsigned int n;
+
+	if (pos < EXT4_MIN_INLINE_DATA_SIZE) {
+		n = min_t(unsigned int, len, EXT4_MIN_INLINE_DATA_SIZE - pos);
+		memcpy(buf, ext4_inline_iblock(is) + pos, n);
+		buf += n;
+		pos += n;
+		len -= n;
+	}
+	if (len)
+		memcpy(buf, ext4_inline_xattr_value(is) +
+		       pos - EXT4_MIN_INLINE_DATA_SIZE, len);
+}
+
+/* Copy @len bytes from @buf to @pos of the inline data */
+static void ext4_write_inline(struct ext4_xattr_ibody_find *is,
+			      const void *buf, unsigned int pos,
+			      unsigned int len)
+{
+	unsigned int n;
+
+	if (pos < EXT4_MIN_INLINE_DATA_SIZE) {
+		n = min_t(unsigned int, len, EXT4_MIN_INLINE_DATA_SIZE - pos);
+		memcpy(ext4_inline_iblock(is) + pos, buf, n);
+		buf += n;
+		pos += n;
+		len -= n;
+	}
+	if (len)
+		memcpy(ext4_inline_xattr_value(is) +
+		       pos - EXT4_MIN_INLINE_DATA_SIZE, buf, len);
+}
+
+/*
+ * Make the inline area @size bytes long, keeping what fits and zeroing
+ * any growth.  @size must not exceed ext4_inline_max_size().
+ */
+static int ext4_inline_resize(handle_t *handle, struct inode *inode,
+			      struct ext4_xattr_ibody_find *is, size_t size)
+{
+	struct ext4_xattr_info i = {
+		.name_index = EXT4_XATTR_INDEX_SYSTEM_DATA,
+		.name = EXT4_XATTR_SYSTEM_DATA,
+		.value = "",
+	};
+	size_t old_size = 0;
+	void *value = NULL;
+	int error;
+
+	size = max_t(size_t, size, EXT4_MIN_INLINE_DATA_SIZE) -
+	       EXT4_MIN_INLINE_DATA_SIZE;
+	if (!is->s.not_found) {
+		old_size = ext4_inline_xattr_size(is);
+		if (size == old_size)
+			return 0;
+	}
+
+	if (size) {
+		value = kzalloc(size, GFP_NOFS);
+		if (!value)
+			return -ENOMEM;
+		if (old_size)
+			memcpy(value, ext4_inline_xattr_value(is),
+			       min(size, old_size));
+		i.value = value;
+		i.value_len = size;
+	}
+
+	error = ext4_xattr_ibody_set(handle, inode, &i, is);
+	kfree(value);
+	if (!error)
+		is->s.not_found = 0;
+	return error;
+}
+
+/*
+ * If the INLINE_DATA feature of this file system is not set, set it,
+ * along with EXT_ATTR, which e2fsck wants to see for system.data.
+ */
+static int ext4_inline_update_super_block(handle_t *handle,
+					  struct super_block *sb)
+{
+	int error;
+
+	if (EXT4_HAS_INCOMPAT_FEATURE(sb, EXT4_FEATURE_INCOMPAT_INLINE_DATA) &&
+	    EXT4_HAS_COMPAT_FEATURE(sb, EXT4_FEATURE_COMPAT_EXT_ATTR))
+		return 0;
+
+	error = ext4_journal_get_write_access(handle, EXT4_SB(sb)->s_sbh);
+	if (error)
+		return error;
+	EXT4_SET_INCOMPAT_FEATURE(sb, EXT4_FEATURE_INCOMPAT_INLINE_DATA);
+	EXT4_SET_COMPAT_FEATURE(sb, EXT4_FEATURE_COMPAT_EXT_ATTR);
+	return ext4_handle_dirty_super(handle, sb);
+}
+
+/*
+ * Turn the empty, blockless @inode into an inline one.  Called with
+ * xattr_sem held for writing and write access to the inode buffer.
+ */
+static int ext4_create_inline_data(handle_t *handle, struct inode *inode,
+				   struct ext4_xattr_ibody_find *is)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	int error;
+
+	error = ext4_inline_update_super_block(handle, inode->i_sb);
+	if (error)
+		return error;
+	error = ext4_inline_resize(handle, inode, is, 0);
+	if (error)
+		return error;
+
+	memset(ext4_inline_iblock(is), 0, EXT4_MIN_INLINE_DATA_SIZE);
+	memset(ei->i_data, 0, sizeof(ei->i_data));
+	ext4_clear_inode_flag(inode, EXT4_INODE_EXTENTS);
+	ext4_set_inode_flag(inode, EXT4_INODE_INLINE_DATA);
+	ext4_clear_inode_state(inode, EXT4_STATE_MAY_INLINE_DATA);
+	return 0;
+}
+
+/*
+ * Drop the inline data of @inode and give it an empty block map.
+ * Called with xattr_sem held for writing and write access to the inode
+ * buffer; the caller has saved whatever it still needs.
+ */
+static int ext4_destroy_inline_data(handle_t *handle, struct inode *inode,
+				    struct ext4_xattr_ibody_find *is)
+{
+	struct ext4_xattr_info i = {
+		.name_index = EXT4_XATTR_INDEX_SYSTEM_DATA,
+		.name = EXT4_XATTR_SYSTEM_DATA,
+	};
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	int error;
+
+	error = ext4_xattr_ibody_set(handle, inode, &i, is);
+	if (error)
+		return error;
+
+	memset(ext4_inline_iblock(is), 0, EXT4_MIN_INLINE_DATA_SIZE);
+	memset(ei->i_data, 0, sizeof(ei->i_data));
+	if (EXT4_HAS_INCOMPAT_FEATURE(inode->i_sb,
+				      EXT4_FEATURE_INCOMPAT_EXTENTS)) {
+		/* What ext4_ext_tree_init() does, minus dirtying the inode */
+		struct ext4_extent_header *eh = ext_inode_hdr(inode);
+
+		eh->eh_depth = 0;
+		eh->eh_entries = 0;
+		eh->eh_magic = EXT4_EXT_MAGIC;
+		eh->eh_max = cpu_to_le16((sizeof(ei->i_data) - sizeof(*eh)) /
+					 sizeof(struct ext4_extent));
+		ext4_set_inode_flag(inode, EXT4_INODE_EXTENTS);
+	}
+	ext4_clear_inode_flag(inode, EXT4_INODE_INLINE_DATA);
+	ext4_fc_mark_ineligible(handle, inode);
+	return 0;
+}
+
+/*
+ * Put @size bytes of contents back inline after moving them out failed,
+ * rather than lose them.  Called with xattr_sem held for writing.
+ */
+static int ext4_restore_inline_data(handle_t *handle, struct inode *inode,
+				    const void *buf, size_t size)
+{
+	struct ext4_xattr_ibody_find is = {
+		.s = { .not_found = -ENODATA, },
+	};
+	int error;
+
+	error = ext4_inline_find(handle, inode, &is);
+	if (!error)
+		error = ext4_create_inline_data(handle, inode, &is);
+	if (!error)
+		error = ext4_inline_resize(handle, inode, &is, size);
+	if (!error) {
+		ext4_write_inline(&is, buf, 0, size);
+		error = ext4_mark_iloc_dirty(handle, inode, &is.iloc);
+		is.iloc.bh = NULL;
+	}
+	brelse(is.iloc.bh);
+	if (error)
+		EXT4_ERROR_INODE(inode, "cannot restore inline data (%d)",
+				 error);
+	return error;
+}
+
+/* Fill @page, page 0 of the file, from the inline data */
+static void ext4_read_inline_page(struct ext4_xattr_ibody_find *is,
+				  struct page *page)
+{
+	size_t len = ext4_inline_size(is);
+	void *kaddr;
+
+	kaddr = kmap_atomic(page, KM_USER0);
+	ext4_read_inline(is, kaddr, 0, len);
+	memset(kaddr + len, 0, PAGE_CACHE_SIZE - len);
+	kunmap_atomic(kaddr, KM_USER0);
+	flush_dcache_page(page);
+	SetPageUptodate(page);
+}
+
+/*
+ * ->readpage() for an inode with inline data.  Returns -EAGAIN if the
+ * data was moved to a block in the meantime.
+ */
+int ext4_readpage_inline(struct inode *inode, struct page *page)
+{
+	struct ext4_xattr_ibody_find is = {
+		.s = { .not_found = -ENODATA, },
+	};
+	int ret = 0;
+
+	down_read(&EXT4_I(inode)->xattr_sem);
+	if (!ext4_has_inline_data(inode)) {
+		up_read(&EXT4_I(inode)->xattr_sem);
+		return -EAGAIN;
+	}
+
+	if (page->index == 0) {
+		ret = ext4_inline_find(NULL, inode, &is);
+		if (!ret)
+			ext4_read_inline_page(&is, page);
+		brelse(is.iloc.bh);
+	} else {
+		/* Past i_size, somebody is reading a hole */
+		zero_user(page, 0, PAGE_CACHE_SIZE);
+		SetPageUptodate(page);
+	}
+	up_read(&EXT4_I(inode)->xattr_sem);
+
+	unlock_page(page);
+	return ret;
+}
+
+/*
+ * ->write_begin() for a write that may go inline: to a file that has
+ * inline data, or a new one that may get it.  Returns 1 with a running
+ * handle and page 0 locked in *@pagep if the write goes inline, having
+ * made room for it.  Returns 0 if the caller should do a normal block
+ * write instead, after the inline data has been moved out if there was
+ * any, or an error.
+ */
+int ext4_try_to_write_inline_data(struct address_space *mapping,
+				  struct inode *inode, loff_t pos,
+				  unsigned len, unsigned flags,
+				  struct page **pagep)
+{
+	struct ext4_xattr_ibody_find is = {
+		.s = { .not_found = -ENODATA, },
+	};
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	int convert = 0;
+	handle_t *handle;
+	struct page *page;
+	size_t max_size;
+	int ret;
+
+	/* The inode block, and the superblock for the feature flag */
+	handle = ext4_journal_start(inode, 2);
+	if (IS_ERR(handle))
+		return PTR_ERR(handle);
+
+	page = grab_cache_page_write_begin(mapping, 0, flags | AOP_FLAG_NOFS);
+	if (!page) {
+		ret = -ENOMEM;
+		goto out_stop;
+	}
+
+	down_write(&ei->xattr_sem);
+	ret = 0;
+	if (!ext4_has_inline_data(inode) &&
+	    (!ext4_test_inode_state(inode, EXT4_STATE_MAY_INLINE_DATA) ||
+	     inode->i_size))
+		goto out_no_inline;
+
+	ret = ext4_inline_find(handle, inode, &is);
+	if (ret)
+		goto out_unlock;
+
+	max_size = ext4_inline_max_size(&is);
+	if (!max_size || pos + len > max_size) {
+		if (ext4_has_inline_data(inode))
+			convert = 1;
+		goto out_no_inline;
+	}
+
+	if (!ext4_has_inline_data(inode)) {
+		ret = ext4_create_inline_data(handle, inode, &is);
+		if (ret)
+			goto out_unlock;
+	}
+	if (pos + len > ext4_inline_size(&is)) {
+		ret = ext4_inline_resize(handle, inode, &is, pos + len);
+		if (ret)
+			goto out_unlock;
+	}
+	if (!PageUptodate(page))
+		ext4_read_inline_page(&is, page);
+
+	ret = ext4_mark_iloc_dirty(handle, inode, &is.iloc);
+	is.iloc.bh = NULL;
+	if (ret)
+		goto out_unlock;
+	up_write(&ei->xattr_sem);
+
+	*pagep = page;
+	return 1;
+
+out_no_inline:
+	ext4_clear_inode_state(inode, EXT4_STATE_MAY_INLINE_DATA);
+out_unlock:
+	up_write(&ei->xattr_sem);
+	brelse(is.iloc.bh);
+	unlock_page(page);
+	page_cache_release(page);
+out_stop:
+	ext4_journal_stop(handle);
+	if (convert)
+		return ext4_convert_inline_data(inode);
+	return ret;
+}
+
+/*
+ * ->write_end() for a write that ext4_try_to_write_inline_data() sent
+ * inline: copy what made it into the page to the inode.
+ */
+int ext4_write_inline_data_end(struct inode *inode, loff_t pos, unsigned len,
+			       unsigned copied, struct page *page)
+{
+	struct ext4_xattr_ibody_find is = {
+		.s = { .not_found = -ENODATA, },
+	};
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	handle_t *handle = ext4_journal_current_handle();
+	void *kaddr;
+	int ret, ret2;
+
+	down_write(&ei->xattr_sem);
+	ret = ext4_inline_find(handle, inode, &is);
+	if (ret)
+		goto out;
+
+	if (copied) {
+		kaddr = kmap_atomic(page, KM_USER0);
+		ext4_write_inline(&is, kaddr + pos, pos, copied);
+		kunmap_atomic(kaddr, KM_USER0);
+	}
+	if (pos + copied > inode->i_size) {
+		i_size_write(inode, pos + copied);
+		ei->i_disksize = pos + copied;
+	}
+
+	ret = ext4_mark_iloc_dirty(handle, inode, &is.iloc);
+	is.iloc.bh = NULL;
+out:
+	up_write(&ei->xattr_sem);
+	brelse(is.iloc.bh);
+	unlock_page(page);
+	page_cache_release(page);
+
+	ret2 = ext4_journal_stop(handle);
+	if (!ret)
+		ret = ret2;
+	return ret ? ret : copied;
+}
+
+/*
+ * Move the inline data of regular file @inode to a block, e.g. because
+ * a write no longer fits or the file is about to be mapped writable.
+ * Also makes sure a new file that may get inline data won't.
+ */
+int ext4_convert_inline_data(struct inode *inode)
+{
+	struct ext4_xattr_ibody_find is = {
+		.s = { .not_found = -ENODATA, },
+	};
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	handle_t *handle;
+	struct page *page;
+	void *kaddr;
+	size_t size;
+	int ret, ret2;
+
+	if (!ext4_has_inline_data(inode)) {
+		ext4_clear_inode_state(inode, EXT4_STATE_MAY_INLINE_DATA);
+		return 0;
+	}
+
+	handle = ext4_journal_start(inode, ext4_writepage_trans_blocks(inode));
+	if (IS_ERR(handle))
+		return PTR_ERR(handle);
+
+	/*
+	 * Holding page 0 keeps out inline writes, which hold it from
+	 * write_begin to write_end.
+	 */
+	page = grab_cache_page_write_begin(inode->i_mapping, 0, AOP_FLAG_NOFS);
+	if (!page) {
+		ret = -ENOMEM;
+		goto out_stop;
+	}
+
+	down_write(&ei->xattr_sem);
+	ret = 0;
+	if (!ext4_has_inline_data(inode))
+		goto out_unlock;
+	ret = ext4_inline_find(handle, inode, &is);
+	if (ret)
+		goto out_unlock;
+
+	size = min_t(size_t, i_size_read(inode), ext4_inline_size(&is));
+	ext4_read_inline_page(&is, page);
+	ret = ext4_destroy_inline_data(handle, inode, &is);
+	if (ret)
+		goto out_unlock;
+	ret = ext4_mark_iloc_dirty(handle, inode, &is.iloc);
+	is.iloc.bh = NULL;
+	up_write(&ei->xattr_sem);
+
+	if (!ret && size) {
+		ret = ext4_convert_page_to_blocks(handle, inode, page, size);
+		if (ret) {
+			down_write(&ei->xattr_sem);
+			kaddr = kmap(page);
+			ext4_restore_inline_data(handle, inode, kaddr, size);
+			kunmap(page);
+			up_write(&ei->xattr_sem);
+		}
+	}
+	goto out_page;
+
+out_unlock:
+	up_write(&ei->xattr_sem);
+	brelse(is.iloc.bh);
+out_page:
+	unlock_page(page);
+	page_cache_release(page);
+out_stop:
+	ext4_clear_inode_state(inode, EXT4_STATE_MAY_INLINE_DATA);
+	ret2 = ext4_journal_stop(handle);
+	if (!ret)
+		ret = ret2;
+	return ret;
+}
+
+/*
+ * Shrink the inline data of @inode to i_size, which the caller has
+ * already set.  Called from ext4_truncate().
+ */
+void ext4_inline_data_truncate(struct inode *inode)
+{
+	struct ext4_xattr_ibody_find is = {
+		.s = { .not_found = -ENODATA, },
+	};
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	handle_t *handle;
+	size_t size, inline_size;
+	int err;
+
+	/* The inode block, and two more for the orphan list */
+	handle = ext4_journal_start(inode, 3);
+	if (IS_ERR(handle)) {
+		ext4_std_error(inode->i_sb, PTR_ERR(handle));
+		return;
+	}
+
+	down_write(&ei->xattr_sem);
+	if (!ext4_has_inline_data(inode))
+		goto out_unlock;
+	err = ext4_inline_find(handle, inode, &is);
+	if (err)
+		goto out_err;
+
+	size = i_size_read(inode);
+	inline_size = ext4_inline_size(&is);
+	if (size < inline_size) {
+		/* Bytes past i_size must read back as zeroes */
+		if (size < EXT4_MIN_INLINE_DATA_SIZE)
+			memset(ext4_inline_iblock(&is) + size, 0,
+			       EXT4_MIN_INLINE_DATA_SIZE - size);
+		err = ext4_inline_resize(handle, inode, &is, size);
+		if (err)
+			goto out_err;
+	}
+	ei->i_disksize = size;
+	err = ext4_mark_iloc_dirty(handle, inode, &is.iloc);
+	is.iloc.bh = NULL;
+out_err:
+	if (err)
+		ext4_std_error(inode->i_sb, err);
+out_unlock:
+	up_write(&ei->xattr_sem);
+	brelse(is.iloc.bh);
+
+	/*
+	 * If this was a simple ftruncate() and the file will remain alive,
+	 * then we need to clear up the orphan record which we created above.
+	 */
+	if (inode->i_nlink)
+		ext4_orphan_del(handle, inode);
+	ext4_journal_stop(handle);
+}
+
+/* Report the inline data of @inode as one extent inside the inode table */
+int ext4_inline_data_fiemap(struct inode *inode,
+			    struct fiemap_extent_info *fieinfo,
+			    int *has_inline_data)
+{
+	struct ext4_xattr_ibody_find is = {
+		.s = { .not_found = -ENODATA, },
+	};
+	__u32 flags = FIEMAP_EXTENT_DATA_INLINE | FIEMAP_EXTENT_NOT_ALIGNED |
+		      FIEMAP_EXTENT_LAST;
+	__u64 physical;
+	int error;
+
+	down_read(&EXT4_I(inode)->xattr_sem);
+	if (!ext4_has_inline_data(inode)) {
+		*has_inline_data = 0;
+		error = 0;
+		goto out;
+	}
+	error = ext4_inline_find(NULL, inode, &is);
+	if (error)
+		goto out;
+
+	physical = (__u64)is.iloc.bh->b_blocknr <<
+		   inode->i_sb->s_blocksize_bits;
+	physical += (char *)ext4_inline_iblock(&is) - is.iloc.bh->b_data;
+	error = fiemap_fill_next_extent(fieinfo, 0, physical,
+					S_ISDIR(inode->i_mode) ?
+					ext4_inline_size(&is) :
+					i_size_read(inode), flags);
+	if (error > 0)
+		error = 0;
+out:
+	brelse(is.iloc.bh);
+	up_read(&EXT4_I(inode)->xattr_sem);
+	return error;
+}
+
+/*
+ * Directories
+ */
+
+/*
+ * The two runs of entries of an inline directory: the rest of i_block
+ * after the parent, and the xattr value (of size 0 at first).
+ */
+static void *ext4_inline_dir_area(struct ext4_xattr_ibody_find *is, int n,
+				  int *size)
+{
+	if (n == 0) {
+		*size = EXT4_INLINE_DIR_BLOCK_SIZE;
+		return ext4_inline_iblock(is) + EXT4_INLINE_DOTDOT_SIZE;
+	}
+	*size = ext4_inline_xattr_size(is);
+	return ext4_inline_xattr_value(is);
+}
+
+/*
+ * Make the new directory @inode inline, with @parent as "..".  Returns
+ * -ENOSPC if the inode has no room and needs a block after all.
+ */
+int ext4_init_inline_dir(handle_t *handle, struct inode *parent,
+			 struct inode *inode)
+{
+	struct ext4_xattr_ibody_find is = {
+		.s = { .not_found = -ENODATA, },
+	};
+	struct ext4_dir_entry_2 *de;
+	void *iblock;
+	int ret;
+
+	down_write(&EXT4_I(inode)->xattr_sem);
+	ret = ext4_inline_find(handle, inode, &is);
+	if (ret)
+		goto out;
+	ret = -ENOSPC;
+	if (!ext4_inline_max_size(&is))
+		goto out;
+	ret = ext4_create_inline_data(handle, inode, &is);
+	if (ret)
+		goto out;
+
+	iblock = ext4_inline_iblock(&is);
+	*(__le32 *)iblock = cpu_to_le32(parent->i_ino);
+	de = (struct ext4_dir_entry_2 *)(iblock + EXT4_INLINE_DOTDOT_SIZE);
+	de->inode = 0;
+	de->rec_len = ext4_rec_len_to_disk(EXT4_INLINE_DIR_BLOCK_SIZE,
+					   inode->i_sb->s_blocksize);
+	inode->i_size = EXT4_I(inode)->i_disksize = EXT4_MIN_INLINE_DATA_SIZE;
+
+	ret = ext4_mark_iloc_dirty(handle, inode, &is.iloc);
+	is.iloc.bh = NULL;
+out:
+	ext4_clear_inode_state(inode, EXT4_STATE_MAY_INLINE_DATA);
+	up_write(&EXT4_I(inode)->xattr_sem);
+	brelse(is.iloc.bh);
+	return ret;
+}
+
+/*
+ * ->readdir() of an inline directory.  f_pos is 0 for ".", 1 for ".."
+ * and the offset into the inline area for everything else.
+ */
+int ext4_read_inline_dir(struct file *filp, void *dirent, filldir_t filldir,
+			 int *has_inline_data)
+{
+	struct inode *inode = filp->f_path.dentry->d_inode;
+	struct super_block *sb = inode->i_sb;
+	struct ext4_xattr_ibody_find is = {
+		.s = { .not_found = -ENODATA, },
+	};
+	struct ext4_dir_entry_2 *de;
+	unsigned int offset, size, rec_len;
+	char *buf;
+	int ret;
+
+	down_read(&EXT4_I(inode)->xattr_sem);
+	if (!ext4_has_inline_data(inode)) {
+		up_read(&EXT4_I(inode)->xattr_sem);
+		*has_inline_data = 0;
+		return 0;
+	}
+	ret = ext4_inline_find(NULL, inode, &is);
+	if (ret)
+		goto out_unlock;
+	size = ext4_inline_size(&is);
+	buf = kmalloc(size, GFP_NOFS);
+	if (!buf) {
+		ret = -ENOMEM;
+		goto out_unlock;
+	}
+	/* filldir() may fault, so work on a copy */
+	ext4_read_inline(&is, buf, 0, size);
+	brelse(is.iloc.bh);
+	up_read(&EXT4_I(inode)->xattr_sem);
+
+	if (filp->f_pos == 0) {
+		if (filldir(dirent, ".", 1, 0, inode->i_ino, DT_DIR))
+			goto out;
+		filp->f_pos = 1;
+	}
+	if (filp->f_pos == 1) {
+		if (filldir(dirent, "..", 2, 1, le32_to_cpu(*(__le32 *)buf),
+			    DT_DIR))
+			goto out;
+		filp->f_pos = EXT4_INLINE_DOTDOT_SIZE;
+	}
+
+	/* The two runs of entries are contiguous in the copy */
+	for (offset = EXT4_INLINE_DOTDOT_SIZE; offset < size;
+	     offset += rec_len) {
+		de = (struct ext4_dir_entry_2 *)(buf + offset);
+		if (ext4_check_dir_entry(inode, filp, de, NULL, buf, size,
+					 offset)) {
+			filp->f_pos = size;
+			break;
+		}
+		rec_len = ext4_rec_len_from_disk(de->rec_len, sb->s_blocksize);
+		/* Skip what was returned already */
+		if (offset < filp->f_pos)
+			continue;
+		if (le32_to_cpu(de->inode) &&
+		    filldir(dirent, de->name, de->name_len, offset,
+			    le32_to_cpu(de->inode),
+			    get_dtype(sb, de->file_type)))
+			break;
+		filp->f_pos = offset + rec_len;
+	}
+out:
+	kfree(buf);
+	return 0;
+
+out_unlock:
+	brelse(is.iloc.bh);
+	up_read(&EXT4_I(inode)->xattr_sem);
+	return ret;
+}
+
+/*
+ * Look @d_name up in an inline directory.  On success, *@res_dir points
+ * into the returned inode table buffer.  "." and ".." are not there.
+ */
+struct buffer_head *ext4_find_inline_entry(struct inode *dir,
+					   const struct qstr *d_name,
+					   struct ext4_dir_entry_2 **res_dir,
+					   int *has_inline_data)
+{
+	struct ext4_xattr_ibody_find is = {
+		.s = { .not_found = -ENODATA, },
+	};
+	struct buffer_head *bh = NULL;
+	int n, size, ret;
+	void *buf;
+
+	down_read(&EXT4_I(dir)->xattr_sem);
+	if (!ext4_has_inline_data(dir)) {
+		*has_inline_data = 0;
+		goto out;
+	}
+	if (ext4_inline_find(NULL, dir, &is))
+		goto out;
+
+	for (n = 0; n < 2; n++) {
+		buf = ext4_inline_dir_area(&is, n, &size);
+		if (!size)
+			continue;
+		ret = search_dir(is.iloc.bh, buf, size, dir, d_name,
+				 n ? EXT4_MIN_INLINE_DATA_SIZE :
+				     EXT4_INLINE_DOTDOT_SIZE, res_dir);
+		if (ret == 1) {
+			bh = is.iloc.bh;
+			is.iloc.bh = NULL;
+			break;
+		}
+		if (ret < 0)
+			break;
+	}
+out:
+	brelse(is.iloc.bh);
+	up_read(&EXT4_I(dir)->xattr_sem);
+	return bh;
+}
+
+/*
+ * Move the entries of inline directory @dir to a new block 0, behind
+ * "." and "..".  Called with xattr_sem held for writing and write
+ * access to the inode buffer, which is consumed.
+ */
+static int ext4_convert_inline_dir(handle_t *handle, struct inode *dir,
+				   struct ext4_xattr_ibody_find *is)
+{
+	unsigned int blocksize = dir->i_sb->s_blocksize;
+	unsigned int offset, size = ext4_inline_size(is);
+	struct ext4_dir_entry_2 *de;
+	struct buffer_head *bh;
+	int no_expand, ret;
+	char *buf;
+
+	buf = kmalloc(size, GFP_NOFS);
+	if (!buf)
+		return -ENOMEM;
+	ext4_read_inline(is, buf, 0, size);
+
+	/* Don't give up the inline copy of a corrupted directory */
+	for (offset = EXT4_INLINE_DOTDOT_SIZE; offset < size;
+	     offset += ext4_rec_len_from_disk(de->rec_len, blocksize)) {
+		de = (struct ext4_dir_entry_2 *)(buf + offset);
+		if (ext4_check_dir_entry(dir, NULL, de, is->iloc.bh,
+					 buf, size, offset)) {
+			ret = -EIO;
+			goto out;
+		}
+	}
+
+	/* Allocating the block dirties the inode, which mustn't expand it */
+	no_expand = ext4_test_inode_state(dir, EXT4_STATE_NO_EXPAND);
+	ext4_set_inode_state(dir, EXT4_STATE_NO_EXPAND);
+
+	ret = ext4_destroy_inline_data(handle, dir, is);
+	if (ret)
+		goto out_expand;
+	ret = ext4_mark_iloc_dirty(handle, dir, &is->iloc);
+	is->iloc.bh = NULL;
+	if (ret)
+		goto out_expand;
+
+	bh = ext4_bread(handle, dir, 0, 1, &ret);
+	if (!bh) {
+		ext4_restore_inline_data(handle, dir, buf, size);
+		goto out_expand;
+	}
+	BUFFER_TRACE(bh, "get_write_access");
+	ret = ext4_journal_get_write_access(handle, bh);
+	if (ret)
+		goto out_brelse;
+
+	de = ext4_init_dot_dotdot(dir, (struct ext4_dir_entry_2 *)bh->b_data,
+				  blocksize, le32_to_cpu(*(__le32 *)buf), 1);
+	size -= EXT4_INLINE_DOTDOT_SIZE;
+	memcpy(de, buf + EXT4_INLINE_DOTDOT_SIZE, size);
+	offset = (char *)de - bh->b_data + size;
+	de = (struct ext4_dir_entry_2 *)(bh->b_data + offset);
+	memset(de, 0, blocksize - offset);
+	de->rec_len = ext4_rec_len_to_disk(blocksize - offset, blocksize);
+
+	BUFFER_TRACE(bh, "call ext4_handle_dirty_metadata");
+	ret = ext4_handle_dirty_metadata(handle, dir, bh);
+	if (ret)
+		goto out_brelse;
+	dir->i_size = EXT4_I(dir)->i_disksize = blocksize;
+	dir->i_version++;
+	ret = ext4_mark_inode_dirty(handle, dir);
+out_brelse:
+	brelse(bh);
+out_expand:
+	if (!no_expand)
+		ext4_clear_inode_state(dir, EXT4_STATE_NO_EXPAND);
+out:
+	kfree(buf);
+	brelse(is->iloc.bh);
+	is->iloc.bh = NULL;
+	return ret;
+}
+
+/*
+ * Add the entry for @dentry to its inline parent.  Returns 1 if it was
+ * added inline, 0 if the caller should add it to block 0, into which
+ * the directory has been converted for lack of room, or an error.
+ */
+int ext4_try_add_inline_entry(handle_t *handle, struct dentry *dentry,
+			      struct inode *inode)
+{
+	struct inode *dir = dentry->d_parent->d_inode;
+	const char *name = (const char *)dentry->d_name.name;
+	int namelen = dentry->d_name.len;
+	struct ext4_xattr_ibody_find is = {
+		.s = { .not_found = -ENODATA, },
+	};
+	struct ext4_dir_entry_2 *de;
+	size_t old_size, new_size;
+	int n, size, ret;
+	void *buf;
+
+	down_write(&EXT4_I(dir)->xattr_sem);
+	ret = 0;
+	if (!ext4_has_inline_data(dir))
+		goto out;
+	ret = ext4_inline_find(handle, dir, &is);
+	if (ret)
+		goto out;
+
+	ret = -ENOSPC;
+	for (n = 0; n < 2 && ret == -ENOSPC; n++) {
+		buf = ext4_inline_dir_area(&is, n, &size);
+		if (size)
+			ret = ext4_find_dest_de(dir, is.iloc.bh, buf, size,
+						name, namelen, &de);
+	}
+
+	if (ret == -ENOSPC) {
+		/* Grow the xattr value by a free entry for the name */
+		old_size = ext4_inline_size(&is);
+		new_size = old_size + EXT4_DIR_REC_LEN(namelen);
+		if (new_size <= ext4_inline_max_size(&is)) {
+			ret = ext4_inline_resize(handle, dir, &is, new_size);
+			if (ret)
+				goto out;
+			de = ext4_inline_xattr_value(&is) + old_size -
+			     EXT4_MIN_INLINE_DATA_SIZE;
+			de->inode = 0;
+			de->rec_len = ext4_rec_len_to_disk(
+					EXT4_DIR_REC_LEN(namelen),
+					dir->i_sb->s_blocksize);
+			i_size_write(dir, new_size);
+			EXT4_I(dir)->i_disksize = new_size;
+		}
+	}
+	if (ret == -ENOSPC) {
+		ret = ext4_convert_inline_dir(handle, dir, &is);
+		goto out;
+	}
+	if (ret)
+		goto out;
+
+	ext4_insert_dentry(inode, de, name, namelen);
+	/* See add_dirent_to_buf() about updating the times here */
+	dir->i_mtime = dir->i_ctime = ext4_current_time(dir);
+	dir->i_version++;
+	ret = ext4_mark_iloc_dirty(handle, dir, &is.iloc);
+	is.iloc.bh = NULL;
+	if (!ret)
+		ret = 1;
+out:
+	up_write(&EXT4_I(dir)->xattr_sem);
+	brelse(is.iloc.bh);
+	return ret;
+}
+
+/*
+ * Delete the entry @de_del, found by ext4_find_inline_entry(), from an
+ * inline directory.
+ */
+int ext4_delete_inline_entry(handle_t *handle, struct inode *dir,
+			     struct ext4_dir_entry_2 *de_del,
+			     struct buffer_head *bh, int *has_inline_data)
+{
+	struct ext4_xattr_ibody_find is = {
+		.s = { .not_found = -ENODATA, },
+	};
+	int n, size, ret;
+	void *buf;
+
+	down_write(&EXT4_I(dir)->xattr_sem);
+	if (!ext4_has_inline_data(dir)) {
+		*has_inline_data = 0;
+		ret = 0;
+		goto out;
+	}
+	ret = ext4_inline_find(handle, dir, &is);
+	if (ret)
+		goto out;
+
+	ret = -ENOENT;
+	for (n = 0; n < 2; n++) {
+		buf = ext4_inline_dir_area(&is, n, &size);
+		if ((void *)de_del >= buf && (void *)de_del < buf + size) {
+			ret = ext4_generic_delete_entry(handle, dir, de_del,
+							is.iloc.bh, buf, size);
+			break;
+		}
+	}
+	if (ret)
+		goto out;
+
+	ret = ext4_mark_iloc_dirty(handle, dir, &is.iloc);
+	is.iloc.bh = NULL;
+	if (unlikely(ret))
+		ext4_std_error(dir->i_sb, ret);
+out:
+	up_write(&EXT4_I(dir)->xattr_sem);
+	brelse(is.iloc.bh);
+	return ret;
+}
+
+/* Whether an inline directory is empty, as for empty_dir() */
+int empty_inline_dir(struct inode *dir, int *has_inline_data)
+{
+	struct ext4_xattr_ibody_find is = {
+		.s = { .not_found = -ENODATA, },
+	};
+	unsigned int blocksize = dir->i_sb->s_blocksize;
+	struct ext4_dir_entry_2 *de;
+	int n, size, offset;
+	int empty = 1;
+	void *buf;
+
+	down_read(&EXT4_I(dir)->xattr_sem);
+	if (!ext4_has_inline_data(dir)) {
+		*has_inline_data = 0;
+		goto out;
+	}
+	if (ext4_inline_find(NULL, dir, &is)) {
+		ext4_warning(dir->i_sb,
+			     "bad inline directory (dir #%lu)", dir->i_ino);
+		goto out;
+	}
+
+	for (n = 0; n < 2 && empty; n++) {
+		buf = ext4_inline_dir_area(&is, n, &size);
+		for (offset = 0; offset < size;
+		     offset += ext4_rec_len_from_disk(de->rec_len, blocksize)) {
+			de = buf + offset;
+			if (ext4_check_dir_entry(dir, NULL, de, is.iloc.bh,
+						 buf, size, offset))
+				break;
+			if (le32_to_cpu(de->inode)) {
+				empty = 0;
+				break;
+			}
+		}
+	}
+out:
+	brelse(is.iloc.bh);
+	up_read(&EXT4_I(dir)->xattr_sem);
+	return empty;
+}
+
+/*
+ * Get the parent of directory @dir into *@ino if @dir is inline.
+ * Returns 1 if it was, 0 if the caller should look at block 0.
+ */
+int ext4_inline_dir_parent(struct inode *dir, __u32 *ino)
+{
+	struct ext4_xattr_ibody_find is = {
+		.s = { .not_found = -ENODATA, },
+	};
+	int ret = 0;
+
+	if (!ext4_has_inline_data(dir))
+		return 0;
+
+	down_read(&EXT4_I(dir)->xattr_sem);
+	if (ext4_has_inline_data(dir)) {
+		ret = ext4_inline_find(NULL, dir, &is);
+		if (!ret) {
+			*ino = le32_to_cpu(*(__le32 *)ext4_inline_iblock(&is));
+			ret = 1;
+		}
+	}
+	brelse(is.iloc.bh);
+	up_read(&EXT4_I(dir)->xattr_sem);
+	return ret;
+}
+
+/*
+ * Make @ino the parent of directory @dir, which was inline when the
+ * caller looked.  Adding an entry to @dir may have moved it to a block
+ * since, as rename doesn't lock the directory being moved.
+ */
+int ext4_set_inline_dir_parent(handle_t *handle, struct inode *dir, __u32 ino)
+{
+	struct ext4_xattr_ibody_find is = {
+		.s = { .not_found = -ENODATA, },
+	};
+	unsigned int blocksize = dir->i_sb->s_blocksize;
+	struct ext4_dir_entry_2 *de;
+	struct buffer_head *bh;
+	int ret;
+
+	down_write(&EXT4_I(dir)->xattr_sem);
+	if (ext4_has_inline_data(dir)) {
+		ret = ext4_inline_find(handle, dir, &is);
+		if (!ret) {
+			*(__le32 *)ext4_inline_iblock(&is) = cpu_to_le32(ino);
+			ret = ext4_mark_iloc_dirty(handle, dir, &is.iloc);
+			is.iloc.bh = NULL;
+		}
+		brelse(is.iloc.bh);
+		up_write(&EXT4_I(dir)->xattr_sem);
+		return ret;
+	}
+	up_write(&EXT4_I(dir)->xattr_sem);
+
+	bh = ext4_bread(handle, dir, 0, 0, &ret);
+	if (!bh)
+		return ret ? ret : -EIO;
+	BUFFER_TRACE(bh, "get_write_access");
+	ret = ext4_journal_get_write_access(handle, bh);
+	if (!ret) {
+		/* ".." follows "." */
+		de = (struct ext4_dir_entry_2 *)bh->b_data;
+		de = (struct ext4_dir_entry_2 *)(bh->b_data +
+			ext4_rec_len_from_disk(de->rec_len, blocksize));
+		de->inode = cpu_to_le32(ino);
+		BUFFER_TRACE(bh, "call ext4_handle_dirty_metadata");
+		ret = ext4_handle_dirty_metadata(handle, dir, bh);
+	}
+	brelse(bh);
+	return ret;
+}
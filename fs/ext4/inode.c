@@ -1620,6 +1620,16 @@ static int ext4_write_begin(struct file *file, struct address_space *mapping,
 	unsigned from, to;
 
 	trace_ext4_write_begin(inode, pos, len, flags);
+	if (ext4_has_inline_data(inode) ||
+	    ext4_test_inode_state(inode, EXT4_STATE_MAY_INLINE_DATA)) {
+		ret = ext4_try_to_write_inline_data(mapping, inode, pos, len,
+						    flags, pagep);
+		if (ret < 0)
+			return ret;
+		if (ret == 1)
+			return 0;
+	}
+
 	/*
 	 * Reserve one block more for addition to orphan list in case
 	 * we allocate blocks but write fails for some reason
@@ -1764,6 +1774,9 @@ static int ext4_ordered_write_end(struct file *file,
 	int ret = 0, ret2;
 
 	trace_ext4_ordered_write_end(inode, pos, len, copied);
+	if (ext4_has_inline_data(inode))
+		return ext4_write_inline_data_end(inode, pos, len, copied,
+						  page);
 	ret = ext4_jbd2_file_inode(handle, inode);
 
 	if (ret == 0) {
@@ -1808,6 +1821,9 @@ static int ext4_writeback_write_end(struct file *file,
 	int ret = 0, ret2;
 
 	trace_ext4_writeback_write_end(inode, pos, len, copied);
+	if (ext4_has_inline_data(inode))
+		return ext4_write_inline_data_end(inode, pos, len, copied,
+						  page);
 	ret2 = ext4_generic_write_end(file, mapping, pos, len, copied,
 							page, fsdata);
 	copied = ret2;
@@ -1852,6 +1868,9 @@ static int ext4_journalled_write_end(struct file *file,
 	loff_t new_i_size;
 
 	trace_ext4_journalled_write_end(inode, pos, len, copied);
+	if (ext4_has_inline_data(inode))
+		return ext4_write_inline_data_end(inode, pos, len, copied,
+						  page);
 	from = pos & (PAGE_CACHE_SIZE - 1);
 	to = from + len;
 
@@ -3132,6 +3151,16 @@ static int ext4_da_write_begin(struct file *file, struct address_space *mapping,
 	}
 	*fsdata = (void *)0;
 	trace_ext4_da_write_begin(inode, pos, len, flags);
+
+	if (ext4_has_inline_data(inode) ||
+	    ext4_test_inode_state(inode, EXT4_STATE_MAY_INLINE_DATA)) {
+		ret = ext4_try_to_write_inline_data(mapping, inode, pos, len,
+						    flags, pagep);
+		if (ret < 0)
+			return ret;
+		if (ret == 1)
+			return 0;
+	}
 retry:
 	/*
 	 * With delayed allocation, we don't log the i_disksize update
@@ -3224,6 +3253,9 @@ static int ext4_da_write_end(struct file *file,
 	}
 
 	trace_ext4_da_write_end(inode, pos, len, copied);
+	if (ext4_has_inline_data(inode))
+		return ext4_write_inline_data_end(inode, pos, len, copied,
+						  page);
 	start = pos & (PAGE_CACHE_SIZE - 1);
 	end = start + copied - 1;
 
@@ -3268,6 +3300,48 @@ static int ext4_da_write_end(struct file *file,
 	return ret ? ret : copied;
 }
 
+/*
+ * Give the first @len bytes of locked, uptodate page 0 of @inode, whose
+ * inline data has just been dropped, blocks to be written back to, the
+ * way write_begin and write_end would for the current data mode.  @len
+ * is less than an inode, so normally a single block is mapped and a
+ * failure leaves nothing allocated.
+ */
+int ext4_convert_page_to_blocks(handle_t *handle, struct inode *inode,
+				struct page *page, unsigned len)
+{
+	int ret, partial = 0;
+
+	if (test_opt(inode->i_sb, DELALLOC) &&
+	    !ext4_should_journal_data(inode)) {
+		ret = __block_write_begin(page, 0, len,
+					  ext4_da_get_block_prep);
+		if (!ret)
+			ret = block_commit_write(page, 0, len);
+		return ret;
+	}
+
+	ret = __block_write_begin(page, 0, len, ext4_get_block);
+	if (ret)
+		return ret;
+	if (ext4_should_journal_data(inode)) {
+		ret = walk_page_buffers(handle, page_buffers(page), 0, len,
+					NULL, do_journal_get_write_access);
+		if (!ret)
+			ret = walk_page_buffers(handle, page_buffers(page),
+						0, len, &partial,
+						write_end_fn);
+		ext4_set_inode_state(inode, EXT4_STATE_JDATA);
+		return ret;
+	}
+	if (ext4_should_order_data(inode)) {
+		ret = ext4_jbd2_file_inode(handle, inode);
+		if (ret)
+			return ret;
+	}
+	return block_commit_write(page, 0, len);
+}
+
 static void ext4_da_invalidatepage(struct page *page, unsigned long offset)
 {
 	/*
@@ -3350,6 +3424,10 @@ static sector_t ext4_bmap(struct address_space *mapping, sector_t block)
 	journal_t *journal;
 	int err;
 
+	/* Inline data has no block of its own */
+	if (ext4_has_inline_data(inode))
+		return 0;
+
 	if (mapping_tagged(mapping, PAGECACHE_TAG_DIRTY) &&
 			test_opt(inode->i_sb, DELALLOC)) {
 		/*
@@ -3395,7 +3473,15 @@ static sector_t ext4_bmap(struct address_space *mapping, sector_t block)
 
 static int ext4_readpage(struct file *file, struct page *page)
 {
+	struct inode *inode = page->mapping->host;
+	int ret;
+
 	trace_ext4_readpage(page);
+	if (ext4_has_inline_data(inode)) {
+		ret = ext4_readpage_inline(inode, page);
+		if (ret != -EAGAIN)
+			return ret;
+	}
 	return mpage_readpage(page, ext4_get_block);
 }
 
@@ -3403,6 +3489,9 @@ static int
 ext4_readpages(struct file *file, struct address_space *mapping,
 		struct list_head *pages, unsigned nr_pages)
 {
+	/* Leave inline data to ->readpage() */
+	if (ext4_has_inline_data(mapping->host))
+		return 0;
 	return mpage_readpages(mapping, pages, nr_pages, ext4_get_block);
 }
 
@@ -3822,6 +3911,12 @@ static ssize_t ext4_direct_IO(int rw, struct kiocb *iocb,
 	struct inode *inode = file->f_mapping->host;
 	ssize_t ret;
 
+	/* Let inline data go through the page cache */
+	if (ext4_has_inline_data(inode))
+		return 0;
+	if (rw == WRITE)
+		ext4_clear_inode_state(inode, EXT4_STATE_MAY_INLINE_DATA);
+
 	trace_ext4_direct_IO_enter(inode, offset, iov_length(iov, nr_segs), rw);
 	if (ext4_test_inode_flag(inode, EXT4_INODE_EXTENTS))
 		ret = ext4_ext_direct_IO(rw, iocb, iov, offset, nr_segs);
@@ -4516,6 +4611,12 @@ void ext4_truncate(struct inode *inode)
 	if (inode->i_size == 0 && !test_opt(inode->i_sb, NO_AUTO_DA_ALLOC))
 		ext4_set_inode_state(inode, EXT4_STATE_DA_ALLOC_CLOSE);
 
+	if (ext4_has_inline_data(inode)) {
+		ext4_inline_data_truncate(inode);
+		trace_ext4_truncate_exit(inode);
+		return;
+	}
+
 	if (ext4_test_inode_flag(inode, EXT4_INODE_EXTENTS)) {
 		ext4_ext_truncate(inode);
 		trace_ext4_truncate_exit(inode);
@@ -4952,6 +5053,9 @@ struct inode *ext4_iget(struct super_block *sb, unsigned long ino)
 	 */
 	for (block = 0; block < EXT4_N_BLOCKS; block++)
 		ei->i_data[block] = raw_inode->i_block[block];
+	/* Inline data is only ever looked at in the raw inode */
+	if (ext4_has_inline_data(inode))
+		memset(ei->i_data, 0, sizeof(ei->i_data));
 	INIT_LIST_HEAD(&ei->i_orphan);
 
 	/*
@@ -4977,6 +5081,7 @@ struct inode *ext4_iget(struct super_block *sb, unsigned long ino)
 		read_unlock(&journal->j_state_lock);
 		ei->i_sync_tid = tid;
 		ei->i_datasync_tid = tid;
+		ei->i_fc_ineligible_tid = tid;
 	}
 
 	if (EXT4_INODE_SIZE(inode->i_sb) > EXT4_GOOD_OLD_INODE_SIZE) {
@@ -5000,6 +5105,14 @@ struct inode *ext4_iget(struct super_block *sb, unsigned long ino)
 	} else
 		ei->i_extra_isize = 0;
 
+	if (ext4_has_inline_data(inode) &&
+	    (!ext4_test_inode_state(inode, EXT4_STATE_XATTR) ||
+	     !(S_ISREG(inode->i_mode) || S_ISDIR(inode->i_mode)))) {
+		EXT4_ERROR_INODE(inode, "bad inline data inode");
+		ret = -EIO;
+		goto bad_inode;
+	}
+
 	EXT4_INODE_GET_XTIME(i_ctime, inode, raw_inode);
 	EXT4_INODE_GET_XTIME(i_mtime, inode, raw_inode);
 	EXT4_INODE_GET_XTIME(i_atime, inode, raw_inode);
@@ -5019,6 +5132,8 @@ struct inode *ext4_iget(struct super_block *sb, unsigned long ino)
 				 ei->i_file_acl);
 		ret = -EIO;
 		goto bad_inode;
+	} else if (ext4_has_inline_data(inode)) {
+		/* Nothing in i_block to validate */
 	} else if (ext4_test_inode_flag(inode, EXT4_INODE_EXTENTS)) {
 		if (S_ISREG(inode->i_mode) || S_ISDIR(inode->i_mode) ||
 		    (S_ISLNK(inode->i_mode) &&
@@ -5212,9 +5327,11 @@ static int ext4_do_update_inode(handle_t *handle,
 				cpu_to_le32(new_encode_dev(inode->i_rdev));
 			raw_inode->i_block[2] = 0;
 		}
-	} else
+	} else if (!ext4_has_inline_data(inode)) {
+		/* i_block of an inline inode is maintained in place */
 		for (block = 0; block < EXT4_N_BLOCKS; block++)
 			raw_inode->i_block[block] = ei->i_data[block];
+	}
 
 	raw_inode->i_disk_version = cpu_to_le32(inode->i_version);
 	if (ei->i_extra_isize) {
@@ -5373,6 +5490,13 @@ int ext4_setattr(struct dentry *dentry, struct iattr *attr)
 	}
 
 	if (attr->ia_valid & ATTR_SIZE) {
+		/* Growing a file past its inline data gives it a block */
+		if (ext4_has_inline_data(inode) &&
+		    attr->ia_size > inode->i_size) {
+			error = ext4_convert_inline_data(inode);
+			if (error)
+				goto err_out;
+		}
 		if (!(ext4_test_inode_flag(inode, EXT4_INODE_EXTENTS))) {
 			struct ext4_sb_info *sbi = EXT4_SB(inode->i_sb);
 
@@ -5708,7 +5832,8 @@ int ext4_mark_inode_dirty(handle_t *handle, struct inode *inode)
 	err = ext4_reserve_inode_write(handle, inode, &iloc);
 	if (ext4_handle_valid(handle) &&
 	    EXT4_I(inode)->i_extra_isize < sbi->s_want_extra_isize &&
-	    !ext4_test_inode_state(inode, EXT4_STATE_NO_EXPAND)) {
+	    !ext4_test_inode_state(inode, EXT4_STATE_NO_EXPAND) &&
+	    !ext4_has_inline_data(inode)) {
 		/*
 		 * We need extra buffer credits since we may write into EA block
 		 * with this same handle. If journal_extend fails, then it will
@@ -5876,6 +6001,13 @@ int ext4_page_mkwrite(struct vm_area_struct *vma, struct vm_fault *vmf)
 	 * get i_mutex because we are already holding mmap_sem.
 	 */
 	down_read(&inode->i_alloc_sem);
+	/* A page mapped writable can't be kept in sync with inline data */
+	if (ext4_has_inline_data(inode)) {
+		ret = ext4_convert_inline_data(inode);
+		if (ret)
+			goto out_unlock;
+		ret = -EINVAL;
+	}
 	size = i_size_read(inode);
 	if (page->mapping != mapping || size <= page_offset(page)
 	    || !PageUptodate(page)) {
@@ -679,23 +679,39 @@ static void ext4_mb_mark_free_simple(struct super_block *sb,
 
 /*
  * Cache the order of the largest free extent we have available in this block
- * group.
+ * group, and keep the group on the matching s_mb_largest_free_orders list.
+ * Called with the group locked.
  */
 static void
 mb_set_largest_free_order(struct super_block *sb, struct ext4_group_info *grp)
 {
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	int old = grp->bb_largest_free_order;
+	int new = -1; /* uninit */
 	int i;
-	int bits;
-
-	grp->bb_largest_free_order = -1; /* uninit */
 
-	bits = sb->s_blocksize_bits + 1;
-	for (i = bits; i >= 0; i--) {
+	for (i = MB_NUM_ORDERS(sb) - 1; i >= 0; i--) {
 		if (grp->bb_counters[i] > 0) {
-			grp->bb_largest_free_order = i;
+			new = i;
 			break;
 		}
 	}
+
+	if (old == new && !list_empty(&grp->bb_largest_free_order_node))
+		return;
+
+	if (old >= 0 && !list_empty(&grp->bb_largest_free_order_node)) {
+		write_lock(&sbi->s_mb_largest_free_orders_locks[old]);
+		list_del_init(&grp->bb_largest_free_order_node);
+		write_unlock(&sbi->s_mb_largest_free_orders_locks[old]);
+	}
+	grp->bb_largest_free_order = new;
+	if (new >= 0) {
+		write_lock(&sbi->s_mb_largest_free_orders_locks[new]);
+		list_add_tail(&grp->bb_largest_free_order_node,
+			      &sbi->s_mb_largest_free_orders[new]);
+		write_unlock(&sbi->s_mb_largest_free_orders_locks[new]);
+	}
 }
 
 static noinline_for_stack
@@ -1558,6 +1574,18 @@ static void ext4_mb_use_best_found(struct ext4_allocation_context *ac,
 		sbi->s_mb_last_start = ac->ac_f_ex.fe_start;
 		spin_unlock(&sbi->s_md_lock);
 	}
+	/* and where this cpu's next group preallocation should go */
+	if (ac->ac_flags & EXT4_MB_HINT_GROUP_ALLOC) {
+		struct ext4_locality_group *lg = ac->ac_lg;
+
+		lg->lg_goal_group = ac->ac_f_ex.fe_group;
+		lg->lg_goal_start = ac->ac_f_ex.fe_start + ac->ac_f_ex.fe_len;
+		if (lg->lg_goal_start >= EXT4_BLOCKS_PER_GROUP(ac->ac_sb)) {
+			lg->lg_goal_group++;
+			lg->lg_goal_start = 0;
+		}
+		lg->lg_goal_valid = 1;
+	}
 }
 
 /*
@@ -1954,12 +1982,101 @@ static int ext4_mb_good_group(struct ext4_allocation_context *ac,
 	return 0;
 }
 
+/*
+ * Scan a group which ext4_mb_good_group() accepted without the group
+ * lock, checking it again once locked.
+ */
+static int ext4_mb_scan_group(struct ext4_allocation_context *ac,
+			      ext4_group_t group, int cr)
+{
+	struct super_block *sb = ac->ac_sb;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_buddy e4b;
+	int err;
+
+	err = ext4_mb_load_buddy(sb, group, &e4b);
+	if (err)
+		return err;
+
+	ext4_lock_group(sb, group);
+
+	/*
+	 * We need to check again after locking the
+	 * block group
+	 */
+	if (!ext4_mb_good_group(ac, group, cr)) {
+		ext4_unlock_group(sb, group);
+		ext4_mb_unload_buddy(&e4b);
+		return 0;
+	}
+
+	ac->ac_groups_scanned++;
+	if (sbi->s_mb_stats)
+		atomic_inc(&sbi->s_bal_cr_groups[cr]);
+	if (cr == 0)
+		ext4_mb_simple_scan_group(ac, &e4b);
+	else if (cr == 1 && sbi->s_stripe &&
+			!(ac->ac_g_ex.fe_len % sbi->s_stripe))
+		ext4_mb_scan_aligned(ac, &e4b);
+	else
+		ext4_mb_complex_scan_group(ac, &e4b);
+
+	ext4_unlock_group(sb, group);
+	ext4_mb_unload_buddy(&e4b);
+
+	return 0;
+}
+
+/*
+ * Look up a group with a free extent of at least 2^order blocks in
+ * the s_mb_largest_free_orders index instead of walking all groups.
+ * No group lock is taken, and groups whose lock is held are passed
+ * over since another allocator is likely working there.  The choice
+ * is verified by ext4_mb_scan_group().
+ */
+static int ext4_mb_find_group_by_order(struct ext4_allocation_context *ac,
+				       int order, int cr, ext4_group_t ngroups,
+				       ext4_group_t *group)
+{
+	struct super_block *sb = ac->ac_sb;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_group_info *grp;
+	int i;
+
+	for (i = order; i < MB_NUM_ORDERS(sb); i++) {
+		if (list_empty(&sbi->s_mb_largest_free_orders[i]))
+			continue;
+
+		read_lock(&sbi->s_mb_largest_free_orders_locks[i]);
+		list_for_each_entry(grp, &sbi->s_mb_largest_free_orders[i],
+				    bb_largest_free_order_node) {
+			if (grp->bb_group >= ngroups)
+				continue;
+			if (spin_is_locked(ext4_group_lock_ptr(sb,
+							grp->bb_group))) {
+				if (sbi->s_mb_stats)
+					atomic_inc(&sbi->s_bal_busy_skips);
+				continue;
+			}
+			if (ext4_mb_good_group(ac, grp->bb_group, cr)) {
+				*group = grp->bb_group;
+				read_unlock(&sbi->s_mb_largest_free_orders_locks[i]);
+				return 1;
+			}
+		}
+		read_unlock(&sbi->s_mb_largest_free_orders_locks[i]);
+	}
+
+	return 0;
+}
+
 static noinline_for_stack int
 ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 {
 	ext4_group_t ngroups, group, i;
 	int cr;
 	int err = 0;
+	int cpu_goal = 0;
 	struct ext4_sb_info *sbi;
 	struct super_block *sb;
 	struct ext4_buddy e4b;
@@ -1973,10 +2090,26 @@ ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 
 	BUG_ON(ac->ac_status == AC_STATUS_FOUND);
 
+	/*
+	 * Group preallocations of a cpu follow each other, so concurrent
+	 * small file writers on different cpus don't all start at the
+	 * same goal (lg_mutex is held)
+	 */
+	if ((ac->ac_flags & EXT4_MB_HINT_GROUP_ALLOC) &&
+	    ac->ac_lg->lg_goal_valid && ac->ac_lg->lg_goal_group < ngroups) {
+		ac->ac_g_ex.fe_group = ac->ac_lg->lg_goal_group;
+		ac->ac_g_ex.fe_start = ac->ac_lg->lg_goal_start;
+		cpu_goal = 1;
+	}
+
 	/* first, try the goal */
 	err = ext4_mb_find_by_goal(ac, &e4b);
-	if (err || ac->ac_status == AC_STATUS_FOUND)
+	if (err || ac->ac_status == AC_STATUS_FOUND) {
+		if (cpu_goal && ac->ac_status == AC_STATUS_FOUND &&
+		    sbi->s_mb_stats)
+			atomic_inc(&sbi->s_bal_cpu_goals);
 		goto out;
+	}
 
 	if (unlikely(ac->ac_flags & EXT4_MB_HINT_GOAL_ONLY))
 		goto out;
@@ -2019,6 +2152,31 @@ ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 repeat:
 	for (; cr < 4 && ac->ac_status == AC_STATUS_CONTINUE; cr++) {
 		ac->ac_criteria = cr;
+
+		/*
+		 * For the first two criteria the largest free extent
+		 * tells which groups may do, try the index first
+		 */
+		if (cr <= 1) {
+			int order = cr ? fls(ac->ac_g_ex.fe_len) - 1 :
+					 ac->ac_2order;
+
+			if (ext4_mb_find_group_by_order(ac, order, cr,
+							ngroups, &group)) {
+				err = ext4_mb_scan_group(ac, group, cr);
+				if (err)
+					goto out;
+			}
+			if (sbi->s_mb_stats) {
+				if (ac->ac_status != AC_STATUS_CONTINUE)
+					atomic_inc(&sbi->s_bal_idx_hits);
+				else
+					atomic_inc(&sbi->s_bal_idx_misses);
+			}
+			if (ac->ac_status != AC_STATUS_CONTINUE)
+				break;
+		}
+
 		/*
 		 * searching for the right group start
 		 * from the goal value specified
@@ -2033,34 +2191,10 @@ repeat:
 			if (!ext4_mb_good_group(ac, group, cr))
 				continue;
 
-			err = ext4_mb_load_buddy(sb, group, &e4b);
+			err = ext4_mb_scan_group(ac, group, cr);
 			if (err)
 				goto out;
 
-			ext4_lock_group(sb, group);
-
-			/*
-			 * We need to check again after locking the
-			 * block group
-			 */
-			if (!ext4_mb_good_group(ac, group, cr)) {
-				ext4_unlock_group(sb, group);
-				ext4_mb_unload_buddy(&e4b);
-				continue;
-			}
-
-			ac->ac_groups_scanned++;
-			if (cr == 0)
-				ext4_mb_simple_scan_group(ac, &e4b);
-			else if (cr == 1 && sbi->s_stripe &&
-					!(ac->ac_g_ex.fe_len % sbi->s_stripe))
-				ext4_mb_scan_aligned(ac, &e4b);
-			else
-				ext4_mb_complex_scan_group(ac, &e4b);
-
-			ext4_unlock_group(sb, group);
-			ext4_mb_unload_buddy(&e4b);
-
 			if (ac->ac_status != AC_STATUS_CONTINUE)
 				break;
 		}
@@ -2091,6 +2225,12 @@ repeat:
 			goto repeat;
 		}
 	}
+
+	if (sbi->s_mb_stats) {
+		atomic_add(ac->ac_groups_scanned, &sbi->s_bal_groups_scanned);
+		if (ac->ac_status == AC_STATUS_FOUND)
+			atomic_inc(&sbi->s_bal_cr_hits[ac->ac_criteria]);
+	}
 out:
 	return err;
 }
@@ -2194,6 +2334,62 @@ static const struct file_operations ext4_mb_seq_groups_fops = {
 	.release	= seq_release,
 };
 
+static int ext4_mb_seq_stats_show(struct seq_file *seq, void *v)
+{
+	struct super_block *sb = seq->private;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	int cr;
+
+	seq_printf(seq, "mballoc:\n");
+	seq_printf(seq, "\tcollecting: %u\n", sbi->s_mb_stats);
+	seq_printf(seq, "\treqs: %u\n", atomic_read(&sbi->s_bal_reqs));
+	seq_printf(seq, "\tsuccess: %u\n", atomic_read(&sbi->s_bal_success));
+	seq_printf(seq, "\tblocks: %u\n", atomic_read(&sbi->s_bal_allocated));
+	seq_printf(seq, "\textents_scanned: %u\n",
+		   atomic_read(&sbi->s_bal_ex_scanned));
+	seq_printf(seq, "\tgroups_scanned: %u\n",
+		   atomic_read(&sbi->s_bal_groups_scanned));
+	seq_printf(seq, "\tgoal_hits: %u\n", atomic_read(&sbi->s_bal_goals));
+	seq_printf(seq, "\tcpu_goal_hits: %u\n",
+		   atomic_read(&sbi->s_bal_cpu_goals));
+	seq_printf(seq, "\t2^n_hits: %u\n", atomic_read(&sbi->s_bal_2orders));
+	seq_printf(seq, "\tbreaks: %u\n", atomic_read(&sbi->s_bal_breaks));
+	seq_printf(seq, "\tlost: %u\n", atomic_read(&sbi->s_mb_lost_chunks));
+	seq_printf(seq, "\tindex_hits: %u\n",
+		   atomic_read(&sbi->s_bal_idx_hits));
+	seq_printf(seq, "\tindex_misses: %u\n",
+		   atomic_read(&sbi->s_bal_idx_misses));
+	seq_printf(seq, "\tbusy_groups_skipped: %u\n",
+		   atomic_read(&sbi->s_bal_busy_skips));
+	for (cr = 0; cr < 4; cr++)
+		seq_printf(seq, "\tcr%d: %u groups scanned, %u hits\n", cr,
+			   atomic_read(&sbi->s_bal_cr_groups[cr]),
+			   atomic_read(&sbi->s_bal_cr_hits[cr]));
+	seq_printf(seq, "\tbuddies_generated: %lu\n",
+		   sbi->s_mb_buddies_generated);
+	seq_printf(seq, "\tbuddies_time_used: %llu\n",
+		   sbi->s_mb_generation_time);
+	seq_printf(seq, "\tpreallocated: %u\n",
+		   atomic_read(&sbi->s_mb_preallocated));
+	seq_printf(seq, "\tdiscarded: %u\n",
+		   atomic_read(&sbi->s_mb_discarded));
+
+	return 0;
+}
+
+static int ext4_mb_seq_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ext4_mb_seq_stats_show, PDE(inode)->data);
+}
+
+static const struct file_operations ext4_mb_seq_stats_fops = {
+	.owner		= THIS_MODULE,
+	.open		= ext4_mb_seq_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 static struct kmem_cache *get_groupinfo_cache(int blocksize_bits)
 {
 	int cache_index = blocksize_bits - EXT4_MIN_BLOCK_LOG_SIZE;
@@ -2260,6 +2456,8 @@ int ext4_mb_add_groupinfo(struct super_block *sb, ext4_group_t group,
 	init_rwsem(&meta_group_info[i]->alloc_sem);
 	meta_group_info[i]->bb_free_root = RB_ROOT;
 	meta_group_info[i]->bb_largest_free_order = -1;  /* uninit */
+	meta_group_info[i]->bb_group = group;
+	INIT_LIST_HEAD(&meta_group_info[i]->bb_largest_free_order_node);
 
 #ifdef DOUBLE_CHECK
 	{
@@ -2438,6 +2636,25 @@ int ext4_mb_init(struct super_block *sb, int needs_recovery)
 		goto out;
 	}
 
+	i = MB_NUM_ORDERS(sb) * sizeof(*sbi->s_mb_largest_free_orders);
+	sbi->s_mb_largest_free_orders = kmalloc(i, GFP_KERNEL);
+	if (sbi->s_mb_largest_free_orders == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	i = MB_NUM_ORDERS(sb) * sizeof(*sbi->s_mb_largest_free_orders_locks);
+	sbi->s_mb_largest_free_orders_locks = kmalloc(i, GFP_KERNEL);
+	if (sbi->s_mb_largest_free_orders_locks == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < MB_NUM_ORDERS(sb); i++) {
+		INIT_LIST_HEAD(&sbi->s_mb_largest_free_orders[i]);
+		rwlock_init(&sbi->s_mb_largest_free_orders_locks[i]);
+	}
+
 	ret = ext4_groupinfo_create_slab(sb->s_blocksize);
 	if (ret < 0)
 		goto out;
@@ -2485,11 +2702,15 @@ int ext4_mb_init(struct super_block *sb, int needs_recovery)
 		for (j = 0; j < PREALLOC_TB_SIZE; j++)
 			INIT_LIST_HEAD(&lg->lg_prealloc_list[j]);
 		spin_lock_init(&lg->lg_prealloc_lock);
+		lg->lg_goal_valid = 0;
 	}
 
-	if (sbi->s_proc)
+	if (sbi->s_proc) {
 		proc_create_data("mb_groups", S_IRUGO, sbi->s_proc,
 				 &ext4_mb_seq_groups_fops, sb);
+		proc_create_data("mb_stats", S_IRUGO, sbi->s_proc,
+				 &ext4_mb_seq_stats_fops, sb);
+	}
 
 	if (sbi->s_journal)
 		sbi->s_journal->j_commit_callback = release_blocks_on_commit;
@@ -2497,6 +2718,8 @@ out:
 	if (ret) {
 		kfree(sbi->s_mb_offsets);
 		kfree(sbi->s_mb_maxs);
+		kfree(sbi->s_mb_largest_free_orders);
+		kfree(sbi->s_mb_largest_free_orders_locks);
 	}
 	return ret;
 }
@@ -2548,6 +2771,8 @@ int ext4_mb_release(struct super_block *sb)
 	}
 	kfree(sbi->s_mb_offsets);
 	kfree(sbi->s_mb_maxs);
+	kfree(sbi->s_mb_largest_free_orders);
+	kfree(sbi->s_mb_largest_free_orders_locks);
 	if (sbi->s_buddy_cache)
 		iput(sbi->s_buddy_cache);
 	if (sbi->s_mb_stats) {
@@ -2575,8 +2800,10 @@ int ext4_mb_release(struct super_block *sb)
 	}
 
 	free_percpu(sbi->s_locality_groups);
-	if (sbi->s_proc)
+	if (sbi->s_proc) {
 		remove_proc_entry("mb_groups", sbi->s_proc);
+		remove_proc_entry("mb_stats", sbi->s_proc);
+	}
 
 	return 0;
 }
@@ -4484,6 +4711,8 @@ void ext4_free_blocks(handle_t *handle, struct inode *inode,
 
 	ext4_debug("freeing block %llu\n", block);
 	trace_ext4_free_blocks(inode, block, count, flags);
+	/* Fast commit replay only ever marks blocks in use */
+	ext4_fc_mark_ineligible(handle, inode);
 
 	if (flags & EXT4_FREE_BLOCKS_FORGET) {
 		struct buffer_head *tbh = bh;
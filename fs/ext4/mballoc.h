@@ -94,6 +94,11 @@ extern u8 mb_enable_debug;
  */
 #define MB_DEFAULT_GROUP_PREALLOC	512
 
+/*
+ * number of buddy orders, order 0 being the bitmap itself
+ */
+#define MB_NUM_ORDERS(sb)		((sb)->s_blocksize_bits + 2)
+
 
 struct ext4_free_data {
 	/* this links the free block information from group_info */
@@ -160,6 +165,10 @@ struct ext4_locality_group {
 	/* list of preallocations */
 	struct list_head	lg_prealloc_list[PREALLOC_TB_SIZE];
 	spinlock_t		lg_prealloc_lock;
+	/* where this cpu's last group preallocation ended */
+	ext4_group_t		lg_goal_group;
+	ext4_grpblk_t		lg_goal_start;
+	int			lg_goal_valid;
 };
 
 struct ext4_allocation_context {
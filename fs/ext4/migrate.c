@@ -16,6 +16,7 @@
 #include <linux/slab.h>
 #include "ext4_jbd2.h"
 #include "ext4_extents.h"
+#include "xattr.h"
 
 /*
  * The contiguous blocks details which can be
@@ -471,11 +472,12 @@ int ext4_ext_migrate(struct inode *inode)
 
 	/*
 	 * If the filesystem does not support extents, or the inode
-	 * already is extent-based, error out.
+	 * already is extent-based or has no blocks to map, error out.
 	 */
 	if (!EXT4_HAS_INCOMPAT_FEATURE(inode->i_sb,
 				       EXT4_FEATURE_INCOMPAT_EXTENTS) ||
-	    (ext4_test_inode_flag(inode, EXT4_INODE_EXTENTS)))
+	    (ext4_test_inode_flag(inode, EXT4_INODE_EXTENTS)) ||
+	    ext4_has_inline_data(inode))
 		return -EINVAL;
 
 	if (S_ISLNK(inode->i_mode) && inode->i_blocks == 0)
@@ -818,6 +818,9 @@ move_extent_per_page(struct file *o_filp, struct inode *donor_inode,
 		*err = PTR_ERR(handle);
 		return 0;
 	}
+	/* Extents change hands between the two inodes */
+	ext4_fc_mark_ineligible(handle, orig_inode);
+	ext4_fc_mark_ineligible(handle, donor_inode);
 
 	if (segment_eq(get_fs(), KERNEL_DS))
 		w_flags |= AOP_FLAG_UNINTERRUPTIBLE;
@@ -765,6 +765,7 @@ static void ext4_put_super(struct super_block *sb)
 		ext4_commit_super(sb, 1);
 
 	if (sbi->s_journal) {
+		ext4_fc_release(sb);
 		err = jbd2_journal_destroy(sbi->s_journal);
 		sbi->s_journal = NULL;
 		if (err < 0)
@@ -869,6 +870,7 @@ static struct inode *ext4_alloc_inode(struct super_block *sb)
 	ei->cur_aio_dio = NULL;
 	ei->i_sync_tid = 0;
 	ei->i_datasync_tid = 0;
+	ei->i_fc_ineligible_tid = 0;
 	atomic_set(&ei->i_ioend_count, 0);
 	atomic_set(&ei->i_aiodio_unwritten, 0);
 
@@ -1068,6 +1070,10 @@ static int ext4_show_options(struct seq_file *seq, struct vfsmount *vfs)
 		seq_puts(seq, ",journal_async_commit");
 	else if (test_opt(sb, JOURNAL_CHECKSUM))
 		seq_puts(seq, ",journal_checksum");
+	if (test_opt2(sb, FAST_COMMIT))
+		seq_puts(seq, ",fast_commit");
+	if (test_opt2(sb, INLINE_DATA))
+		seq_puts(seq, ",inline_data");
 	if (test_opt(sb, I_VERSION))
 		seq_puts(seq, ",i_version");
 	if (!test_opt(sb, DELALLOC) &&
@@ -1280,7 +1286,8 @@ enum {
 	Opt_auto_da_alloc, Opt_noauto_da_alloc, Opt_noload, Opt_nobh, Opt_bh,
 	Opt_commit, Opt_min_batch_time, Opt_max_batch_time,
 	Opt_journal_update, Opt_journal_dev,
-	Opt_journal_checksum, Opt_journal_async_commit,
+	Opt_journal_checksum, Opt_journal_async_commit, Opt_fast_commit,
+	Opt_inline_data,
 	Opt_abort, Opt_data_journal, Opt_data_ordered, Opt_data_writeback,
 	Opt_data_err_abort, Opt_data_err_ignore,
 	Opt_usrjquota, Opt_grpjquota, Opt_offusrjquota, Opt_offgrpjquota,
@@ -1327,6 +1334,8 @@ static const match_table_t tokens = {
 	{Opt_journal_dev, "journal_dev=%u"},
 	{Opt_journal_checksum, "journal_checksum"},
 	{Opt_journal_async_commit, "journal_async_commit"},
+	{Opt_fast_commit, "fast_commit"},
+	{Opt_inline_data, "inline_data"},
 	{Opt_abort, "abort"},
 	{Opt_data_journal, "data=journal"},
 	{Opt_data_ordered, "data=ordered"},
@@ -1601,6 +1610,12 @@ static int parse_options(char *options, struct super_block *sb,
 			set_opt(sb, JOURNAL_ASYNC_COMMIT);
 			set_opt(sb, JOURNAL_CHECKSUM);
 			break;
+		case Opt_fast_commit:
+			set_opt2(sb, FAST_COMMIT);
+			break;
+		case Opt_inline_data:
+			set_opt2(sb, INLINE_DATA);
+			break;
 		case Opt_noload:
 			set_opt(sb, NOLOAD);
 			break;
@@ -2628,6 +2643,15 @@ static int ext4_feature_set_ok(struct super_block *sb, int readonly)
 		return 0;
 	}
 
+#ifndef CONFIG_EXT4_FS_XATTR
+	if (EXT4_HAS_INCOMPAT_FEATURE(sb, EXT4_FEATURE_INCOMPAT_INLINE_DATA)) {
+		ext4_msg(sb, KERN_ERR,
+			"Couldn't mount because of inline data "
+			"without CONFIG_EXT4_FS_XATTR");
+		return 0;
+	}
+#endif
+
 	if (readonly)
 		return 1;
 
@@ -3420,6 +3444,7 @@ static int ext4_fill_super(struct super_block *sb, void *data, int silent)
 #endif
 
 	bgl_lock_init(sbi->s_blockgroup_lock);
+	ext4_fc_init(sb);
 
 	for (i = 0; i < db_count; i++) {
 		block = descriptor_loc(sb, logical_sb_block, i);
@@ -3545,6 +3570,9 @@ static int ext4_fill_super(struct super_block *sb, void *data, int silent)
 				JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT);
 	}
 
+	if (ext4_fc_setup(sb))
+		goto failed_mount_wq;
+
 	/* We have now updated the journal if required, so we can
 	 * validate the data journaling mode. */
 	switch (test_opt(sb, DATA_FLAGS)) {
@@ -3647,6 +3675,12 @@ no_journal:
 			 "available");
 	}
 
+	if (test_opt2(sb, INLINE_DATA) && !sbi->s_want_extra_isize) {
+		ext4_msg(sb, KERN_WARNING, "Ignoring inline_data option - "
+			 "inodes have no room for it");
+		clear_opt2(sb, INLINE_DATA);
+	}
+
 	if (test_opt(sb, DELALLOC) &&
 	    (test_opt(sb, DATA_FLAGS) == EXT4_MOUNT_JOURNAL_DATA)) {
 		ext4_msg(sb, KERN_WARNING, "Ignoring delalloc option - "
@@ -3735,6 +3769,7 @@ failed_mount4:
 failed_mount_wq:
 	ext4_release_system_zone(sb);
 	if (sbi->s_journal) {
+		ext4_fc_release(sb);
 		jbd2_journal_destroy(sbi->s_journal);
 		sbi->s_journal = NULL;
 	}
@@ -4323,6 +4358,11 @@ static int ext4_remount(struct super_block *sb, int *flags, char *data)
 	if (sbi->s_mount_flags & EXT4_MF_FS_ABORTED)
 		ext4_abort(sb, "Abort forced by user");
 
+	/* The fast commit area can only be set up at mount time */
+	if (sbi->s_journal &&
+	    sbi->s_journal->j_fc_last == sbi->s_journal->j_last)
+		clear_opt2(sb, FAST_COMMIT);
+
 	sb->s_flags = (sb->s_flags & ~MS_POSIXACL) |
 		(test_opt(sb, POSIX_ACL) ? MS_POSIXACL : 0);
 
@@ -22,6 +22,7 @@
 #include <linux/mm.h>
 #include <linux/kthread.h>
 #include <linux/freezer.h>
+#include <linux/workqueue.h>
 #include <linux/writeback.h>
 #include <linux/blkdev.h>
 #include <linux/backing-dev.h>
@@ -510,7 +511,7 @@ static int writeback_sb_inodes(struct super_block *sb, struct bdi_writeback *wb,
 		struct writeback_control *wbc, bool only_this_sb)
 {
 	while (!list_empty(&wb->b_io)) {
-		long pages_skipped;
+		long pages_skipped, nr_to_write;
 		struct inode *inode = wb_inode(wb->b_io.prev);
 
 		if (inode->i_sb != sb) {
@@ -555,8 +556,14 @@ static int writeback_sb_inodes(struct super_block *sb, struct bdi_writeback *wb,
 
 		__iget(inode);
 
+		/* Somebody else writing it back just requeues it */
+		if (!(inode->i_state & I_SYNC))
+			atomic_long_inc(&wb->inodes_written);
+		nr_to_write = wbc->nr_to_write;
 		pages_skipped = wbc->pages_skipped;
 		writeback_single_inode(inode, wbc);
+		atomic_long_add(nr_to_write - wbc->nr_to_write,
+				&wb->pages_written);
 		if (wbc->pages_skipped != pages_skipped) {
 			/*
 			 * writeback is not making progress due to locked
@@ -580,13 +587,22 @@ static int writeback_sb_inodes(struct super_block *sb, struct bdi_writeback *wb,
 	return 1;
 }
 
+/*
+ * Both writeback_inodes_wb() and __writeback_inodes_sb() write back a
+ * batch of up to nr_to_write pages from as many inodes as it takes,
+ * under a single plug: with lots of small files, the I/O for one inode
+ * is often just a request or two, which can then be merged and sorted
+ * with that for the next inodes before it reaches the queue.
+ */
 void writeback_inodes_wb(struct bdi_writeback *wb,
 		struct writeback_control *wbc)
 {
+	struct blk_plug plug;
 	int ret = 0;
 
 	if (!wbc->wb_start)
 		wbc->wb_start = jiffies; /* livelock avoidance */
+	blk_start_plug(&plug);
 	spin_lock(&inode_wb_list_lock);
 	if (!wbc->for_kupdate || list_empty(&wb->b_io))
 		queue_io(wb, wbc->older_than_this);
@@ -606,19 +622,24 @@ void writeback_inodes_wb(struct bdi_writeback *wb,
 			break;
 	}
 	spin_unlock(&inode_wb_list_lock);
+	blk_finish_plug(&plug);
 	/* Leave any unwritten inodes on b_io */
 }
 
 static void __writeback_inodes_sb(struct super_block *sb,
 		struct bdi_writeback *wb, struct writeback_control *wbc)
 {
+	struct blk_plug plug;
+
 	WARN_ON(!rwsem_is_locked(&sb->s_umount));
 
+	blk_start_plug(&plug);
 	spin_lock(&inode_wb_list_lock);
 	if (!wbc->for_kupdate || list_empty(&wb->b_io))
 		queue_io(wb, wbc->older_than_this);
 	writeback_sb_inodes(sb, wb, wbc, true);
 	spin_unlock(&inode_wb_list_lock);
+	blk_finish_plug(&plug);
 }
 
 /*
@@ -640,6 +661,129 @@ static inline bool over_bground_thresh(void)
 		global_page_state(NR_UNSTABLE_NFS) > background_thresh);
 }
 
+/*
+ * Extra flusher workers.  With bdi->flush_workers > 1, background and
+ * kupdate-style writeback of a bdi that has more than one batch to
+ * write gets help from flush_workers - 1 work items, each taking
+ * inodes off the same b_io list in batches of its own.  I_SYNC keeps
+ * any one inode to a single writer.  The flusher thread still decides
+ * when to stop, and waits for its helpers before it moves on.
+ */
+struct wb_helpers;
+
+struct wb_helper {
+	struct work_struct work;
+	struct wb_helpers *helpers;
+};
+
+struct wb_helpers {
+	struct bdi_writeback *wb;
+	struct wb_writeback_work *work;
+	unsigned long *older_than_this;
+	unsigned long wb_start;
+	atomic_long_t wrote;		/* pages not yet accounted to work */
+	int stop;
+	int nr;
+	struct wb_helper helper[0];
+};
+
+static void wb_helper_fn(struct work_struct *w)
+{
+	struct wb_helper *helper = container_of(w, struct wb_helper, work);
+	struct wb_helpers *h = helper->helpers;
+	struct writeback_control wbc = {
+		.sync_mode		= WB_SYNC_NONE,
+		.older_than_this	= h->older_than_this,
+		.wb_start		= h->wb_start,
+		.for_kupdate		= h->work->for_kupdate,
+		.for_background		= h->work->for_background,
+		.range_cyclic		= 1,
+	};
+	long wrote;
+
+	while (!ACCESS_ONCE(h->stop)) {
+		if (wbc.for_background && !over_bground_thresh())
+			break;
+
+		wbc.more_io = 0;
+		wbc.nr_to_write = MAX_WRITEBACK_PAGES;
+		wbc.pages_skipped = 0;
+		writeback_inodes_wb(h->wb, &wbc);
+
+		wrote = MAX_WRITEBACK_PAGES - wbc.nr_to_write;
+		atomic_long_add(wrote, &h->wrote);
+		/* Waiting for busy inodes is left to the flusher thread */
+		if (!wrote)
+			break;
+		cond_resched();
+	}
+}
+
+static struct wb_helpers *wb_start_helpers(struct bdi_writeback *wb,
+					   struct wb_writeback_work *work,
+					   unsigned long *older_than_this,
+					   unsigned long wb_start)
+{
+	int nr = wb->bdi->flush_workers - 1;
+	struct wb_helpers *h;
+	int i;
+
+	if (nr <= 0 || work->sb || work->sync_mode != WB_SYNC_NONE ||
+	    work->tagged_writepages || !work->range_cyclic)
+		return NULL;
+
+	h = kzalloc(sizeof(*h) + nr * sizeof(h->helper[0]), GFP_NOFS);
+	if (!h)
+		return NULL;
+	h->wb = wb;
+	h->work = work;
+	h->older_than_this = older_than_this;
+	h->wb_start = wb_start;
+	h->nr = nr;
+	for (i = 0; i < nr; i++) {
+		h->helper[i].helpers = h;
+		INIT_WORK(&h->helper[i].work, wb_helper_fn);
+		queue_work(system_unbound_wq, &h->helper[i].work);
+	}
+	return h;
+}
+
+/* Returns the pages the helpers wrote since they were last asked */
+static long wb_stop_helpers(struct wb_helpers *h)
+{
+	long wrote;
+	int i;
+
+	h->stop = 1;
+	for (i = 0; i < h->nr; i++)
+		flush_work(&h->helper[i].work);
+	wrote = atomic_long_read(&h->wrote);
+	kfree(h);
+	return wrote;
+}
+
+/*
+ * Update the writeback rates shown in debugfs, over at least a second
+ * of writeback.  Idle time in between is not counted: with @start,
+ * a stale sample is just restarted.
+ */
+static void wb_update_rates(struct bdi_writeback *wb, bool start)
+{
+	unsigned long elapsed = jiffies - wb->stat_stamp;
+	unsigned long pages = atomic_long_read(&wb->pages_written);
+	unsigned long inodes = atomic_long_read(&wb->inodes_written);
+
+	if (elapsed < HZ)
+		return;
+	if (!start) {
+		wb->pages_per_sec = (pages - wb->stat_pages) * HZ / elapsed;
+		wb->inodes_per_sec = (inodes - wb->stat_inodes) * HZ / elapsed;
+	}
+	wb->stat_stamp = jiffies;
+	wb->stat_pages = pages;
+	wb->stat_inodes = inodes;
+}
+
 /*
  * Explicit flushing or periodic writeback of "old" data.
  *
@@ -669,6 +813,8 @@ static long wb_writeback(struct bdi_writeback *wb,
 	unsigned long oldest_jif;
 	long wrote = 0;
 	long write_chunk = MAX_WRITEBACK_PAGES;
+	struct wb_helpers *helpers = NULL;
+	long helped;
 	struct inode *inode;
 
 	if (wbc.for_kupdate) {
@@ -698,7 +844,15 @@ static long wb_writeback(struct bdi_writeback *wb,
 		write_chunk = LONG_MAX;
 
 	wbc.wb_start = jiffies; /* livelock avoidance */
+	wb_update_rates(wb, true);
 	for (;;) {
+		if (helpers) {
+			helped = atomic_long_xchg(&helpers->wrote, 0);
+			work->nr_pages -= helped;
+			wrote += helped;
+		}
+		wb_update_rates(wb, false);
+
 		/*
 		 * Stop writeback when nr_pages has been consumed
 		 */
@@ -737,10 +891,16 @@ static long wb_writeback(struct bdi_writeback *wb,
 		wrote += write_chunk - wbc.nr_to_write;
 
 		/*
-		 * If we consumed everything, see if we have more
+		 * If we consumed everything, see if we have more, and
+		 * whether others could help with it
 		 */
-		if (wbc.nr_to_write <= 0)
+		if (wbc.nr_to_write <= 0) {
+			if (!helpers)
+				helpers = wb_start_helpers(wb, work,
+							   wbc.older_than_this,
+							   wbc.wb_start);
 			continue;
+		}
 		/*
 		 * Didn't write everything and we don't have more IO, bail
 		 */
@@ -767,6 +927,13 @@ static long wb_writeback(struct bdi_writeback *wb,
 		spin_unlock(&inode_wb_list_lock);
 	}
 
+	if (helpers) {
+		helped = wb_stop_helpers(helpers);
+		work->nr_pages -= helped;
+		wrote += helped;
+	}
+	wb_update_rates(wb, false);
+
 	return wrote;
 }
 
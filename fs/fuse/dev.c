@@ -20,17 +20,19 @@
 #include <linux/swap.h>
 #include <linux/splice.h>
 #include <linux/freezer.h>
+#include <linux/compat.h>
 
 MODULE_ALIAS_MISCDEV(FUSE_MINOR);
 MODULE_ALIAS("devname:fuse");
 
 static struct kmem_cache *fuse_req_cachep;
 
-static struct fuse_conn *fuse_get_conn(struct file *file)
+static struct fuse_queue *fuse_get_queue(struct file *file)
 {
 	/*
 	 * Lockless access is OK, because file->private data is set
-	 * once during mount and is valid until the file is released.
+	 * once during mount (or cloning) and is valid until the file
+	 * is released.
 	 */
 	return file->private_data;
 }
@@ -228,59 +230,120 @@ static unsigned len_args(unsigned numargs, struct fuse_arg *args)
 	return nbytes;
 }
 
-static u64 fuse_get_unique(struct fuse_conn *fc)
+/*
+ * Unique IDs are striped over the queues, so that they are unique
+ * within the connection without a shared counter
+ */
+static u64 fuse_get_unique(struct fuse_queue *q)
 {
-	fc->reqctr++;
+	q->reqctr += FUSE_MAX_QUEUES;
 	/* zero is special */
-	if (fc->reqctr == 0)
-		fc->reqctr = 1;
+	if (q->reqctr == 0)
+		q->reqctr += FUSE_MAX_QUEUES;
 
-	return fc->reqctr;
+	return q->reqctr;
 }
 
-static void queue_request(struct fuse_conn *fc, struct fuse_req *req)
+/*
+ * Lock the queue of the current cpu, or the next one that is still
+ * alive.  Returns NULL if all channels have been closed.
+ */
+static struct fuse_queue *fuse_lock_queue(struct fuse_conn *fc)
+{
+	unsigned nr = ACCESS_ONCE(fc->nr_queues);
+	unsigned id, i;
+
+	/* Pairs with smp_wmb() in fuse_dev_clone() */
+	smp_rmb();
+	id = raw_smp_processor_id() % nr;
+	for (i = 0; i < nr; i++) {
+		struct fuse_queue *q = fc->queues[(id + i) % nr];
+
+		spin_lock(&q->lock);
+		if (!q->dead)
+			return q;
+		spin_unlock(&q->lock);
+	}
+	return NULL;
+}
+
+/*
+ * Lock the queue a request is on.  Pending requests may be moved to
+ * another queue when their channel is closed, so recheck after
+ * locking.
+ */
+static struct fuse_queue *fuse_lock_req(struct fuse_req *req)
+{
+	struct fuse_queue *q;
+
+	for (;;) {
+		q = ACCESS_ONCE(req->q);
+		spin_lock(&q->lock);
+		if (likely(q == req->q))
+			return q;
+		spin_unlock(&q->lock);
+	}
+}
+
+static void wake_queue(struct fuse_queue *q)
+{
+	wake_up(&q->waitq);
+	kill_fasync(&q->fasync, SIGIO, POLL_IN);
+}
+
+static void queue_request(struct fuse_queue *q, struct fuse_req *req)
 {
 	req->in.h.len = sizeof(struct fuse_in_header) +
 		len_args(req->in.numargs, (struct fuse_arg *) req->in.args);
-	list_add_tail(&req->list, &fc->pending);
+	req->q = q;
+	list_add_tail(&req->list, &q->pending);
 	req->state = FUSE_REQ_PENDING;
 	if (!req->waiting) {
 		req->waiting = 1;
-		atomic_inc(&fc->num_waiting);
+		atomic_inc(&q->fc->num_waiting);
 	}
-	wake_up(&fc->waitq);
-	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+	wake_queue(q);
 }
 
 void fuse_queue_forget(struct fuse_conn *fc, struct fuse_forget_link *forget,
 		       u64 nodeid, u64 nlookup)
 {
+	struct fuse_queue *q;
+
 	forget->forget_one.nodeid = nodeid;
 	forget->forget_one.nlookup = nlookup;
 
-	spin_lock(&fc->lock);
-	if (fc->connected) {
-		fc->forget_list_tail->next = forget;
-		fc->forget_list_tail = forget;
-		wake_up(&fc->waitq);
-		kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+	q = fuse_lock_queue(fc);
+	if (q && fc->connected) {
+		q->forget_list_tail->next = forget;
+		q->forget_list_tail = forget;
+		wake_queue(q);
 	} else {
 		kfree(forget);
 	}
-	spin_unlock(&fc->lock);
+	if (q)
+		spin_unlock(&q->lock);
 }
 
+/*
+ * Called with fc->lock held
+ */
 static void flush_bg_queue(struct fuse_conn *fc)
 {
 	while (fc->active_background < fc->max_background &&
 	       !list_empty(&fc->bg_queue)) {
+		struct fuse_queue *q;
 		struct fuse_req *req;
 
+		q = fuse_lock_queue(fc);
+		if (!q)
+			break;
 		req = list_entry(fc->bg_queue.next, struct fuse_req, list);
 		list_del(&req->list);
 		fc->active_background++;
-		req->in.h.unique = fuse_get_unique(fc);
-		queue_request(fc, req);
+		req->in.h.unique = fuse_get_unique(q);
+		queue_request(q, req);
+		spin_unlock(&q->lock);
 	}
 }
 
@@ -292,17 +355,20 @@ static void flush_bg_queue(struct fuse_conn *fc)
  * the 'end' callback is called if given, else the reference to the
  * request is released
  *
- * Called with fc->lock, unlocks it
+ * Called with q->lock, unlocks it
  */
-static void request_end(struct fuse_conn *fc, struct fuse_req *req)
-__releases(fc->lock)
+static void request_end(struct fuse_queue *q, struct fuse_req *req)
+__releases(q->lock)
 {
+	struct fuse_conn *fc = q->fc;
 	void (*end) (struct fuse_conn *, struct fuse_req *) = req->end;
 	req->end = NULL;
 	list_del(&req->list);
 	list_del(&req->intr_entry);
 	req->state = FUSE_REQ_FINISHED;
+	spin_unlock(&q->lock);
 	if (req->background) {
+		spin_lock(&fc->lock);
 		if (fc->num_background == fc->max_background) {
 			fc->blocked = 0;
 			wake_up_all(&fc->blocked_waitq);
@@ -315,50 +381,53 @@ __releases(fc->lock)
 		fc->num_background--;
 		fc->active_background--;
 		flush_bg_queue(fc);
+		spin_unlock(&fc->lock);
 	}
-	spin_unlock(&fc->lock);
 	wake_up(&req->waitq);
 	if (end)
 		end(fc, req);
 	fuse_put_request(fc, req);
 }
 
-static void wait_answer_interruptible(struct fuse_conn *fc,
-				      struct fuse_req *req)
-__releases(fc->lock)
-__acquires(fc->lock)
+static struct fuse_queue *wait_answer_interruptible(struct fuse_queue *q,
+						    struct fuse_req *req)
+__releases(q->lock)
+__acquires(req->q->lock)
 {
 	if (signal_pending(current))
-		return;
+		return q;
 
-	spin_unlock(&fc->lock);
+	spin_unlock(&q->lock);
 	wait_event_interruptible(req->waitq, req->state == FUSE_REQ_FINISHED);
-	spin_lock(&fc->lock);
+	return fuse_lock_req(req);
 }
 
-static void queue_interrupt(struct fuse_conn *fc, struct fuse_req *req)
+static void queue_interrupt(struct fuse_queue *q, struct fuse_req *req)
 {
-	list_add_tail(&req->intr_entry, &fc->interrupts);
-	wake_up(&fc->waitq);
-	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+	list_add_tail(&req->intr_entry, &q->interrupts);
+	wake_queue(q);
 }
 
+/*
+ * Called with the lock of the request's queue held, releases it
+ */
 static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
-__releases(fc->lock)
-__acquires(fc->lock)
+__releases(req->q->lock)
 {
+	struct fuse_queue *q = req->q;
+
 	if (!fc->no_interrupt) {
 		/* Any signal may interrupt this */
-		wait_answer_interruptible(fc, req);
+		q = wait_answer_interruptible(q, req);
 
 		if (req->aborted)
 			goto aborted;
 		if (req->state == FUSE_REQ_FINISHED)
-			return;
+			goto out;
 
 		req->interrupted = 1;
 		if (req->state == FUSE_REQ_SENT)
-			queue_interrupt(fc, req);
+			queue_interrupt(q, req);
 	}
 
 	if (!req->force) {
@@ -366,20 +435,20 @@ __acquires(fc->lock)
 
 		/* Only fatal signals may interrupt this */
 		block_sigs(&oldset);
-		wait_answer_interruptible(fc, req);
+		q = wait_answer_interruptible(q, req);
 		restore_sigs(&oldset);
 
 		if (req->aborted)
 			goto aborted;
 		if (req->state == FUSE_REQ_FINISHED)
-			return;
+			goto out;
 
 		/* Request is not yet in userspace, bail out */
 		if (req->state == FUSE_REQ_PENDING) {
 			list_del(&req->list);
 			__fuse_put_request(req);
 			req->out.h.error = -EINTR;
-			return;
+			goto out;
 		}
 	}
 
@@ -387,15 +456,15 @@ __acquires(fc->lock)
 	 * Either request is already in userspace, or it was forced.
 	 * Wait it out.
 	 */
-	spin_unlock(&fc->lock);
+	spin_unlock(&q->lock);
 
 	while (req->state != FUSE_REQ_FINISHED)
 		wait_event_freezable(req->waitq,
 				     req->state == FUSE_REQ_FINISHED);
-	spin_lock(&fc->lock);
+	q = fuse_lock_req(req);
 
 	if (!req->aborted)
-		return;
+		goto out;
 
  aborted:
 	BUG_ON(req->state != FUSE_REQ_FINISHED);
@@ -405,30 +474,36 @@ __acquires(fc->lock)
 		   locked state, there mustn't be any filesystem
 		   operation (e.g. page fault), since that could lead
 		   to deadlock */
-		spin_unlock(&fc->lock);
+		spin_unlock(&q->lock);
 		wait_event(req->waitq, !req->locked);
-		spin_lock(&fc->lock);
+		return;
 	}
+ out:
+	spin_unlock(&q->lock);
 }
 
 void fuse_request_send(struct fuse_conn *fc, struct fuse_req *req)
 {
+	struct fuse_queue *q;
+
 	req->isreply = 1;
-	spin_lock(&fc->lock);
-	if (!fc->connected)
+	q = fuse_lock_queue(fc);
+	if (!q || !fc->connected)
 		req->out.h.error = -ENOTCONN;
 	else if (fc->conn_error)
 		req->out.h.error = -ECONNREFUSED;
 	else {
-		req->in.h.unique = fuse_get_unique(fc);
-		queue_request(fc, req);
+		req->in.h.unique = fuse_get_unique(q);
+		queue_request(q, req);
 		/* acquire extra reference, since request is still needed
 		   after request_end() */
 		__fuse_get_request(req);
 
 		request_wait_answer(fc, req);
+		return;
 	}
-	spin_unlock(&fc->lock);
+	if (q)
+		spin_unlock(&q->lock);
 }
 EXPORT_SYMBOL_GPL(fuse_request_send);
 
@@ -455,8 +530,12 @@ static void fuse_request_send_nowait(struct fuse_conn *fc, struct fuse_req *req)
 		fuse_request_send_nowait_locked(fc, req);
 		spin_unlock(&fc->lock);
 	} else {
+		spin_unlock(&fc->lock);
+		/* Not background yet, so this only needs a queue lock */
 		req->out.h.error = -ENOTCONN;
-		request_end(fc, req);
+		req->q = &fc->main_queue;
+		spin_lock(&req->q->lock);
+		request_end(req->q, req);
 	}
 }
 
@@ -470,16 +549,18 @@ EXPORT_SYMBOL_GPL(fuse_request_send_background);
 static int fuse_request_send_notify_reply(struct fuse_conn *fc,
 					  struct fuse_req *req, u64 unique)
 {
+	struct fuse_queue *q;
 	int err = -ENODEV;
 
 	req->isreply = 0;
 	req->in.h.unique = unique;
-	spin_lock(&fc->lock);
-	if (fc->connected) {
-		queue_request(fc, req);
+	q = fuse_lock_queue(fc);
+	if (q && fc->connected) {
+		queue_request(q, req);
 		err = 0;
 	}
-	spin_unlock(&fc->lock);
+	if (q)
+		spin_unlock(&q->lock);
 
 	return err;
 }
@@ -501,16 +582,16 @@ void fuse_request_send_background_locked(struct fuse_conn *fc,
  * anything that could cause a page-fault.  If the request was already
  * aborted bail out.
  */
-static int lock_request(struct fuse_conn *fc, struct fuse_req *req)
+static int lock_request(struct fuse_req *req)
 {
 	int err = 0;
 	if (req) {
-		spin_lock(&fc->lock);
+		spin_lock(&req->q->lock);
 		if (req->aborted)
 			err = -ENOENT;
 		else
 			req->locked = 1;
-		spin_unlock(&fc->lock);
+		spin_unlock(&req->q->lock);
 	}
 	return err;
 }
@@ -520,14 +601,14 @@ static int lock_request(struct fuse_conn *fc, struct fuse_req *req)
  * requester thread is currently waiting for it to be unlocked, so
  * wake it up.
  */
-static void unlock_request(struct fuse_conn *fc, struct fuse_req *req)
+static void unlock_request(struct fuse_req *req)
 {
 	if (req) {
-		spin_lock(&fc->lock);
+		spin_lock(&req->q->lock);
 		req->locked = 0;
 		if (req->aborted)
 			wake_up(&req->waitq);
-		spin_unlock(&fc->lock);
+		spin_unlock(&req->q->lock);
 	}
 }
 
@@ -539,6 +620,7 @@ struct fuse_copy_state {
 	struct pipe_buffer *pipebufs;
 	struct pipe_buffer *currbuf;
 	struct pipe_inode_info *pipe;
+	unsigned nr_pipebufs;
 	unsigned long nr_segs;
 	unsigned long seglen;
 	unsigned long addr;
@@ -594,7 +676,7 @@ static int fuse_copy_fill(struct fuse_copy_state *cs)
 	unsigned long offset;
 	int err;
 
-	unlock_request(cs->fc, cs->req);
+	unlock_request(cs->req);
 	fuse_copy_finish(cs);
 	if (cs->pipebufs) {
 		struct pipe_buffer *buf = cs->pipebufs;
@@ -614,7 +696,7 @@ static int fuse_copy_fill(struct fuse_copy_state *cs)
 		} else {
 			struct page *page;
 
-			if (cs->nr_segs == cs->pipe->buffers)
+			if (cs->nr_segs == cs->nr_pipebufs)
 				return -EIO;
 
 			page = alloc_page(GFP_HIGHUSER);
@@ -652,7 +734,7 @@ static int fuse_copy_fill(struct fuse_copy_state *cs)
 		cs->addr += cs->len;
 	}
 
-	return lock_request(cs->fc, cs->req);
+	return lock_request(cs->req);
 }
 
 /* Do as much copy to/from userspace buffer as we can */
@@ -700,7 +782,7 @@ static int fuse_try_move_page(struct fuse_copy_state *cs, struct page **pagep)
 	struct address_space *mapping;
 	pgoff_t index;
 
-	unlock_request(cs->fc, cs->req);
+	unlock_request(cs->req);
 	fuse_copy_finish(cs);
 
 	err = buf->ops->confirm(cs->pipe, buf);
@@ -757,12 +839,12 @@ static int fuse_try_move_page(struct fuse_copy_state *cs, struct page **pagep)
 		lru_cache_add_file(newpage);
 
 	err = 0;
-	spin_lock(&cs->fc->lock);
+	spin_lock(&cs->req->q->lock);
 	if (cs->req->aborted)
 		err = -ENOENT;
 	else
 		*pagep = newpage;
-	spin_unlock(&cs->fc->lock);
+	spin_unlock(&cs->req->q->lock);
 
 	if (err) {
 		unlock_page(newpage);
@@ -782,7 +864,7 @@ out_fallback:
 	cs->mapaddr = buf->ops->map(cs->pipe, buf, 1);
 	cs->buf = cs->mapaddr + buf->offset;
 
-	err = lock_request(cs->fc, cs->req);
+	err = lock_request(cs->req);
 	if (err)
 		return err;
 
@@ -794,10 +876,10 @@ static int fuse_ref_page(struct fuse_copy_state *cs, struct page *page,
 {
 	struct pipe_buffer *buf;
 
-	if (cs->nr_segs == cs->pipe->buffers)
+	if (cs->nr_segs == cs->nr_pipebufs)
 		return -EIO;
 
-	unlock_request(cs->fc, cs->req);
+	unlock_request(cs->req);
 	fuse_copy_finish(cs);
 
 	buf = cs->pipebufs;
@@ -910,36 +992,43 @@ static int fuse_copy_args(struct fuse_copy_state *cs, unsigned numargs,
 	return err;
 }
 
-static int forget_pending(struct fuse_conn *fc)
+static int forget_pending(struct fuse_queue *q)
 {
-	return fc->forget_list_head.next != NULL;
+	return q->forget_list_head.next != NULL;
 }
 
-static int request_pending(struct fuse_conn *fc)
+static int request_pending(struct fuse_queue *q)
 {
-	return !list_empty(&fc->pending) || !list_empty(&fc->interrupts) ||
-		forget_pending(fc);
+	return !list_empty(&q->pending) || !list_empty(&q->interrupts) ||
+		forget_pending(q);
 }
 
-/* Wait until a request is available on the pending list */
-static void request_wait(struct fuse_conn *fc)
-__releases(fc->lock)
-__acquires(fc->lock)
+/*
+ * Wait until a request is available on the pending list
+ *
+ * fc->connected is cleared without holding q->lock, so the task state
+ * has to be set before testing it.
+ */
+static void request_wait(struct fuse_queue *q)
+__releases(q->lock)
+__acquires(q->lock)
 {
 	DECLARE_WAITQUEUE(wait, current);
 
-	add_wait_queue_exclusive(&fc->waitq, &wait);
-	while (fc->connected && !request_pending(fc)) {
+	add_wait_queue_exclusive(&q->waitq, &wait);
+	for (;;) {
 		set_current_state(TASK_INTERRUPTIBLE);
+		if (!q->fc->connected || request_pending(q))
+			break;
 		if (signal_pending(current))
 			break;
 
-		spin_unlock(&fc->lock);
+		spin_unlock(&q->lock);
 		schedule();
-		spin_lock(&fc->lock);
+		spin_lock(&q->lock);
 	}
 	set_current_state(TASK_RUNNING);
-	remove_wait_queue(&fc->waitq, &wait);
+	remove_wait_queue(&q->waitq, &wait);
 }
 
 /*
@@ -948,11 +1037,11 @@ __acquires(fc->lock)
  * Unlike other requests this is assembled on demand, without a need
  * to allocate a separate fuse_req structure.
  *
- * Called with fc->lock held, releases it
+ * Called with q->lock held, releases it
  */
-static int fuse_read_interrupt(struct fuse_conn *fc, struct fuse_copy_state *cs,
+static int fuse_read_interrupt(struct fuse_queue *q, struct fuse_copy_state *cs,
 			       size_t nbytes, struct fuse_req *req)
-__releases(fc->lock)
+__releases(q->lock)
 {
 	struct fuse_in_header ih;
 	struct fuse_interrupt_in arg;
@@ -960,7 +1049,7 @@ __releases(fc->lock)
 	int err;
 
 	list_del_init(&req->intr_entry);
-	req->intr_unique = fuse_get_unique(fc);
+	req->intr_unique = fuse_get_unique(q);
 	memset(&ih, 0, sizeof(ih));
 	memset(&arg, 0, sizeof(arg));
 	ih.len = reqsize;
@@ -968,7 +1057,7 @@ __releases(fc->lock)
 	ih.unique = req->intr_unique;
 	arg.unique = req->in.h.unique;
 
-	spin_unlock(&fc->lock);
+	spin_unlock(&q->lock);
 	if (nbytes < reqsize)
 		return -EINVAL;
 
@@ -980,21 +1069,21 @@ __releases(fc->lock)
 	return err ? err : reqsize;
 }
 
-static struct fuse_forget_link *dequeue_forget(struct fuse_conn *fc,
+static struct fuse_forget_link *dequeue_forget(struct fuse_queue *q,
 					       unsigned max,
 					       unsigned *countp)
 {
-	struct fuse_forget_link *head = fc->forget_list_head.next;
+	struct fuse_forget_link *head = q->forget_list_head.next;
 	struct fuse_forget_link **newhead = &head;
 	unsigned count;
 
 	for (count = 0; *newhead != NULL && count < max; count++)
 		newhead = &(*newhead)->next;
 
-	fc->forget_list_head.next = *newhead;
+	q->forget_list_head.next = *newhead;
 	*newhead = NULL;
-	if (fc->forget_list_head.next == NULL)
-		fc->forget_list_tail = &fc->forget_list_head;
+	if (q->forget_list_head.next == NULL)
+		q->forget_list_tail = &q->forget_list_head;
 
 	if (countp != NULL)
 		*countp = count;
@@ -1002,24 +1091,24 @@ static struct fuse_forget_link *dequeue_forget(struct fuse_conn *fc,
 	return head;
 }
 
-static int fuse_read_single_forget(struct fuse_conn *fc,
+static int fuse_read_single_forget(struct fuse_queue *q,
 				   struct fuse_copy_state *cs,
 				   size_t nbytes)
-__releases(fc->lock)
+__releases(q->lock)
 {
 	int err;
-	struct fuse_forget_link *forget = dequeue_forget(fc, 1, NULL);
+	struct fuse_forget_link *forget = dequeue_forget(q, 1, NULL);
 	struct fuse_forget_in arg = {
 		.nlookup = forget->forget_one.nlookup,
 	};
 	struct fuse_in_header ih = {
 		.opcode = FUSE_FORGET,
 		.nodeid = forget->forget_one.nodeid,
-		.unique = fuse_get_unique(fc),
+		.unique = fuse_get_unique(q),
 		.len = sizeof(ih) + sizeof(arg),
 	};
 
-	spin_unlock(&fc->lock);
+	spin_unlock(&q->lock);
 	kfree(forget);
 	if (nbytes < ih.len)
 		return -EINVAL;
@@ -1035,9 +1124,9 @@ __releases(fc->lock)
 	return ih.len;
 }
 
-static int fuse_read_batch_forget(struct fuse_conn *fc,
+static int fuse_read_batch_forget(struct fuse_queue *q,
 				   struct fuse_copy_state *cs, size_t nbytes)
-__releases(fc->lock)
+__releases(q->lock)
 {
 	int err;
 	unsigned max_forgets;
@@ -1046,18 +1135,18 @@ __releases(fc->lock)
 	struct fuse_batch_forget_in arg = { .count = 0 };
 	struct fuse_in_header ih = {
 		.opcode = FUSE_BATCH_FORGET,
-		.unique = fuse_get_unique(fc),
+		.unique = fuse_get_unique(q),
 		.len = sizeof(ih) + sizeof(arg),
 	};
 
 	if (nbytes < ih.len) {
-		spin_unlock(&fc->lock);
+		spin_unlock(&q->lock);
 		return -EINVAL;
 	}
 
 	max_forgets = (nbytes - ih.len) / sizeof(struct fuse_forget_one);
-	head = dequeue_forget(fc, max_forgets, &count);
-	spin_unlock(&fc->lock);
+	head = dequeue_forget(q, max_forgets, &count);
+	spin_unlock(&q->lock);
 
 	arg.count = count;
 	ih.len += count * sizeof(struct fuse_forget_one);
@@ -1084,14 +1173,14 @@ __releases(fc->lock)
 	return ih.len;
 }
 
-static int fuse_read_forget(struct fuse_conn *fc, struct fuse_copy_state *cs,
+static int fuse_read_forget(struct fuse_queue *q, struct fuse_copy_state *cs,
 			    size_t nbytes)
-__releases(fc->lock)
+__releases(q->lock)
 {
-	if (fc->minor < 16 || fc->forget_list_head.next->next == NULL)
-		return fuse_read_single_forget(fc, cs, nbytes);
+	if (q->fc->minor < 16 || q->forget_list_head.next->next == NULL)
+		return fuse_read_single_forget(q, cs, nbytes);
 	else
-		return fuse_read_batch_forget(fc, cs, nbytes);
+		return fuse_read_batch_forget(q, cs, nbytes);
 }
 
 /*
@@ -1103,46 +1192,47 @@ __releases(fc->lock)
  * request_end().  Otherwise add it to the processing list, and set
  * the 'sent' flag.
  */
-static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
+static ssize_t fuse_dev_do_read(struct fuse_queue *q, struct file *file,
 				struct fuse_copy_state *cs, size_t nbytes)
 {
+	struct fuse_conn *fc = q->fc;
 	int err;
 	struct fuse_req *req;
 	struct fuse_in *in;
 	unsigned reqsize;
 
  restart:
-	spin_lock(&fc->lock);
+	spin_lock(&q->lock);
 	err = -EAGAIN;
 	if ((file->f_flags & O_NONBLOCK) && fc->connected &&
-	    !request_pending(fc))
+	    !request_pending(q))
 		goto err_unlock;
 
-	request_wait(fc);
+	request_wait(q);
 	err = -ENODEV;
 	if (!fc->connected)
 		goto err_unlock;
 	err = -ERESTARTSYS;
-	if (!request_pending(fc))
+	if (!request_pending(q))
 		goto err_unlock;
 
-	if (!list_empty(&fc->interrupts)) {
-		req = list_entry(fc->interrupts.next, struct fuse_req,
+	if (!list_empty(&q->interrupts)) {
+		req = list_entry(q->interrupts.next, struct fuse_req,
 				 intr_entry);
-		return fuse_read_interrupt(fc, cs, nbytes, req);
+		return fuse_read_interrupt(q, cs, nbytes, req);
 	}
 
-	if (forget_pending(fc)) {
-		if (list_empty(&fc->pending) || fc->forget_batch-- > 0)
-			return fuse_read_forget(fc, cs, nbytes);
+	if (forget_pending(q)) {
+		if (list_empty(&q->pending) || q->forget_batch-- > 0)
+			return fuse_read_forget(q, cs, nbytes);
 
-		if (fc->forget_batch <= -8)
-			fc->forget_batch = 16;
+		if (q->forget_batch <= -8)
+			q->forget_batch = 16;
 	}
 
-	req = list_entry(fc->pending.next, struct fuse_req, list);
+	req = list_entry(q->pending.next, struct fuse_req, list);
 	req->state = FUSE_REQ_READING;
-	list_move(&req->list, &fc->io);
+	list_move(&req->list, &q->io);
 
 	in = &req->in;
 	reqsize = in->h.len;
@@ -1152,40 +1242,40 @@ static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
 		/* SETXATTR is special, since it may contain too large data */
 		if (in->h.opcode == FUSE_SETXATTR)
 			req->out.h.error = -E2BIG;
-		request_end(fc, req);
+		request_end(q, req);
 		goto restart;
 	}
-	spin_unlock(&fc->lock);
+	spin_unlock(&q->lock);
 	cs->req = req;
 	err = fuse_copy_one(cs, &in->h, sizeof(in->h));
 	if (!err)
 		err = fuse_copy_args(cs, in->numargs, in->argpages,
 				     (struct fuse_arg *) in->args, 0);
 	fuse_copy_finish(cs);
-	spin_lock(&fc->lock);
+	spin_lock(&q->lock);
 	req->locked = 0;
 	if (req->aborted) {
-		request_end(fc, req);
+		request_end(q, req);
 		return -ENODEV;
 	}
 	if (err) {
 		req->out.h.error = -EIO;
-		request_end(fc, req);
+		request_end(q, req);
 		return err;
 	}
 	if (!req->isreply)
-		request_end(fc, req);
+		request_end(q, req);
 	else {
 		req->state = FUSE_REQ_SENT;
-		list_move_tail(&req->list, &fc->processing);
+		list_move_tail(&req->list, &q->processing);
 		if (req->interrupted)
-			queue_interrupt(fc, req);
-		spin_unlock(&fc->lock);
+			queue_interrupt(q, req);
+		spin_unlock(&q->lock);
 	}
 	return reqsize;
 
  err_unlock:
-	spin_unlock(&fc->lock);
+	spin_unlock(&q->lock);
 	return err;
 }
 
@@ -1194,13 +1284,13 @@ static ssize_t fuse_dev_read(struct kiocb *iocb, const struct iovec *iov,
 {
 	struct fuse_copy_state cs;
 	struct file *file = iocb->ki_filp;
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (!fc)
+	struct fuse_queue *q = fuse_get_queue(file);
+	if (!q)
 		return -EPERM;
 
-	fuse_copy_init(&cs, fc, 1, iov, nr_segs);
+	fuse_copy_init(&cs, q->fc, 1, iov, nr_segs);
 
-	return fuse_dev_do_read(fc, file, &cs, iov_length(iov, nr_segs));
+	return fuse_dev_do_read(q, file, &cs, iov_length(iov, nr_segs));
 }
 
 static int fuse_dev_pipe_buf_steal(struct pipe_inode_info *pipe,
@@ -1226,20 +1316,24 @@ static ssize_t fuse_dev_splice_read(struct file *in, loff_t *ppos,
 	int ret;
 	int page_nr = 0;
 	int do_wakeup = 0;
+	unsigned nbufs;
 	struct pipe_buffer *bufs;
 	struct fuse_copy_state cs;
-	struct fuse_conn *fc = fuse_get_conn(in);
-	if (!fc)
+	struct fuse_queue *q = fuse_get_queue(in);
+	if (!q)
 		return -EPERM;
 
-	bufs = kmalloc(pipe->buffers * sizeof(struct pipe_buffer), GFP_KERNEL);
+	/* The pipe isn't locked until later and may grow, keep to nbufs */
+	nbufs = ACCESS_ONCE(pipe->buffers);
+	bufs = kmalloc(nbufs * sizeof(struct pipe_buffer), GFP_KERNEL);
 	if (!bufs)
 		return -ENOMEM;
 
-	fuse_copy_init(&cs, fc, 1, NULL, 0);
+	fuse_copy_init(&cs, q->fc, 1, NULL, 0);
 	cs.pipebufs = bufs;
+	cs.nr_pipebufs = nbufs;
 	cs.pipe = pipe;
-	ret = fuse_dev_do_read(fc, in, &cs, len);
+	ret = fuse_dev_do_read(q, in, &cs, len);
 	if (ret < 0)
 		goto out;
 
@@ -1607,11 +1701,11 @@ static int fuse_notify(struct fuse_conn *fc, enum fuse_notify_code code,
 }
 
 /* Look up request on processing list by unique ID */
-static struct fuse_req *request_find(struct fuse_conn *fc, u64 unique)
+static struct fuse_req *request_find(struct fuse_queue *q, u64 unique)
 {
 	struct list_head *entry;
 
-	list_for_each(entry, &fc->processing) {
+	list_for_each(entry, &q->processing) {
 		struct fuse_req *req;
 		req = list_entry(entry, struct fuse_req, list);
 		if (req->in.h.unique == unique || req->intr_unique == unique)
@@ -1650,9 +1744,10 @@ static int copy_out_args(struct fuse_copy_state *cs, struct fuse_out *out,
  * it from the list and copy the rest of the buffer to the request.
  * The request is finished by calling request_end()
  */
-static ssize_t fuse_dev_do_write(struct fuse_conn *fc,
+static ssize_t fuse_dev_do_write(struct fuse_queue *q,
 				 struct fuse_copy_state *cs, size_t nbytes)
 {
+	struct fuse_conn *fc = q->fc;
 	int err;
 	struct fuse_req *req;
 	struct fuse_out_header oh;
@@ -1681,20 +1776,20 @@ static ssize_t fuse_dev_do_write(struct fuse_conn *fc,
 	if (oh.error <= -1000 || oh.error > 0)
 		goto err_finish;
 
-	spin_lock(&fc->lock);
+	spin_lock(&q->lock);
 	err = -ENOENT;
 	if (!fc->connected)
 		goto err_unlock;
 
-	req = request_find(fc, oh.unique);
+	req = request_find(q, oh.unique);
 	if (!req)
 		goto err_unlock;
 
 	if (req->aborted) {
-		spin_unlock(&fc->lock);
+		spin_unlock(&q->lock);
 		fuse_copy_finish(cs);
-		spin_lock(&fc->lock);
-		request_end(fc, req);
+		spin_lock(&q->lock);
+		request_end(q, req);
 		return -ENOENT;
 	}
 	/* Is it an interrupt reply? */
@@ -1706,38 +1801,40 @@ static ssize_t fuse_dev_do_write(struct fuse_conn *fc,
 		if (oh.error == -ENOSYS)
 			fc->no_interrupt = 1;
 		else if (oh.error == -EAGAIN)
-			queue_interrupt(fc, req);
+			queue_interrupt(q, req);
 
-		spin_unlock(&fc->lock);
+		spin_unlock(&q->lock);
 		fuse_copy_finish(cs);
 		return nbytes;
 	}
 
 	req->state = FUSE_REQ_WRITING;
-	list_move(&req->list, &fc->io);
+	list_move(&req->list, &q->io);
 	req->out.h = oh;
 	req->locked = 1;
 	cs->req = req;
 	if (!req->out.page_replace)
 		cs->move_pages = 0;
-	spin_unlock(&fc->lock);
+	spin_unlock(&q->lock);
 
 	err = copy_out_args(cs, &req->out, nbytes);
 	fuse_copy_finish(cs);
+	if (!err)
+		fuse_passthrough_setup(fc, req);
 
-	spin_lock(&fc->lock);
+	spin_lock(&q->lock);
 	req->locked = 0;
 	if (!err) {
 		if (req->aborted)
 			err = -ENOENT;
 	} else if (!req->aborted)
 		req->out.h.error = -EIO;
-	request_end(fc, req);
+	request_end(q, req);
 
 	return err ? err : nbytes;
 
  err_unlock:
-	spin_unlock(&fc->lock);
+	spin_unlock(&q->lock);
  err_finish:
 	fuse_copy_finish(cs);
 	return err;
@@ -1747,13 +1844,13 @@ static ssize_t fuse_dev_write(struct kiocb *iocb, const struct iovec *iov,
 			      unsigned long nr_segs, loff_t pos)
 {
 	struct fuse_copy_state cs;
-	struct fuse_conn *fc = fuse_get_conn(iocb->ki_filp);
-	if (!fc)
+	struct fuse_queue *q = fuse_get_queue(iocb->ki_filp);
+	if (!q)
 		return -EPERM;
 
-	fuse_copy_init(&cs, fc, 0, iov, nr_segs);
+	fuse_copy_init(&cs, q->fc, 0, iov, nr_segs);
 
-	return fuse_dev_do_write(fc, &cs, iov_length(iov, nr_segs));
+	return fuse_dev_do_write(q, &cs, iov_length(iov, nr_segs));
 }
 
 static ssize_t fuse_dev_splice_write(struct pipe_inode_info *pipe,
@@ -1764,19 +1861,22 @@ static ssize_t fuse_dev_splice_write(struct pipe_inode_info *pipe,
 	unsigned idx;
 	struct pipe_buffer *bufs;
 	struct fuse_copy_state cs;
-	struct fuse_conn *fc;
+	struct fuse_queue *q;
 	size_t rem;
 	ssize_t ret;
 
-	fc = fuse_get_conn(out);
-	if (!fc)
+	q = fuse_get_queue(out);
+	if (!q)
 		return -EPERM;
 
+	/* Size bufs under the lock, the pipe may grow until then */
+	pipe_lock(pipe);
 	bufs = kmalloc(pipe->buffers * sizeof(struct pipe_buffer), GFP_KERNEL);
-	if (!bufs)
+	if (!bufs) {
+		pipe_unlock(pipe);
 		return -ENOMEM;
+	}
 
-	pipe_lock(pipe);
 	nbuf = 0;
 	rem = 0;
 	for (idx = 0; idx < pipe->nrbufs && rem < len; idx++)
@@ -1816,14 +1916,20 @@ static ssize_t fuse_dev_splice_write(struct pipe_inode_info *pipe,
 	}
 	pipe_unlock(pipe);
 
-	fuse_copy_init(&cs, fc, 0, NULL, nbuf);
+	fuse_copy_init(&cs, q->fc, 0, NULL, nbuf);
 	cs.pipebufs = bufs;
 	cs.pipe = pipe;
 
+	/*
+	 * With SPLICE_F_MOVE try to move the pages into the page cache.
+	 * Only buffers the pipe allows to be stolen are moved (gifted user
+	 * pages, anonymous pipe pages, page cache pages), everything else
+	 * still falls back to copying.
+	 */
 	if (flags & SPLICE_F_MOVE)
 		cs.move_pages = 1;
 
-	ret = fuse_dev_do_write(fc, &cs, len);
+	ret = fuse_dev_do_write(q, &cs, len);
 
 	for (idx = 0; idx < nbuf; idx++) {
 		struct pipe_buffer *buf = &bufs[idx];
@@ -1837,18 +1943,18 @@ out:
 static unsigned fuse_dev_poll(struct file *file, poll_table *wait)
 {
 	unsigned mask = POLLOUT | POLLWRNORM;
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (!fc)
+	struct fuse_queue *q = fuse_get_queue(file);
+	if (!q)
 		return POLLERR;
 
-	poll_wait(file, &fc->waitq, wait);
+	poll_wait(file, &q->waitq, wait);
 
-	spin_lock(&fc->lock);
-	if (!fc->connected)
+	spin_lock(&q->lock);
+	if (!q->fc->connected)
 		mask = POLLERR;
-	else if (request_pending(fc))
+	else if (request_pending(q))
 		mask |= POLLIN | POLLRDNORM;
-	spin_unlock(&fc->lock);
+	spin_unlock(&q->lock);
 
 	return mask;
 }
@@ -1856,18 +1962,18 @@ static unsigned fuse_dev_poll(struct file *file, poll_table *wait)
 /*
  * Abort all requests on the given list (pending or processing)
  *
- * This function releases and reacquires fc->lock
+ * This function releases and reacquires q->lock
  */
-static void end_requests(struct fuse_conn *fc, struct list_head *head)
-__releases(fc->lock)
-__acquires(fc->lock)
+static void end_requests(struct fuse_queue *q, struct list_head *head)
+__releases(q->lock)
+__acquires(q->lock)
 {
 	while (!list_empty(head)) {
 		struct fuse_req *req;
 		req = list_entry(head->next, struct fuse_req, list);
 		req->out.h.error = -ECONNABORTED;
-		request_end(fc, req);
-		spin_lock(&fc->lock);
+		request_end(q, req);
+		spin_lock(&q->lock);
 	}
 }
 
@@ -1882,13 +1988,13 @@ __acquires(fc->lock)
  * called after waiting for the request to be unlocked (if it was
  * locked).
  */
-static void end_io_requests(struct fuse_conn *fc)
-__releases(fc->lock)
-__acquires(fc->lock)
+static void end_io_requests(struct fuse_queue *q)
+__releases(q->lock)
+__acquires(q->lock)
 {
-	while (!list_empty(&fc->io)) {
+	while (!list_empty(&q->io)) {
 		struct fuse_req *req =
-			list_entry(fc->io.next, struct fuse_req, list);
+			list_entry(q->io.next, struct fuse_req, list);
 		void (*end) (struct fuse_conn *, struct fuse_req *) = req->end;
 
 		req->aborted = 1;
@@ -1899,25 +2005,39 @@ __acquires(fc->lock)
 		if (end) {
 			req->end = NULL;
 			__fuse_get_request(req);
-			spin_unlock(&fc->lock);
+			spin_unlock(&q->lock);
 			wait_event(req->waitq, !req->locked);
-			end(fc, req);
-			fuse_put_request(fc, req);
-			spin_lock(&fc->lock);
+			end(q->fc, req);
+			fuse_put_request(q->fc, req);
+			spin_lock(&q->lock);
 		}
 	}
 }
 
-static void end_queued_requests(struct fuse_conn *fc)
-__releases(fc->lock)
-__acquires(fc->lock)
+static void end_queued_requests(struct fuse_queue *q)
+__releases(q->lock)
+__acquires(q->lock)
 {
-	fc->max_background = UINT_MAX;
-	flush_bg_queue(fc);
-	end_requests(fc, &fc->pending);
-	end_requests(fc, &fc->processing);
-	while (forget_pending(fc))
-		kfree(dequeue_forget(fc, 1, NULL));
+	end_requests(q, &q->pending);
+	end_requests(q, &q->processing);
+	while (forget_pending(q))
+		kfree(dequeue_forget(q, 1, NULL));
+}
+
+/*
+ * Mark the queue dead, so that nothing new is queued on it, and abort
+ * everything on it.  Requests on the io list must be aborted first,
+ * see fuse_abort_conn().
+ */
+static void end_queue(struct fuse_queue *q)
+{
+	spin_lock(&q->lock);
+	q->dead = 1;
+	end_io_requests(q);
+	end_queued_requests(q);
+	spin_unlock(&q->lock);
+	wake_up_all(&q->waitq);
+	kill_fasync(&q->fasync, SIGIO, POLL_IN);
 }
 
 static void end_polls(struct fuse_conn *fc)
@@ -1935,6 +2055,32 @@ static void end_polls(struct fuse_conn *fc)
 	}
 }
 
+/*
+ * Disconnect and abort the requests on all queues
+ *
+ * Called with fc->lock held, releases it
+ */
+static void end_conn(struct fuse_conn *fc)
+__releases(fc->lock)
+{
+	unsigned i;
+
+	fc->connected = 0;
+	fc->blocked = 0;
+	fc->max_background = UINT_MAX;
+	flush_bg_queue(fc);
+	spin_unlock(&fc->lock);
+
+	/* No queues are added once the connection is down */
+	for (i = 0; i < fc->nr_queues; i++)
+		end_queue(fc->queues[i]);
+
+	spin_lock(&fc->lock);
+	end_polls(fc);
+	wake_up_all(&fc->blocked_waitq);
+	spin_unlock(&fc->lock);
+}
+
 /*
  * Abort all requests.
  *
@@ -1957,31 +2103,71 @@ static void end_polls(struct fuse_conn *fc)
 void fuse_abort_conn(struct fuse_conn *fc)
 {
 	spin_lock(&fc->lock);
-	if (fc->connected) {
-		fc->connected = 0;
-		fc->blocked = 0;
-		end_io_requests(fc);
-		end_queued_requests(fc);
-		end_polls(fc);
-		wake_up_all(&fc->waitq);
-		wake_up_all(&fc->blocked_waitq);
-		kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+	if (fc->connected)
+		end_conn(fc);
+	else
+		spin_unlock(&fc->lock);
+}
+EXPORT_SYMBOL_GPL(fuse_abort_conn);
+
+/*
+ * Close one of several channels of a live connection
+ *
+ * Requests and forgets not yet read are moved to another channel.
+ * Requests already read can only be answered on this channel, so
+ * they are aborted.
+ *
+ * Called with fc->lock held, releases it
+ */
+static void retire_queue(struct fuse_conn *fc, struct fuse_queue *q)
+__releases(fc->lock)
+{
+	struct fuse_queue *to = NULL;
+	unsigned i;
+
+	spin_lock(&q->lock);
+	q->dead = 1;
+	for (i = 0; i < fc->nr_queues && !to; i++) {
+		if (!fc->queues[i]->dead)
+			to = fc->queues[i];
+	}
+	if (to) {
+		spin_lock_nested(&to->lock, SINGLE_DEPTH_NESTING);
+		while (!list_empty(&q->pending)) {
+			struct fuse_req *req;
+
+			req = list_entry(q->pending.next, struct fuse_req,
+					 list);
+			req->q = to;
+			list_move_tail(&req->list, &to->pending);
+		}
+		if (forget_pending(q)) {
+			to->forget_list_tail->next = q->forget_list_head.next;
+			to->forget_list_tail = q->forget_list_tail;
+			q->forget_list_head.next = NULL;
+			q->forget_list_tail = &q->forget_list_head;
+		}
+		wake_queue(to);
+		spin_unlock(&to->lock);
 	}
+	spin_unlock(&q->lock);
 	spin_unlock(&fc->lock);
+
+	end_queue(q);
 }
-EXPORT_SYMBOL_GPL(fuse_abort_conn);
 
 int fuse_dev_release(struct inode *inode, struct file *file)
 {
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (fc) {
+	struct fuse_queue *q = fuse_get_queue(file);
+	if (q) {
+		struct fuse_conn *fc = q->fc;
+
 		spin_lock(&fc->lock);
-		fc->connected = 0;
-		fc->blocked = 0;
-		end_queued_requests(fc);
-		end_polls(fc);
-		wake_up_all(&fc->blocked_waitq);
-		spin_unlock(&fc->lock);
+		fc->live_queues--;
+		if (fc->connected && fc->live_queues)
+			retire_queue(fc, q);
+		else
+			end_conn(fc);
 		fuse_conn_put(fc);
 	}
 
@@ -1991,13 +2177,118 @@ EXPORT_SYMBOL_GPL(fuse_dev_release);
 
 static int fuse_dev_fasync(int fd, struct file *file, int on)
 {
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (!fc)
+	struct fuse_queue *q = fuse_get_queue(file);
+	if (!q)
 		return -EPERM;
 
 	/* No locking - fasync_helper does its own locking */
-	return fasync_helper(fd, file, on, &fc->fasync);
+	return fasync_helper(fd, file, on, &q->fasync);
+}
+
+/*
+ * Attach @file as another channel of the connection @fc, with a
+ * request queue of its own
+ */
+static int fuse_dev_clone(struct fuse_conn *fc, struct file *file)
+{
+	struct fuse_queue *q;
+	int err;
+
+	q = kmalloc(sizeof(*q), GFP_KERNEL);
+	if (!q)
+		return -ENOMEM;
+
+	mutex_lock(&fuse_mutex);
+	err = -EINVAL;
+	if (file->private_data)
+		goto err_unlock;
+
+	spin_lock(&fc->lock);
+	err = -ENODEV;
+	if (!fc->connected)
+		goto err_unlock_fc;
+	err = -EMFILE;
+	if (fc->nr_queues == FUSE_MAX_QUEUES)
+		goto err_unlock_fc;
+
+	fuse_queue_init(q, fc, fc->nr_queues);
+	fc->queues[fc->nr_queues] = q;
+	/* Pairs with smp_rmb() in fuse_lock_queue() */
+	smp_wmb();
+	fc->nr_queues++;
+	fc->live_queues++;
+	spin_unlock(&fc->lock);
+
+	file->private_data = q;
+	fuse_conn_get(fc);
+	mutex_unlock(&fuse_mutex);
+
+	return 0;
+
+ err_unlock_fc:
+	spin_unlock(&fc->lock);
+ err_unlock:
+	mutex_unlock(&fuse_mutex);
+	kfree(q);
+	return err;
+}
+
+static int fuse_dev_ioctl_clone(struct file *file, __u32 __user *argp)
+{
+	struct fuse_queue *oldq;
+	struct file *old;
+	int oldfd;
+	int err;
+
+	if (get_user(oldfd, argp))
+		return -EFAULT;
+
+	old = fget(oldfd);
+	if (!old)
+		return -EINVAL;
+
+	err = -EINVAL;
+	oldq = old->f_op == &fuse_dev_operations ? fuse_get_queue(old) : NULL;
+	if (oldq)
+		err = fuse_dev_clone(oldq->fc, file);
+	fput(old);
+
+	return err;
+}
+
+static int fuse_dev_ioctl(struct file *file, unsigned int cmd,
+			  unsigned long arg)
+{
+	struct fuse_queue *q;
+	int val;
+
+	switch (cmd) {
+	case FUSE_DEV_IOC_CLONE:
+		return fuse_dev_ioctl_clone(file, (__u32 __user *) arg);
+
+	case FUSE_DEV_IOC_BACKING_OPEN:
+	case FUSE_DEV_IOC_BACKING_CLOSE:
+		q = fuse_get_queue(file);
+		if (!q)
+			return -EPERM;
+		if (get_user(val, (__u32 __user *) arg))
+			return -EFAULT;
+		if (cmd == FUSE_DEV_IOC_BACKING_OPEN)
+			return fuse_passthrough_register(q->fc, val);
+		return fuse_passthrough_unregister(q->fc, val);
+
+	default:
+		return -ENOTTY;
+	}
+}
+
+#ifdef CONFIG_COMPAT
+static long fuse_dev_compat_ioctl(struct file *file, unsigned int cmd,
+				  unsigned long arg)
+{
+	return fuse_dev_ioctl(file, cmd, (unsigned long)compat_ptr(arg));
 }
+#endif
 
 const struct file_operations fuse_dev_operations = {
 	.owner		= THIS_MODULE,
@@ -2011,6 +2302,10 @@ const struct file_operations fuse_dev_operations = {
 	.poll		= fuse_dev_poll,
 	.release	= fuse_dev_release,
 	.fasync		= fuse_dev_fasync,
+	.unlocked_ioctl	= fuse_dev_ioctl,
+#ifdef CONFIG_COMPAT
+	.compat_ioctl	= fuse_dev_compat_ioctl,
+#endif
 };
 EXPORT_SYMBOL_GPL(fuse_dev_operations);
 
@@ -18,7 +18,8 @@
 static const struct file_operations fuse_direct_io_file_operations;
 
 static int fuse_send_open(struct fuse_conn *fc, u64 nodeid, struct file *file,
-			  int opcode, struct fuse_open_out *outargp)
+			  int opcode, struct fuse_open_out *outargp,
+			  struct fuse_file *ff)
 {
 	struct fuse_open_in inarg;
 	struct fuse_req *req;
@@ -42,6 +43,7 @@ static int fuse_send_open(struct fuse_conn *fc, u64 nodeid, struct file *file,
 	req->out.args[0].value = outargp;
 	fuse_request_send(fc, req);
 	err = req->out.h.error;
+	fuse_passthrough_open(ff, req, file->f_mode);
 	fuse_put_request(fc, req);
 
 	return err;
@@ -64,6 +66,7 @@ struct fuse_file *fuse_file_alloc(struct fuse_conn *fc)
 
 	INIT_LIST_HEAD(&ff->write_entry);
 	atomic_set(&ff->count, 0);
+	ff->passthrough_filp = NULL;
 	RB_CLEAR_NODE(&ff->polled_node);
 	init_waitqueue_head(&ff->poll_wait);
 
@@ -76,6 +79,7 @@ struct fuse_file *fuse_file_alloc(struct fuse_conn *fc)
 
 void fuse_file_free(struct fuse_file *ff)
 {
+	fuse_passthrough_release(ff);
 	fuse_request_free(ff->reserved_req);
 	kfree(ff);
 }
@@ -132,6 +136,7 @@ static void fuse_file_put(struct fuse_file *ff, bool sync)
 			req->end = fuse_release_end;
 			fuse_request_send_background(ff->fc, req);
 		}
+		fuse_passthrough_release(ff);
 		kfree(ff);
 	}
 }
@@ -148,7 +153,7 @@ int fuse_do_open(struct fuse_conn *fc, u64 nodeid, struct file *file,
 	if (!ff)
 		return -ENOMEM;
 
-	err = fuse_send_open(fc, nodeid, file, opcode, &outarg);
+	err = fuse_send_open(fc, nodeid, file, opcode, &outarg, ff);
 	if (err) {
 		fuse_file_free(ff);
 		return err;
@@ -171,12 +176,27 @@ void fuse_finish_open(struct inode *inode, struct file *file)
 	struct fuse_file *ff = file->private_data;
 	struct fuse_conn *fc = get_fuse_conn(inode);
 
+	/* Passthrough takes precedence over direct I/O */
+	if (ff->passthrough_filp)
+		ff->open_flags &= ~FOPEN_DIRECT_IO;
+	else
+		ff->open_flags &= ~FOPEN_PASSTHROUGH;
 	if (ff->open_flags & FOPEN_DIRECT_IO)
 		file->f_op = &fuse_direct_io_file_operations;
 	if (!(ff->open_flags & FOPEN_KEEP_CACHE))
 		invalidate_inode_pages2(inode->i_mapping);
 	if (ff->open_flags & FOPEN_NONSEEKABLE)
 		nonseekable_open(inode, file);
+	if (fc->writeback_cache && (file->f_mode & FMODE_WRITE) &&
+	    S_ISREG(inode->i_mode)) {
+		struct fuse_inode *fi = get_fuse_inode(inode);
+
+		/* Cached writes are written back through any writable open */
+		spin_lock(&fc->lock);
+		if (list_empty(&ff->write_entry))
+			list_add(&ff->write_entry, &fi->write_files);
+		spin_unlock(&fc->lock);
+	}
 	if (fc->atomic_o_trunc && (file->f_flags & O_TRUNC)) {
 		struct fuse_inode *fi = get_fuse_inode(inode);
 
@@ -244,6 +264,7 @@ void fuse_release_common(struct file *file, int opcode)
 
 	req = ff->reserved_req;
 	fuse_prepare_release(ff, file->f_flags, opcode);
+	fuse_passthrough_release(ff);
 
 	/* Hold vfsmount and dentry until release is finished */
 	path_get(&file->f_path);
@@ -268,6 +289,15 @@ static int fuse_open(struct inode *inode, struct file *file)
 
 static int fuse_release(struct inode *inode, struct file *file)
 {
+	struct fuse_conn *fc = get_fuse_conn(inode);
+
+	/*
+	 * Pages dirtied since the last flush must be written back while
+	 * this file is still usable for writepage
+	 */
+	if (fc->writeback_cache)
+		write_inode_now(inode, 1);
+
 	fuse_release_common(file, FUSE_RELEASE);
 
 	/* return value is ignored by VFS */
@@ -281,6 +311,7 @@ void fuse_sync_release(struct fuse_file *ff, int flags)
 	ff->reserved_req->force = 1;
 	fuse_request_send(ff->fc, ff->reserved_req);
 	fuse_put_request(ff->fc, ff->reserved_req);
+	fuse_passthrough_release(ff);
 	kfree(ff);
 }
 EXPORT_SYMBOL_GPL(fuse_sync_release);
@@ -326,7 +357,8 @@ static bool fuse_page_is_writeback(struct inode *inode, pgoff_t index)
 
 		BUG_ON(req->inode != inode);
 		curr_index = req->misc.write.in.offset >> PAGE_CACHE_SHIFT;
-		if (curr_index == index) {
+		if (curr_index <= index &&
+		    index < curr_index + req->num_pages) {
 			found = true;
 			break;
 		}
@@ -350,6 +382,40 @@ static int fuse_wait_on_page_writeback(struct inode *inode, pgoff_t index)
 	return 0;
 }
 
+/*
+ * Wait for all pending writepages on the inode to finish.
+ *
+ * This is currently done by blocking further writes with FUSE_NOWRITE
+ * and waiting for all sent writes to complete.
+ *
+ * This must be called under i_mutex, otherwise the FUSE_NOWRITE usage
+ * could conflict with truncation.
+ */
+static void fuse_sync_writes(struct inode *inode)
+{
+	fuse_set_nowrite(inode);
+	fuse_release_nowrite(inode);
+}
+
+/*
+ * With a writeback cache, write back dirty pages and then the mtime
+ * they caused, so that the WRITEs don't overtake the SETATTR.
+ *
+ * Called with i_mutex held, see fuse_sync_writes().
+ */
+static int fuse_writeback_cache_sync(struct inode *inode)
+{
+	int err;
+
+	err = filemap_write_and_wait(inode->i_mapping);
+	if (err)
+		return err;
+
+	fuse_sync_writes(inode);
+
+	return sync_inode_metadata(inode, 1);
+}
+
 static int fuse_flush(struct file *file, fl_owner_t id)
 {
 	struct inode *inode = file->f_path.dentry->d_inode;
@@ -362,6 +428,14 @@ static int fuse_flush(struct file *file, fl_owner_t id)
 	if (is_bad_inode(inode))
 		return -EIO;
 
+	if (fc->writeback_cache) {
+		mutex_lock(&inode->i_mutex);
+		err = fuse_writeback_cache_sync(inode);
+		mutex_unlock(&inode->i_mutex);
+		if (err)
+			return err;
+	}
+
 	if (fc->no_flush)
 		return 0;
 
@@ -385,21 +459,6 @@ static int fuse_flush(struct file *file, fl_owner_t id)
 	return err;
 }
 
-/*
- * Wait for all pending writepages on the inode to finish.
- *
- * This is currently done by blocking further writes with FUSE_NOWRITE
- * and waiting for all sent writes to complete.
- *
- * This must be called under i_mutex, otherwise the FUSE_NOWRITE usage
- * could conflict with truncation.
- */
-static void fuse_sync_writes(struct inode *inode)
-{
-	fuse_set_nowrite(inode);
-	fuse_release_nowrite(inode);
-}
-
 int fuse_fsync_common(struct file *file, int datasync, int isdir)
 {
 	struct inode *inode = file->f_mapping->host;
@@ -420,11 +479,17 @@ int fuse_fsync_common(struct file *file, int datasync, int isdir)
 	 * wait for all outstanding writes, before sending the FSYNC
 	 * request.
 	 */
-	err = write_inode_now(inode, 0);
-	if (err)
-		return err;
+	if (fc->writeback_cache && !isdir) {
+		err = fuse_writeback_cache_sync(inode);
+		if (err)
+			return err;
+	} else {
+		err = write_inode_now(inode, 0);
+		if (err)
+			return err;
 
-	fuse_sync_writes(inode);
+		fuse_sync_writes(inode);
+	}
 
 	req = fuse_get_req(fc);
 	if (IS_ERR(req))
@@ -499,6 +564,13 @@ static void fuse_read_update_size(struct inode *inode, loff_t size,
 	struct fuse_conn *fc = get_fuse_conn(inode);
 	struct fuse_inode *fi = get_fuse_inode(inode);
 
+	/*
+	 * With a writeback cache, data beyond the filesystem's EOF may
+	 * still be on its way, the kernel's size is the right one.
+	 */
+	if (fc->writeback_cache)
+		return;
+
 	spin_lock(&fc->lock);
 	if (attr_ver == fi->attr_version && size < inode->i_size) {
 		fi->attr_version = ++fc->attr_version;
@@ -507,7 +579,7 @@ static void fuse_read_update_size(struct inode *inode, loff_t size,
 	spin_unlock(&fc->lock);
 }
 
-static int fuse_readpage(struct file *file, struct page *page)
+static int fuse_do_readpage(struct file *file, struct page *page)
 {
 	struct inode *inode = page->mapping->host;
 	struct fuse_conn *fc = get_fuse_conn(inode);
@@ -518,9 +590,8 @@ static int fuse_readpage(struct file *file, struct page *page)
 	u64 attr_ver;
 	int err;
 
-	err = -EIO;
 	if (is_bad_inode(inode))
-		goto out;
+		return -EIO;
 
 	/*
 	 * Page writeback can extend beyond the lifetime of the
@@ -530,9 +601,8 @@ static int fuse_readpage(struct file *file, struct page *page)
 	fuse_wait_on_page_writeback(inode, page->index);
 
 	req = fuse_get_req(fc);
-	err = PTR_ERR(req);
 	if (IS_ERR(req))
-		goto out;
+		return PTR_ERR(req);
 
 	attr_ver = fuse_get_attr_version(fc);
 
@@ -555,8 +625,17 @@ static int fuse_readpage(struct file *file, struct page *page)
 	}
 
 	fuse_invalidate_attr(inode); /* atime changed */
- out:
+
+	return err;
+}
+
+static int fuse_readpage(struct file *file, struct page *page)
+{
+	int err;
+
+	err = fuse_do_readpage(file, page);
 	unlock_page(page);
+
 	return err;
 }
 
@@ -688,6 +767,10 @@ static ssize_t fuse_file_aio_read(struct kiocb *iocb, const struct iovec *iov,
 				  unsigned long nr_segs, loff_t pos)
 {
 	struct inode *inode = iocb->ki_filp->f_mapping->host;
+	struct fuse_file *ff = iocb->ki_filp->private_data;
+
+	if (ff->passthrough_filp)
+		return fuse_passthrough_read(iocb, iov, nr_segs, pos);
 
 	if (pos + iov_length(iov, nr_segs) > i_size_read(inode)) {
 		int err;
@@ -748,11 +831,40 @@ static int fuse_write_begin(struct file *file, struct address_space *mapping,
 			struct page **pagep, void **fsdata)
 {
 	pgoff_t index = pos >> PAGE_CACHE_SHIFT;
+	struct inode *inode = mapping->host;
+	struct page *page;
+	loff_t fsize;
+	int err;
 
-	*pagep = grab_cache_page_write_begin(mapping, index, flags);
-	if (!*pagep)
+	*pagep = page = grab_cache_page_write_begin(mapping, index, flags);
+	if (!page)
 		return -ENOMEM;
-	return 0;
+
+	if (!get_fuse_conn(inode)->writeback_cache)
+		return 0;
+
+	/* Don't dirty a page again while its previous contents are sent */
+	fuse_wait_on_page_writeback(inode, index);
+
+	if (PageUptodate(page) || len == PAGE_CACHE_SIZE)
+		return 0;
+
+	/* Nothing to read if the page starts at or beyond EOF */
+	fsize = i_size_read(inode);
+	if (fsize <= (pos & PAGE_CACHE_MASK)) {
+		unsigned off = pos & ~PAGE_CACHE_MASK;
+
+		if (off)
+			zero_user_segment(page, 0, off);
+		return 0;
+	}
+
+	err = fuse_do_readpage(file, page);
+	if (err) {
+		unlock_page(page);
+		page_cache_release(page);
+	}
+	return err;
 }
 
 void fuse_write_update_size(struct inode *inode, loff_t pos)
@@ -815,9 +927,28 @@ static int fuse_write_end(struct file *file, struct address_space *mapping,
 	struct inode *inode = mapping->host;
 	int res = 0;
 
-	if (copied)
+	if (get_fuse_conn(inode)->writeback_cache) {
+		/* A short copy into a page that was not read is retried */
+		if (!copied || (!PageUptodate(page) && copied < len))
+			goto out;
+
+		if (!PageUptodate(page)) {
+			/* Zero any unwritten bytes at the end of the page */
+			unsigned endoff = (pos + copied) & ~PAGE_CACHE_MASK;
+
+			if (endoff)
+				zero_user_segment(page, endoff,
+						  PAGE_CACHE_SIZE);
+			SetPageUptodate(page);
+		}
+		fuse_write_update_size(inode, pos + copied);
+		set_page_dirty(page);
+		res = copied;
+	} else if (copied) {
 		res = fuse_buffered_write(file, inode, pos, copied, page);
+	}
 
+ out:
 	unlock_page(page);
 	page_cache_release(page);
 	return res;
@@ -981,11 +1112,24 @@ static ssize_t fuse_file_aio_write(struct kiocb *iocb, const struct iovec *iov,
 	size_t count = 0;
 	ssize_t written = 0;
 	struct inode *inode = mapping->host;
+	struct fuse_file *ff = file->private_data;
 	ssize_t err;
 	struct iov_iter i;
 
 	WARN_ON(iocb->ki_pos != pos);
 
+	if (ff->passthrough_filp)
+		return fuse_passthrough_write(iocb, iov, nr_segs, pos);
+
+	if (get_fuse_conn(inode)->writeback_cache) {
+		/* Refresh the mode for suid clearing, the size is ours */
+		err = fuse_update_attributes(inode, NULL, file, NULL);
+		if (err)
+			return err;
+
+		return generic_file_aio_write(iocb, iov, nr_segs, pos);
+	}
+
 	err = generic_segment_checks(iov, &nr_segs, &count, VERIFY_READ);
 	if (err)
 		return err;
@@ -1174,7 +1318,10 @@ static ssize_t fuse_direct_write(struct file *file, const char __user *buf,
 
 static void fuse_writepage_free(struct fuse_conn *fc, struct fuse_req *req)
 {
-	__free_page(req->pages[0]);
+	unsigned i;
+
+	for (i = 0; i < req->num_pages; i++)
+		__free_page(req->pages[i]);
 	fuse_file_put(req->ff, false);
 }
 
@@ -1183,11 +1330,14 @@ static void fuse_writepage_finish(struct fuse_conn *fc, struct fuse_req *req)
 	struct inode *inode = req->inode;
 	struct fuse_inode *fi = get_fuse_inode(inode);
 	struct backing_dev_info *bdi = inode->i_mapping->backing_dev_info;
+	unsigned i;
 
 	list_del(&req->writepages_entry);
-	dec_bdi_stat(bdi, BDI_WRITEBACK);
-	dec_zone_page_state(req->pages[0], NR_WRITEBACK_TEMP);
-	bdi_writeout_inc(bdi);
+	for (i = 0; i < req->num_pages; i++) {
+		dec_bdi_stat(bdi, BDI_WRITEBACK);
+		dec_zone_page_state(req->pages[i], NR_WRITEBACK_TEMP);
+		bdi_writeout_inc(bdi);
+	}
 	wake_up(&fi->page_waitq);
 }
 
@@ -1199,14 +1349,15 @@ __acquires(fc->lock)
 	struct fuse_inode *fi = get_fuse_inode(req->inode);
 	loff_t size = i_size_read(req->inode);
 	struct fuse_write_in *inarg = &req->misc.write.in;
+	loff_t data_size = (loff_t)req->num_pages << PAGE_CACHE_SHIFT;
 
 	if (!fc->connected)
 		goto out_free;
 
-	if (inarg->offset + PAGE_CACHE_SIZE <= size) {
-		inarg->size = PAGE_CACHE_SIZE;
+	if (inarg->offset + data_size <= size) {
+		inarg->size = data_size;
 	} else if (inarg->offset < size) {
-		inarg->size = size & (PAGE_CACHE_SIZE - 1);
+		inarg->size = size - inarg->offset;
 	} else {
 		/* Got truncated off completely */
 		goto out_free;
@@ -1259,6 +1410,21 @@ static void fuse_writepage_end(struct fuse_conn *fc, struct fuse_req *req)
 	fuse_writepage_free(fc, req);
 }
 
+/* Any file open for writing will do to write back cached pages */
+static struct fuse_file *fuse_write_file_get(struct fuse_conn *fc,
+					     struct fuse_inode *fi)
+{
+	struct fuse_file *ff;
+
+	spin_lock(&fc->lock);
+	BUG_ON(list_empty(&fi->write_files));
+	ff = list_entry(fi->write_files.next, struct fuse_file, write_entry);
+	fuse_file_get(ff);
+	spin_unlock(&fc->lock);
+
+	return ff;
+}
+
 static int fuse_writepage_locked(struct page *page)
 {
 	struct address_space *mapping = page->mapping;
@@ -1279,11 +1445,7 @@ static int fuse_writepage_locked(struct page *page)
 	if (!tmp_page)
 		goto err_free;
 
-	spin_lock(&fc->lock);
-	BUG_ON(list_empty(&fi->write_files));
-	ff = list_entry(fi->write_files.next, struct fuse_file, write_entry);
-	req->ff = fuse_file_get(ff);
-	spin_unlock(&fc->lock);
+	req->ff = ff = fuse_write_file_get(fc, fi);
 
 	fuse_write_fill(req, ff, page_offset(page), 0);
 
@@ -1325,6 +1487,121 @@ static int fuse_writepage(struct page *page, struct writeback_control *wbc)
 	return err;
 }
 
+struct fuse_fill_wb_data {
+	struct fuse_req *req;
+	struct fuse_file *ff;
+	struct inode *inode;
+};
+
+static void fuse_writepages_send(struct fuse_fill_wb_data *data)
+{
+	struct inode *inode = data->inode;
+	struct fuse_conn *fc = get_fuse_conn(inode);
+	struct fuse_inode *fi = get_fuse_inode(inode);
+
+	spin_lock(&fc->lock);
+	list_add_tail(&data->req->list, &fi->queued_writes);
+	fuse_flush_writepages(inode);
+	spin_unlock(&fc->lock);
+	data->req = NULL;
+}
+
+/*
+ * Like fuse_writepage_locked(), but contiguous dirty pages are copied
+ * into one request, up to max_write bytes.
+ */
+static int fuse_writepages_fill(struct page *page,
+				struct writeback_control *wbc, void *_data)
+{
+	struct fuse_fill_wb_data *data = _data;
+	struct fuse_req *req = data->req;
+	struct inode *inode = data->inode;
+	struct fuse_conn *fc = get_fuse_conn(inode);
+	struct fuse_inode *fi = get_fuse_inode(inode);
+	struct page *tmp_page;
+	int err = -ENOMEM;
+
+	if (req &&
+	    (req->num_pages == FUSE_MAX_PAGES_PER_REQ || !fc->big_writes ||
+	     (req->num_pages + 1) * PAGE_CACHE_SIZE > fc->max_write ||
+	     (req->misc.write.in.offset >> PAGE_CACHE_SHIFT) +
+	     req->num_pages != page->index)) {
+		fuse_writepages_send(data);
+		req = NULL;
+	}
+
+	tmp_page = alloc_page(GFP_NOFS | __GFP_HIGHMEM);
+	if (!tmp_page)
+		goto out_unlock;
+
+	if (!req) {
+		req = fuse_request_alloc_nofs();
+		if (!req) {
+			__free_page(tmp_page);
+			goto out_unlock;
+		}
+
+		if (!data->ff)
+			data->ff = fuse_write_file_get(fc, fi);
+		req->ff = fuse_file_get(data->ff);
+
+		fuse_write_fill(req, data->ff, page_offset(page), 0);
+		req->misc.write.in.write_flags |= FUSE_WRITE_CACHE;
+		req->in.argpages = 1;
+		req->page_offset = 0;
+		req->end = fuse_writepage_end;
+		req->inode = inode;
+
+		spin_lock(&fc->lock);
+		list_add(&req->writepages_entry, &fi->writepages);
+		spin_unlock(&fc->lock);
+		data->req = req;
+	}
+
+	set_page_writeback(page);
+	copy_highpage(tmp_page, page);
+	req->pages[req->num_pages] = tmp_page;
+
+	inc_bdi_stat(page->mapping->backing_dev_info, BDI_WRITEBACK);
+	inc_zone_page_state(tmp_page, NR_WRITEBACK_TEMP);
+
+	/* Protected by fc->lock against fuse_page_is_writeback() */
+	spin_lock(&fc->lock);
+	req->num_pages++;
+	spin_unlock(&fc->lock);
+	end_page_writeback(page);
+	err = 0;
+
+ out_unlock:
+	if (err)
+		redirty_page_for_writepage(wbc, page);
+	unlock_page(page);
+	return err;
+}
+
+static int fuse_writepages(struct address_space *mapping,
+			   struct writeback_control *wbc)
+{
+	struct inode *inode = mapping->host;
+	struct fuse_fill_wb_data data;
+	int err;
+
+	if (is_bad_inode(inode))
+		return -EIO;
+
+	data.req = NULL;
+	data.ff = NULL;
+	data.inode = inode;
+
+	err = write_cache_pages(mapping, wbc, fuse_writepages_fill, &data);
+	if (data.req)
+		fuse_writepages_send(&data);
+	if (data.ff)
+		fuse_file_put(data.ff, false);
+
+	return err;
+}
+
 static int fuse_launder_page(struct page *page)
 {
 	int err = 0;
@@ -1370,6 +1647,8 @@ static int fuse_page_mkwrite(struct vm_area_struct *vma, struct vm_fault *vmf)
 	 */
 	struct inode *inode = vma->vm_file->f_mapping->host;
 
+	/* Only updates mtime with a writeback cache, see fuse_iget() */
+	file_update_time(vma->vm_file);
 	fuse_wait_on_page_writeback(inode, page->index);
 	return 0;
 }
@@ -1377,16 +1656,21 @@ static int fuse_page_mkwrite(struct vm_area_struct *vma, struct vm_fault *vmf)
 static const struct vm_operations_struct fuse_file_vm_ops = {
 	.close		= fuse_vma_close,
 	.fault		= filemap_fault,
+	.map_pages	= filemap_map_pages,
 	.page_mkwrite	= fuse_page_mkwrite,
 };
 
 static int fuse_file_mmap(struct file *file, struct vm_area_struct *vma)
 {
+	struct fuse_file *ff = file->private_data;
+
+	if (ff->passthrough_filp)
+		return fuse_passthrough_mmap(file, vma);
+
 	if ((vma->vm_flags & VM_SHARED) && (vma->vm_flags & VM_MAYWRITE)) {
 		struct inode *inode = file->f_dentry->d_inode;
 		struct fuse_conn *fc = get_fuse_conn(inode);
 		struct fuse_inode *fi = get_fuse_inode(inode);
-		struct fuse_file *ff = file->private_data;
 		/*
 		 * file may be written through mmap, so chain it onto the
 		 * inodes's write_file list
@@ -2171,6 +2455,7 @@ static const struct file_operations fuse_direct_io_file_operations = {
 static const struct address_space_operations fuse_file_aops  = {
 	.readpage	= fuse_readpage,
 	.writepage	= fuse_writepage,
+	.writepages	= fuse_writepages,
 	.launder_page	= fuse_launder_page,
 	.write_begin	= fuse_write_begin,
 	.write_end	= fuse_write_end,
@@ -22,6 +22,9 @@
 #include <linux/rbtree.h>
 #include <linux/poll.h>
 #include <linux/workqueue.h>
+#include <linux/idr.h>
+
+#define FUSE_SUPER_MAGIC 0x65735546
 
 /** Max number of pages that can be used in a single read request */
 #define FUSE_MAX_PAGES_PER_REQ 32
@@ -32,6 +35,9 @@
 /** It could be as large as PATH_MAX, but would that have any uses? */
 #define FUSE_NAME_MAX 1024
 
+/** Maximum number of /dev/fuse channels (request queues) per connection */
+#define FUSE_MAX_QUEUES 32
+
 /** Number of dentries for each connection in the control filesystem */
 #define FUSE_CTL_NUM_DENTRIES 5
 
@@ -135,6 +141,9 @@ struct fuse_file {
 
 	/** Wait queue head for poll */
 	wait_queue_head_t poll_wait;
+
+	/** Backing file serving read, write and mmap, if passthrough */
+	struct file *passthrough_filp;
 };
 
 /** One input argument of a request */
@@ -209,9 +218,12 @@ enum fuse_req_state {
  */
 struct fuse_req {
 	/** This can be on either pending processing or io lists in
-	    fuse_conn */
+	    fuse_queue, or on the bg_queue of fuse_conn */
 	struct list_head list;
 
+	/** The queue the request was sent on */
+	struct fuse_queue *q;
+
 	/** Entry on the interrupts list  */
 	struct list_head intr_entry;
 
@@ -224,7 +236,7 @@ struct fuse_req {
 	/*
 	 * The following bitfields are either set once before the
 	 * request is queued or setting/clearing them is protected by
-	 * fuse_conn->lock
+	 * the lock of the fuse_queue the request is on
 	 */
 
 	/** True if the request has reply */
@@ -307,6 +319,60 @@ struct fuse_req {
 
 	/** Request is stolen from fuse_file->reserved_req */
 	struct file *stolen_file;
+
+	/** Backing file passed in the reply to OPEN or CREATE */
+	struct file *passthrough_filp;
+};
+
+/**
+ * A request queue, served by one /dev/fuse channel.
+ *
+ * The file descriptor used for mounting is the first channel, more can
+ * be attached with the FUSE_DEV_IOC_CLONE ioctl.  Requests are queued
+ * on the channel of the submitting cpu, so daemon threads serving
+ * different channels do not contend on a single lock.  A reply must be
+ * written to the channel the request was read from.
+ */
+struct fuse_queue {
+	/** Lock protecting the lists below and the requests on them */
+	spinlock_t lock;
+
+	/** The connection this queue belongs to */
+	struct fuse_conn *fc;
+
+	/** Index in fc->queues */
+	unsigned id;
+
+	/** The channel was closed, no new requests may be queued */
+	unsigned dead:1;
+
+	/** Readers of the channel are waiting on this */
+	wait_queue_head_t waitq;
+
+	/** The list of pending requests */
+	struct list_head pending;
+
+	/** The list of requests being processed */
+	struct list_head processing;
+
+	/** The list of requests under I/O */
+	struct list_head io;
+
+	/** Pending interrupts */
+	struct list_head interrupts;
+
+	/** Queue of pending forgets */
+	struct fuse_forget_link forget_list_head;
+	struct fuse_forget_link *forget_list_tail;
+
+	/** Batching of FORGET requests (positive indicates FORGET batch) */
+	int forget_batch;
+
+	/** The last unique request id handed out on this queue */
+	u64 reqctr;
+
+	/** O_ASYNC requests */
+	struct fasync_struct *fasync;
 };
 
 /**
@@ -341,17 +407,17 @@ struct fuse_conn {
 	/** Maximum write size */
 	unsigned max_write;
 
-	/** Readers of the connection are waiting on this */
-	wait_queue_head_t waitq;
+	/** The request queues, added under lock and read locklessly */
+	struct fuse_queue *queues[FUSE_MAX_QUEUES];
 
-	/** The list of pending requests */
-	struct list_head pending;
+	/** Number of entries in queues */
+	unsigned nr_queues;
 
-	/** The list of requests being processed */
-	struct list_head processing;
+	/** Number of queues whose channel is still open, protected by lock */
+	unsigned live_queues;
 
-	/** The list of requests under I/O */
-	struct list_head io;
+	/** The queue of the channel used for mounting */
+	struct fuse_queue main_queue;
 
 	/** The next unique kernel file handle */
 	u64 khctr;
@@ -359,6 +425,9 @@ struct fuse_conn {
 	/** rbtree of fuse_files waiting for poll events indexed by ph */
 	struct rb_root polled_files;
 
+	/** Backing files registered for passthrough, protected by lock */
+	struct idr backing_files;
+
 	/** Maximum number of outstanding background requests */
 	unsigned max_background;
 
@@ -374,16 +443,6 @@ struct fuse_conn {
 	/** The list of background requests set aside for later queuing */
 	struct list_head bg_queue;
 
-	/** Pending interrupts */
-	struct list_head interrupts;
-
-	/** Queue of pending forgets */
-	struct fuse_forget_link forget_list_head;
-	struct fuse_forget_link *forget_list_tail;
-
-	/** Batching of FORGET requests (positive indicates FORGET batch) */
-	int forget_batch;
-
 	/** Flag indicating if connection is blocked.  This will be
 	    the case before the INIT reply is received, and if there
 	    are too many outstading backgrounds requests */
@@ -395,9 +454,6 @@ struct fuse_conn {
 	/** waitq for reserved requests */
 	wait_queue_head_t reserved_req_waitq;
 
-	/** The next unique request id */
-	u64 reqctr;
-
 	/** Connection established, cleared on umount, connection
 	    abort and device release */
 	unsigned connected;
@@ -472,6 +528,12 @@ struct fuse_conn {
 	/** Don't apply umask to creation modes */
 	unsigned dont_mask:1;
 
+	/** May files be opened in passthrough mode? */
+	unsigned passthrough:1;
+
+	/** Cache buffered writes, size and mtime are kept by the kernel */
+	unsigned writeback_cache:1;
+
 	/** The number of requests waiting for completion */
 	atomic_t num_waiting;
 
@@ -493,9 +555,6 @@ struct fuse_conn {
 	/** number of dentries used in the above array */
 	int ctl_ndents;
 
-	/** O_ASYNC requests */
-	struct fasync_struct *fasync;
-
 	/** Key for lock owner ID scrambling */
 	u32 scramble_key[4];
 
@@ -702,6 +761,11 @@ void fuse_conn_kill(struct fuse_conn *fc);
  */
 void fuse_conn_init(struct fuse_conn *fc);
 
+/**
+ * Initialize a request queue of fuse_conn
+ */
+void fuse_queue_init(struct fuse_queue *q, struct fuse_conn *fc, unsigned id);
+
 /**
  * Release reference to fuse_conn
  */
@@ -763,4 +827,25 @@ int fuse_dev_release(struct inode *inode, struct file *file);
 
 void fuse_write_update_size(struct inode *inode, loff_t pos);
 
+/**
+ * Send the locally updated mtime of a writeback cached file
+ */
+int fuse_flush_mtime(struct inode *inode);
+
+/**
+ * Passthrough of read, write and mmap to a backing file, see passthrough.c
+ */
+int fuse_passthrough_register(struct fuse_conn *fc, int fd);
+int fuse_passthrough_unregister(struct fuse_conn *fc, int id);
+void fuse_passthrough_conn_release(struct fuse_conn *fc);
+void fuse_passthrough_setup(struct fuse_conn *fc, struct fuse_req *req);
+void fuse_passthrough_open(struct fuse_file *ff, struct fuse_req *req,
+			   fmode_t mode);
+void fuse_passthrough_release(struct fuse_file *ff);
+ssize_t fuse_passthrough_read(struct kiocb *iocb, const struct iovec *iov,
+			      unsigned long nr_segs, loff_t pos);
+ssize_t fuse_passthrough_write(struct kiocb *iocb, const struct iovec *iov,
+			       unsigned long nr_segs, loff_t pos);
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma);
+
 #endif /* _FS_FUSE_I_H */
@@ -0,0 +1,305 @@
+/*
+  FUSE: Filesystem in Userspace
+  Passthrough of read, write and mmap to a backing file
+
+  This program can be distributed under the terms of the GNU GPL.
+  See the file COPYING.
+*/
+
+/*
+ * Passthrough: a filesystem that only relays data to a file on another
+ * filesystem may register that file with FUSE_DEV_IOC_BACKING_OPEN and
+ * name it in the reply to OPEN or CREATE.  Read, write and mmap of the
+ * FUSE file are then served from the backing file directly, without a
+ * round trip to the daemon.
+ *
+ * Lookup, permission checking, attributes, flush, fsync, locks and
+ * release still go through the daemon.  The backing file was opened by
+ * the daemon, so the I/O is checked and done with the credentials it
+ * was opened with, as if the daemon did it.
+ */
+
+#include "fuse_i.h"
+
+#include <linux/fs.h>
+#include <linux/file.h>
+#include <linux/cred.h>
+#include <linux/pagemap.h>
+#include <linux/fsnotify.h>
+#include <linux/uio.h>
+
+static struct fuse_open_out *passthrough_open_out(struct fuse_req *req)
+{
+	switch (req->in.h.opcode) {
+	case FUSE_OPEN:
+		return req->out.args[0].value;
+	case FUSE_CREATE:
+		return req->out.args[1].value;
+	default:
+		return NULL;
+	}
+}
+
+static bool passthrough_usable(struct file *lower)
+{
+	struct inode *inode = lower->f_path.dentry->d_inode;
+
+	if (!S_ISREG(inode->i_mode))
+		return false;
+	if (!lower->f_op || !lower->f_op->aio_read || !lower->f_op->aio_write)
+		return false;
+	/* No stacking, a FUSE file could lead back to this daemon */
+	if (inode->i_sb->s_magic == FUSE_SUPER_MAGIC)
+		return false;
+
+	return true;
+}
+
+/*
+ * The backing file is looked up by the daemon in an ioctl rather than
+ * from the reply, as a write to /dev/fuse may be done by any process the
+ * daemon hands the descriptor to, and the reply would then name a file
+ * descriptor of that process.
+ */
+int fuse_passthrough_register(struct fuse_conn *fc, int fd)
+{
+	struct file *lower;
+	int id, err;
+
+	if (!fc->passthrough)
+		return -EOPNOTSUPP;
+
+	lower = fget(fd);
+	if (!lower)
+		return -EBADF;
+
+	err = -EINVAL;
+	if (!passthrough_usable(lower))
+		goto out_fput;
+
+	do {
+		err = -ENOMEM;
+		if (!idr_pre_get(&fc->backing_files, GFP_KERNEL))
+			goto out_fput;
+		spin_lock(&fc->lock);
+		err = idr_get_new_above(&fc->backing_files, lower, 1, &id);
+		spin_unlock(&fc->lock);
+	} while (err == -EAGAIN);
+	if (err)
+		goto out_fput;
+
+	return id;
+
+ out_fput:
+	fput(lower);
+	return err;
+}
+
+int fuse_passthrough_unregister(struct fuse_conn *fc, int id)
+{
+	struct file *lower = NULL;
+
+	spin_lock(&fc->lock);
+	if (id > 0)
+		lower = idr_find(&fc->backing_files, id);
+	if (lower)
+		idr_remove(&fc->backing_files, id);
+	spin_unlock(&fc->lock);
+
+	if (!lower)
+		return -ENOENT;
+
+	fput(lower);
+	return 0;
+}
+
+static int passthrough_put_backing(int id, void *p, void *data)
+{
+	fput(p);
+	return 0;
+}
+
+void fuse_passthrough_conn_release(struct fuse_conn *fc)
+{
+	idr_for_each(&fc->backing_files, passthrough_put_backing, NULL);
+	idr_remove_all(&fc->backing_files);
+	idr_destroy(&fc->backing_files);
+}
+
+/*
+ * Called from the write to /dev/fuse carrying the reply.  The request is
+ * still locked, so an aborted requester waits for this to finish before
+ * looking at the result.
+ */
+void fuse_passthrough_setup(struct fuse_conn *fc, struct fuse_req *req)
+{
+	struct fuse_open_out *outarg;
+	struct file *lower = NULL;
+
+	if (req->out.h.error)
+		return;
+
+	outarg = passthrough_open_out(req);
+	if (!outarg || !(outarg->open_flags & FOPEN_PASSTHROUGH))
+		return;
+
+	/* Fall back to normal I/O unless the backing file is there */
+	outarg->open_flags &= ~FOPEN_PASSTHROUGH;
+
+	spin_lock(&fc->lock);
+	if (outarg->backing_id > 0)
+		lower = idr_find(&fc->backing_files, outarg->backing_id);
+	if (lower)
+		get_file(lower);
+	spin_unlock(&fc->lock);
+	if (!lower)
+		return;
+
+	outarg->open_flags |= FOPEN_PASSTHROUGH;
+	req->passthrough_filp = lower;
+}
+
+/*
+ * Called by the opener after the OPEN or CREATE request has finished:
+ * take over the backing file, provided it was opened with at least the
+ * access @mode of the FUSE file.
+ */
+void fuse_passthrough_open(struct fuse_file *ff, struct fuse_req *req,
+			   fmode_t mode)
+{
+	struct file *lower = req->passthrough_filp;
+
+	if (!lower)
+		return;
+
+	mode &= FMODE_READ | FMODE_WRITE;
+	req->passthrough_filp = NULL;
+	if (req->out.h.error || (lower->f_mode & mode) != mode) {
+		fput(lower);
+		return;
+	}
+
+	ff->passthrough_filp = lower;
+}
+
+void fuse_passthrough_release(struct fuse_file *ff)
+{
+	if (ff->passthrough_filp) {
+		fput(ff->passthrough_filp);
+		ff->passthrough_filp = NULL;
+	}
+}
+
+static ssize_t passthrough_rw(struct kiocb *iocb, const struct iovec *iov,
+			      unsigned long nr_segs, loff_t pos, int write)
+{
+	struct fuse_file *ff = iocb->ki_filp->private_data;
+	struct file *lower = ff->passthrough_filp;
+	const struct cred *old_cred;
+	struct kiocb kiocb;
+	ssize_t ret;
+
+	old_cred = override_creds(lower->f_cred);
+
+	/* Mandatory locks and the LSM, as in vfs_read() and vfs_write() */
+	ret = rw_verify_area(write ? WRITE : READ, lower, &pos,
+			     iov_length(iov, nr_segs));
+	if (ret < 0)
+		goto out;
+
+	init_sync_kiocb(&kiocb, lower);
+	kiocb.ki_pos = pos;
+	kiocb.ki_left = iov_length(iov, nr_segs);
+	kiocb.ki_nbytes = kiocb.ki_left;
+
+	if (write)
+		ret = lower->f_op->aio_write(&kiocb, iov, nr_segs, kiocb.ki_pos);
+	else
+		ret = lower->f_op->aio_read(&kiocb, iov, nr_segs, kiocb.ki_pos);
+	if (ret == -EIOCBQUEUED)
+		ret = wait_on_sync_kiocb(&kiocb);
+	iocb->ki_pos = kiocb.ki_pos;
+
+	if (ret > 0) {
+		if (write)
+			fsnotify_modify(lower);
+		else
+			fsnotify_access(lower);
+	}
+ out:
+	revert_creds(old_cred);
+	return ret;
+}
+
+ssize_t fuse_passthrough_read(struct kiocb *iocb, const struct iovec *iov,
+			      unsigned long nr_segs, loff_t pos)
+{
+	struct inode *inode = iocb->ki_filp->f_mapping->host;
+	ssize_t ret;
+
+	ret = passthrough_rw(iocb, iov, nr_segs, pos, 0);
+	/* atime may have changed */
+	fuse_invalidate_attr(inode);
+
+	return ret;
+}
+
+ssize_t fuse_passthrough_write(struct kiocb *iocb, const struct iovec *iov,
+			       unsigned long nr_segs, loff_t pos)
+{
+	struct file *file = iocb->ki_filp;
+	struct fuse_file *ff = file->private_data;
+	struct inode *inode = file->f_mapping->host;
+	struct inode *lower_inode = ff->passthrough_filp->f_mapping->host;
+	ssize_t ret;
+
+	mutex_lock(&inode->i_mutex);
+	/* The backing file need not have been opened with O_APPEND */
+	if (file->f_flags & O_APPEND)
+		pos = i_size_read(lower_inode);
+
+	ret = passthrough_rw(iocb, iov, nr_segs, pos, 1);
+	if (ret > 0) {
+		fuse_write_update_size(inode, iocb->ki_pos);
+		/* Drop data cached by other, non-passthrough opens */
+		if (inode->i_mapping->nrpages)
+			invalidate_inode_pages2_range(inode->i_mapping,
+					pos >> PAGE_CACHE_SHIFT,
+					(iocb->ki_pos - 1) >> PAGE_CACHE_SHIFT);
+	}
+	/* The daemon stays authoritative for size and times */
+	fuse_invalidate_attr(inode);
+	mutex_unlock(&inode->i_mutex);
+
+	return ret;
+}
+
+/*
+ * Map the backing file instead of the FUSE file, so page faults are
+ * served from its page cache.
+ */
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct fuse_file *ff = file->private_data;
+	struct file *lower = ff->passthrough_filp;
+	int err;
+
+	if (!lower->f_op->mmap)
+		return -ENODEV;
+
+	/* The backing file's mmap may look at vm_file, switch it first */
+	get_file(lower);
+	vma->vm_file = lower;
+
+	err = lower->f_op->mmap(lower, vma);
+	if (err) {
+		/* mmap_region() drops its reference to file on error */
+		vma->vm_file = file;
+		fput(lower);
+		return err;
+	}
+
+	/* The vma keeps the reference to lower, not the one mmap_region() took */
+	fput(file);
+	return 0;
+}
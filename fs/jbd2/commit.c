@@ -21,6 +21,7 @@
 #include <linux/mm.h>
 #include <linux/pagemap.h>
 #include <linux/jiffies.h>
+#include <linux/ktime.h>
 #include <linux/crc32.h>
 #include <linux/writeback.h>
 #include <linux/backing-dev.h>
@@ -302,6 +303,16 @@ static void write_tag_block(int tag_bytes, journal_block_tag_t *tag,
 		tag->t_blocknr_high = cpu_to_be32((block >> 31) >> 1);
 }
 
+/* Microseconds since *phase, which is moved on to now */
+static u64 jbd2_phase_us(ktime_t *phase)
+{
+	ktime_t now = ktime_get();
+	u64 us = ktime_us_delta(now, *phase);
+
+	*phase = now;
+	return us;
+}
+
 /*
  * jbd2_journal_commit_transaction
  *
@@ -318,7 +329,7 @@ void jbd2_journal_commit_transaction(journal_t *journal)
 	int flags;
 	int err;
 	unsigned long long blocknr;
-	ktime_t start_time;
+	ktime_t start_time, phase;
 	u64 commit_time;
 	char *tagp = NULL;
 	journal_header_t *header;
@@ -363,6 +374,7 @@ void jbd2_journal_commit_transaction(journal_t *journal)
 	stats.run.rs_locked = jiffies;
 	stats.run.rs_running = jbd2_time_diff(commit_transaction->t_start,
 					      stats.run.rs_locked);
+	phase = ktime_get();
 
 	spin_lock(&commit_transaction->t_handle_lock);
 	while (atomic_read(&commit_transaction->t_updates)) {
@@ -418,15 +430,6 @@ void jbd2_journal_commit_transaction(journal_t *journal)
 		jbd2_journal_refile_buffer(journal, jh);
 	}
 
-	/*
-	 * Now try to drop any written-back buffers from the journal's
-	 * checkpoint lists.  We do this *before* commit because it potentially
-	 * frees some memory
-	 */
-	spin_lock(&journal->j_list_lock);
-	__jbd2_journal_clean_checkpoint_list(journal);
-	spin_unlock(&journal->j_list_lock);
-
 	jbd_debug (3, "JBD: commit phase 1\n");
 
 	/*
@@ -444,23 +447,36 @@ void jbd2_journal_commit_transaction(journal_t *journal)
 	journal->j_running_transaction = NULL;
 	start_time = ktime_get();
 	commit_transaction->t_log_start = journal->j_head;
+	stats.run.rs_lock_us = jbd2_phase_us(&phase);
 	wake_up(&journal->j_wait_transaction_locked);
 	write_unlock(&journal->j_state_lock);
 
+	/*
+	 * New handles go to the next transaction from here on, so
+	 * everything below overlaps with it running.
+	 *
+	 * Now try to drop any written-back buffers from the journal's
+	 * checkpoint lists.  We do this *before* commit because it potentially
+	 * frees some memory
+	 */
+	spin_lock(&journal->j_list_lock);
+	__jbd2_journal_clean_checkpoint_list(journal);
+	spin_unlock(&journal->j_list_lock);
+
 	jbd_debug (3, "JBD: commit phase 2\n");
 
 	/*
 	 * Now start flushing things to disk, in the order they appear
-	 * on the transaction lists.  Data blocks go first.
+	 * on the transaction lists.  Data blocks go first.  All writes of
+	 * the commit are plugged together, up to the commit record.
 	 */
+	blk_start_plug(&plug);
 	err = journal_submit_data_buffers(journal, commit_transaction);
 	if (err)
 		jbd2_journal_abort(journal, err);
 
-	blk_start_plug(&plug);
 	jbd2_journal_write_revoke_records(journal, commit_transaction,
 					  WRITE_SYNC);
-	blk_finish_plug(&plug);
 
 	jbd_debug(3, "JBD: commit phase 2\n");
 
@@ -487,7 +503,6 @@ void jbd2_journal_commit_transaction(journal_t *journal)
 	err = 0;
 	descriptor = NULL;
 	bufs = 0;
-	blk_start_plug(&plug);
 	while (commit_transaction->t_buffers) {
 
 		/* Find the next buffer to be journaled... */
@@ -661,7 +676,10 @@ start_journal_io:
 		}
 	}
 
+	stats.run.rs_submit_us = jbd2_phase_us(&phase);
+
 	err = journal_finish_inode_data_buffers(journal, commit_transaction);
+	stats.run.rs_data_wait_us = jbd2_phase_us(&phase);
 	if (err) {
 		printk(KERN_WARNING
 			"JBD2: Detected IO errors while flushing file data "
@@ -702,9 +720,10 @@ start_journal_io:
            transaction's t_log_list queue, and metadata buffers are on
            the t_iobuf_list queue.
 
-	   Wait for the buffers in reverse order.  That way we are
-	   less likely to be woken up until all IOs have completed, and
-	   so we incur less scheduling load.
+	   Wait for the metadata buffers in the order they were submitted,
+	   so that each shadowed buffer is handed back as soon as its own
+	   write is done: handles of the running transaction that want to
+	   modify it are blocked until then.
 	*/
 
 	jbd_debug(3, "JBD: commit phase 3\n");
@@ -717,7 +736,7 @@ wait_for_iobuf:
 	while (commit_transaction->t_iobuf_list != NULL) {
 		struct buffer_head *bh;
 
-		jh = commit_transaction->t_iobuf_list->b_tprev;
+		jh = commit_transaction->t_iobuf_list;
 		bh = jh2bh(jh);
 		if (buffer_locked(bh)) {
 			wait_on_buffer(bh);
@@ -746,7 +765,7 @@ wait_for_iobuf:
 
 		/* We also have to unlock and free the corresponding
                    shadowed buffer */
-		jh = commit_transaction->t_shadow_list->b_tprev;
+		jh = commit_transaction->t_shadow_list;
 		bh = jh2bh(jh);
 		clear_bit(BH_JWrite, &bh->b_state);
 		J_ASSERT_BH(bh, buffer_jbddirty(bh));
@@ -800,6 +819,7 @@ wait_for_iobuf:
 
 	if (err)
 		jbd2_journal_abort(journal, err);
+	stats.run.rs_log_wait_us = jbd2_phase_us(&phase);
 
 	jbd_debug(3, "JBD: commit phase 5\n");
 	write_lock(&journal->j_state_lock);
@@ -824,6 +844,7 @@ wait_for_iobuf:
 
 	if (err)
 		jbd2_journal_abort(journal, err);
+	stats.run.rs_commit_us = jbd2_phase_us(&phase);
 
 	/* End of a transaction!  Finally, we can do checkpoint
            processing: any buffers committed as a result of this
@@ -971,6 +992,7 @@ restart_loop:
 	commit_transaction->t_start = jiffies;
 	stats.run.rs_logging = jbd2_time_diff(stats.run.rs_logging,
 					      commit_transaction->t_start);
+	stats.run.rs_checkpoint_us = jbd2_phase_us(&phase);
 
 	/*
 	 * File the transaction statistics
@@ -994,6 +1016,12 @@ restart_loop:
 	journal->j_stats.run.rs_handle_count += stats.run.rs_handle_count;
 	journal->j_stats.run.rs_blocks += stats.run.rs_blocks;
 	journal->j_stats.run.rs_blocks_logged += stats.run.rs_blocks_logged;
+	journal->j_stats.run.rs_lock_us += stats.run.rs_lock_us;
+	journal->j_stats.run.rs_submit_us += stats.run.rs_submit_us;
+	journal->j_stats.run.rs_data_wait_us += stats.run.rs_data_wait_us;
+	journal->j_stats.run.rs_log_wait_us += stats.run.rs_log_wait_us;
+	journal->j_stats.run.rs_commit_us += stats.run.rs_commit_us;
+	journal->j_stats.run.rs_checkpoint_us += stats.run.rs_checkpoint_us;
 	spin_unlock(&journal->j_history_lock);
 
 	commit_transaction->t_state = T_FINISHED;
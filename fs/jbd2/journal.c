@@ -75,6 +75,8 @@ EXPORT_SYMBOL(jbd2_journal_update_format);
 EXPORT_SYMBOL(jbd2_journal_check_used_features);
 EXPORT_SYMBOL(jbd2_journal_check_available_features);
 EXPORT_SYMBOL(jbd2_journal_set_features);
+EXPORT_SYMBOL(jbd2_journal_set_fc_blocks);
+EXPORT_SYMBOL(jbd2_journal_fc_buf);
 EXPORT_SYMBOL(jbd2_journal_load);
 EXPORT_SYMBOL(jbd2_journal_destroy);
 EXPORT_SYMBOL(jbd2_journal_abort);
@@ -712,6 +714,93 @@ int jbd2_journal_bmap(journal_t *journal, unsigned long blocknr,
 	return err;
 }
 
+/*
+ * Fast commit area
+ *
+ * With the FC_AREA feature the last s_fc_area_blks blocks of the
+ * journal are not part of the circular log.  The client file system
+ * writes its own records there to make single inodes durable without
+ * committing the running transaction; jbd2 only reserves the space and
+ * hands out buffers for it.
+ */
+
+static unsigned int journal_fc_blocks(journal_superblock_t *sb)
+{
+	if (!(sb->s_feature_incompat &
+	      cpu_to_be32(JBD2_FEATURE_INCOMPAT_FC_AREA)))
+		return 0;
+	return be32_to_cpu(sb->s_fc_area_blks);
+}
+
+/**
+ * int jbd2_journal_set_fc_blocks() - Reserve room for fast commits
+ * @journal: Journal to act on.
+ * @nblocks: Number of blocks to reserve, 0 to drop the fast commit area.
+ *
+ * Must be called right after jbd2_journal_load(), while the log is still
+ * empty, since it moves the end of the log.
+ */
+int jbd2_journal_set_fc_blocks(journal_t *journal, unsigned int nblocks)
+{
+	journal_superblock_t *sb = journal->j_superblock;
+	unsigned long maxlen = be32_to_cpu(sb->s_maxlen);
+	int err = 0;
+
+	if (nblocks == journal_fc_blocks(sb))
+		return 0;
+	if (journal->j_format_version < 2)
+		return -EINVAL;
+	if (journal->j_first + JBD2_MIN_JOURNAL_BLOCKS + nblocks > maxlen + 1)
+		return -ENOSPC;
+
+	write_lock(&journal->j_state_lock);
+	if (journal->j_running_transaction ||
+	    journal->j_committing_transaction ||
+	    journal->j_head != journal->j_tail) {
+		err = -EBUSY;
+		goto out;
+	}
+
+	if (nblocks) {
+		sb->s_feature_incompat |=
+			cpu_to_be32(JBD2_FEATURE_INCOMPAT_FC_AREA);
+	} else {
+		sb->s_feature_incompat &=
+			~cpu_to_be32(JBD2_FEATURE_INCOMPAT_FC_AREA);
+	}
+	sb->s_fc_area_blks = cpu_to_be32(nblocks);
+
+	journal->j_last = maxlen - nblocks;
+	journal->j_fc_last = maxlen;
+	journal->j_head = journal->j_first;
+	journal->j_tail = journal->j_first;
+	journal->j_free = journal->j_last - journal->j_first;
+out:
+	write_unlock(&journal->j_state_lock);
+	if (!err)
+		jbd2_journal_update_superblock(journal, 1);
+	return err;
+}
+
+/**
+ * struct buffer_head *jbd2_journal_fc_buf() - Get a fast commit block
+ * @journal: Journal to act on.
+ * @off: Block offset into the fast commit area.
+ *
+ * Returns the buffer for the block, or NULL if @off is outside the area
+ * or the block cannot be mapped.  The buffer is not read in.
+ */
+struct buffer_head *jbd2_journal_fc_buf(journal_t *journal, unsigned int off)
+{
+	unsigned long long blocknr;
+
+	if (journal->j_last + off >= journal->j_fc_last)
+		return NULL;
+	if (jbd2_journal_bmap(journal, journal->j_last + off, &blocknr))
+		return NULL;
+	return __getblk(journal->j_dev, blocknr, journal->j_blocksize);
+}
+
 /*
  * We play buffer_head aliasing tricks to write data/metadata blocks to
  * the journal without copying their contents, but for journal
@@ -790,6 +879,19 @@ static int jbd2_seq_info_show(struct seq_file *seq, void *v)
 	    s->stats->run.rs_blocks / s->stats->ts_tid);
 	seq_printf(seq, "  %lu logged blocks per transaction\n",
 	    s->stats->run.rs_blocks_logged / s->stats->ts_tid);
+	seq_printf(seq, "commit phases (average):\n");
+	seq_printf(seq, "  %lluus locked, new handles held off\n",
+	    div_u64(s->stats->run.rs_lock_us, s->stats->ts_tid));
+	seq_printf(seq, "  %lluus submitting data and log blocks\n",
+	    div_u64(s->stats->run.rs_submit_us, s->stats->ts_tid));
+	seq_printf(seq, "  %lluus waiting for data\n",
+	    div_u64(s->stats->run.rs_data_wait_us, s->stats->ts_tid));
+	seq_printf(seq, "  %lluus waiting for log blocks\n",
+	    div_u64(s->stats->run.rs_log_wait_us, s->stats->ts_tid));
+	seq_printf(seq, "  %lluus writing commit block and flushing\n",
+	    div_u64(s->stats->run.rs_commit_us, s->stats->ts_tid));
+	seq_printf(seq, "  %lluus filing buffers for checkpoint\n",
+	    div_u64(s->stats->run.rs_checkpoint_us, s->stats->ts_tid));
 	return 0;
 }
 
@@ -1091,7 +1193,7 @@ static int journal_reset(journal_t *journal)
 	unsigned long long first, last;
 
 	first = be32_to_cpu(sb->s_first);
-	last = be32_to_cpu(sb->s_maxlen);
+	last = be32_to_cpu(sb->s_maxlen) - journal_fc_blocks(sb);
 	if (first + JBD2_MIN_JOURNAL_BLOCKS > last + 1) {
 		printk(KERN_ERR "JBD: Journal too short (blocks %llu-%llu).\n",
 		       first, last);
@@ -1101,6 +1203,7 @@ static int journal_reset(journal_t *journal)
 
 	journal->j_first = first;
 	journal->j_last = last;
+	journal->j_fc_last = be32_to_cpu(sb->s_maxlen);
 
 	journal->j_head = first;
 	journal->j_tail = first;
@@ -1277,7 +1380,9 @@ static int load_superblock(journal_t *journal)
 	journal->j_tail_sequence = be32_to_cpu(sb->s_sequence);
 	journal->j_tail = be32_to_cpu(sb->s_start);
 	journal->j_first = be32_to_cpu(sb->s_first);
-	journal->j_last = be32_to_cpu(sb->s_maxlen);
+	journal->j_fc_last = be32_to_cpu(sb->s_maxlen);
+	/* Recovery must wrap the log where it was wrapped when written */
+	journal->j_last = journal->j_fc_last - journal_fc_blocks(sb);
 	journal->j_errno = be32_to_cpu(sb->s_errno);
 
 	return 0;
@@ -20,6 +20,7 @@
 #include <linux/audit.h>
 #include <linux/syscalls.h>
 #include <linux/fcntl.h>
+#include <linux/vmstat.h>
 
 #include <asm/uaccess.h>
 #include <asm/ioctls.h>
@@ -35,6 +36,20 @@ unsigned int pipe_max_size = 1048576;
  */
 unsigned int pipe_min_size = PAGE_SIZE;
 
+/*
+ * Pipes stop growing on their own once the pipes of their user hold this
+ * many buffer slots in total. Can be set by root in
+ * /proc/sys/fs/pipe-user-pages, zero turns automatic growth off
+ */
+unsigned long pipe_user_pages = PIPE_DEF_BUFFERS * 1024;
+
+/*
+ * A pipe whose writer finds it full PIPE_GROW_FILLS times within
+ * PIPE_GROW_WINDOW is streaming, see pipe_autogrow()
+ */
+#define PIPE_GROW_FILLS		4
+#define PIPE_GROW_WINDOW	(HZ / 10)
+
 /*
  * We use a start+len construction, which provides full use of the 
  * allocated memory.
@@ -601,6 +616,8 @@ redo2:
 		}
 		if (bufs < pipe->buffers)
 			continue;
+		if (pipe_autogrow(pipe))
+			continue;
 		if (filp->f_flags & O_NONBLOCK) {
 			if (!ret)
 				ret = -EAGAIN;
@@ -902,6 +919,8 @@ struct pipe_inode_info * alloc_pipe_info(struct inode *inode)
 			pipe->r_counter = pipe->w_counter = 1;
 			pipe->inode = inode;
 			pipe->buffers = PIPE_DEF_BUFFERS;
+			pipe->user = get_uid(current_user());
+			atomic_long_add(PIPE_DEF_BUFFERS, &pipe->user->pipe_bufs);
 			return pipe;
 		}
 		kfree(pipe);
@@ -921,6 +940,8 @@ void __free_pipe_info(struct pipe_inode_info *pipe)
 	}
 	if (pipe->tmp_page)
 		__free_page(pipe->tmp_page);
+	atomic_long_sub(pipe->buffers, &pipe->user->pipe_bufs);
+	free_uid(pipe->user);
 	kfree(pipe->bufs);
 	kfree(pipe);
 }
@@ -1165,10 +1186,46 @@ static long pipe_set_size(struct pipe_inode_info *pipe, unsigned long nr_pages)
 	pipe->curbuf = 0;
 	kfree(pipe->bufs);
 	pipe->bufs = bufs;
+	atomic_long_add((long)nr_pages - pipe->buffers, &pipe->user->pipe_bufs);
 	pipe->buffers = nr_pages;
 	return nr_pages * PAGE_SIZE;
 }
 
+/*
+ * Called with the pipe locked by a writer that found it full. A pipe
+ * that keeps filling up faster than its reader drains it is better off
+ * with more room, so that every wakeup of either side moves more data:
+ * double its size, up to pipe-max-size for the pipe and pipe-user-pages
+ * for all the pipes of its user. Pipes sized with F_SETPIPE_SZ and the
+ * internal pipes of splice are left alone. Returns 1 if the pipe grew.
+ */
+int pipe_autogrow(struct pipe_inode_info *pipe)
+{
+	unsigned int nr_pages = pipe->buffers * 2;
+
+	if (!pipe->inode || pipe->fixed_size)
+		return 0;
+
+	if (time_after(jiffies, pipe->fill_stamp + PIPE_GROW_WINDOW)) {
+		pipe->fill_stamp = jiffies;
+		pipe->fills = 0;
+	}
+	if (++pipe->fills < PIPE_GROW_FILLS)
+		return 0;
+
+	if (nr_pages > pipe_max_size >> PAGE_SHIFT ||
+	    atomic_long_read(&pipe->user->pipe_bufs) + pipe->buffers >
+							pipe_user_pages)
+		return 0;
+
+	if (pipe_set_size(pipe, nr_pages) < 0)
+		return 0;
+
+	pipe->fills = 0;
+	count_vm_event(PIPE_GROW);
+	return 1;
+}
+
 /*
  * Currently we rely on the pipe array holding a power-of-2 number
  * of pages.
@@ -1237,6 +1294,8 @@ long pipe_fcntl(struct file *file, unsigned int cmd, unsigned long arg)
 			goto out;
 		}
 		ret = pipe_set_size(pipe, nr_pages);
+		if (ret > 0)
+			pipe->fixed_size = 1;
 		break;
 		}
 	case F_GETPIPE_SZ:
@@ -11,6 +11,7 @@
 #include <linux/rmap.h>
 #include <linux/swap.h>
 #include <linux/swapops.h>
+#include <linux/vma_stats.h>
 
 #include <asm/elf.h>
 #include <asm/uaccess.h>
@@ -338,6 +339,7 @@ struct mem_size_stats {
 	unsigned long anonymous_thp;
 	unsigned long swap;
 	u64 pss;
+	u64 pss_locked;
 };
 
 
@@ -420,28 +422,30 @@ static int smaps_pte_range(pmd_t *pmd, unsigned long addr, unsigned long end,
 	return 0;
 }
 
-static int show_smap(struct seq_file *m, void *v)
+/*
+ * Add the pages of vma to mss.  The caller holds mmap_sem and zeroes mss
+ * once, so that the pages of several vmas can be added up.
+ */
+static void smaps_walk_vma(struct vm_area_struct *vma,
+			   struct mem_size_stats *mss)
 {
-	struct proc_maps_private *priv = m->private;
-	struct task_struct *task = priv->task;
-	struct vm_area_struct *vma = v;
-	struct mem_size_stats mss;
 	struct mm_walk smaps_walk = {
 		.pmd_entry = smaps_pte_range,
 		.mm = vma->vm_mm,
-		.private = &mss,
+		.private = mss,
 	};
+	u64 pss = mss->pss;
 
-	memset(&mss, 0, sizeof mss);
-	mss.vma = vma;
-	/* mmap_sem is held in m_start */
+	mss->vma = vma;
 	if (vma->vm_mm && !is_vm_hugetlb_page(vma))
 		walk_page_range(vma->vm_start, vma->vm_end, &smaps_walk);
+	if (vma->vm_flags & VM_LOCKED)
+		mss->pss_locked += mss->pss - pss;
+}
 
-	show_map_vma(m, vma);
-
+static void show_smap_counters(struct seq_file *m, struct mem_size_stats *mss)
+{
 	seq_printf(m,
-		   "Size:           %8lu kB\n"
 		   "Rss:            %8lu kB\n"
 		   "Pss:            %8lu kB\n"
 		   "Shared_Clean:   %8lu kB\n"
@@ -451,25 +455,42 @@ static int show_smap(struct seq_file *m, void *v)
 		   "Referenced:     %8lu kB\n"
 		   "Anonymous:      %8lu kB\n"
 		   "AnonHugePages:  %8lu kB\n"
-		   "Swap:           %8lu kB\n"
+		   "Swap:           %8lu kB\n",
+		   mss->resident >> 10,
+		   (unsigned long)(mss->pss >> (10 + PSS_SHIFT)),
+		   mss->shared_clean  >> 10,
+		   mss->shared_dirty  >> 10,
+		   mss->private_clean >> 10,
+		   mss->private_dirty >> 10,
+		   mss->referenced >> 10,
+		   mss->anonymous >> 10,
+		   mss->anonymous_thp >> 10,
+		   mss->swap >> 10);
+}
+
+static int show_smap(struct seq_file *m, void *v)
+{
+	struct proc_maps_private *priv = m->private;
+	struct task_struct *task = priv->task;
+	struct vm_area_struct *vma = v;
+	struct mem_size_stats mss;
+
+	memset(&mss, 0, sizeof mss);
+	/* mmap_sem is held in m_start */
+	smaps_walk_vma(vma, &mss);
+
+	show_map_vma(m, vma);
+
+	seq_printf(m, "Size:           %8lu kB\n",
+		   (vma->vm_end - vma->vm_start) >> 10);
+	show_smap_counters(m, &mss);
+	seq_printf(m,
 		   "KernelPageSize: %8lu kB\n"
 		   "MMUPageSize:    %8lu kB\n"
 		   "Locked:         %8lu kB\n",
-		   (vma->vm_end - vma->vm_start) >> 10,
-		   mss.resident >> 10,
-		   (unsigned long)(mss.pss >> (10 + PSS_SHIFT)),
-		   mss.shared_clean  >> 10,
-		   mss.shared_dirty  >> 10,
-		   mss.private_clean >> 10,
-		   mss.private_dirty >> 10,
-		   mss.referenced >> 10,
-		   mss.anonymous >> 10,
-		   mss.anonymous_thp >> 10,
-		   mss.swap >> 10,
 		   vma_kernel_pagesize(vma) >> 10,
 		   vma_mmu_pagesize(vma) >> 10,
-		   (vma->vm_flags & VM_LOCKED) ?
-			(unsigned long)(mss.pss >> (10 + PSS_SHIFT)) : 0);
+		   (unsigned long)(mss.pss_locked >> (10 + PSS_SHIFT)));
 
 	if (m->count < m->size)  /* vma is copied successfully */
 		m->version = (vma != get_gate_vma(task->mm))
@@ -496,6 +517,176 @@ const struct file_operations proc_smaps_operations = {
 	.release	= seq_release_private,
 };
 
+/*
+ * /proc/pid/smaps_rollup: the counters of smaps added up over all the
+ * mappings, in one record.  The header line spans from the first mapping
+ * to the last so that smaps parsers can read it unchanged.
+ */
+int proc_pid_smaps_rollup(struct seq_file *m, struct pid_namespace *ns,
+			  struct pid *pid, struct task_struct *task)
+{
+	struct mem_size_stats mss;
+	struct vm_area_struct *vma;
+	struct mm_struct *mm;
+	unsigned long start = 0, end = 0;
+	int len;
+
+	mm = mm_for_maps(task);
+	if (IS_ERR(mm))
+		return PTR_ERR(mm);
+
+	memset(&mss, 0, sizeof mss);
+	if (mm) {
+		down_read(&mm->mmap_sem);
+		if (mm->mmap)
+			start = mm->mmap->vm_start;
+		for (vma = mm->mmap; vma; vma = vma->vm_next) {
+			smaps_walk_vma(vma, &mss);
+			end = vma->vm_end;
+		}
+		up_read(&mm->mmap_sem);
+		mmput(mm);
+	}
+
+	seq_printf(m, "%08lx-%08lx ---p 00000000 00:00 0 %n", start, end, &len);
+	pad_len_spaces(m, len);
+	seq_puts(m, "[rollup]\n");
+	show_smap_counters(m, &mss);
+	seq_printf(m, "Locked:         %8lu kB\n",
+		   (unsigned long)(mss.pss_locked >> (10 + PSS_SHIFT)));
+	return 0;
+}
+
+static void fill_vma_stats(struct vma_stats *vs, struct vm_area_struct *vma)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	struct file *file = vma->vm_file;
+	vm_flags_t flags = vma->vm_flags;
+	struct mem_size_stats mss;
+
+	memset(&mss, 0, sizeof mss);
+	smaps_walk_vma(vma, &mss);
+
+	memset(vs, 0, sizeof(*vs));
+	vs->start = vma->vm_start;
+	vs->end = vma->vm_end;
+	if (file) {
+		struct inode *inode = file->f_path.dentry->d_inode;
+		vs->dev = new_encode_dev(inode->i_sb->s_dev);
+		vs->ino = inode->i_ino;
+		vs->pgoff = (u64)vma->vm_pgoff << PAGE_SHIFT;
+	}
+
+	if (flags & VM_READ)
+		vs->flags |= VMA_STATS_READ;
+	if (flags & VM_WRITE)
+		vs->flags |= VMA_STATS_WRITE;
+	if (flags & VM_EXEC)
+		vs->flags |= VMA_STATS_EXEC;
+	if (flags & VM_MAYSHARE)
+		vs->flags |= VMA_STATS_SHARED;
+	if (is_vm_hugetlb_page(vma))
+		vs->flags |= VMA_STATS_HUGETLB;
+	/* The same tests as show_map_vma() */
+	if (!file) {
+		if (vma->vm_start <= mm->brk && vma->vm_end >= mm->start_brk)
+			vs->flags |= VMA_STATS_HEAP;
+		else if (vma->vm_start <= mm->start_stack &&
+			 vma->vm_end >= mm->start_stack)
+			vs->flags |= VMA_STATS_STACK;
+	}
+
+	vs->rss = mss.resident;
+	vs->pss = mss.pss >> PSS_SHIFT;
+	vs->shared_clean = mss.shared_clean;
+	vs->shared_dirty = mss.shared_dirty;
+	vs->private_clean = mss.private_clean;
+	vs->private_dirty = mss.private_dirty;
+	vs->referenced = mss.referenced;
+	vs->anonymous = mss.anonymous;
+	vs->anonymous_thp = mss.anonymous_thp;
+	vs->swap = mss.swap;
+	vs->locked = mss.pss_locked >> PSS_SHIFT;
+}
+
+#define VMA_STATS_PER_PAGE	(PAGE_SIZE / sizeof(struct vma_stats))
+
+/*
+ * /proc/pid/vma_stats: one struct vma_stats per mapping, see
+ * linux/vma_stats.h.  The file position is the address to continue from.
+ * The records are gathered a page at a time and copied out with mmap_sem
+ * dropped, since faulting on the user buffer takes it again.
+ */
+static ssize_t vma_stats_read(struct file *file, char __user *buf,
+			      size_t count, loff_t *ppos)
+{
+	struct task_struct *task = get_proc_task(file->f_path.dentry->d_inode);
+	struct vm_area_struct *vma;
+	struct vma_stats *stats;
+	struct mm_struct *mm;
+	unsigned long addr = *ppos;
+	size_t n, max, len;
+	ssize_t copied = 0;
+	int ret = -ESRCH;
+
+	if (!task)
+		goto out;
+
+	ret = -EINVAL;
+	if (count % sizeof(*stats) || *ppos != addr)
+		goto out_task;
+
+	ret = -ENOMEM;
+	stats = (struct vma_stats *)__get_free_page(GFP_TEMPORARY);
+	if (!stats)
+		goto out_task;
+
+	mm = mm_for_maps(task);
+	ret = PTR_ERR(mm);
+	if (!mm || IS_ERR(mm))
+		goto out_free;
+
+	ret = 0;
+	while (count) {
+		max = min(count / sizeof(*stats), VMA_STATS_PER_PAGE);
+		n = 0;
+		down_read(&mm->mmap_sem);
+		for (vma = find_vma(mm, addr); vma && n < max;
+		     vma = vma->vm_next) {
+			fill_vma_stats(&stats[n++], vma);
+			addr = vma->vm_end;
+		}
+		up_read(&mm->mmap_sem);
+		if (!n)
+			break;
+
+		len = n * sizeof(*stats);
+		if (copy_to_user(buf, stats, len)) {
+			ret = -EFAULT;
+			goto out_mm;
+		}
+		copied += len;
+		buf += len;
+		count -= len;
+	}
+	*ppos = addr;
+	ret = copied;
+
+out_mm:
+	mmput(mm);
+out_free:
+	free_page((unsigned long)stats);
+out_task:
+	put_task_struct(task);
+out:
+	return ret;
+}
+
+const struct file_operations proc_vma_stats_operations = {
+	.llseek		= mem_lseek, /* borrow this */
+	.read		= vma_stats_read,
+};
+
 static int clear_refs_pte_range(pmd_t *pmd, unsigned long addr,
 				unsigned long end, struct mm_walk *walk)
 {
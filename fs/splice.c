@@ -24,6 +24,7 @@
 #include <linux/memcontrol.h>
 #include <linux/mm_inline.h>
 #include <linux/swap.h>
+#include <linux/backing-dev.h>
 #include <linux/writeback.h>
 #include <linux/buffer_head.h>
 #include <linux/module.h>
@@ -148,8 +149,13 @@ static int user_page_pipe_buf_steal(struct pipe_inode_info *pipe,
 	if (!(buf->flags & PIPE_BUF_FLAG_GIFT))
 		return 1;
 
-	buf->flags |= PIPE_BUF_FLAG_LRU;
-	return generic_pipe_buf_steal(pipe, buf);
+	if (generic_pipe_buf_steal(pipe, buf))
+		return 1;
+
+	/* Pages gift_user_pages() took away are off the LRU */
+	if (PageLRU(buf->page))
+		buf->flags |= PIPE_BUF_FLAG_LRU;
+	return 0;
 }
 
 static const struct pipe_buf_operations user_page_pipe_buf_ops = {
@@ -228,6 +234,9 @@ ssize_t splice_to_pipe(struct pipe_inode_info *pipe,
 			break;
 		}
 
+		if (pipe_autogrow(pipe))
+			continue;
+
 		if (spd->flags & SPLICE_F_NONBLOCK) {
 			if (!ret)
 				ret = -EAGAIN;
@@ -275,11 +284,18 @@ static void spd_release_page(struct splice_pipe_desc *spd, unsigned int i)
  */
 int splice_grow_spd(struct pipe_inode_info *pipe, struct splice_pipe_desc *spd)
 {
-	if (pipe->buffers <= PIPE_DEF_BUFFERS)
+	/*
+	 * The pipe isn't locked and may grow under us, see pipe_autogrow(),
+	 * so size the arrays once and fill no more than nr_pages_max.
+	 */
+	unsigned int buffers = ACCESS_ONCE(pipe->buffers);
+
+	spd->nr_pages_max = buffers;
+	if (buffers <= PIPE_DEF_BUFFERS)
 		return 0;
 
-	spd->pages = kmalloc(pipe->buffers * sizeof(struct page *), GFP_KERNEL);
-	spd->partial = kmalloc(pipe->buffers * sizeof(struct partial_page), GFP_KERNEL);
+	spd->pages = kmalloc(buffers * sizeof(struct page *), GFP_KERNEL);
+	spd->partial = kmalloc(buffers * sizeof(struct partial_page), GFP_KERNEL);
 
 	if (spd->pages && spd->partial)
 		return 0;
@@ -289,10 +305,9 @@ int splice_grow_spd(struct pipe_inode_info *pipe, struct splice_pipe_desc *spd)
 	return -ENOMEM;
 }
 
-void splice_shrink_spd(struct pipe_inode_info *pipe,
-		       struct splice_pipe_desc *spd)
+void splice_shrink_spd(struct splice_pipe_desc *spd)
 {
-	if (pipe->buffers <= PIPE_DEF_BUFFERS)
+	if (spd->nr_pages_max <= PIPE_DEF_BUFFERS)
 		return;
 
 	kfree(spd->pages);
@@ -326,7 +341,7 @@ __generic_file_splice_read(struct file *in, loff_t *ppos,
 	index = *ppos >> PAGE_CACHE_SHIFT;
 	loff = *ppos & ~PAGE_CACHE_MASK;
 	req_pages = (len + loff + PAGE_CACHE_SIZE - 1) >> PAGE_CACHE_SHIFT;
-	nr_pages = min(req_pages, pipe->buffers);
+	nr_pages = min(req_pages, spd.nr_pages_max);
 
 	/*
 	 * Lookup the (hopefully) full range of pages we need.
@@ -497,7 +512,7 @@ fill_it:
 	if (spd.nr_pages)
 		error = splice_to_pipe(pipe, &spd);
 
-	splice_shrink_spd(pipe, &spd);
+	splice_shrink_spd(&spd);
 	return error;
 }
 
@@ -608,8 +623,8 @@ ssize_t default_file_splice_read(struct file *in, loff_t *ppos,
 
 	res = -ENOMEM;
 	vec = __vec;
-	if (pipe->buffers > PIPE_DEF_BUFFERS) {
-		vec = kmalloc(pipe->buffers * sizeof(struct iovec), GFP_KERNEL);
+	if (spd.nr_pages_max > PIPE_DEF_BUFFERS) {
+		vec = kmalloc(spd.nr_pages_max * sizeof(struct iovec), GFP_KERNEL);
 		if (!vec)
 			goto shrink_ret;
 	}
@@ -617,7 +632,7 @@ ssize_t default_file_splice_read(struct file *in, loff_t *ppos,
 	offset = *ppos & ~PAGE_CACHE_MASK;
 	nr_pages = (len + offset + PAGE_CACHE_SIZE - 1) >> PAGE_CACHE_SHIFT;
 
-	for (i = 0; i < nr_pages && i < pipe->buffers && len; i++) {
+	for (i = 0; i < nr_pages && i < spd.nr_pages_max && len; i++) {
 		struct page *page;
 
 		page = alloc_page(GFP_USER);
@@ -665,7 +680,7 @@ ssize_t default_file_splice_read(struct file *in, loff_t *ppos,
 shrink_ret:
 	if (vec != __vec)
 		kfree(vec);
-	splice_shrink_spd(pipe, &spd);
+	splice_shrink_spd(&spd);
 	return res;
 
 err:
@@ -696,6 +711,55 @@ static int pipe_to_sendpage(struct pipe_inode_info *pipe,
 				    sd->len, &pos, more);
 }
 
+/*
+ * Steal the page of @buf and add it to @mapping at @index, if there's no
+ * page cached there yet. pagecache_write_begin() then finds it and the
+ * data doesn't have to be copied. If anything fails the page is left in
+ * the pipe and the caller copies it as usual. Returns 1 if the page was
+ * added, and the caller must then pipe_unmove_page() it if the write
+ * doesn't go through.
+ */
+static int pipe_move_page(struct pipe_inode_info *pipe,
+			  struct pipe_buffer *buf,
+			  struct address_space *mapping, pgoff_t index)
+{
+	struct page *page = buf->page;
+
+	if (mapping_cap_swap_backed(mapping))
+		return 0;
+
+	if (buf->ops->steal(pipe, buf))
+		return 0;
+
+	/*
+	 * A stolen page comes back locked. It must also be a plain page by
+	 * now, no longer in any mapping nor anon, or it can't be moved.
+	 */
+	if (page->mapping || PageSwapBacked(page) || PageCompound(page) ||
+	    add_to_page_cache_locked(page, mapping, index, GFP_KERNEL)) {
+		unlock_page(page);
+		return 0;
+	}
+
+	if (!(buf->flags & PIPE_BUF_FLAG_LRU))
+		lru_cache_add_file(page);
+	SetPageUptodate(page);
+	unlock_page(page);
+	return 1;
+}
+
+/*
+ * Take a page pipe_move_page() added back out of @mapping, so that data
+ * that was never written doesn't stay cached in place of the file's.
+ */
+static void pipe_unmove_page(struct page *page, struct address_space *mapping)
+{
+	lock_page(page);
+	if (page->mapping == mapping)
+		truncate_inode_page(mapping, page);
+	unlock_page(page);
+}
+
 /*
  * This is a little more tricky than the file -> pipe splicing. There are
  * basically three cases:
@@ -715,6 +779,9 @@ static int pipe_to_sendpage(struct pipe_inode_info *pipe,
  * the pipe page referenced outside of the pipe and page cache. If
  * SPLICE_F_MOVE isn't set, or we cannot move the page, we simply create
  * a new page in the output file page cache and fill/dirty that.
+ *
+ * Moving is done for full, page aligned buffers only, see
+ * pipe_move_page(); all the other cases copy.
  */
 int pipe_to_file(struct pipe_inode_info *pipe, struct pipe_buffer *buf,
 		 struct splice_desc *sd)
@@ -724,6 +791,7 @@ int pipe_to_file(struct pipe_inode_info *pipe, struct pipe_buffer *buf,
 	unsigned int offset, this_len;
 	struct page *page;
 	void *fsdata;
+	int moved = 0;
 	int ret;
 
 	offset = sd->pos & ~PAGE_CACHE_MASK;
@@ -732,12 +800,22 @@ int pipe_to_file(struct pipe_inode_info *pipe, struct pipe_buffer *buf,
 	if (this_len + offset > PAGE_CACHE_SIZE)
 		this_len = PAGE_CACHE_SIZE - offset;
 
+	if ((sd->flags & SPLICE_F_MOVE) && !offset && !buf->offset &&
+	    this_len == PAGE_CACHE_SIZE)
+		moved = pipe_move_page(pipe, buf, mapping,
+				       sd->pos >> PAGE_CACHE_SHIFT);
+
 	ret = pagecache_write_begin(file, mapping, sd->pos, this_len,
 				AOP_FLAG_UNINTERRUPTIBLE, &page, &fsdata);
-	if (unlikely(ret))
+	if (unlikely(ret)) {
+		if (moved)
+			pipe_unmove_page(buf->page, mapping);
 		goto out;
+	}
 
-	if (buf->page != page) {
+	if (buf->page == page) {
+		count_vm_event(SPLICE_MOVE);
+	} else {
 		/*
 		 * Careful, ->map() uses KM_USER0!
 		 */
@@ -748,9 +826,12 @@ int pipe_to_file(struct pipe_inode_info *pipe, struct pipe_buffer *buf,
 		flush_dcache_page(page);
 		kunmap_atomic(dst, KM_USER1);
 		buf->ops->unmap(pipe, buf, src);
+		count_vm_event(SPLICE_COPY);
 	}
 	ret = pagecache_write_end(file, mapping, sd->pos, this_len, this_len,
 				page, fsdata);
+	if (unlikely(ret != this_len) && moved && buf->page == page)
+		pipe_unmove_page(page, mapping);
 out:
 	return ret;
 }
@@ -1386,6 +1467,9 @@ static long do_splice(struct file *in, loff_t __user *off_in,
  * our ones pages[] map instead of splitting that operation into pieces.
  * Could easily be exported as a generic helper for other users, in which
  * case one would probably want to add a 'max_nr_pages' parameter as well.
+ *
+ * partial->private is set to the user address of each page, for
+ * vmsplice_gift_pages().
  */
 static int get_iovec_page_array(const struct iovec __user *iov,
 				unsigned int nr_vecs, struct page **pages,
@@ -1450,6 +1534,8 @@ static int get_iovec_page_array(const struct iovec __user *iov,
 
 			partial[buffers].offset = off;
 			partial[buffers].len = plen;
+			partial[buffers].private = ((unsigned long)base &
+						PAGE_MASK) + i * PAGE_SIZE;
 
 			off = 0;
 			len -= plen;
@@ -1599,6 +1685,44 @@ static long vmsplice_to_user(struct file *file, const struct iovec __user *iov,
 	return ret;
 }
 
+/*
+ * vmsplice(SPLICE_F_GIFT | SPLICE_F_MOVE) gives the pages away for good:
+ * once they are in the pipe, gift_user_pages() unmaps them from the caller
+ * and takes them off the LRU, so that splicing them on to a file can move
+ * them into its page cache instead of copying them. Only the pages that
+ * made it into the pipe are taken, the caller still owns the rest when
+ * the pipe was full.
+ */
+static long vmsplice_gift_pages(struct pipe_inode_info *pipe,
+				struct splice_pipe_desc *spd)
+{
+	struct page **pages = spd->pages;
+	struct partial_page *partial = spd->partial;
+	int nr_pages = spd->nr_pages;
+	int i, run, gifted = 0;
+	long ret;
+
+	/* The reader may drop the pipe's references while we're at it */
+	for (i = 0; i < nr_pages; i++)
+		page_cache_get(pages[i]);
+
+	ret = splice_to_pipe(pipe, spd);
+
+	/* Gifts are page aligned, so the first ret / PAGE_SIZE went in */
+	for (i = 0; ret > 0 && i < ret >> PAGE_SHIFT; i += run) {
+		for (run = 1; i + run < ret >> PAGE_SHIFT; run++)
+			if (partial[i + run].private !=
+			    partial[i].private + run * PAGE_SIZE)
+				break;
+		gifted += gift_user_pages(partial[i].private, run, &pages[i]);
+	}
+	count_vm_events(SPLICE_GIFT, gifted);
+
+	for (i = 0; i < nr_pages; i++)
+		page_cache_release(pages[i]);
+	return ret;
+}
+
 /*
  * vmsplice splices a user address range into a pipe. It can be thought of
  * as splice-from-memory, where the regular splice is splice-from-file (or
@@ -1628,13 +1752,16 @@ static long vmsplice_to_pipe(struct file *file, const struct iovec __user *iov,
 
 	spd.nr_pages = get_iovec_page_array(iov, nr_segs, spd.pages,
 					    spd.partial, flags & SPLICE_F_GIFT,
-					    pipe->buffers);
+					    spd.nr_pages_max);
 	if (spd.nr_pages <= 0)
 		ret = spd.nr_pages;
+	else if ((flags & (SPLICE_F_GIFT | SPLICE_F_MOVE)) ==
+					(SPLICE_F_GIFT | SPLICE_F_MOVE))
+		ret = vmsplice_gift_pages(pipe, &spd);
 	else
 		ret = splice_to_pipe(pipe, &spd);
 
-	splice_shrink_spd(pipe, &spd);
+	splice_shrink_spd(&spd);
 	return ret;
 }
 
@@ -25,11 +25,14 @@
 #include <linux/mutex.h>
 #include <linux/slab.h>
 #include <linux/buffer_head.h>
+#include <linux/cpumask.h>
+#include <linux/err.h>
 
 #include "squashfs_fs.h"
 #include "squashfs_fs_sb.h"
 #include "decompressor.h"
 #include "squashfs.h"
+#include "page_actor.h"
 
 /*
  * This file (and decompressor.h) implements a decompressor framework for
@@ -77,34 +80,111 @@ const struct squashfs_decompressor *squashfs_lookup_decompressor(int id)
 }
 
 
-void *squashfs_decompressor_init(struct super_block *sb, unsigned short flags)
+int squashfs_max_decompressors(void)
+{
+#ifdef CONFIG_SQUASHFS_DECOMP_PERCPU
+	return nr_cpu_ids;
+#else
+	return 1;
+#endif
+}
+
+
+struct squashfs_stream *squashfs_decompressor_init(struct super_block *sb,
+	unsigned short flags)
 {
 	struct squashfs_sb_info *msblk = sb->s_fs_info;
+	struct squashfs_stream *stream;
+	struct squashfs_page_actor actor;
 	void *strm, *buffer = NULL;
-	int length = 0;
+	int i = 0, length = 0, nr = squashfs_max_decompressors();
+
+	stream = kcalloc(nr, sizeof(*stream), GFP_KERNEL);
+	if (stream == NULL)
+		return ERR_PTR(-ENOMEM);
 
 	/*
 	 * Read decompressor specific options from file system if present
 	 */
 	if (SQUASHFS_COMP_OPTS(flags)) {
 		buffer = kmalloc(PAGE_CACHE_SIZE, GFP_KERNEL);
-		if (buffer == NULL)
-			return ERR_PTR(-ENOMEM);
+		if (buffer == NULL) {
+			strm = ERR_PTR(-ENOMEM);
+			goto failed;
+		}
 
-		length = squashfs_read_data(sb, &buffer,
-			sizeof(struct squashfs_super_block), 0, NULL,
-			PAGE_CACHE_SIZE, 1);
+		squashfs_page_actor_init(&actor, &buffer, 1, 0);
+		length = squashfs_read_data(sb,
+			sizeof(struct squashfs_super_block), 0, NULL, &actor);
 
 		if (length < 0) {
 			strm = ERR_PTR(length);
-			goto finished;
+			goto failed;
 		}
 	}
 
-	strm = msblk->decompressor->init(msblk, buffer, length);
+	/*
+	 * Only streams for CPUs that can come online are allocated, the
+	 * others are left NULL and never picked by squashfs_decompress()
+	 */
+	for (i = 0; i < nr; i++) {
+		mutex_init(&stream[i].mutex);
+		if (nr > 1 && !cpu_possible(i))
+			continue;
+		strm = msblk->decompressor->init(msblk, buffer, length);
+		if (IS_ERR(strm))
+			goto failed;
+		stream[i].stream = strm;
+	}
 
-finished:
+	msblk->nr_streams = nr;
 	kfree(buffer);
+	return stream;
 
+failed:
+	while (--i >= 0)
+		if (stream[i].stream)
+			msblk->decompressor->free(stream[i].stream);
+	kfree(stream);
+	kfree(buffer);
 	return strm;
 }
+
+
+void squashfs_decompressor_free(struct squashfs_sb_info *msblk)
+{
+	int i;
+
+	if (msblk->stream == NULL)
+		return;
+
+	for (i = 0; i < msblk->nr_streams; i++)
+		if (msblk->stream[i].stream)
+			msblk->decompressor->free(msblk->stream[i].stream);
+	kfree(msblk->stream);
+	msblk->stream = NULL;
+}
+
+
+/*
+ * Decompress with the stream of the CPU we are running on.  The task may
+ * be migrated while it sleeps on the stream mutex or the buffer heads,
+ * which is harmless: another reader on this CPU then just waits for us.
+ */
+int squashfs_decompress(struct squashfs_sb_info *msblk,
+	struct buffer_head **bh, int b, int offset, int length,
+	struct squashfs_page_actor *output)
+{
+	struct squashfs_stream *stream = msblk->stream;
+	int res;
+
+	if (msblk->nr_streams > 1)
+		stream += raw_smp_processor_id();
+
+	mutex_lock(&stream->mutex);
+	res = msblk->decompressor->decompress(msblk, stream->stream, bh, b,
+		offset, length, output);
+	mutex_unlock(&stream->mutex);
+
+	return res;
+}
@@ -23,30 +23,29 @@
  * decompressor.h
  */
 
+struct squashfs_page_actor;
+
 struct squashfs_decompressor {
 	void	*(*init)(struct squashfs_sb_info *, void *, int);
 	void	(*free)(void *);
-	int	(*decompress)(struct squashfs_sb_info *, void **,
-		struct buffer_head **, int, int, int, int, int);
+	int	(*decompress)(struct squashfs_sb_info *, void *,
+		struct buffer_head **, int, int, int,
+		struct squashfs_page_actor *);
 	int	id;
 	char	*name;
 	int	supported;
 };
 
-static inline void squashfs_decompressor_free(struct squashfs_sb_info *msblk,
-	void *s)
-{
-	if (msblk->decompressor)
-		msblk->decompressor->free(s);
-}
-
-static inline int squashfs_decompress(struct squashfs_sb_info *msblk,
-	void **buffer, struct buffer_head **bh, int b, int offset, int length,
-	int srclength, int pages)
-{
-	return msblk->decompressor->decompress(msblk, buffer, bh, b, offset,
-		length, srclength, pages);
-}
+/*
+ * A decompressor stream and the lock serialising its users.  There is
+ * one of these per possible CPU (or just one, without
+ * CONFIG_SQUASHFS_DECOMP_PERCPU), so that readers on different CPUs
+ * decompress in parallel.
+ */
+struct squashfs_stream {
+	struct mutex	mutex;
+	void		*stream;
+} ____cacheline_aligned_in_smp;
 
 #ifdef CONFIG_SQUASHFS_XZ
 extern const struct squashfs_decompressor squashfs_xz_comp_ops;
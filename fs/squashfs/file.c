@@ -409,6 +409,16 @@ static int squashfs_readpage(struct file *file, struct page *page)
 				 msblk->block_size;
 			sparse = 1;
 		} else {
+			/*
+			 * Decompress the datablock straight into the page
+			 * cache if every page it covers can be grabbed.
+			 */
+			int res = squashfs_readpage_block(page, block, bsize);
+			if (res == 0)
+				return 0;
+			if (res != -EAGAIN)
+				goto error_out;
+
 			/*
 			 * Read and decompress datablock.
 			 */
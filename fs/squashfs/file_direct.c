@@ -0,0 +1,149 @@
+/*
+ * Squashfs - a compressed read only filesystem for Linux
+ *
+ * Copyright (c) 2002, 2003, 2004, 2005, 2006, 2007, 2008
+ * Phillip Lougher <phillip@squashfs.org.uk>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * file_direct.c
+ */
+
+/*
+ * This file decompresses file datablocks straight into the page cache.
+ *
+ * A datablock (128 KiB by default) covers many pages.  Rather than
+ * decompressing it into the "data" cache and copying each page out,
+ * squashfs_readpage_block() grabs and locks every page the block covers
+ * and hands them to the decompressor as its output, through a page
+ * actor that maps one page at a time.
+ * The neighbouring pages are filled for free, which is what readahead
+ * would otherwise have had to ask for one readpage at a time.
+ *
+ * If any of the pages can't be grabbed (locked by a racing reader, or
+ * already uptodate because only some were reclaimed) the caller falls
+ * back to the cached path in file.c.
+ */
+
+#include <linux/fs.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/pagemap.h>
+#include <linux/highmem.h>
+
+#include "squashfs_fs.h"
+#include "squashfs_fs_sb.h"
+#include "squashfs_fs_i.h"
+#include "squashfs.h"
+#include "page_actor.h"
+
+static void release_pages_but(struct page **page, int pages,
+	struct page *target_page)
+{
+	int i;
+
+	for (i = 0; i < pages; i++) {
+		if (page[i] == NULL || page[i] == target_page)
+			continue;
+		unlock_page(page[i]);
+		page_cache_release(page[i]);
+	}
+}
+
+
+/*
+ * Read the datablock @block of compressed size @bsize covering
+ * @target_page directly into the page cache.  Returns 0 when all the
+ * pages have been filled, -EAGAIN if the caller should fall back to
+ * the cached path, or another error if the block couldn't be read.
+ * @target_page is left locked in the error cases.
+ */
+int squashfs_readpage_block(struct page *target_page, u64 block, int bsize)
+{
+	struct inode *inode = target_page->mapping->host;
+	struct squashfs_sb_info *msblk = inode->i_sb->s_fs_info;
+	int file_end = (i_size_read(inode) - 1) >> PAGE_CACHE_SHIFT;
+	int mask = (1 << (msblk->block_log - PAGE_CACHE_SHIFT)) - 1;
+	int start_index = target_page->index & ~mask;
+	int end_index = start_index | mask;
+	int i, n, pages, bytes, res = -EAGAIN;
+	struct squashfs_page_actor actor;
+	struct page **page;
+	void *pageaddr;
+
+	if (end_index > file_end)
+		end_index = file_end;
+	pages = end_index - start_index + 1;
+
+	/* If these can't be allocated the cached path still works */
+	page = kcalloc(pages, sizeof(*page), GFP_KERNEL);
+	if (page == NULL)
+		goto out;
+
+	/* Try to grab all the pages covered by the block */
+	for (i = 0, n = start_index; i < pages; i++, n++) {
+		page[i] = (n == target_page->index) ? target_page :
+			grab_cache_page_nowait(target_page->mapping, n);
+
+		if (page[i] == NULL || (page[i] != target_page &&
+						PageUptodate(page[i]))) {
+			if (page[i]) {
+				unlock_page(page[i]);
+				page_cache_release(page[i]);
+				page[i] = NULL;
+			}
+			release_pages_but(page, pages, target_page);
+			goto out;
+		}
+	}
+
+	/*
+	 * The last block of a file may cover fewer pages than block_size,
+	 * so bound the output by what was grabbed, not by block_size
+	 */
+	squashfs_page_actor_init_pages(&actor, page, pages,
+		min_t(int, msblk->block_size, pages << PAGE_CACHE_SHIFT));
+	res = squashfs_read_data(inode->i_sb, block, bsize, NULL, &actor);
+
+	if (res >= 0) {
+		/* Zero whatever the block didn't cover, e.g. past EOF */
+		for (i = 0, bytes = res; i < pages; i++,
+						bytes -= PAGE_CACHE_SIZE) {
+			int avail = clamp_t(int, bytes, 0, PAGE_CACHE_SIZE);
+
+			if (avail < PAGE_CACHE_SIZE) {
+				pageaddr = kmap_atomic(page[i], KM_USER0);
+				memset(pageaddr + avail, 0,
+					PAGE_CACHE_SIZE - avail);
+				kunmap_atomic(pageaddr, KM_USER0);
+			}
+			flush_dcache_page(page[i]);
+			SetPageUptodate(page[i]);
+		}
+	} else
+		ERROR("Unable to read page, block %llx, size %x\n", block,
+			bsize);
+
+	release_pages_but(page, pages, target_page);
+	if (res >= 0) {
+		unlock_page(target_page);
+		res = 0;
+	}
+
+out:
+	kfree(page);
+	return res;
+}
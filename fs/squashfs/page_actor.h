@@ -0,0 +1,87 @@
+#ifndef PAGE_ACTOR_H
+#define PAGE_ACTOR_H
+/*
+ * Squashfs - a compressed read only filesystem for Linux
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * page_actor.h
+ */
+
+#include <linux/highmem.h>
+
+/*
+ * The output of squashfs_read_data(), walked one PAGE_CACHE_SIZE page at
+ * a time.  It is either an array of kernel buffers (the caches) or an
+ * array of page cache pages (file_direct.c), which are kmap_atomic()ed
+ * one at a time, so the decompressors must not sleep between
+ * squashfs_first_page() and squashfs_finish_page().
+ */
+struct squashfs_page_actor {
+	void		**buffer;
+	struct page	**page;
+	void		*pageaddr;	/* the mapped page, if any */
+	int		pages;
+	int		length;		/* bytes the output can take */
+	int		next_page;
+};
+
+static inline void squashfs_page_actor_init(struct squashfs_page_actor *actor,
+	void **buffer, int pages, int length)
+{
+	actor->buffer = buffer;
+	actor->page = NULL;
+	actor->pageaddr = NULL;
+	actor->pages = pages;
+	actor->length = length ? length : pages * PAGE_CACHE_SIZE;
+	actor->next_page = 0;
+}
+
+static inline void squashfs_page_actor_init_pages(
+	struct squashfs_page_actor *actor, struct page **page, int pages,
+	int length)
+{
+	squashfs_page_actor_init(actor, NULL, pages, length);
+	actor->page = page;
+}
+
+static inline void squashfs_finish_page(struct squashfs_page_actor *actor)
+{
+	if (actor->pageaddr) {
+		kunmap_atomic(actor->pageaddr, KM_USER0);
+		actor->pageaddr = NULL;
+	}
+}
+
+/* Returns the next page of the output, or NULL past its end */
+static inline void *squashfs_next_page(struct squashfs_page_actor *actor)
+{
+	squashfs_finish_page(actor);
+	if (actor->next_page == actor->pages)
+		return NULL;
+	if (actor->buffer)
+		return actor->buffer[actor->next_page++];
+	actor->pageaddr = kmap_atomic(actor->page[actor->next_page++],
+				      KM_USER0);
+	return actor->pageaddr;
+}
+
+static inline void *squashfs_first_page(struct squashfs_page_actor *actor)
+{
+	squashfs_finish_page(actor);
+	actor->next_page = 0;
+	return squashfs_next_page(actor);
+}
+#endif
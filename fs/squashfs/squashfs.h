@@ -27,9 +27,11 @@
 
 #define WARNING(s, args...)	pr_warning("SQUASHFS: "s, ## args)
 
+struct squashfs_page_actor;
+
 /* block.c */
-extern int squashfs_read_data(struct super_block *, void **, u64, int, u64 *,
-				int, int);
+extern int squashfs_read_data(struct super_block *, u64, int, u64 *,
+				struct squashfs_page_actor *);
 
 /* cache.c */
 extern struct squashfs_cache *squashfs_cache_init(char *, int, int);
@@ -48,12 +50,29 @@ extern void *squashfs_read_table(struct super_block *, u64, int);
 
 /* decompressor.c */
 extern const struct squashfs_decompressor *squashfs_lookup_decompressor(int);
-extern void *squashfs_decompressor_init(struct super_block *, unsigned short);
+extern struct squashfs_stream *squashfs_decompressor_init(struct super_block *,
+				unsigned short);
+extern void squashfs_decompressor_free(struct squashfs_sb_info *);
+extern int squashfs_decompress(struct squashfs_sb_info *,
+				struct buffer_head **, int, int, int,
+				struct squashfs_page_actor *);
+extern int squashfs_max_decompressors(void);
 
 /* export.c */
 extern __le64 *squashfs_read_inode_lookup_table(struct super_block *, u64, u64,
 				unsigned int);
 
+/* file_direct.c */
+#ifdef CONFIG_SQUASHFS_FILE_DIRECT
+extern int squashfs_readpage_block(struct page *, u64, int);
+#else
+static inline int squashfs_readpage_block(struct page *page, u64 block,
+				int bsize)
+{
+	return -EAGAIN;
+}
+#endif
+
 /* fragment.c */
 extern int squashfs_frag_lookup(struct super_block *, unsigned int, u64 *);
 extern __le64 *squashfs_read_fragment_index_table(struct super_block *,
@@ -13,6 +13,7 @@
 
 #include "yaffs_checkptrw.h"
 #include "yaffs_getblockinfo.h"
+#include "yaffs_nand.h"
 
 static int yaffs2_checkpt_space_ok(struct yaffs_dev *dev)
 {
@@ -57,6 +58,8 @@ static int yaffs_checkpt_erase(struct yaffs_dev *dev)
 	}
 
 	dev->blocks_in_checkpt = 0;
+	dev->checkpt_marker_chunk = -1;
+	dev->checkpt_stale = 0;
 
 	return 1;
 }
@@ -110,6 +113,7 @@ static void yaffs2_checkpt_find_block(struct yaffs_dev *dev)
 
 			dev->param.read_chunk_tags_fn(dev, realigned_chunk,
 						      NULL, &tags);
+			yaffs_count_ecc(dev, &tags);
 			yaffs_trace(YAFFS_TRACE_CHECKPOINT,
 				"find next checkpt block: search: block %d oid %d seq %d eccr %d",
 				i, tags.obj_id, tags.seq_number,
@@ -328,6 +332,7 @@ int yaffs2_checkpt_rd(struct yaffs_dev *dev, void *data, int n_bytes)
 							      dev->
 							      checkpt_buffer,
 							      &tags);
+				yaffs_count_ecc(dev, &tags);
 
 				if (tags.chunk_id != (dev->checkpt_page_seq + 1)
 				    || tags.ecc_result > YAFFS_ECC_RESULT_FIXED
@@ -366,7 +371,17 @@ int yaffs_checkpt_close(struct yaffs_dev *dev)
 	if (dev->checkpt_open_write) {
 		if (dev->checkpt_byte_offs != 0)
 			yaffs2_checkpt_flush_buffer(dev);
-	} else if (dev->checkpt_block_list) {
+	}
+
+	/* The chunk after the checkpoint data is where the stale marker goes */
+	if (dev->checkpt_cur_block >= 0 && dev->checkpt_cur_chunk > 0)
+		dev->checkpt_marker_chunk =
+		    dev->checkpt_cur_block * dev->param.chunks_per_block +
+		    dev->checkpt_cur_chunk;
+	else
+		dev->checkpt_marker_chunk = -1;
+
+	if (!dev->checkpt_open_write && dev->checkpt_block_list) {
 		int i;
 		for (i = 0;
 		     i < dev->blocks_in_checkpt
@@ -413,3 +428,74 @@ int yaffs2_checkpt_invalidate_stream(struct yaffs_dev *dev)
 
 	return yaffs_checkpt_erase(dev);
 }
+
+/*
+ * Rather than erasing the checkpoint on the first change after it was
+ * written, mark it stale so that a mount after power loss can start from
+ * it and only replay the blocks written since.
+ * Returns 1 if the checkpoint was kept, 0 if it has to be erased.
+ */
+int yaffs2_checkpt_mark_stale(struct yaffs_dev *dev)
+{
+	struct yaffs_ext_tags tags;
+	u8 *buffer;
+	int result;
+
+	if (dev->checkpt_marker_chunk < 0 || !dev->param.write_chunk_tags_fn)
+		return 0;
+
+	memset(&tags, 0, sizeof(tags));
+	tags.seq_number = YAFFS_SEQUENCE_CHECKPOINT_DATA;
+	tags.n_bytes = 0;	/* Checkpoint data chunks are never empty */
+
+	buffer = yaffs_get_temp_buffer(dev, __LINE__);
+	memset(buffer, 0, dev->data_bytes_per_chunk);
+
+	yaffs_trace(YAFFS_TRACE_CHECKPOINT,
+		"checkpoint stale marker at chunk %d",
+		dev->checkpt_marker_chunk);
+
+	dev->n_page_writes++;
+	result = dev->param.write_chunk_tags_fn(dev,
+				dev->checkpt_marker_chunk - dev->chunk_offset,
+				buffer, &tags);
+
+	yaffs_release_temp_buffer(dev, buffer, __LINE__);
+
+	dev->checkpt_marker_chunk = -1;
+	dev->checkpt_stale = (result == YAFFS_OK);
+
+	return dev->checkpt_stale;
+}
+
+/*
+ * Look for the stale marker after a checkpoint that has just been read.
+ * Returns 1 if the checkpoint is stale, 0 if it is current and -1 if
+ * the chunk holds something that should not be there.
+ */
+int yaffs2_checkpt_read_marker(struct yaffs_dev *dev)
+{
+	struct yaffs_ext_tags tags;
+
+	/* No room for a marker, so a stale checkpoint would have been erased */
+	if (dev->checkpt_marker_chunk < 0)
+		return 0;
+
+	memset(&tags, 0, sizeof(tags));
+	dev->n_page_reads++;
+	dev->param.read_chunk_tags_fn(dev,
+				dev->checkpt_marker_chunk - dev->chunk_offset,
+				NULL, &tags);
+	yaffs_count_ecc(dev, &tags);
+
+	if (!tags.chunk_used)
+		return 0;
+
+	if (tags.seq_number == YAFFS_SEQUENCE_CHECKPOINT_DATA &&
+	    tags.n_bytes == 0 && tags.ecc_result <= YAFFS_ECC_RESULT_FIXED) {
+		dev->checkpt_marker_chunk = -1;
+		return 1;
+	}
+
+	return -1;
+}
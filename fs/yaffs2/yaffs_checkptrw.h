@@ -30,4 +30,8 @@ int yaffs_checkpt_close(struct yaffs_dev *dev);
 
 int yaffs2_checkpt_invalidate_stream(struct yaffs_dev *dev);
 
+int yaffs2_checkpt_mark_stale(struct yaffs_dev *dev);
+
+int yaffs2_checkpt_read_marker(struct yaffs_dev *dev);
+
 #endif
@@ -46,6 +46,9 @@
 static int yaffs_wr_data_obj(struct yaffs_obj *in, int inode_chunk,
 			     const u8 * buffer, int n_bytes, int use_reserve);
 
+static void yaffs_gc_summary_note(struct yaffs_dev *dev, int block,
+				  struct yaffs_block_info *bi);
+
 
 
 /* Function to calculate chunk and offset */
@@ -477,6 +480,7 @@ static int yaffs_alloc_chunk(struct yaffs_dev *dev, int use_reserver,
 		/* If the block is full set the state to full */
 		if (dev->alloc_page >= dev->param.chunks_per_block) {
 			bi->block_state = YAFFS_BLOCK_STATE_FULL;
+			yaffs_gc_summary_note(dev, dev->alloc_block, bi);
 			dev->alloc_block = -1;
 		}
 
@@ -515,6 +519,7 @@ void yaffs_skip_rest_of_block(struct yaffs_dev *dev)
 		    yaffs_get_block_info(dev, dev->alloc_block);
 		if (bi->block_state == YAFFS_BLOCK_STATE_ALLOCATING) {
 			bi->block_state = YAFFS_BLOCK_STATE_FULL;
+			yaffs_gc_summary_note(dev, dev->alloc_block, bi);
 			dev->alloc_block = -1;
 		}
 	}
@@ -1201,6 +1206,7 @@ static void yaffs_soft_del_chunk(struct yaffs_dev *dev, int chunk)
 		the_block->soft_del_pages++;
 		dev->n_free_chunks++;
 		yaffs2_update_oldest_dirty_seq(dev, block_no, the_block);
+		yaffs_gc_summary_note(dev, block_no, the_block);
 	}
 }
 
@@ -2679,6 +2685,7 @@ static int yaffs_gc_block(struct yaffs_dev *dev, int block, int whole_block)
 		 * because checkpointing does not restore gc.
 		 */
 		bi->block_state = YAFFS_BLOCK_STATE_FULL;
+		yaffs_gc_summary_note(dev, block, bi);
 	} else {
 		/* The gc completed. */
 		/* Do any required cleanups */
@@ -2715,6 +2722,117 @@ static int yaffs_gc_block(struct yaffs_dev *dev, int block, int whole_block)
 	return ret_val;
 }
 
+/*
+ * GC summary.
+ * Rather than hunting through the block info for a dirty block each time gc
+ * runs, the dirtiest full blocks are remembered as their chunks get deleted.
+ * A block is looked at when it becomes full, for the chunks it lost while
+ * it was being allocated from, and then whenever it loses another one.
+ * Entries for blocks that are no longer full are dropped lazily.  If the
+ * summary fills up some candidates are forgotten, and the summary is
+ * rebuilt from the block info once it has been used up.
+ */
+
+static inline int yaffs_gc_live_pages(struct yaffs_block_info *bi)
+{
+	return bi->pages_in_use - bi->soft_del_pages;
+}
+
+static void yaffs_gc_summary_note(struct yaffs_dev *dev, int block,
+				  struct yaffs_block_info *bi)
+{
+	int i;
+	int live;
+	int worst = -1;
+	int worst_live = -1;
+
+	if (bi->block_state != YAFFS_BLOCK_STATE_FULL)
+		return;
+
+	live = yaffs_gc_live_pages(bi);
+	if (live >= dev->param.chunks_per_block)
+		return;		/* Nothing to collect */
+
+	for (i = 0; i < dev->gc_summary_n; i++) {
+		struct yaffs_block_info *sbi;
+		int slive;
+
+		if (dev->gc_summary[i] == block)
+			return;
+
+		sbi = yaffs_get_block_info(dev, dev->gc_summary[i]);
+		if (sbi->block_state != YAFFS_BLOCK_STATE_FULL)
+			slive = dev->param.chunks_per_block + 1;
+		else
+			slive = yaffs_gc_live_pages(sbi);
+		if (slive > worst_live) {
+			worst = i;
+			worst_live = slive;
+		}
+	}
+
+	if (dev->gc_summary_n < YAFFS_GC_SUMMARY_SIZE) {
+		dev->gc_summary[dev->gc_summary_n++] = block;
+		return;
+	}
+
+	/* Full: one of the two misses out */
+	dev->gc_summary_overflow = 1;
+	if (live < worst_live)
+		dev->gc_summary[worst] = block;
+}
+
+static void yaffs_gc_summary_rebuild(struct yaffs_dev *dev)
+{
+	int i;
+	struct yaffs_block_info *bi = dev->block_info;
+
+	dev->gc_summary_overflow = 0;
+	dev->gc_summary_rebuilds++;
+
+	for (i = dev->internal_start_block; i <= dev->internal_end_block;
+	     i++, bi++) {
+		if (bi->block_state == YAFFS_BLOCK_STATE_FULL &&
+		    yaffs_gc_live_pages(bi) < dev->param.chunks_per_block)
+			yaffs_gc_summary_note(dev, i, bi);
+	}
+}
+
+/* Returns the dirtiest block in the summary that can be collected, or 0 */
+static int yaffs_gc_summary_pick(struct yaffs_dev *dev, int *live_out)
+{
+	int i = 0;
+	int best = 0;
+	int best_live = 0;
+
+	if (dev->gc_summary_n == 0 && dev->gc_summary_overflow)
+		yaffs_gc_summary_rebuild(dev);
+
+	while (i < dev->gc_summary_n) {
+		int block = dev->gc_summary[i];
+		struct yaffs_block_info *bi = yaffs_get_block_info(dev, block);
+		int live;
+
+		if (bi->block_state != YAFFS_BLOCK_STATE_FULL) {
+			dev->gc_summary[i] =
+			    dev->gc_summary[--dev->gc_summary_n];
+			continue;
+		}
+
+		live = yaffs_gc_live_pages(bi);
+		if (live < dev->param.chunks_per_block &&
+		    (best < 1 || live < best_live) &&
+		    yaffs_block_ok_for_gc(dev, bi)) {
+			best = block;
+			best_live = live;
+		}
+		i++;
+	}
+
+	*live_out = best_live;
+	return best;
+}
+
 /*
  * FindBlockForgarbageCollection is used to select the dirtiest block (or close enough)
  * for garbage collection.
@@ -2724,7 +2842,6 @@ static unsigned yaffs_find_gc_block(struct yaffs_dev *dev,
 				    int aggressive, int background)
 {
 	int i;
-	int iterations;
 	unsigned selected = 0;
 	int prioritised = 0;
 	int prioritised_exist = 0;
@@ -2771,11 +2888,9 @@ static unsigned yaffs_find_gc_block(struct yaffs_dev *dev,
 
 	if (!selected) {
 		int pages_used;
-		int n_blocks =
-		    dev->internal_end_block - dev->internal_start_block + 1;
+
 		if (aggressive) {
 			threshold = dev->param.chunks_per_block;
-			iterations = n_blocks;
 		} else {
 			int max_threshold;
 
@@ -2792,38 +2907,15 @@ static unsigned yaffs_find_gc_block(struct yaffs_dev *dev,
 				threshold = YAFFS_GC_PASSIVE_THRESHOLD;
 			if (threshold > max_threshold)
 				threshold = max_threshold;
-
-			iterations = n_blocks / 16 + 1;
-			if (iterations > 100)
-				iterations = 100;
 		}
 
-		for (i = 0;
-		     i < iterations &&
-		     (dev->gc_dirtiest < 1 ||
-		      dev->gc_pages_in_use > YAFFS_GC_GOOD_ENOUGH); i++) {
-			dev->gc_block_finder++;
-			if (dev->gc_block_finder < dev->internal_start_block ||
-			    dev->gc_block_finder > dev->internal_end_block)
-				dev->gc_block_finder =
-				    dev->internal_start_block;
-
-			bi = yaffs_get_block_info(dev, dev->gc_block_finder);
-
-			pages_used = bi->pages_in_use - bi->soft_del_pages;
-
-			if (bi->block_state == YAFFS_BLOCK_STATE_FULL &&
-			    pages_used < dev->param.chunks_per_block &&
-			    (dev->gc_dirtiest < 1
-			     || pages_used < dev->gc_pages_in_use)
-			    && yaffs_block_ok_for_gc(dev, bi)) {
-				dev->gc_dirtiest = dev->gc_block_finder;
-				dev->gc_pages_in_use = pages_used;
-			}
-		}
+		dev->gc_dirtiest = yaffs_gc_summary_pick(dev, &pages_used);
+		dev->gc_pages_in_use = pages_used;
 
-		if (dev->gc_dirtiest > 0 && dev->gc_pages_in_use <= threshold)
+		if (dev->gc_dirtiest > 0 && dev->gc_pages_in_use <= threshold) {
 			selected = dev->gc_dirtiest;
+			dev->gc_summary_hits++;
+		}
 	}
 
 	/*
@@ -2865,8 +2957,8 @@ static unsigned yaffs_find_gc_block(struct yaffs_dev *dev,
 	} else {
 		dev->gc_not_done++;
 		yaffs_trace(YAFFS_TRACE_GC,
-			"GC none: finder %d skip %d threshold %d dirtiest %d using %d oldest %d%s",
-			dev->gc_block_finder, dev->gc_not_done, threshold,
+			"GC none: summary %d skip %d threshold %d dirtiest %d using %d oldest %d%s",
+			dev->gc_summary_n, dev->gc_not_done, threshold,
 			dev->gc_dirtiest, dev->gc_pages_in_use,
 			dev->oldest_dirty_block, background ? " bg" : "");
 	}
@@ -3067,6 +3159,8 @@ void yaffs_chunk_del(struct yaffs_dev *dev, int chunk_id, int mark_flash,
 		    bi->block_state != YAFFS_BLOCK_STATE_ALLOCATING &&
 		    bi->block_state != YAFFS_BLOCK_STATE_NEEDS_SCANNING) {
 			yaffs_block_became_dirty(dev, block);
+		} else {
+			yaffs_gc_summary_note(dev, block, bi);
 		}
 
 	}
@@ -4263,10 +4357,11 @@ void yaffs_handle_shadowed_obj(struct yaffs_dev *dev, int obj_id,
 
 	} else {
 		/* Handle YAFFS2 case (backward scanning)
-		 * If the shadowed object exists then ignore.
+		 * If the shadowed object exists then ignore, unless it came
+		 * from a checkpoint being replayed and has not been seen yet.
 		 */
 		obj = yaffs_find_by_number(dev, obj_id);
-		if (obj)
+		if (obj && (obj->valid || !obj->ckpt_replay))
 			return;
 	}
 
@@ -4279,7 +4374,8 @@ void yaffs_handle_shadowed_obj(struct yaffs_dev *dev, int obj_id,
 		return;
 	obj->is_shadowed = 1;
 	yaffs_add_obj_to_dir(dev->unlinked_dir, obj);
-	obj->variant.file_variant.shrink_size = 0;
+	if (obj->variant_type == YAFFS_OBJECT_TYPE_FILE)
+		obj->variant.file_variant.shrink_size = 0;
 	obj->valid = 1;		/* So that we don't read any other info for this file */
 
 }
@@ -4916,7 +5012,16 @@ int yaffs_guts_initialise(struct yaffs_dev *dev)
 	dev->passive_gc_count = 0;
 	dev->oldest_dirty_gc_count = 0;
 	dev->bg_gcs = 0;
+	dev->bg_gc_idle = 0;
+	dev->bg_gc_busy_skips = 0;
 	dev->gc_block_finder = 0;
+	dev->gc_summary_n = 0;
+	dev->gc_summary_overflow = 1;	/* Nothing known until scanned */
+	dev->gc_summary_hits = 0;
+	dev->gc_summary_rebuilds = 0;
+	dev->n_replayed_blocks = 0;
+	dev->checkpt_marker_chunk = -1;
+	dev->checkpt_stale = 0;
 	dev->buffered_block = -1;
 	dev->doing_buffered_block_rewrite = 0;
 	dev->n_deleted_files = 0;
@@ -60,7 +60,7 @@
 #define YAFFS_OBJECT_SPACE		0x40000
 #define YAFFS_MAX_OBJECT_ID		(YAFFS_OBJECT_SPACE -1)
 
-#define YAFFS_CHECKPOINT_VERSION 	4
+#define YAFFS_CHECKPOINT_VERSION 	5
 
 #ifdef CONFIG_YAFFS_UNICODE
 #define YAFFS_MAX_NAME_LENGTH		127
@@ -87,6 +87,9 @@
 
 #define YAFFS_N_TEMP_BUFFERS		6
 
+/* Number of dirtiest full blocks tracked as gc candidates */
+#define YAFFS_GC_SUMMARY_SIZE		16
+
 /* We limit the number attempts at sucessfully saving a chunk of data.
  * Small-page devices have 32 pages per block; large-page devices have 64.
  * Default to something in the order of 5 to 10 blocks worth of chunks.
@@ -398,6 +401,7 @@ struct yaffs_obj {
 
 	u8 xattr_known:1;	/* We know if this has object has xattribs or not. */
 	u8 has_xattr:1;		/* This object has xattribs. Valid if xattr_known. */
+	u8 ckpt_replay:1;	/* Restored from a stale checkpoint that is being replayed. */
 
 	u8 serial;		/* serial number of chunk in NAND. Cached here */
 	u16 sum;		/* sum of the name to speed searching */
@@ -524,6 +528,8 @@ struct yaffs_param {
 
 	int enable_xattr;	/* Enable xattribs */
 
+	int n_scan_threads;	/* Threads reading tags ahead of the mount scan. <= 1 reads in line */
+
 	/* NAND access functions (Must be set before calling YAFFS) */
 
 	int (*write_chunk_fn) (struct yaffs_dev * dev,
@@ -632,6 +638,15 @@ struct yaffs_dev {
 
 	int checkpoint_blocks_required;	/* Number of blocks needed to store current checkpoint set */
 
+	/* A checkpoint that is older than the file system is still used at
+	 * mount time: the blocks written since it was taken are replayed on
+	 * top of it. The first change after a checkpoint writes a marker to
+	 * the chunk following the checkpoint data to say that it is stale.
+	 */
+	int checkpt_marker_chunk;	/* Where the stale marker goes, -1 if no room */
+	int checkpt_stale;	/* The checkpoint on NAND needs replaying */
+	unsigned checkpt_seq;	/* seq_number when the checkpoint was taken */
+
 	/* Block Info */
 	struct yaffs_block_info *block_info;
 	u8 *chunk_bits;		/* bitmap of chunks in use */
@@ -672,6 +687,15 @@ struct yaffs_dev {
 	unsigned gc_chunk;
 	unsigned gc_skip;
 
+	/* The dirtiest full blocks, kept up to date as chunks are deleted so
+	 * that gc doesn't have to hunt through the block info for a victim.
+	 * gc_summary_overflow is set when a candidate may have been missed
+	 * and the summary has to be rebuilt from the block info once empty.
+	 */
+	int gc_summary[YAFFS_GC_SUMMARY_SIZE];
+	int gc_summary_n;
+	int gc_summary_overflow;
+
 	/* Special directories */
 	struct yaffs_obj *root_dir;
 	struct yaffs_obj *lost_n_found;
@@ -724,6 +748,11 @@ struct yaffs_dev {
 	u32 oldest_dirty_gc_count;
 	u32 n_gc_blocks;
 	u32 bg_gcs;
+	u32 bg_gc_idle;
+	u32 bg_gc_busy_skips;
+	u32 gc_summary_hits;
+	u32 gc_summary_rebuilds;
+	u32 n_replayed_blocks;	/* Blocks replayed over a stale checkpoint at mount */
 	u32 n_retired_writes;
 	u32 n_retired_blocks;
 	u32 n_ecc_fixed;
@@ -910,6 +939,8 @@ struct yaffs_tnode *yaffs_find_tnode_0(struct yaffs_dev *dev,
 
 u32 yaffs_get_group_base(struct yaffs_dev *dev, struct yaffs_tnode *tn,
 			 unsigned pos);
+void yaffs_load_tnode_0(struct yaffs_dev *dev, struct yaffs_tnode *tn,
+			unsigned pos, unsigned val);
 
 int yaffs_is_non_empty_dir(struct yaffs_obj *obj);
 #endif
@@ -180,12 +180,10 @@ int nandmtd1_read_chunk_tags(struct yaffs_dev *dev,
 	case -EUCLEAN:
 		/* MTD's ECC fixed the data */
 		eccres = YAFFS_ECC_RESULT_FIXED;
-		dev->n_ecc_fixed++;
 		break;
 
 	case -EBADMSG:
 		/* MTD's ECC could not fix the data */
-		dev->n_ecc_unfixed++;
 		/* fall into... */
 	default:
 		rettags(etags, YAFFS_ECC_RESULT_UNFIXED, 0);
@@ -17,27 +17,50 @@
 
 #include "yaffs_getblockinfo.h"
 
+/*
+ * Just the read: no statistics and no handling of ECC errors, which
+ * touch the device and block state.  For the scan reader threads, which
+ * leave tags->ecc_result to the scan.
+ */
+int yaffs_rd_chunk_tags_nand_raw(struct yaffs_dev *dev, int nand_chunk,
+				 u8 * buffer, struct yaffs_ext_tags *tags)
+{
+	int realigned_chunk = nand_chunk - dev->chunk_offset;
+
+	if (dev->param.read_chunk_tags_fn)
+		return dev->param.read_chunk_tags_fn(dev, realigned_chunk,
+						     buffer, tags);
+	return yaffs_tags_compat_rd(dev, realigned_chunk, buffer, tags);
+}
+
+/*
+ * Count the ECC result of a read_chunk_tags_fn read.  The drivers only
+ * report it in the tags, so that the scan readers can share the device.
+ */
+void yaffs_count_ecc(struct yaffs_dev *dev, struct yaffs_ext_tags *tags)
+{
+	if (tags->ecc_result == YAFFS_ECC_RESULT_FIXED)
+		dev->n_ecc_fixed++;
+	else if (tags->ecc_result == YAFFS_ECC_RESULT_UNFIXED)
+		dev->n_ecc_unfixed++;
+}
+
 int yaffs_rd_chunk_tags_nand(struct yaffs_dev *dev, int nand_chunk,
 			     u8 * buffer, struct yaffs_ext_tags *tags)
 {
 	int result;
 	struct yaffs_ext_tags local_tags;
 
-	int realigned_chunk = nand_chunk - dev->chunk_offset;
-
 	dev->n_page_reads++;
 
 	/* If there are no tags provided, use local tags to get prioritised gc working */
 	if (!tags)
 		tags = &local_tags;
 
+	result = yaffs_rd_chunk_tags_nand_raw(dev, nand_chunk, buffer, tags);
+	/* yaffs_tags_compat_rd() counts its own */
 	if (dev->param.read_chunk_tags_fn)
-		result =
-		    dev->param.read_chunk_tags_fn(dev, realigned_chunk, buffer,
-						  tags);
-	else
-		result = yaffs_tags_compat_rd(dev,
-					      realigned_chunk, buffer, tags);
+		yaffs_count_ecc(dev, tags);
 	if (tags && tags->ecc_result > YAFFS_ECC_RESULT_NO_ERROR) {
 
 		struct yaffs_block_info *bi;
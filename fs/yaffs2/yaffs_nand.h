@@ -20,6 +20,11 @@
 int yaffs_rd_chunk_tags_nand(struct yaffs_dev *dev, int nand_chunk,
 			     u8 * buffer, struct yaffs_ext_tags *tags);
 
+int yaffs_rd_chunk_tags_nand_raw(struct yaffs_dev *dev, int nand_chunk,
+				 u8 * buffer, struct yaffs_ext_tags *tags);
+
+void yaffs_count_ecc(struct yaffs_dev *dev, struct yaffs_ext_tags *tags);
+
 int yaffs_wr_chunk_tags_nand(struct yaffs_dev *dev,
 			     int nand_chunk,
 			     const u8 * buffer, struct yaffs_ext_tags *tags);
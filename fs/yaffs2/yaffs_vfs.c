@@ -96,6 +96,8 @@ unsigned int yaffs_wr_attempts = YAFFS_WR_ATTEMPTS;
 unsigned int yaffs_auto_checkpoint = 1;
 unsigned int yaffs_gc_control = 1;
 unsigned int yaffs_bg_enable = 1;
+unsigned int yaffs_scan_threads;
+unsigned int yaffs_checkpt_window = 64;
 
 /* Module Parameters */
 module_param(yaffs_trace_mask, uint, 0644);
@@ -103,6 +105,8 @@ module_param(yaffs_wr_attempts, uint, 0644);
 module_param(yaffs_auto_checkpoint, uint, 0644);
 module_param(yaffs_gc_control, uint, 0644);
 module_param(yaffs_bg_enable, uint, 0644);
+module_param(yaffs_scan_threads, uint, 0644);
+module_param(yaffs_checkpt_window, uint, 0644);
 
 
 #define yaffs_inode_to_obj_lv(iptr) ((iptr)->i_private)
@@ -1623,6 +1627,8 @@ static int yaffs_bg_thread_fn(void *data)
 	unsigned long next_gc = now;
 	unsigned long expires;
 	unsigned int urgency;
+	u32 last_writes = dev->n_page_writes;
+	int idle;
 
 	int gc_result;
 	struct timer_list timer;
@@ -1651,12 +1657,43 @@ static int yaffs_bg_thread_fn(void *data)
 
 		if (time_after(now, next_gc) && yaffs_bg_enable) {
 			if (!dev->is_checkpointed) {
+				/*
+				 * Nobody has written since the last pass, so
+				 * gc can make progress without getting in
+				 * anyone's way.  When writers are active
+				 * leave non-urgent gc for later.
+				 */
+				idle = (dev->n_page_writes == last_writes);
 				urgency = yaffs_bg_gc_urgency(dev);
-				gc_result = yaffs_bg_gc(dev, urgency);
+				if (urgency > 0 || idle) {
+					gc_result = yaffs_bg_gc(dev, urgency);
+					if (!urgency)
+						dev->bg_gc_idle++;
+				} else {
+					gc_result = 0;
+					dev->bg_gc_busy_skips++;
+				}
+				last_writes = dev->n_page_writes;
+
+				/*
+				 * Once enough blocks have been written past
+				 * the checkpoint, take a new one while idle
+				 * so that a mount after power loss has less
+				 * to replay.
+				 */
+				if (idle && !urgency && yaffs_checkpt_window &&
+				    !dev->read_only &&
+				    !dev->param.skip_checkpt_wr &&
+				    dev->seq_number - dev->checkpt_seq >=
+				    yaffs_checkpt_window)
+					yaffs_flush_super(context->super, 1);
+
 				if (urgency > 1)
 					next_gc = now + HZ / 20 + 1;
 				else if (urgency > 0)
 					next_gc = now + HZ / 10 + 1;
+				else if (idle && !gc_result)
+					next_gc = now + HZ / 4 + 1;
 				else
 					next_gc = now + HZ * 2;
 			} else	{
@@ -2296,6 +2333,11 @@ static struct super_block *yaffs_internal_read_super(int yaffs_version,
 	param->skip_checkpt_rd = options.skip_checkpoint_read;
 	param->skip_checkpt_wr = options.skip_checkpoint_write;
 
+	/* Tag readers for the mount scan, 0 means one per cpu up to 4 */
+	param->n_scan_threads = yaffs_scan_threads;
+	if (!param->n_scan_threads)
+		param->n_scan_threads = min_t(int, num_online_cpus(), 4);
+
 	mutex_lock(&yaffs_context_lock);
 	/* Get a mount id */
 	found = 0;
@@ -2472,6 +2514,16 @@ static char *yaffs_dump_dev_part1(char *buf, struct yaffs_dev *dev)
 		    dev->oldest_dirty_gc_count);
 	buf += sprintf(buf, "n_gc_blocks........... %u\n", dev->n_gc_blocks);
 	buf += sprintf(buf, "bg_gcs................ %u\n", dev->bg_gcs);
+	buf += sprintf(buf, "bg_gc_idle............ %u\n", dev->bg_gc_idle);
+	buf += sprintf(buf, "bg_gc_busy_skips...... %u\n",
+		dev->bg_gc_busy_skips);
+	buf += sprintf(buf, "gc_summary_hits....... %u\n",
+		dev->gc_summary_hits);
+	buf += sprintf(buf, "gc_summary_rebuilds... %u\n",
+		dev->gc_summary_rebuilds);
+	buf += sprintf(buf, "n_replayed_blocks..... %u\n",
+		dev->n_replayed_blocks);
+	buf += sprintf(buf, "checkpt_stale......... %d\n", dev->checkpt_stale);
 	buf +=
 	    sprintf(buf, "n_retired_writes...... %u\n", dev->n_retired_writes);
 	buf +=
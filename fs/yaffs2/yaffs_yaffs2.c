@@ -732,10 +732,12 @@ static int yaffs2_wr_checkpt_data(struct yaffs_dev *dev)
 	if (!yaffs_checkpt_close(dev))
 		ok = 0;
 
-	if (ok)
+	if (ok) {
 		dev->is_checkpointed = 1;
-	else
+		dev->checkpt_seq = dev->seq_number;
+	} else {
 		dev->is_checkpointed = 0;
+	}
 
 	return dev->is_checkpointed;
 }
@@ -786,6 +788,17 @@ static int yaffs2_rd_checkpt_data(struct yaffs_dev *dev)
 	if (!yaffs_checkpt_close(dev))
 		ok = 0;
 
+	if (ok) {
+		/* Is there a stale marker after it? */
+		int marker = yaffs2_checkpt_read_marker(dev);
+
+		if (marker < 0)
+			ok = 0;
+		else
+			dev->checkpt_stale = marker;
+		dev->checkpt_seq = dev->seq_number;
+	}
+
 	if (ok)
 		dev->is_checkpointed = 1;
 	else
@@ -797,7 +810,13 @@ static int yaffs2_rd_checkpt_data(struct yaffs_dev *dev)
 
 void yaffs2_checkpt_invalidate(struct yaffs_dev *dev)
 {
-	if (dev->is_checkpointed || dev->blocks_in_checkpt > 0) {
+	/* Keep a checkpoint that can be marked stale, it is still a good
+	 * place for the next mount to start from.
+	 */
+	if (dev->is_checkpointed && yaffs2_checkpt_mark_stale(dev)) {
+		dev->is_checkpointed = 0;
+	} else if (dev->is_checkpointed ||
+		   (dev->blocks_in_checkpt > 0 && !dev->checkpt_stale)) {
 		dev->is_checkpointed = 0;
 		yaffs2_checkpt_invalidate_stream(dev);
 	}
@@ -837,7 +856,15 @@ int yaffs2_checkpt_restore(struct yaffs_dev *dev)
 
 	retval = yaffs2_rd_checkpt_data(dev);
 
-	if (dev->is_checkpointed) {
+	if (retval && dev->checkpt_stale) {
+		/* Bring it up to date with what was written after it */
+		dev->is_checkpointed = 0;
+		retval = yaffs2_scan_replay(dev);
+		if (!retval)
+			dev->checkpt_stale = 0;
+	}
+
+	if (retval) {
 		yaffs_verify_objects(dev);
 		yaffs_verify_blocks(dev);
 		yaffs_verify_free_chunks(dev);
@@ -940,6 +967,7 @@ int yaffs2_handle_hole(struct yaffs_obj *obj, loff_t new_size)
 struct yaffs_block_index {
 	int seq;
 	int block;
+	int first_chunk;	/* Chunks below this are already known */
 };
 
 static int yaffs2_ybicmp(const void *a, const void *b)
@@ -954,134 +982,278 @@ static int yaffs2_ybicmp(const void *a, const void *b)
 		return aseq - bseq;
 }
 
-int yaffs2_scan_backwards(struct yaffs_dev *dev)
-{
-	struct yaffs_ext_tags tags;
-	int blk;
-	int block_iter;
-	int start_iter;
-	int end_iter;
-	int n_to_scan = 0;
+/*
+ * Scan readers.
+ * The scan spends most of its time waiting for tags to come off the NAND.
+ * Reader threads fetch the tags of the blocks the scan is going to want
+ * next into a window of slots, so that the reads overlap with the work of
+ * building the objects. Step k of the scan is block_index[n_blocks - 1 - k],
+ * held in slot k % window until the scan hands it back.
+ * The readers only read: the scan counts the reads and ECC results and
+ * deals with ECC errors as it takes each chunk's tags, so that the device
+ * and block state is only ever changed by the scanning thread.
+ */
+#define YAFFS_SCAN_MAX_THREADS	8
+
+struct yaffs_scan_reader {
+	struct yaffs_dev *dev;
+	struct yaffs_block_index *block_index;
+	int n_blocks;
+	int window;
+	struct yaffs_ext_tags *tags;	/* window * chunks_per_block */
+	int *slot_step;		/* Step held by each slot, -1 if none */
+	int next;		/* Next step to be read */
+	int consumed;		/* Steps the scan has finished with */
+	int stop;
+	atomic_t running;
+	spinlock_t lock;
+	wait_queue_head_t wq;
+	struct completion done;
+};
 
-	int chunk;
-	int result;
+static int yaffs2_scan_reader_fn(void *data)
+{
+	struct yaffs_scan_reader *r = data;
+	struct yaffs_dev *dev = r->dev;
+	int cpb = dev->param.chunks_per_block;
+	struct yaffs_block_index *bix;
+	struct yaffs_ext_tags *t;
+	int step;
 	int c;
-	int deleted;
-	enum yaffs_block_state state;
-	struct yaffs_obj *hard_list = NULL;
-	struct yaffs_block_info *bi;
-	u32 seq_number;
-	struct yaffs_obj_hdr *oh;
-	struct yaffs_obj *in;
-	struct yaffs_obj *parent;
-	int n_blocks = dev->internal_end_block - dev->internal_start_block + 1;
-	int is_unlinked;
-	u8 *chunk_data;
 
-	int file_size;
-	int is_shrink;
-	int found_chunks;
-	int equiv_id;
-	int alloc_failed = 0;
+	while (1) {
+		wait_event(r->wq, r->stop || r->next >= r->n_blocks ||
+			   r->next < r->consumed + r->window);
 
-	struct yaffs_block_index *block_index = NULL;
-	int alt_block_index = 0;
-
-	yaffs_trace(YAFFS_TRACE_SCAN,
-		"yaffs2_scan_backwards starts  intstartblk %d intendblk %d...",
-		dev->internal_start_block, dev->internal_end_block);
-
-	dev->seq_number = YAFFS_LOWEST_SEQUENCE_NUMBER;
+		spin_lock(&r->lock);
+		if (r->stop || r->next >= r->n_blocks) {
+			spin_unlock(&r->lock);
+			break;
+		}
+		if (r->next >= r->consumed + r->window) {
+			/* Another reader got the free slot */
+			spin_unlock(&r->lock);
+			continue;
+		}
+		step = r->next++;
+		spin_unlock(&r->lock);
+
+		bix = &r->block_index[r->n_blocks - 1 - step];
+		t = r->tags + (step % r->window) * cpb;
+		for (c = bix->first_chunk; c < cpb; c++)
+			yaffs_rd_chunk_tags_nand_raw(dev, bix->block * cpb + c,
+						     NULL, &t[c]);
+
+		spin_lock(&r->lock);
+		r->slot_step[step % r->window] = step;
+		spin_unlock(&r->lock);
+		wake_up_all(&r->wq);
+	}
 
-	block_index = kmalloc(n_blocks * sizeof(struct yaffs_block_index),
-			GFP_NOFS);
+	if (atomic_dec_and_test(&r->running))
+		complete(&r->done);
+	return 0;
+}
 
-	if (!block_index) {
-		block_index =
-		    vmalloc(n_blocks * sizeof(struct yaffs_block_index));
-		alt_block_index = 1;
-	}
+static int yaffs2_scan_reader_ready(struct yaffs_scan_reader *r, int step)
+{
+	int ready;
 
-	if (!block_index) {
-		yaffs_trace(YAFFS_TRACE_SCAN,
-			"yaffs2_scan_backwards() could not allocate block index!"
-			);
-		return YAFFS_FAIL;
-	}
+	spin_lock(&r->lock);
+	ready = (r->slot_step[step % r->window] == step);
+	spin_unlock(&r->lock);
+	return ready;
+}
 
-	dev->blocks_in_checkpt = 0;
+/* Wait for the tags of step to be read, returns them indexed by chunk */
+static struct yaffs_ext_tags *yaffs2_scan_reader_get(struct yaffs_scan_reader
+						     *r, int step)
+{
+	wait_event(r->wq, yaffs2_scan_reader_ready(r, step));
+	return r->tags + (step % r->window) * r->dev->param.chunks_per_block;
+}
 
-	chunk_data = yaffs_get_temp_buffer(dev, __LINE__);
+static void yaffs2_scan_reader_put(struct yaffs_scan_reader *r, int step)
+{
+	spin_lock(&r->lock);
+	r->slot_step[step % r->window] = -1;
+	r->consumed = step + 1;
+	spin_unlock(&r->lock);
+	wake_up_all(&r->wq);
+}
 
-	/* Scan all the blocks to determine their state */
-	bi = dev->block_info;
-	for (blk = dev->internal_start_block; blk <= dev->internal_end_block;
-	     blk++) {
-		yaffs_clear_chunk_bits(dev, blk);
-		bi->pages_in_use = 0;
-		bi->soft_del_pages = 0;
+static void yaffs2_scan_reader_stop(struct yaffs_scan_reader *r)
+{
+	spin_lock(&r->lock);
+	r->stop = 1;
+	spin_unlock(&r->lock);
+	wake_up_all(&r->wq);
+	wait_for_completion(&r->done);
+
+	vfree(r->tags);
+	kfree(r->slot_step);
+	kfree(r);
+}
 
-		yaffs_query_init_block_state(dev, blk, &state, &seq_number);
+/*
+ * Start the readers for a scan of block_index, or return NULL to have the
+ * scan read its own tags. Inband tags need the whole chunk and the temp
+ * buffers, so they are always read in line.
+ */
+static struct yaffs_scan_reader *yaffs2_scan_reader_start(struct yaffs_dev
+							  *dev,
+							  struct
+							  yaffs_block_index
+							  *block_index,
+							  int n_blocks)
+{
+	struct yaffs_scan_reader *r;
+	struct task_struct *task;
+	int n_threads = dev->param.n_scan_threads;
+	int i;
 
-		bi->block_state = state;
-		bi->seq_number = seq_number;
+	if (n_threads <= 1 || n_blocks < 2 || dev->param.inband_tags)
+		return NULL;
+	if (n_threads > YAFFS_SCAN_MAX_THREADS)
+		n_threads = YAFFS_SCAN_MAX_THREADS;
+
+	r = kzalloc(sizeof(*r), GFP_NOFS);
+	if (!r)
+		return NULL;
+
+	r->dev = dev;
+	r->block_index = block_index;
+	r->n_blocks = n_blocks;
+	r->window = n_threads * 4;
+	if (r->window > n_blocks)
+		r->window = n_blocks;
+	r->tags = vmalloc(r->window * dev->param.chunks_per_block *
+			  sizeof(struct yaffs_ext_tags));
+	r->slot_step = kmalloc(r->window * sizeof(int), GFP_NOFS);
+	if (!r->tags || !r->slot_step) {
+		vfree(r->tags);
+		kfree(r->slot_step);
+		kfree(r);
+		return NULL;
+	}
+	for (i = 0; i < r->window; i++)
+		r->slot_step[i] = -1;
+
+	spin_lock_init(&r->lock);
+	init_waitqueue_head(&r->wq);
+	init_completion(&r->done);
+	atomic_set(&r->running, n_threads);
+
+	for (i = 0; i < n_threads; i++) {
+		task = kthread_run(yaffs2_scan_reader_fn, r, "yaffs-scan/%d", i);
+		if (IS_ERR(task)) {
+			/* Run with the ones we have */
+			if (atomic_sub_and_test(n_threads - i, &r->running))
+				complete(&r->done);
+			break;
+		}
+	}
 
-		if (bi->seq_number == YAFFS_SEQUENCE_CHECKPOINT_DATA)
-			bi->block_state = state = YAFFS_BLOCK_STATE_CHECKPOINT;
-		if (bi->seq_number == YAFFS_SEQUENCE_BAD_BLOCK)
-			bi->block_state = state = YAFFS_BLOCK_STATE_DEAD;
+	if (i == 0) {
+		vfree(r->tags);
+		kfree(r->slot_step);
+		kfree(r);
+		return NULL;
+	}
 
-		yaffs_trace(YAFFS_TRACE_SCAN_DEBUG,
-			"Block scanning block %d state %d seq %d",
-			blk, state, seq_number);
+	yaffs_trace(YAFFS_TRACE_SCAN,
+		"%d scan readers, window %d blocks", i, r->window);
 
-		if (state == YAFFS_BLOCK_STATE_CHECKPOINT) {
-			dev->blocks_in_checkpt++;
+	return r;
+}
 
-		} else if (state == YAFFS_BLOCK_STATE_DEAD) {
-			yaffs_trace(YAFFS_TRACE_BAD_BLOCKS,
-				"block %d is bad", blk);
-		} else if (state == YAFFS_BLOCK_STATE_EMPTY) {
-			yaffs_trace(YAFFS_TRACE_SCAN_DEBUG, "Block empty ");
-			dev->n_erased_blocks++;
-			dev->n_free_chunks += dev->param.chunks_per_block;
-		} else if (state == YAFFS_BLOCK_STATE_NEEDS_SCANNING) {
+/*
+ * Checkpoint replay.
+ * A chunk is new if it was written after the checkpoint was taken: it is
+ * in a block with a later sequence number or past the allocation point of
+ * the block that was being allocated from.
+ */
+struct yaffs2_replay {
+	unsigned seq;		/* seq_number of the checkpoint */
+	int alloc_block;	/* Block being allocated from at checkpoint */
+	int alloc_page;
+	u8 *erased;		/* Blocks erased since the checkpoint */
+};
 
-			/* Determine the highest sequence number */
-			if (seq_number >= YAFFS_LOWEST_SEQUENCE_NUMBER &&
-			    seq_number < YAFFS_HIGHEST_SEQUENCE_NUMBER) {
+static int yaffs2_replay_chunk_is_new(struct yaffs_dev *dev,
+				      struct yaffs2_replay *rp, int chunk)
+{
+	int blk = chunk / dev->param.chunks_per_block;
+	struct yaffs_block_info *bi = yaffs_get_block_info(dev, blk);
 
-				block_index[n_to_scan].seq = seq_number;
-				block_index[n_to_scan].block = blk;
+	if (bi->seq_number > rp->seq)
+		return 1;
+	return blk == rp->alloc_block &&
+	    (chunk % dev->param.chunks_per_block) >= rp->alloc_page;
+}
 
-				n_to_scan++;
+/*
+ * A new data chunk replaces the one the checkpoint had. Drop the old one
+ * first since the backwards scan would otherwise keep it.
+ */
+static void yaffs2_replay_drop_chunk(struct yaffs_dev *dev,
+				     struct yaffs2_replay *rp,
+				     struct yaffs_obj *in, int inode_chunk)
+{
+	struct yaffs_tnode *tn;
+	int existing;
 
-				if (seq_number >= dev->seq_number)
-					dev->seq_number = seq_number;
-			} else {
-				/* TODO: Nasty sequence number! */
-				yaffs_trace(YAFFS_TRACE_SCAN,
-					"Block scanning block %d has bad sequence number %d",
-					blk, seq_number);
+	tn = yaffs_find_tnode_0(dev, &in->variant.file_variant, inode_chunk);
+	if (!tn)
+		return;
 
-			}
-		}
-		bi++;
-	}
+	existing = yaffs_get_group_base(dev, tn, inode_chunk);
+	if (existing <= 0 || yaffs2_replay_chunk_is_new(dev, rp, existing))
+		return;
 
-	yaffs_trace(YAFFS_TRACE_SCAN, "%d blocks to be sorted...", n_to_scan);
+	yaffs_chunk_del(dev, existing, 1, __LINE__);
+	yaffs_load_tnode_0(dev, tn, inode_chunk, 0);
+	in->n_data_chunks--;
+}
 
-	cond_resched();
+/*
+ * yaffs2_scan_blocks()
+ * Scan the blocks in block_index, newest first. rp is set when replaying
+ * over a checkpoint. Returns YAFFS_FAIL if the scan could not be completed.
+ */
+static int yaffs2_scan_blocks(struct yaffs_dev *dev,
+			      struct yaffs_block_index *block_index,
+			      int n_to_scan, struct yaffs2_replay *rp,
+			      u8 *chunk_data, struct yaffs_obj **hard_list_ptr)
+{
+	struct yaffs_ext_tags tags;
+	struct yaffs_ext_tags *blk_tags;
+	struct yaffs_scan_reader *reader;
+	int blk;
+	int block_iter;
+	int start_iter;
+	int end_iter;
 
-	/* Sort the blocks by sequence number */
-	sort(block_index, n_to_scan, sizeof(struct yaffs_block_index),
-		   yaffs2_ybicmp, NULL);
+	int chunk;
+	int result;
+	int c;
+	int deleted;
+	enum yaffs_block_state state;
+	struct yaffs_obj *hard_list = *hard_list_ptr;
+	struct yaffs_block_info *bi;
+	struct yaffs_obj_hdr *oh;
+	struct yaffs_obj *in;
+	struct yaffs_obj *parent;
+	int is_unlinked;
 
-	cond_resched();
+	int file_size;
+	int is_shrink;
+	int found_chunks;
+	int equiv_id;
+	int alloc_failed = 0;
 
-	yaffs_trace(YAFFS_TRACE_SCAN, "...done");
+	reader = yaffs2_scan_reader_start(dev, block_index, n_to_scan);
 
-	/* Now scan the blocks looking at the data. */
 	start_iter = 0;
 	end_iter = n_to_scan - 1;
 	yaffs_trace(YAFFS_TRACE_SCAN_DEBUG, "%d blocks to scan", n_to_scan);
@@ -1100,12 +1272,15 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 
 		state = bi->block_state;
 
+		blk_tags = reader ?
+		    yaffs2_scan_reader_get(reader, end_iter - block_iter) : NULL;
+
 		deleted = 0;
 
 		/* For each chunk in each block that needs scanning.... */
 		found_chunks = 0;
 		for (c = dev->param.chunks_per_block - 1;
-		     !alloc_failed && c >= 0 &&
+		     !alloc_failed && c >= block_index[block_iter].first_chunk &&
 		     (state == YAFFS_BLOCK_STATE_NEEDS_SCANNING ||
 		      state == YAFFS_BLOCK_STATE_ALLOCATING); c--) {
 			/* Scan backwards...
@@ -1114,8 +1289,16 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 
 			chunk = blk * dev->param.chunks_per_block + c;
 
-			result = yaffs_rd_chunk_tags_nand(dev, chunk, NULL,
-							  &tags);
+			if (blk_tags) {
+				tags = blk_tags[c];
+				dev->n_page_reads++;
+				yaffs_count_ecc(dev, &tags);
+				if (tags.ecc_result >
+				    YAFFS_ECC_RESULT_NO_ERROR)
+					yaffs_handle_chunk_error(dev, bi);
+			} else
+				result = yaffs_rd_chunk_tags_nand(dev, chunk,
+								  NULL, &tags);
 
 			/* Let's have a good look at this chunk... */
 
@@ -1213,6 +1396,9 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 				    && chunk_base <
 				    in->variant.file_variant.shrink_size) {
 					/* This has not been invalidated by a resize */
+					if (in->ckpt_replay)
+						yaffs2_replay_drop_chunk(dev,
+							rp, in, tags.chunk_id);
 					if (!yaffs_put_chunk_in_file
 					    (in, tags.chunk_id, chunk, -1)) {
 						alloc_failed = 1;
@@ -1228,8 +1414,12 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 					    scanned_size < endpos) {
 						in->variant.file_variant.
 						    scanned_size = endpos;
-						in->variant.file_variant.
-						    file_size = endpos;
+						/* A replayed file may be bigger already */
+						if (in->variant.file_variant.
+						    file_size < endpos)
+							in->variant.
+							    file_variant.
+							    file_size = endpos;
 					}
 
 				} else if (in) {
@@ -1372,13 +1562,31 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 				}
 
 				if (!in->valid && in->variant_type !=
-				    (oh ? oh->type : tags.extra_obj_type))
+				    (oh ? oh->type : tags.extra_obj_type)) {
 					yaffs_trace(YAFFS_TRACE_ERROR,
 						"yaffs tragedy: Bad object type, %d != %d, for object %d at chunk %d during scan",
 						oh ?
 						oh->type : tags.extra_obj_type,
 						in->variant_type, tags.obj_id,
 						chunk);
+					if (in->ckpt_replay) {
+						/* The object id has been reused.
+						 * Leave it to a full scan.
+						 */
+						alloc_failed = 1;
+						continue;
+					}
+				}
+
+				if (!in->valid && in->ckpt_replay &&
+				    in->hdr_chunk > 0) {
+					/* The header the checkpoint knew of
+					 * has been replaced.
+					 */
+					yaffs_chunk_del(dev, in->hdr_chunk, 1,
+							__LINE__);
+					in->hdr_chunk = 0;
+				}
 
 				if (!in->valid &&
 				    (tags.obj_id == YAFFS_OBJECTID_ROOT ||
@@ -1408,6 +1616,7 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 
 						in->yst_mode = oh->yst_mode;
 						yaffs_load_attribs(in, oh);
+						in->lazy_loaded = 0;
 
 						if (oh->shadows_obj > 0)
 							yaffs_handle_shadowed_obj
@@ -1491,6 +1700,13 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 						/* Todo got a problem */
 						break;
 					case YAFFS_OBJECT_TYPE_FILE:
+						/* Only data newer than the header
+						 * can take the size past it.
+						 */
+						in->variant.file_variant.
+						    file_size =
+						    in->variant.file_variant.
+						    scanned_size;
 
 						if (in->variant.
 						    file_variant.scanned_size <
@@ -1520,6 +1736,11 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 						break;
 					case YAFFS_OBJECT_TYPE_HARDLINK:
 						if (!is_unlinked) {
+							/* Off any chain the checkpoint
+							 * put it on.
+							 */
+							list_del_init(&in->
+								      hard_links);
 							in->variant.
 							    hardlink_variant.
 							    equiv_id = equiv_id;
@@ -1571,8 +1792,135 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 			yaffs_block_became_dirty(dev, blk);
 		}
 
+		if (reader)
+			yaffs2_scan_reader_put(reader, end_iter - block_iter);
+	}
+
+	if (reader)
+		yaffs2_scan_reader_stop(reader);
+
+	*hard_list_ptr = hard_list;
+
+	return alloc_failed ? YAFFS_FAIL : YAFFS_OK;
+}
+
+int yaffs2_scan_backwards(struct yaffs_dev *dev)
+{
+	int blk;
+	int n_to_scan = 0;
+
+	enum yaffs_block_state state;
+	struct yaffs_obj *hard_list = NULL;
+	struct yaffs_block_info *bi;
+	u32 seq_number;
+	int n_blocks = dev->internal_end_block - dev->internal_start_block + 1;
+	u8 *chunk_data;
+
+	int alloc_failed = 0;
+
+	struct yaffs_block_index *block_index = NULL;
+	int alt_block_index = 0;
+
+	yaffs_trace(YAFFS_TRACE_SCAN,
+		"yaffs2_scan_backwards starts  intstartblk %d intendblk %d...",
+		dev->internal_start_block, dev->internal_end_block);
+
+	dev->seq_number = YAFFS_LOWEST_SEQUENCE_NUMBER;
+
+	block_index = kmalloc(n_blocks * sizeof(struct yaffs_block_index),
+			GFP_NOFS);
+
+	if (!block_index) {
+		block_index =
+		    vmalloc(n_blocks * sizeof(struct yaffs_block_index));
+		alt_block_index = 1;
 	}
 
+	if (!block_index) {
+		yaffs_trace(YAFFS_TRACE_SCAN,
+			"yaffs2_scan_backwards() could not allocate block index!"
+			);
+		return YAFFS_FAIL;
+	}
+
+	dev->blocks_in_checkpt = 0;
+
+	chunk_data = yaffs_get_temp_buffer(dev, __LINE__);
+
+	/* Scan all the blocks to determine their state */
+	bi = dev->block_info;
+	for (blk = dev->internal_start_block; blk <= dev->internal_end_block;
+	     blk++) {
+		yaffs_clear_chunk_bits(dev, blk);
+		bi->pages_in_use = 0;
+		bi->soft_del_pages = 0;
+
+		yaffs_query_init_block_state(dev, blk, &state, &seq_number);
+
+		bi->block_state = state;
+		bi->seq_number = seq_number;
+
+		if (bi->seq_number == YAFFS_SEQUENCE_CHECKPOINT_DATA)
+			bi->block_state = state = YAFFS_BLOCK_STATE_CHECKPOINT;
+		if (bi->seq_number == YAFFS_SEQUENCE_BAD_BLOCK)
+			bi->block_state = state = YAFFS_BLOCK_STATE_DEAD;
+
+		yaffs_trace(YAFFS_TRACE_SCAN_DEBUG,
+			"Block scanning block %d state %d seq %d",
+			blk, state, seq_number);
+
+		if (state == YAFFS_BLOCK_STATE_CHECKPOINT) {
+			dev->blocks_in_checkpt++;
+
+		} else if (state == YAFFS_BLOCK_STATE_DEAD) {
+			yaffs_trace(YAFFS_TRACE_BAD_BLOCKS,
+				"block %d is bad", blk);
+		} else if (state == YAFFS_BLOCK_STATE_EMPTY) {
+			yaffs_trace(YAFFS_TRACE_SCAN_DEBUG, "Block empty ");
+			dev->n_erased_blocks++;
+			dev->n_free_chunks += dev->param.chunks_per_block;
+		} else if (state == YAFFS_BLOCK_STATE_NEEDS_SCANNING) {
+
+			/* Determine the highest sequence number */
+			if (seq_number >= YAFFS_LOWEST_SEQUENCE_NUMBER &&
+			    seq_number < YAFFS_HIGHEST_SEQUENCE_NUMBER) {
+
+				block_index[n_to_scan].seq = seq_number;
+				block_index[n_to_scan].block = blk;
+				block_index[n_to_scan].first_chunk = 0;
+
+				n_to_scan++;
+
+				if (seq_number >= dev->seq_number)
+					dev->seq_number = seq_number;
+			} else {
+				/* TODO: Nasty sequence number! */
+				yaffs_trace(YAFFS_TRACE_SCAN,
+					"Block scanning block %d has bad sequence number %d",
+					blk, seq_number);
+
+			}
+		}
+		bi++;
+	}
+
+	yaffs_trace(YAFFS_TRACE_SCAN, "%d blocks to be sorted...", n_to_scan);
+
+	cond_resched();
+
+	/* Sort the blocks by sequence number */
+	sort(block_index, n_to_scan, sizeof(struct yaffs_block_index),
+		   yaffs2_ybicmp, NULL);
+
+	cond_resched();
+
+	yaffs_trace(YAFFS_TRACE_SCAN, "...done");
+
+	/* Now scan the blocks looking at the data. */
+	if (!yaffs2_scan_blocks(dev, block_index, n_to_scan, NULL,
+				chunk_data, &hard_list))
+		alloc_failed = 1;
+
 	yaffs_skip_rest_of_block(dev);
 
 	if (alt_block_index)
@@ -1596,3 +1944,296 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 
 	return YAFFS_OK;
 }
+
+/*
+ * Drop the chunks of a file that are in erased blocks. The blocks have
+ * already been reset so the chunks are not deleted, just forgotten.
+ */
+static void yaffs2_replay_prune_worker(struct yaffs_obj *in,
+				       struct yaffs_tnode *tn, u32 level,
+				       int chunk_offset, u8 *erased)
+{
+	struct yaffs_dev *dev = in->my_dev;
+	int cpb = dev->param.chunks_per_block;
+	int i;
+	int chunk;
+
+	if (!tn)
+		return;
+
+	if (level > 0) {
+		for (i = 0; i < YAFFS_NTNODES_INTERNAL; i++)
+			yaffs2_replay_prune_worker(in, tn->internal[i],
+						   level - 1,
+						   (chunk_offset <<
+						    YAFFS_TNODES_INTERNAL_BITS)
+						   + i, erased);
+		return;
+	}
+
+	for (i = 0; i < YAFFS_NTNODES_LEVEL0; i++) {
+		chunk = yaffs_get_group_base(dev, tn, i);
+		if (chunk > 0 &&
+		    erased[chunk / cpb - dev->internal_start_block]) {
+			yaffs_load_tnode_0(dev, tn, i, 0);
+			in->n_data_chunks--;
+		}
+	}
+}
+
+/*
+ * Delete the chunks of a file that the checkpoint had and that a shrink
+ * since then has cut off.
+ */
+static void yaffs2_replay_shrink_worker(struct yaffs_obj *in,
+					struct yaffs_tnode *tn, u32 level,
+					int chunk_offset,
+					struct yaffs2_replay *rp)
+{
+	struct yaffs_dev *dev = in->my_dev;
+	u32 shrink_size = in->variant.file_variant.shrink_size;
+	int inode_chunk;
+	int i;
+	int chunk;
+
+	if (!tn)
+		return;
+
+	if (level > 0) {
+		for (i = 0; i < YAFFS_NTNODES_INTERNAL; i++)
+			yaffs2_replay_shrink_worker(in, tn->internal[i],
+						    level - 1,
+						    (chunk_offset <<
+						     YAFFS_TNODES_INTERNAL_BITS)
+						    + i, rp);
+		return;
+	}
+
+	for (i = 0; i < YAFFS_NTNODES_LEVEL0; i++) {
+		inode_chunk = (chunk_offset << YAFFS_TNODES_LEVEL0_BITS) + i;
+		chunk = yaffs_get_group_base(dev, tn, i);
+		if (chunk > 0 && inode_chunk > 0 &&
+		    (u32) (inode_chunk - 1) * dev->data_bytes_per_chunk >=
+		    shrink_size &&
+		    !yaffs2_replay_chunk_is_new(dev, rp, chunk)) {
+			yaffs_chunk_del(dev, chunk, 1, __LINE__);
+			yaffs_load_tnode_0(dev, tn, i, 0);
+			in->n_data_chunks--;
+		}
+	}
+}
+
+/*
+ * yaffs2_scan_replay()
+ * Bring a stale checkpoint that has just been read up to date by scanning
+ * only the blocks written since it was taken. The blocks are scanned
+ * backwards just like a full scan, with the objects from the checkpoint
+ * marked invalid so that newer headers replace them. Anything that does
+ * not fit returns YAFFS_FAIL and the caller falls back to a full scan.
+ */
+int yaffs2_scan_replay(struct yaffs_dev *dev)
+{
+	struct yaffs2_replay replay;
+	struct yaffs_block_index *block_index = NULL;
+	struct yaffs_block_info *bi;
+	struct yaffs_obj *hard_list = NULL;
+	struct yaffs_obj *obj;
+	struct list_head *lh;
+	struct list_head *n;
+	enum yaffs_block_state state;
+	u32 seq_number;
+	int n_blocks = dev->internal_end_block - dev->internal_start_block + 1;
+	int n_to_scan = 0;
+	int alt_block_index = 0;
+	int ok = 1;
+	int blk;
+	int i;
+	u8 *chunk_data;
+
+	if (dev->chunk_grp_size > 1)
+		return YAFFS_FAIL;
+
+	replay.seq = dev->seq_number;
+	replay.alloc_block = dev->alloc_block;
+	replay.alloc_page = dev->alloc_page;
+	replay.erased = kzalloc(n_blocks, GFP_NOFS);
+	if (!replay.erased)
+		return YAFFS_FAIL;
+
+	block_index = kmalloc(n_blocks * sizeof(struct yaffs_block_index),
+			      GFP_NOFS);
+	if (!block_index) {
+		block_index =
+		    vmalloc(n_blocks * sizeof(struct yaffs_block_index));
+		alt_block_index = 1;
+	}
+	if (!block_index) {
+		kfree(replay.erased);
+		return YAFFS_FAIL;
+	}
+
+	/* Find what has changed since the checkpoint */
+	for (blk = dev->internal_start_block;
+	     ok && blk <= dev->internal_end_block; blk++) {
+		bi = yaffs_get_block_info(dev, blk);
+		if (bi->block_state == YAFFS_BLOCK_STATE_CHECKPOINT ||
+		    bi->block_state == YAFFS_BLOCK_STATE_DEAD)
+			continue;
+
+		yaffs_query_init_block_state(dev, blk, &state, &seq_number);
+
+		if (state == YAFFS_BLOCK_STATE_DEAD ||
+		    seq_number == YAFFS_SEQUENCE_BAD_BLOCK) {
+			/* Retired since */
+			replay.erased[blk - dev->internal_start_block] = 1;
+			bi->block_state = YAFFS_BLOCK_STATE_DEAD;
+		} else if (seq_number == YAFFS_SEQUENCE_CHECKPOINT_DATA) {
+			/* Some other checkpoint. Something is badly wrong */
+			ok = 0;
+		} else if (state == YAFFS_BLOCK_STATE_EMPTY) {
+			if (bi->block_state != YAFFS_BLOCK_STATE_EMPTY) {
+				replay.erased[blk - dev->internal_start_block] =
+				    1;
+				bi->block_state = YAFFS_BLOCK_STATE_EMPTY;
+			}
+		} else if (seq_number > replay.seq &&
+			   seq_number < YAFFS_HIGHEST_SEQUENCE_NUMBER) {
+			/* Written since, maybe after being erased */
+			if (bi->block_state != YAFFS_BLOCK_STATE_EMPTY)
+				replay.erased[blk - dev->internal_start_block] =
+				    1;
+			bi->block_state = YAFFS_BLOCK_STATE_NEEDS_SCANNING;
+			bi->seq_number = seq_number;
+			block_index[n_to_scan].seq = seq_number;
+			block_index[n_to_scan].block = blk;
+			block_index[n_to_scan].first_chunk = 0;
+			n_to_scan++;
+		} else if (blk == replay.alloc_block &&
+			   seq_number == bi->seq_number) {
+			/* Written past where the checkpoint left it */
+			bi->block_state = YAFFS_BLOCK_STATE_NEEDS_SCANNING;
+			block_index[n_to_scan].seq = seq_number;
+			block_index[n_to_scan].block = blk;
+			block_index[n_to_scan].first_chunk = replay.alloc_page;
+			n_to_scan++;
+		} else if (seq_number != bi->seq_number) {
+			ok = 0;
+		}
+	}
+
+	if (!ok) {
+		yaffs_trace(YAFFS_TRACE_CHECKPOINT | YAFFS_TRACE_SCAN,
+			"checkpoint replay: unexpected block %d", blk - 1);
+		goto out;
+	}
+
+	/* Forget what was in the erased blocks */
+	for (blk = dev->internal_start_block; blk <= dev->internal_end_block;
+	     blk++) {
+		if (!replay.erased[blk - dev->internal_start_block])
+			continue;
+		bi = yaffs_get_block_info(dev, blk);
+		yaffs_clear_chunk_bits(dev, blk);
+		bi->pages_in_use = 0;
+		bi->soft_del_pages = 0;
+		bi->has_shrink_hdr = 0;
+		if (bi->block_state == YAFFS_BLOCK_STATE_EMPTY)
+			bi->seq_number = 0;
+	}
+
+	/* Make the objects open to newer headers */
+	for (i = 0; i < YAFFS_NOBJECT_BUCKETS; i++) {
+		list_for_each(lh, &dev->obj_bucket[i].list) {
+			obj = list_entry(lh, struct yaffs_obj, hash_link);
+			obj->ckpt_replay = 1;
+			if (obj == dev->unlinked_dir || obj == dev->del_dir)
+				continue;
+			obj->valid = 0;
+			if (obj->hdr_chunk > 0 &&
+			    replay.erased[obj->hdr_chunk /
+					  dev->param.chunks_per_block -
+					  dev->internal_start_block])
+				obj->hdr_chunk = 0;
+			if (obj->variant_type == YAFFS_OBJECT_TYPE_FILE) {
+				obj->variant.file_variant.scanned_size = 0;
+				obj->variant.file_variant.shrink_size = ~0;
+				yaffs2_replay_prune_worker(obj,
+					obj->variant.file_variant.top,
+					obj->variant.file_variant.top_level,
+					0, replay.erased);
+			}
+		}
+	}
+
+	for (i = 0; i < n_to_scan; i++)
+		if (block_index[i].seq > dev->seq_number)
+			dev->seq_number = block_index[i].seq;
+	dev->alloc_block = -1;
+	dev->alloc_page = -1;
+
+	sort(block_index, n_to_scan, sizeof(struct yaffs_block_index),
+	     yaffs2_ybicmp, NULL);
+
+	chunk_data = yaffs_get_temp_buffer(dev, __LINE__);
+	ok = yaffs2_scan_blocks(dev, block_index, n_to_scan, &replay,
+				chunk_data, &hard_list);
+	yaffs_release_temp_buffer(dev, chunk_data, __LINE__);
+
+	yaffs_skip_rest_of_block(dev);
+	yaffs_link_fixup(dev, hard_list);
+
+	if (!ok)
+		goto out;
+
+	for (i = 0; i < YAFFS_NOBJECT_BUCKETS; i++) {
+		list_for_each_safe(lh, n, &dev->obj_bucket[i].list) {
+			obj = list_entry(lh, struct yaffs_obj, hash_link);
+			if (!obj->ckpt_replay)
+				continue;
+			if (!obj->valid && (obj->fake || obj->hdr_chunk > 0)) {
+				/* Not changed since the checkpoint */
+				obj->valid = 1;
+			} else if (!obj->valid) {
+				/* Its last header has been erased, so it was
+				 * deleted and has been collected.
+				 */
+				yaffs_add_obj_to_dir(dev->unlinked_dir, obj);
+				if (obj->variant_type == YAFFS_OBJECT_TYPE_FILE)
+					obj->variant.file_variant.shrink_size =
+					    0;
+				obj->valid = 1;
+			}
+			if (obj->variant_type == YAFFS_OBJECT_TYPE_FILE &&
+			    obj->variant.file_variant.shrink_size != ~0)
+				yaffs2_replay_shrink_worker(obj,
+					obj->variant.file_variant.top,
+					obj->variant.file_variant.top_level,
+					0, &replay);
+			obj->ckpt_replay = 0;
+		}
+	}
+
+	dev->n_erased_blocks = 0;
+	for (blk = dev->internal_start_block; blk <= dev->internal_end_block;
+	     blk++)
+		if (yaffs_get_block_info(dev, blk)->block_state ==
+		    YAFFS_BLOCK_STATE_EMPTY)
+			dev->n_erased_blocks++;
+	dev->n_free_chunks = yaffs_count_free_chunks(dev);
+	dev->oldest_dirty_seq = 0;
+	dev->gc_summary_n = 0;
+	dev->gc_summary_overflow = 1;
+	dev->n_replayed_blocks = n_to_scan;
+
+	yaffs_trace(YAFFS_TRACE_CHECKPOINT | YAFFS_TRACE_MOUNT,
+		"checkpoint replay: %d blocks scanned", n_to_scan);
+
+out:
+	if (alt_block_index)
+		vfree(block_index);
+	else
+		kfree(block_index);
+	kfree(replay.erased);
+
+	return ok ? YAFFS_OK : YAFFS_FAIL;
+}
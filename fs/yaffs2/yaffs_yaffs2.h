@@ -35,5 +35,6 @@ int yaffs2_checkpt_restore(struct yaffs_dev *dev);
 
 int yaffs2_handle_hole(struct yaffs_obj *obj, loff_t new_size);
 int yaffs2_scan_backwards(struct yaffs_dev *dev);
+int yaffs2_scan_replay(struct yaffs_dev *dev);
 
 #endif
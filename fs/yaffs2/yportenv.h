@@ -30,6 +30,9 @@
 #include <linux/stat.h>
 #include <linux/sort.h>
 #include <linux/bitops.h>
+#include <linux/kthread.h>
+#include <linux/wait.h>
+#include <linux/completion.h>
 
 #define YCHAR char
 #define YUCHAR unsigned char
@@ -685,9 +685,17 @@ __SYSCALL(__NR_syncfs, sys_syncfs)
 __SYSCALL(__NR_setns, sys_setns)
 #define __NR_sendmmsg 269
 __SC_COMP(__NR_sendmmsg, sys_sendmmsg, compat_sys_sendmmsg)
+/*
+ * Not in mainline: numbered well above its range, and below the
+ * deprecated syscalls at 1024.
+ */
+#define __NR_io_ring_setup 1000
+__SYSCALL(__NR_io_ring_setup, sys_io_ring_setup)
+#define __NR_io_ring_enter 1001
+__SYSCALL(__NR_io_ring_enter, sys_io_ring_enter)
 
 #undef __NR_syscalls
-#define __NR_syscalls 270
+#define __NR_syscalls 1002
 
 /*
  * All syscalls below here should go away really,
@@ -3,6 +3,8 @@
 
 #include <linux/list.h>
 #include <linux/workqueue.h>
+#include <linux/wait.h>
+#include <linux/mutex.h>
 #include <linux/aio_abi.h>
 #include <linux/uio.h>
 #include <linux/rcupdate.h>
@@ -77,12 +79,13 @@ struct kioctx;
  *
  * If ki_retry returns -EIOCBRETRY it has made a promise that kick_iocb()
  * will be called on the kiocb pointer in the future.  This may happen
- * through generic helpers that associate kiocb->ki_wait with a wait
- * queue head that ki_retry uses via current->io_wait.  It can also happen
- * with custom tracking and manual calls to kick_iocb(), though that is
- * discouraged.  In either case, kick_iocb() must be called once and only
- * once.  ki_retry must ensure forward progress, the AIO core will wait
- * indefinitely for kick_iocb() to be called.
+ * through generic helpers that queue kiocb->ki_wait on a wait queue head,
+ * as generic_file_aio_read() does on a page locked for I/O; its wake
+ * function kicks the kiocb.  It can also happen with custom tracking and
+ * manual calls to kick_iocb(), though that is discouraged.  In either
+ * case, kick_iocb() must be called once and only once.  ki_retry must
+ * ensure forward progress, the AIO core will wait indefinitely for
+ * kick_iocb() to be called.
  */
 struct kiocb {
 	struct list_head	ki_run_list;
@@ -117,6 +120,9 @@ struct kiocb {
 
 	struct list_head	ki_list;	/* the aio core uses this
 						 * for cancellation */
+	struct wait_bit_queue	ki_wait;	/* kicks the retry when woken */
+	unsigned		ki_events;	/* poll events to wait for */
+	const struct cred	*ki_cred;	/* submitter's, for the retries */
 
 	/*
 	 * If the aio_resfd field of the userspace iocb is not zero,
@@ -197,6 +203,13 @@ struct kioctx {
 
 	struct aio_ring_info	ring_info;
 
+	/* submission ring of io_ring_setup(), in mm */
+	struct aio_sq_ring __user *sq_ring;
+	unsigned long		sq_mmap_size;
+	unsigned		sq_nr;
+	unsigned		sq_head;	/* trusted copy */
+	struct mutex		sq_lock;
+
 	struct delayed_work	wq;
 
 	struct rcu_head		rcu_head;
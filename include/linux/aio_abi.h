@@ -37,15 +37,30 @@ enum {
 	IOCB_CMD_PWRITE = 1,
 	IOCB_CMD_FSYNC = 2,
 	IOCB_CMD_FDSYNC = 3,
-	/* These two are experimental.
+	/* This one is experimental.
 	 * IOCB_CMD_PREADX = 4,
-	 * IOCB_CMD_POLL = 5,
 	 */
+	IOCB_CMD_POLL = 5,
 	IOCB_CMD_NOOP = 6,
 	IOCB_CMD_PREADV = 7,
 	IOCB_CMD_PWRITEV = 8,
+	IOCB_CMD_SENDMSG = 9,
+	IOCB_CMD_RECVMSG = 10,
 };
 
+/*
+ * IOCB_CMD_POLL takes the poll events to wait for in aio_buf and returns
+ * the events that fired.  IOCB_CMD_SENDMSG and IOCB_CMD_RECVMSG take a
+ * struct msghdr in aio_buf and MSG_* flags in aio_nbytes, and wait for
+ * the socket instead of blocking when it isn't ready.  They fail with
+ * EINVAL if the msghdr carries control messages.
+ *
+ * An iocb can only wait on one waitqueue of the file, so these commands
+ * fail at submit time with EOPNOTSUPP on files whose poll method uses
+ * several (such as ttys, or connected unix datagram sockets when
+ * sending).
+ */
+
 /*
  * Valid flags for the "aio_flags" member of the "struct iocb".
  *
@@ -104,6 +119,29 @@ struct iocb {
 	__u32	aio_resfd;
 }; /* 64 bytes */
 
+/*
+ * Submission ring of io_ring_setup().  The application fills
+ * iocbs[tail % nr] and advances tail, io_ring_enter() submits the
+ * entries from head up to tail and advances head.  Completions go to the
+ * struct aio_ring at the context id, which userland may reap directly.
+ */
+struct aio_sq_ring {
+	__u32	head;		/* written by the kernel */
+	__u32	tail;		/* written by the application */
+	__u32	nr;		/* number of iocbs */
+	__u32	header_length;	/* size of aio_sq_ring */
+
+	struct iocb	iocbs[0];
+};
+
+struct io_ring_params {
+	__u32	sq_entries;	/* entries in the submission ring */
+	__u32	cq_entries;	/* events in the completion ring */
+	__u64	sq_ring;	/* address of the struct aio_sq_ring */
+	__u64	ctx;		/* context id, address of the struct aio_ring */
+	__u64	reserved[2];
+};
+
 #undef IFBIG
 #undef IFLITTLE
 
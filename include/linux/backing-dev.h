@@ -57,8 +57,19 @@ struct bdi_writeback {
 	struct list_head b_dirty;	/* dirty inodes */
 	struct list_head b_io;		/* parked for writeback */
 	struct list_head b_more_io;	/* parked for more writeback */
+
+	atomic_long_t pages_written;	/* pages written back in total */
+	atomic_long_t inodes_written;	/* inodes written back in total */
+	unsigned long stat_stamp;	/* last rate update */
+	unsigned long stat_pages;	/* pages_written at stat_stamp */
+	unsigned long stat_inodes;	/* inodes_written at stat_stamp */
+	unsigned long pages_per_sec;	/* rates while writeback ran */
+	unsigned long inodes_per_sec;
 };
 
+/* Most threads writing back one bdi at the same time */
+#define BDI_MAX_FLUSH_WORKERS	8
+
 struct backing_dev_info {
 	struct list_head bdi_list;
 	unsigned long ra_pages;	/* max readahead in PAGE_CACHE_SIZE units */
@@ -76,6 +87,7 @@ struct backing_dev_info {
 
 	unsigned int min_ratio;
 	unsigned int max_ratio, max_prop_frac;
+	unsigned int flush_workers;	/* threads sharing background writeback */
 
 	struct bdi_writeback wb;  /* default writeback info for this bdi */
 	spinlock_t wb_lock;	  /* protects work_list */
@@ -43,7 +43,11 @@ struct dentry_stat_t {
 	int nr_unused;
 	int age_limit;          /* age in seconds */
 	int want_pages;         /* pages requested by system */
-	int dummy[2];
+	int nr_negative;        /* unused negative dentries on the lru */
+	int dummy;
+	int nr_buckets;         /* current hash table size */
+	int nr_hashed;          /* dentries on the hash chains */
+	int max_chain;          /* longest hash chain */
 };
 extern struct dentry_stat_t dentry_stat;
 
@@ -207,6 +211,7 @@ struct dentry_operations {
 
 #define DCACHE_CANT_MOUNT	0x0100
 #define DCACHE_GENOCIDE		0x0200
+#define DCACHE_LRU_NEGATIVE	0x0400	/* counted as negative on the lru */
 
 #define DCACHE_OP_HASH		0x1000
 #define DCACHE_OP_COMPARE	0x2000
@@ -419,5 +424,6 @@ static inline bool d_mountpoint(struct dentry *dentry)
 extern struct dentry *lookup_create(struct nameidata *nd, int is_dir);
 
 extern int sysctl_vfs_cache_pressure;
+extern int sysctl_dentry_negative_limit;
 
 #endif	/* __LINUX_DCACHE_H */
@@ -53,6 +53,7 @@
 #define _LINUX_FUSE_H
 
 #include <linux/types.h>
+#include <linux/ioctl.h>
 
 /*
  * Version negotiation:
@@ -145,16 +146,27 @@ struct fuse_file_lock {
  * FOPEN_DIRECT_IO: bypass page cache for this open file
  * FOPEN_KEEP_CACHE: don't invalidate the data cache on open
  * FOPEN_NONSEEKABLE: the file is not seekable
+ * FOPEN_PASSTHROUGH: serve read, write and mmap from the backing file
+ *		      registered as backing_id, see FUSE_DEV_IOC_BACKING_OPEN
+ *
+ * FOPEN_PASSTHROUGH is not in mainline, and takes the top bit to keep
+ * clear of the flags mainline adds from the bottom.
  */
 #define FOPEN_DIRECT_IO		(1 << 0)
 #define FOPEN_KEEP_CACHE	(1 << 1)
 #define FOPEN_NONSEEKABLE	(1 << 2)
+#define FOPEN_PASSTHROUGH	(1 << 31)
 
 /**
  * INIT request/reply flags
  *
  * FUSE_EXPORT_SUPPORT: filesystem handles lookups of "." and ".."
  * FUSE_DONT_MASK: don't apply umask to file mode on create operations
+ * FUSE_WRITEBACK_CACHE: use writeback cache for buffered writes
+ * FUSE_PASSTHROUGH: filesystem may pass a backing file on open
+ *
+ * FUSE_PASSTHROUGH is not in mainline, which keeps its bit reserved for
+ * out of tree passthrough implementations.
  */
 #define FUSE_ASYNC_READ		(1 << 0)
 #define FUSE_POSIX_LOCKS	(1 << 1)
@@ -163,6 +175,8 @@ struct fuse_file_lock {
 #define FUSE_EXPORT_SUPPORT	(1 << 4)
 #define FUSE_BIG_WRITES		(1 << 5)
 #define FUSE_DONT_MASK		(1 << 6)
+#define FUSE_WRITEBACK_CACHE	(1 << 16)
+#define FUSE_PASSTHROUGH	(1 << 31)
 
 /**
  * CUSE INIT request/reply flags
@@ -380,7 +394,7 @@ struct fuse_create_in {
 struct fuse_open_out {
 	__u64	fh;
 	__u32	open_flags;
-	__u32	padding;
+	__s32	backing_id;
 };
 
 struct fuse_release_in {
@@ -624,4 +638,26 @@ struct fuse_notify_retrieve_in {
 	__u64	dummy4;
 };
 
+/* Device ioctls: */
+#define FUSE_DEV_IOC_MAGIC		229
+
+/*
+ * Issued on a newly opened /dev/fuse file with the file descriptor of
+ * an already mounted channel as argument: the new file becomes another
+ * channel of the same connection, with a request queue of its own.
+ * Requests are queued on the channel of the cpu that submits them,
+ * replies have to be written to the channel the request was read from.
+ */
+#define FUSE_DEV_IOC_CLONE		_IOR(FUSE_DEV_IOC_MAGIC, 0, __u32)
+
+/*
+ * Register a backing file for passthrough, given its file descriptor in
+ * the caller.  Returns a backing id to put in fuse_open_out, which stays
+ * valid until closed with FUSE_DEV_IOC_BACKING_CLOSE or the connection
+ * goes away.  Files already opened with it keep their own reference.
+ * Only available once FUSE_PASSTHROUGH has been negotiated.
+ */
+#define FUSE_DEV_IOC_BACKING_OPEN	_IOW(FUSE_DEV_IOC_MAGIC, 1, __u32)
+#define FUSE_DEV_IOC_BACKING_CLOSE	_IOW(FUSE_DEV_IOC_MAGIC, 2, __u32)
+
 #endif /* _LINUX_FUSE_H */
@@ -241,7 +241,10 @@ typedef struct journal_superblock_s
 	__be32	s_max_trans_data;	/* Limit of data blocks per trans. */
 
 /* 0x0050 */
-	__u32	s_padding[44];
+	__u32	s_padding[42];
+/* 0x00F8 */
+	__be32	s_fc_area_blks;		/* Nr of blocks for fast commits */
+	__u32	s_padding2;
 
 /* 0x0100 */
 	__u8	s_users[16*48];		/* ids of all fs'es sharing the log */
@@ -263,13 +266,21 @@ typedef struct journal_superblock_s
 #define JBD2_FEATURE_INCOMPAT_REVOKE		0x00000001
 #define JBD2_FEATURE_INCOMPAT_64BIT		0x00000002
 #define JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT	0x00000004
+/*
+ * Not the fast commit feature of later kernels (0x20, with its block
+ * count at 0x54): the area here holds a different record format, so it
+ * takes a bit and a superblock field well away from the ones they
+ * allocate next.
+ */
+#define JBD2_FEATURE_INCOMPAT_FC_AREA		0x00010000
 
 /* Features known to this kernel version: */
 #define JBD2_KNOWN_COMPAT_FEATURES	JBD2_FEATURE_COMPAT_CHECKSUM
 #define JBD2_KNOWN_ROCOMPAT_FEATURES	0
 #define JBD2_KNOWN_INCOMPAT_FEATURES	(JBD2_FEATURE_INCOMPAT_REVOKE | \
 					JBD2_FEATURE_INCOMPAT_64BIT | \
-					JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT)
+					JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT | \
+					JBD2_FEATURE_INCOMPAT_FC_AREA)
 
 #ifdef __KERNEL__
 
@@ -680,6 +691,14 @@ struct transaction_run_stats_s {
 	__u32			rs_handle_count;
 	__u32			rs_blocks;
 	__u32			rs_blocks_logged;
+
+	/* Commit phases, in microseconds */
+	u64			rs_lock_us;	  /* new handles held off */
+	u64			rs_submit_us;	  /* submitting data and log */
+	u64			rs_data_wait_us;  /* waiting on ordered data */
+	u64			rs_log_wait_us;	  /* waiting on log blocks */
+	u64			rs_commit_us;	  /* commit block and flush */
+	u64			rs_checkpoint_us; /* filing for checkpoint */
 };
 
 struct transaction_stats_s {
@@ -728,6 +747,8 @@ jbd2_time_diff(unsigned long start, unsigned long end)
  * @j_free: Journal free - how many free blocks are there in the journal?
  * @j_first: The block number of the first usable block
  * @j_last: The block number one beyond the last usable block
+ * @j_fc_last: The block number one beyond the fast commit area, which
+ *     starts at @j_last
  * @j_dev: Device where we store the journal
  * @j_blocksize: blocksize for the location where we store the journal.
  * @j_blk_offset: starting block offset for into the device where we store the
@@ -874,6 +895,12 @@ struct journal_s
 	unsigned long		j_first;
 	unsigned long		j_last;
 
+	/*
+	 * Blocks from j_last up to j_fc_last are kept out of the log for the
+	 * client's fast commits.  [j_state_lock]
+	 */
+	unsigned long		j_fc_last;
+
 	/*
 	 * Device, blocksize and starting block offset for the location where we
 	 * store the journal.
@@ -1152,6 +1179,8 @@ extern int	   jbd2_journal_errno      (journal_t *);
 extern void	   jbd2_journal_ack_err    (journal_t *);
 extern int	   jbd2_journal_clear_err  (journal_t *);
 extern int	   jbd2_journal_bmap(journal_t *, unsigned long, unsigned long long *);
+extern int	   jbd2_journal_set_fc_blocks(journal_t *, unsigned int);
+extern struct buffer_head *jbd2_journal_fc_buf(journal_t *, unsigned int);
 extern int	   jbd2_journal_force_commit(journal_t *);
 extern int	   jbd2_journal_file_inode(handle_t *handle, struct jbd2_inode *inode);
 extern int	   jbd2_journal_begin_ordered_truncate(journal_t *journal,
@@ -313,6 +313,11 @@ struct mm_struct {
 #ifdef CONFIG_TRANSPARENT_HUGEPAGE
 	pgtable_t pmd_huge_pte; /* protected by page_table_lock */
 #endif
+#ifdef CONFIG_KSM
+	/* maintained by ksmd, under ksm_thread_mutex */
+	unsigned long ksm_rmap_items;	/* pages tracked by ksmd */
+	unsigned long ksm_merging_pages; /* pages mapped to KSM pages */
+#endif
 #ifdef CONFIG_CPUMASK_OFFSTACK
 	struct cpumask cpumask_allocation;
 #endif
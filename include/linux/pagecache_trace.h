@@ -0,0 +1,32 @@
+#ifndef _LINUX_PAGECACHE_TRACE_H
+#define _LINUX_PAGECACHE_TRACE_H
+
+/*
+ * Recording of page cache misses for later prefetch replay,
+ * see mm/pagecache_trace.c.
+ */
+
+#include <linux/types.h>
+
+struct file;
+
+#ifdef CONFIG_PAGECACHE_TRACE
+extern int pagecache_trace_enabled;
+
+extern void __pagecache_trace_record(struct file *filp, pgoff_t start,
+				     unsigned long nr);
+
+static inline void pagecache_trace_record(struct file *filp, pgoff_t start,
+					  unsigned long nr)
+{
+	if (unlikely(pagecache_trace_enabled) && filp)
+		__pagecache_trace_record(filp, start, nr);
+}
+#else
+static inline void pagecache_trace_record(struct file *filp, pgoff_t start,
+					  unsigned long nr)
+{
+}
+#endif
+
+#endif /* _LINUX_PAGECACHE_TRACE_H */
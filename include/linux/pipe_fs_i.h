@@ -42,6 +42,10 @@ struct pipe_buffer {
  *	@fasync_writers: writer side fasync
  *	@inode: inode this pipe is attached to
  *	@bufs: the circular array of pipe buffers
+ *	@user: the user the buffers are charged to
+ *	@fills: times a writer found the pipe full since @fill_stamp
+ *	@fill_stamp: jiffies when @fills started counting
+ *	@fixed_size: size was set with F_SETPIPE_SZ, don't grow it
  **/
 struct pipe_inode_info {
 	wait_queue_head_t wait;
@@ -56,6 +60,10 @@ struct pipe_inode_info {
 	struct fasync_struct *fasync_writers;
 	struct inode *inode;
 	struct pipe_buffer *bufs;
+	struct user_struct *user;
+	unsigned int fills;
+	unsigned long fill_stamp;
+	unsigned int fixed_size;
 };
 
 /*
@@ -141,8 +149,12 @@ void pipe_unlock(struct pipe_inode_info *);
 void pipe_double_lock(struct pipe_inode_info *, struct pipe_inode_info *);
 
 extern unsigned int pipe_max_size, pipe_min_size;
+extern unsigned long pipe_user_pages;
 int pipe_proc_fn(struct ctl_table *, int, void __user *, size_t *, loff_t *);
 
+/* Grow a pipe its writer keeps finding full */
+int pipe_autogrow(struct pipe_inode_info *pipe);
+
 
 /* Drop the inode semaphore and wait for a pipe event, atomically */
 void pipe_wait(struct pipe_inode_info *pipe);
@@ -153,4 +153,11 @@ extern struct hlist_node *seq_hlist_start_head_rcu(struct hlist_head *head,
 extern struct hlist_node *seq_hlist_next_rcu(void *v,
 						   struct hlist_head *head,
 						   loff_t *ppos);
+
+/* Helpers for iterating over per-cpu hlist_head-s in seq_files */
+extern struct hlist_node *seq_hlist_start_percpu(struct hlist_head __percpu *head,
+						 int *cpu, loff_t pos);
+extern struct hlist_node *seq_hlist_next_percpu(void *v,
+						struct hlist_head __percpu *head,
+						int *cpu, loff_t *pos);
 #endif
@@ -335,5 +335,12 @@ extern int __sys_recvmmsg(int fd, struct mmsghdr __user *mmsg, unsigned int vlen
 			  unsigned int flags, struct timespec *timeout);
 extern int __sys_sendmmsg(int fd, struct mmsghdr __user *mmsg,
 			  unsigned int vlen, unsigned int flags);
+
+struct file;
+
+extern int file_sendmsg(struct file *file, struct msghdr __user *msg,
+			unsigned flags);
+extern int file_recvmsg(struct file *file, struct msghdr __user *msg,
+			unsigned flags);
 #endif /* not kernel and not glibc */
 #endif /* _LINUX_SOCKET_H */
@@ -16,6 +16,7 @@ struct iattr;
 struct inode;
 struct iocb;
 struct io_event;
+struct io_ring_params;
 struct iovec;
 struct itimerspec;
 struct itimerval;
@@ -511,6 +512,10 @@ asmlinkage long sys_io_submit(aio_context_t, long,
 				struct iocb __user * __user *);
 asmlinkage long sys_io_cancel(aio_context_t ctx_id, struct iocb __user *iocb,
 			      struct io_event __user *result);
+asmlinkage long sys_io_ring_setup(unsigned nr_events,
+				  struct io_ring_params __user *params);
+asmlinkage long sys_io_ring_enter(aio_context_t ctx_id, unsigned to_submit,
+				  unsigned min_complete, unsigned flags);
 asmlinkage long sys_sendfile(int out_fd, int in_fd,
 			     off_t __user *offset, size_t count);
 asmlinkage long sys_sendfile64(int out_fd, int in_fd,
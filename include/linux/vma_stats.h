@@ -0,0 +1,46 @@
+#ifndef _LINUX_VMA_STATS_H
+#define _LINUX_VMA_STATS_H
+
+#include <linux/types.h>
+
+/*
+ * Record read from /proc/<pid>/vma_stats, one per mapping.
+ *
+ * The counters are the ones of /proc/<pid>/smaps, in bytes, without the
+ * text formatting.  The file position is the address the next read
+ * continues from: a read returns the records of the mappings at or above
+ * it and leaves it at the end of the last one returned, so lseek() to 0
+ * starts over.  Reads must be a multiple of the record size.
+ *
+ * The layout has no padding, so it is the same for 32-bit and 64-bit
+ * userspace.
+ */
+struct vma_stats {
+	__u64	start;			/* Address range of the mapping */
+	__u64	end;
+	__u64	pgoff;			/* File offset in bytes */
+	__u64	ino;			/* Inode of the mapped file, or 0 */
+	__u32	dev;			/* Its device, new_encode_dev() */
+	__u32	flags;			/* VMA_STATS_* */
+	__u64	rss;
+	__u64	pss;
+	__u64	shared_clean;
+	__u64	shared_dirty;
+	__u64	private_clean;
+	__u64	private_dirty;
+	__u64	referenced;
+	__u64	anonymous;
+	__u64	anonymous_thp;
+	__u64	swap;
+	__u64	locked;
+};
+
+#define VMA_STATS_READ		0x0001
+#define VMA_STATS_WRITE		0x0002
+#define VMA_STATS_EXEC		0x0004
+#define VMA_STATS_SHARED	0x0008
+#define VMA_STATS_HEAP		0x0010	/* [heap] in /proc/<pid>/maps */
+#define VMA_STATS_STACK		0x0020	/* [stack] */
+#define VMA_STATS_HUGETLB	0x0040	/* counters are not walked, all 0 */
+
+#endif /* _LINUX_VMA_STATS_H */
@@ -500,6 +500,14 @@ static void mm_init_aio(struct mm_struct *mm)
 #endif
 }
 
+static void mm_init_ksm(struct mm_struct *mm)
+{
+#ifdef CONFIG_KSM
+	mm->ksm_rmap_items = 0;
+	mm->ksm_merging_pages = 0;
+#endif
+}
+
 static struct mm_struct * mm_init(struct mm_struct * mm, struct task_struct *p)
 {
 	atomic_set(&mm->mm_users, 1);
@@ -515,6 +523,7 @@ static struct mm_struct * mm_init(struct mm_struct * mm, struct task_struct *p)
 	mm->free_area_cache = TASK_UNMAPPED_BASE;
 	mm->cached_hole_size = ~0UL;
 	mm_init_aio(mm);
+	mm_init_ksm(mm);
 	mm_init_owner(mm, p);
 	atomic_set(&mm->oom_disable_count, 0);
 
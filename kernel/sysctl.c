@@ -1410,10 +1410,18 @@ static struct ctl_table fs_table[] = {
 	{
 		.procname	= "dentry-state",
 		.data		= &dentry_stat,
-		.maxlen		= 6*sizeof(int),
+		.maxlen		= sizeof(dentry_stat),
 		.mode		= 0444,
 		.proc_handler	= proc_nr_dentry,
 	},
+	{
+		.procname	= "dentry-negative-limit",
+		.data		= &sysctl_dentry_negative_limit,
+		.maxlen		= sizeof(sysctl_dentry_negative_limit),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.extra1		= &zero,
+	},
 	{
 		.procname	= "overflowuid",
 		.data		= &fs_overflowuid,
@@ -1515,6 +1523,13 @@ static struct ctl_table fs_table[] = {
 		.proc_handler	= &pipe_proc_fn,
 		.extra1		= &pipe_min_size,
 	},
+	{
+		.procname	= "pipe-user-pages",
+		.data		= &pipe_user_pages,
+		.maxlen		= sizeof(pipe_user_pages),
+		.mode		= 0644,
+		.proc_handler	= proc_doulongvec_minmax,
+	},
 	{ }
 };
 
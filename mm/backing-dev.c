@@ -90,12 +90,21 @@ static int bdi_debug_stats_show(struct seq_file *m, void *v)
 		   "b_io:             %8lu\n"
 		   "b_more_io:        %8lu\n"
 		   "bdi_list:         %8u\n"
-		   "state:            %8lx\n",
+		   "state:            %8lx\n"
+		   "flush_workers:    %8u\n"
+		   "PagesWritten:     %8lu\n"
+		   "InodesWritten:    %8lu\n"
+		   "PagesPerSec:      %8lu\n"
+		   "InodesPerSec:     %8lu\n",
 		   (unsigned long) K(bdi_stat(bdi, BDI_WRITEBACK)),
 		   (unsigned long) K(bdi_stat(bdi, BDI_RECLAIMABLE)),
 		   K(bdi_thresh), K(dirty_thresh),
 		   K(background_thresh), nr_dirty, nr_io, nr_more_io,
-		   !list_empty(&bdi->bdi_list), bdi->state);
+		   !list_empty(&bdi->bdi_list), bdi->state,
+		   bdi->flush_workers,
+		   atomic_long_read(&wb->pages_written),
+		   atomic_long_read(&wb->inodes_written),
+		   wb->pages_per_sec, wb->inodes_per_sec);
 #undef K
 
 	return 0;
@@ -204,12 +213,31 @@ static ssize_t max_ratio_store(struct device *dev,
 }
 BDI_SHOW(max_ratio, bdi->max_ratio)
 
+static ssize_t flush_workers_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct backing_dev_info *bdi = dev_get_drvdata(dev);
+	char *end;
+	unsigned int workers;
+	ssize_t ret = -EINVAL;
+
+	workers = simple_strtoul(buf, &end, 10);
+	if (*buf && (end[0] == '\0' || (end[0] == '\n' && end[1] == '\0')) &&
+	    workers >= 1 && workers <= BDI_MAX_FLUSH_WORKERS) {
+		bdi->flush_workers = workers;
+		ret = count;
+	}
+	return ret;
+}
+BDI_SHOW(flush_workers, bdi->flush_workers)
+
 #define __ATTR_RW(attr) __ATTR(attr, 0644, attr##_show, attr##_store)
 
 static struct device_attribute bdi_dev_attrs[] = {
 	__ATTR_RW(read_ahead_kb),
 	__ATTR_RW(min_ratio),
 	__ATTR_RW(max_ratio),
+	__ATTR_RW(flush_workers),
 	__ATTR_NULL,
 };
 
@@ -629,6 +657,7 @@ static void bdi_wb_init(struct bdi_writeback *wb, struct backing_dev_info *bdi)
 	INIT_LIST_HEAD(&wb->b_dirty);
 	INIT_LIST_HEAD(&wb->b_io);
 	INIT_LIST_HEAD(&wb->b_more_io);
+	wb->stat_stamp = jiffies;
 	setup_timer(&wb->wakeup_timer, wakeup_timer_fn, (unsigned long)bdi);
 }
 
@@ -641,6 +670,7 @@ int bdi_init(struct backing_dev_info *bdi)
 	bdi->min_ratio = 0;
 	bdi->max_ratio = 100;
 	bdi->max_prop_frac = PROP_FRAC_BASE;
+	bdi->flush_workers = 1;
 	spin_lock_init(&bdi->wb_lock);
 	INIT_LIST_HEAD(&bdi->bdi_list);
 	INIT_LIST_HEAD(&bdi->work_list);
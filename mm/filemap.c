@@ -35,6 +35,7 @@
 #include <linux/memcontrol.h>
 #include <linux/mm_inline.h> /* for page_is_file_cache() */
 #include <linux/cleancache.h>
+#include <linux/pagecache_trace.h>
 #include "internal.h"
 
 /*
@@ -662,6 +663,45 @@ int __lock_page_killable(struct page *page)
 }
 EXPORT_SYMBOL_GPL(__lock_page_killable);
 
+/*
+ * Lock a page without sleeping for an async read.  If someone else has it
+ * locked, @wait is queued on the page waitqueue and -EIOCBRETRY returned;
+ * its wake function is called once the page is unlocked.
+ */
+static int lock_page_async(struct page *page, struct wait_bit_queue *wait)
+{
+	wait_queue_head_t *q = page_waitqueue(page);
+	unsigned long flags;
+	int queued;
+
+	wait->key.flags = &page->flags;
+	wait->key.bit_nr = PG_locked;
+
+	while (!trylock_page(page)) {
+		spin_lock_irqsave(&q->lock, flags);
+		__add_wait_queue_tail(q, &wait->wait);
+		spin_unlock_irqrestore(&q->lock, flags);
+
+		/* Pairs with the barrier in unlock_page() */
+		smp_mb();
+		if (PageLocked(page))
+			return -EIOCBRETRY;
+
+		/*
+		 * It was unlocked before we got on the queue: take @wait off
+		 * again, unless the wakeup beat us to it and owns it now.
+		 */
+		spin_lock_irqsave(&q->lock, flags);
+		queued = !list_empty(&wait->wait.task_list);
+		if (queued)
+			list_del_init(&wait->wait.task_list);
+		spin_unlock_irqrestore(&q->lock, flags);
+		if (!queued)
+			return -EIOCBRETRY;
+	}
+	return 0;
+}
+
 int __lock_page_or_retry(struct page *page, struct mm_struct *mm,
 			 unsigned int flags)
 {
@@ -1073,15 +1113,21 @@ static void shrink_readahead_size_eio(struct file *filp,
  * @ppos:	current file position
  * @desc:	read_descriptor
  * @actor:	read method
+ * @wait:	wait entry of an async read, NULL to block
  *
  * This is a generic file read routine, and uses the
  * mapping->a_ops->readpage() function for the actual low-level stuff.
  *
+ * An async read doesn't sleep on a page that is locked for I/O: it
+ * returns what it has copied so far or, with nothing copied yet, queues
+ * @wait on the page and fails with -EIOCBRETRY.
+ *
  * This is really ugly. But the goto's actually try to clarify some
  * of the logic when it comes to error handling etc.
  */
 static void do_generic_file_read(struct file *filp, loff_t *ppos,
-		read_descriptor_t *desc, read_actor_t actor)
+		read_descriptor_t *desc, read_actor_t actor,
+		struct wait_bit_queue *wait)
 {
 	struct address_space *mapping = filp->f_mapping;
 	struct inode *inode = mapping->host;
@@ -1201,7 +1247,20 @@ page_ok:
 
 page_not_up_to_date:
 		/* Get exclusive access to the page ... */
-		error = lock_page_killable(page);
+		if (wait) {
+			/*
+			 * With some of the read done, return it rather
+			 * than queue a retry for the rest.
+			 */
+			if (desc->written) {
+				if (trylock_page(page))
+					goto page_not_up_to_date_locked;
+				page_cache_release(page);
+				goto out;
+			}
+			error = lock_page_async(page, wait);
+		} else
+			error = lock_page_killable(page);
 		if (unlikely(error))
 			goto readpage_error;
 
@@ -1393,8 +1452,12 @@ generic_file_aio_read(struct kiocb *iocb, const struct iovec *iov,
 	unsigned long seg = 0;
 	size_t count;
 	loff_t *ppos = &iocb->ki_pos;
+	struct wait_bit_queue *wait = NULL;
 	struct blk_plug plug;
 
+	if (!is_sync_kiocb(iocb))
+		wait = &iocb->ki_wait;
+
 	count = 0;
 	retval = generic_segment_checks(iov, &nr_segs, &count, VERIFY_WRITE);
 	if (retval)
@@ -1464,7 +1527,13 @@ generic_file_aio_read(struct kiocb *iocb, const struct iovec *iov,
 		if (desc.count == 0)
 			continue;
 		desc.error = 0;
-		do_generic_file_read(filp, ppos, &desc, file_read_actor);
+		/*
+		 * An async read may only queue ki_wait with nothing read, so
+		 * return what we have; the retry comes back for the rest.
+		 */
+		if (wait && retval)
+			break;
+		do_generic_file_read(filp, ppos, &desc, file_read_actor, wait);
 		retval += desc.written;
 		if (desc.error) {
 			retval = retval ?: desc.error;
@@ -1538,9 +1607,10 @@ static int page_cache_read(struct file *file, pgoff_t offset)
 			return -ENOMEM;
 
 		ret = add_to_page_cache_lru(page, mapping, offset, GFP_KERNEL);
-		if (ret == 0)
+		if (ret == 0) {
 			ret = mapping->a_ops->readpage(file, page);
-		else if (ret == -EEXIST)
+			pagecache_trace_record(file, offset, 1);
+		} else if (ret == -EEXIST)
 			ret = 0; /* losing race to add is OK */
 
 		page_cache_release(page);
@@ -1752,8 +1822,82 @@ page_not_uptodate:
 }
 EXPORT_SYMBOL(filemap_fault);
 
+/**
+ * filemap_map_pages - map uptodate page cache pages around a fault
+ * @vma:	vma in which the fault was taken
+ * @vmf:	range of file offsets to map, and the pte for vmf->pgoff
+ *
+ * Called with the page table lock held from do_fault_around(): map every
+ * page between vmf->pgoff and vmf->max_pgoff that is already uptodate in
+ * the page cache and whose pte is still empty.  Pages that would need I/O,
+ * are locked by somebody else or still carry the readahead marker are
+ * skipped and left to filemap_fault().
+ */
+void filemap_map_pages(struct vm_area_struct *vma, struct vm_fault *vmf)
+{
+	struct file *file = vma->vm_file;
+	struct address_space *mapping = file->f_mapping;
+	unsigned long address = (unsigned long) vmf->virtual_address;
+	struct page *pages[PAGEVEC_SIZE];
+	pgoff_t index = vmf->pgoff;
+	pgoff_t next, size;
+	unsigned int i, nr;
+	pte_t *pte;
+
+	while (index <= vmf->max_pgoff) {
+		nr = min_t(pgoff_t, PAGEVEC_SIZE, vmf->max_pgoff - index + 1);
+		nr = find_get_pages(mapping, index, nr, pages);
+		if (!nr)
+			break;
+		next = pages[nr - 1]->index + 1;
+
+		for (i = 0; i < nr; i++) {
+			struct page *page = pages[i];
+
+			if (page->index > vmf->max_pgoff)
+				goto skip;
+			if (!PageUptodate(page) || PageReadahead(page) ||
+			    PageHWPoison(page))
+				goto skip;
+			if (!trylock_page(page))
+				goto skip;
+
+			if (page->mapping != mapping || !PageUptodate(page))
+				goto unlock;
+
+			size = (i_size_read(mapping->host) + PAGE_CACHE_SIZE - 1)
+					>> PAGE_CACHE_SHIFT;
+			if (page->index >= size)
+				goto unlock;
+
+			pte = vmf->pte + page->index - vmf->pgoff;
+			if (!pte_none(*pte))
+				goto unlock;
+
+			if (file->f_ra.mmap_miss > 0)
+				file->f_ra.mmap_miss--;
+			do_set_pte(vma, address +
+					(page->index - vmf->pgoff) * PAGE_SIZE,
+				   page, pte, false, false);
+			unlock_page(page);
+			/* the page cache reference is now owned by the pte */
+			continue;
+unlock:
+			unlock_page(page);
+skip:
+			page_cache_release(page);
+		}
+
+		if (next <= index)
+			break;
+		index = next;
+	}
+}
+EXPORT_SYMBOL(filemap_map_pages);
+
 const struct vm_operations_struct generic_file_vm_ops = {
 	.fault		= filemap_fault,
+	.map_pages	= filemap_map_pages,
 };
 
 /* This is used for a general mmap of a disk file */
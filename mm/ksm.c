@@ -189,6 +189,42 @@ static unsigned int ksm_thread_pages_to_scan = 100;
 /* Milliseconds ksmd should sleep between batches */
 static unsigned int ksm_thread_sleep_millisecs = 20;
 
+/*
+ * Adaptive scanning: when enabled, ksmd scans between
+ * KSM_ADAPTIVE_MIN_PAGES and ksm_thread_pages_to_scan pages per batch,
+ * depending on how many pages the previous full scan managed to merge,
+ * and stops altogether after KSM_ADAPTIVE_IDLE_SCANS full scans that
+ * merged nothing, until new memory is registered with MADV_MERGEABLE.
+ */
+static unsigned int ksm_adaptive_scan;
+
+/* Number of pages ksmd currently scans in one batch when adaptive */
+static unsigned int ksm_adaptive_pages = 100;
+
+/*
+ * Set when adaptive ksmd has gone idle for lack of anything to merge;
+ * ksm_scan_kicked records new mergeable memory since the last full scan.
+ * Both are protected by ksm_mmlist_lock.
+ */
+static bool ksm_scan_idle;
+static bool ksm_scan_kicked;
+
+/* Full scans in a row that merged nothing */
+static unsigned int ksm_idle_scans;
+
+/* Pages scanned and merged during the current full scan */
+static unsigned long ksm_scan_pages_scanned;
+static unsigned long ksm_scan_pages_merged;
+
+/* Total number of pages merged since boot */
+static unsigned long ksm_pages_merged;
+
+#define KSM_ADAPTIVE_MIN_PAGES		16
+#define KSM_ADAPTIVE_IDLE_SCANS		2
+/* yield thresholds, in merged pages per thousand scanned */
+#define KSM_ADAPTIVE_HIGH_YIELD		50
+#define KSM_ADAPTIVE_LOW_YIELD		10
+
 #define KSM_RUN_STOP	0
 #define KSM_RUN_MERGE	1
 #define KSM_RUN_UNMERGE	2
@@ -247,6 +283,7 @@ static inline struct rmap_item *alloc_rmap_item(void)
 static inline void free_rmap_item(struct rmap_item *rmap_item)
 {
 	ksm_rmap_items--;
+	rmap_item->mm->ksm_rmap_items--;
 	rmap_item->mm = NULL;	/* debug safety */
 	kmem_cache_free(rmap_item_cache, rmap_item);
 }
@@ -453,6 +490,7 @@ static void remove_node_from_stable_tree(struct stable_node *stable_node)
 			ksm_pages_sharing--;
 		else
 			ksm_pages_shared--;
+		rmap_item->mm->ksm_merging_pages--;
 		put_anon_vma(rmap_item->anon_vma);
 		rmap_item->address &= PAGE_MASK;
 		cond_resched();
@@ -540,6 +578,7 @@ static void remove_rmap_item_from_tree(struct rmap_item *rmap_item)
 			ksm_pages_sharing--;
 		else
 			ksm_pages_shared--;
+		rmap_item->mm->ksm_merging_pages--;
 
 		put_anon_vma(rmap_item->anon_vma);
 		rmap_item->address &= PAGE_MASK;
@@ -1157,6 +1196,10 @@ static void stable_tree_append(struct rmap_item *rmap_item,
 		ksm_pages_sharing++;
 	else
 		ksm_pages_shared++;
+
+	rmap_item->mm->ksm_merging_pages++;
+	ksm_scan_pages_merged++;
+	ksm_pages_merged++;
 }
 
 /*
@@ -1265,6 +1308,7 @@ static struct rmap_item *get_next_rmap_item(struct mm_slot *mm_slot,
 	if (rmap_item) {
 		/* It has already been zeroed */
 		rmap_item->mm = mm_slot->mm;
+		rmap_item->mm->ksm_rmap_items++;
 		rmap_item->address = addr;
 		rmap_item->rmap_list = *rmap_list;
 		*rmap_list = rmap_item;
@@ -1403,6 +1447,68 @@ next_mm:
 	return NULL;
 }
 
+/*
+ * ksm_adapt_scan_rate - called at the end of each full scan to pick the
+ * batch size for the next one from the merge yield of this one: the share
+ * of scanned pages that ended up merged.  A scan that merges nothing is
+ * not enough to go idle, as a page needs two scans with an unchanged
+ * checksum before it can even enter the unstable tree.
+ */
+static void ksm_adapt_scan_rate(void)
+{
+	unsigned long yield = 0;
+	unsigned int max_pages = max_t(unsigned int, ksm_thread_pages_to_scan,
+				       KSM_ADAPTIVE_MIN_PAGES);
+
+	if (ksm_scan_pages_scanned)
+		yield = ksm_scan_pages_merged * 1000 / ksm_scan_pages_scanned;
+
+	if (!ksm_scan_pages_merged) {
+		if (++ksm_idle_scans >= KSM_ADAPTIVE_IDLE_SCANS) {
+			spin_lock(&ksm_mmlist_lock);
+			if (!ksm_scan_kicked)
+				ksm_scan_idle = true;
+			spin_unlock(&ksm_mmlist_lock);
+		}
+		ksm_adaptive_pages /= 2;
+	} else {
+		ksm_idle_scans = 0;
+		if (yield >= KSM_ADAPTIVE_HIGH_YIELD)
+			ksm_adaptive_pages *= 2;
+		else if (yield < KSM_ADAPTIVE_LOW_YIELD)
+			ksm_adaptive_pages /= 2;
+	}
+	ksm_adaptive_pages = clamp_t(unsigned int, ksm_adaptive_pages,
+				     KSM_ADAPTIVE_MIN_PAGES, max_pages);
+
+	ksm_scan_pages_scanned = 0;
+	ksm_scan_pages_merged = 0;
+
+	spin_lock(&ksm_mmlist_lock);
+	if (ksm_scan_kicked)
+		ksm_idle_scans = 0;
+	ksm_scan_kicked = false;
+	spin_unlock(&ksm_mmlist_lock);
+}
+
+/*
+ * ksm_kick_scan - take adaptive ksmd out of idle: called when more memory
+ * becomes mergeable, or when the scanning parameters are changed.
+ */
+static void ksm_kick_scan(void)
+{
+	bool was_idle;
+
+	spin_lock(&ksm_mmlist_lock);
+	ksm_scan_kicked = true;
+	was_idle = ksm_scan_idle;
+	ksm_scan_idle = false;
+	spin_unlock(&ksm_mmlist_lock);
+
+	if (was_idle)
+		wake_up_interruptible(&ksm_thread_wait);
+}
+
 /**
  * ksm_do_scan  - the ksm scanner main worker function.
  * @scan_npages - number of pages we want to scan before we return.
@@ -1411,21 +1517,27 @@ static void ksm_do_scan(unsigned int scan_npages)
 {
 	struct rmap_item *rmap_item;
 	struct page *uninitialized_var(page);
+	unsigned long seqnr = ksm_scan.seqnr;
 
 	while (scan_npages-- && likely(!freezing(current))) {
 		cond_resched();
 		rmap_item = scan_get_next_rmap_item(&page);
 		if (!rmap_item)
-			return;
+			break;
+		ksm_scan_pages_scanned++;
 		if (!PageKsm(page) || !in_stable_tree(rmap_item))
 			cmp_and_merge_page(page, rmap_item);
 		put_page(page);
 	}
+
+	if (ksm_adaptive_scan && ksm_scan.seqnr != seqnr)
+		ksm_adapt_scan_rate();
 }
 
 static int ksmd_should_run(void)
 {
-	return (ksm_run & KSM_RUN_MERGE) && !list_empty(&ksm_mm_head.mm_list);
+	return (ksm_run & KSM_RUN_MERGE) && !ksm_scan_idle &&
+		!list_empty(&ksm_mm_head.mm_list);
 }
 
 static int ksm_scan_thread(void *nothing)
@@ -1436,7 +1548,8 @@ static int ksm_scan_thread(void *nothing)
 	while (!kthread_should_stop()) {
 		mutex_lock(&ksm_thread_mutex);
 		if (ksmd_should_run())
-			ksm_do_scan(ksm_thread_pages_to_scan);
+			ksm_do_scan(ksm_adaptive_scan ? ksm_adaptive_pages :
+						       ksm_thread_pages_to_scan);
 		mutex_unlock(&ksm_thread_mutex);
 
 		try_to_freeze();
@@ -1476,6 +1589,7 @@ int ksm_madvise(struct vm_area_struct *vma, unsigned long start,
 		}
 
 		*vm_flags |= VM_MERGEABLE;
+		ksm_kick_scan();
 		break;
 
 	case MADV_UNMERGEABLE:
@@ -1522,6 +1636,7 @@ int __ksm_enter(struct mm_struct *mm)
 
 	if (needs_wakeup)
 		wake_up_interruptible(&ksm_thread_wait);
+	ksm_kick_scan();
 
 	return 0;
 }
@@ -1867,6 +1982,8 @@ static ssize_t pages_to_scan_store(struct kobject *kobj,
 		return -EINVAL;
 
 	ksm_thread_pages_to_scan = nr_pages;
+	ksm_adaptive_pages = nr_pages;
+	ksm_kick_scan();
 
 	return count;
 }
@@ -1914,13 +2031,53 @@ static ssize_t run_store(struct kobject *kobj, struct kobj_attribute *attr,
 	}
 	mutex_unlock(&ksm_thread_mutex);
 
-	if (flags & KSM_RUN_MERGE)
+	if (flags & KSM_RUN_MERGE) {
+		ksm_kick_scan();
 		wake_up_interruptible(&ksm_thread_wait);
+	}
 
 	return count;
 }
 KSM_ATTR(run);
 
+static ssize_t adaptive_scan_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_adaptive_scan);
+}
+
+static ssize_t adaptive_scan_store(struct kobject *kobj,
+				   struct kobj_attribute *attr,
+				   const char *buf, size_t count)
+{
+	int err;
+	unsigned long enable;
+
+	err = strict_strtoul(buf, 10, &enable);
+	if (err || enable > 1)
+		return -EINVAL;
+
+	mutex_lock(&ksm_thread_mutex);
+	ksm_adaptive_scan = enable;
+	ksm_adaptive_pages = ksm_thread_pages_to_scan;
+	ksm_scan_pages_scanned = 0;
+	ksm_scan_pages_merged = 0;
+	mutex_unlock(&ksm_thread_mutex);
+	ksm_kick_scan();
+
+	return count;
+}
+KSM_ATTR(adaptive_scan);
+
+static ssize_t scan_pages_show(struct kobject *kobj,
+			       struct kobj_attribute *attr, char *buf)
+{
+	if (!ksm_adaptive_scan)
+		return sprintf(buf, "%u\n", ksm_thread_pages_to_scan);
+	return sprintf(buf, "%u\n", ksm_scan_idle ? 0 : ksm_adaptive_pages);
+}
+KSM_ATTR_RO(scan_pages);
+
 static ssize_t pages_shared_show(struct kobject *kobj,
 				 struct kobj_attribute *attr, char *buf)
 {
@@ -1966,6 +2123,13 @@ static ssize_t full_scans_show(struct kobject *kobj,
 }
 KSM_ATTR_RO(full_scans);
 
+static ssize_t pages_merged_show(struct kobject *kobj,
+				 struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_pages_merged);
+}
+KSM_ATTR_RO(pages_merged);
+
 static struct attribute *ksm_attrs[] = {
 	&sleep_millisecs_attr.attr,
 	&pages_to_scan_attr.attr,
@@ -1975,6 +2139,9 @@ static struct attribute *ksm_attrs[] = {
 	&pages_unshared_attr.attr,
 	&pages_volatile_attr.attr,
 	&full_scans_attr.attr,
+	&adaptive_scan_attr.attr,
+	&scan_pages_attr.attr,
+	&pages_merged_attr.attr,
 	NULL,
 };
 
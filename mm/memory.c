@@ -57,6 +57,7 @@
 #include <linux/swapops.h>
 #include <linux/elf.h>
 #include <linux/gfp.h>
+#include <linux/debugfs.h>
 
 #include <asm/io.h>
 #include <asm/pgalloc.h>
@@ -1420,6 +1421,93 @@ int zap_vma_ptes(struct vm_area_struct *vma, unsigned long address,
 }
 EXPORT_SYMBOL_GPL(zap_vma_ptes);
 
+static bool giftable_page(struct vm_area_struct *vma, unsigned long address,
+			  struct page *page)
+{
+	if (vma->vm_file || address >= vma->vm_end ||
+	    (vma->vm_flags & (VM_SHARED | VM_LOCKED | VM_HUGETLB |
+			      VM_PFNMAP | VM_MIXEDMAP)))
+		return false;
+
+	/* Mapped once, here, and nowhere else: not shared with a child */
+	if (!PageAnon(page) || PageKsm(page) || PageCompound(page) ||
+	    PageSwapCache(page) || PageMlocked(page) ||
+	    page_mapcount(page) != 1)
+		return false;
+
+	return follow_page(vma, address, 0) == page;
+}
+
+/*
+ * Strip the anon state off a page whose only pte was just zapped, leaving
+ * a plain page like one from alloc_page() that may be added to a page
+ * cache. It's left on the LRU if it can't be isolated.
+ */
+static bool detach_gifted_page(struct page *page)
+{
+	if (isolate_lru_page(page))
+		return false;
+
+	if (page_mapped(page) || PageSwapCache(page)) {
+		putback_lru_page(page);
+		return false;
+	}
+
+	page->mapping = NULL;
+	ClearPageSwapBacked(page);
+	ClearPageActive(page);
+	ClearPageUnevictable(page);
+	/* A page cache page must start out clean, set_page_dirty() tags it */
+	ClearPageDirty(page);
+	put_page(page);
+	return true;
+}
+
+/**
+ * gift_user_pages - take pages away from the current address space
+ * @start: user address of the first page
+ * @nr_pages: number of pages from @start
+ * @pages: the pages mapped there, each with a reference held by the caller
+ *
+ * Used by vmsplice(SPLICE_F_GIFT | SPLICE_F_MOVE). The pages are unmapped
+ * as for MADV_DONTNEED, so the range reads back as zero fill, and then
+ * taken off the LRU with their anon state stripped, so that the pipe can
+ * move them into a page cache once nobody else holds them. Pages of
+ * private anonymous memory mapped only once can be taken; the first page
+ * that can't ends it.
+ *
+ * Returns the number of leading pages taken.
+ */
+int gift_user_pages(unsigned long start, int nr_pages, struct page **pages)
+{
+	struct mm_struct *mm = current->mm;
+	struct vm_area_struct *vma;
+	unsigned long address = start;
+	int i = 0, run, gifted = 0;
+
+	down_read(&mm->mmap_sem);
+	while (i < nr_pages && gifted == i) {
+		vma = find_vma(mm, address);
+		if (!vma || vma->vm_start > address)
+			break;
+
+		for (run = 0; i + run < nr_pages; run++)
+			if (!giftable_page(vma, address + run * PAGE_SIZE,
+					   pages[i + run]))
+				break;
+		if (!run)
+			break;
+
+		zap_page_range(vma, address, run * PAGE_SIZE, NULL);
+		for (; run; run--, i++, address += PAGE_SIZE)
+			if (gifted == i && detach_gifted_page(pages[i]))
+				gifted++;
+	}
+	up_read(&mm->mmap_sem);
+
+	return gifted;
+}
+
 /**
  * follow_page - look up a page descriptor from a user-virtual address
  * @vma: vm_area_struct mapping @address
@@ -3140,6 +3228,142 @@ oom:
 	return VM_FAULT_OOM;
 }
 
+/**
+ * do_set_pte - setup new PTE entry for given page and add reverse page mapping.
+ *
+ * @vma: virtual memory area
+ * @address: user virtual address
+ * @page: page to map
+ * @pte: pointer to target page table entry
+ * @write: true, if new entry is writable
+ * @anon: true, if it's anonymous page
+ *
+ * Caller must hold page table lock relevant for @pte.
+ */
+void do_set_pte(struct vm_area_struct *vma, unsigned long address,
+		struct page *page, pte_t *pte, bool write, bool anon)
+{
+	pte_t entry;
+
+	flush_icache_page(vma, page);
+	entry = mk_pte(page, vma->vm_page_prot);
+	if (write)
+		entry = maybe_mkwrite(pte_mkdirty(entry), vma);
+	if (anon) {
+		inc_mm_counter_fast(vma->vm_mm, MM_ANONPAGES);
+		page_add_new_anon_rmap(page, vma, address);
+	} else {
+		inc_mm_counter_fast(vma->vm_mm, MM_FILEPAGES);
+		page_add_file_rmap(page);
+	}
+	set_pte_at(vma->vm_mm, address, pte, entry);
+
+	/* no need to invalidate: a not-present page won't be cached */
+	update_mmu_cache(vma, address, pte);
+}
+
+/*
+ * Size of the window, in bytes, that a read fault on a file mapping
+ * tries to map from the page cache in one go.  Always a power of two
+ * between PAGE_SIZE and PTRS_PER_PTE pages, so that the window is
+ * aligned and never crosses a page table.
+ */
+static unsigned long fault_around_bytes = 65536;
+
+static inline unsigned long fault_around_pages(void)
+{
+	return ACCESS_ONCE(fault_around_bytes) >> PAGE_SHIFT;
+}
+
+#ifdef CONFIG_DEBUG_FS
+static int fault_around_bytes_get(void *data, u64 *val)
+{
+	*val = fault_around_bytes;
+	return 0;
+}
+
+static int fault_around_bytes_set(void *data, u64 val)
+{
+	if (val / PAGE_SIZE > PTRS_PER_PTE)
+		return -EINVAL;
+	if (val > PAGE_SIZE)
+		fault_around_bytes = rounddown_pow_of_two(val);
+	else
+		fault_around_bytes = PAGE_SIZE; /* disables fault-around */
+	return 0;
+}
+DEFINE_SIMPLE_ATTRIBUTE(fault_around_bytes_fops,
+		fault_around_bytes_get, fault_around_bytes_set, "%llu\n");
+
+static int __init fault_around_debugfs(void)
+{
+	void *ret;
+
+	ret = debugfs_create_file("fault_around_bytes", 0644, NULL, NULL,
+			&fault_around_bytes_fops);
+	if (!ret)
+		printk(KERN_WARNING
+		       "Failed to create fault_around_bytes in debugfs\n");
+	return 0;
+}
+late_initcall(fault_around_debugfs);
+#endif
+
+/*
+ * do_fault_around() tries to map a few pages around the faulting
+ * address, as long as they are already in the page cache, so that
+ * subsequent accesses to them do not fault at all.
+ *
+ * The window is fault_around_bytes wide and naturally aligned, clipped
+ * to the vma.  Pages whose PTE is already populated are left alone.
+ *
+ * The page table lock for @pte must be held; ->map_pages() runs under it
+ * and must not sleep.
+ */
+static void do_fault_around(struct vm_area_struct *vma, unsigned long address,
+		pte_t *pte, pgoff_t pgoff, unsigned int flags)
+{
+	unsigned long start_addr, nr_pages, mask;
+	pgoff_t max_pgoff;
+	struct vm_fault vmf;
+	int off;
+
+	nr_pages = fault_around_pages();
+	mask = ~(nr_pages * PAGE_SIZE - 1) & PAGE_MASK;
+
+	start_addr = max(address & mask, vma->vm_start);
+	off = ((address - start_addr) >> PAGE_SHIFT) & (PTRS_PER_PTE - 1);
+	pte -= off;
+	pgoff -= off;
+
+	/*
+	 * max_pgoff is either the end of the page table, the end of the
+	 * vma or nr_pages from pgoff, whichever is nearest.
+	 */
+	max_pgoff = pgoff - ((start_addr >> PAGE_SHIFT) & (PTRS_PER_PTE - 1)) +
+		PTRS_PER_PTE - 1;
+	max_pgoff = min3(max_pgoff, vma_pages(vma) + vma->vm_pgoff - 1,
+			pgoff + nr_pages - 1);
+
+	/* Skip leading populated entries; nothing to do if all are. */
+	while (!pte_none(*pte)) {
+		if (++pgoff > max_pgoff)
+			return;
+		start_addr += PAGE_SIZE;
+		if (start_addr >= vma->vm_end)
+			return;
+		pte++;
+	}
+
+	vmf.virtual_address = (void __user *) start_addr;
+	vmf.pte = pte;
+	vmf.pgoff = pgoff;
+	vmf.max_pgoff = max_pgoff;
+	vmf.flags = flags;
+	vmf.page = NULL;
+	vma->vm_ops->map_pages(vma, &vmf);
+}
+
 /*
  * __do_fault() tries to create a new page mapping. It aggressively
  * tries to share with existing pages, but makes a separate copy if
@@ -3160,7 +3384,6 @@ static int __do_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	pte_t *page_table;
 	spinlock_t *ptl;
 	struct page *page;
-	pte_t entry;
 	int anon = 0;
 	int charged = 0;
 	struct page *dirty_page = NULL;
@@ -3168,6 +3391,22 @@ static int __do_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	int ret;
 	int page_mkwrite = 0;
 
+	/*
+	 * On a read fault, first map whatever is already uptodate in the
+	 * page cache around the faulting address.  ->fault() is only
+	 * called if that did not cover the faulting address itself.
+	 */
+	if (!(flags & (FAULT_FLAG_WRITE | FAULT_FLAG_NONLINEAR)) &&
+	    vma->vm_ops->map_pages && fault_around_pages() > 1) {
+		page_table = pte_offset_map_lock(mm, pmd, address, &ptl);
+		do_fault_around(vma, address, page_table, pgoff, flags);
+		if (!pte_same(*page_table, orig_pte)) {
+			pte_unmap_unlock(page_table, ptl);
+			return 0;
+		}
+		pte_unmap_unlock(page_table, ptl);
+	}
+
 	vmf.virtual_address = (void __user *)(address & PAGE_MASK);
 	vmf.pgoff = pgoff;
 	vmf.flags = flags;
@@ -3264,25 +3503,12 @@ static int __do_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	 */
 	/* Only go through if we didn't race with anybody else... */
 	if (likely(pte_same(*page_table, orig_pte))) {
-		flush_icache_page(vma, page);
-		entry = mk_pte(page, vma->vm_page_prot);
-		if (flags & FAULT_FLAG_WRITE)
-			entry = maybe_mkwrite(pte_mkdirty(entry), vma);
-		if (anon) {
-			inc_mm_counter_fast(mm, MM_ANONPAGES);
-			page_add_new_anon_rmap(page, vma, address);
-		} else {
-			inc_mm_counter_fast(mm, MM_FILEPAGES);
-			page_add_file_rmap(page);
-			if (flags & FAULT_FLAG_WRITE) {
-				dirty_page = page;
-				get_page(dirty_page);
-			}
+		do_set_pte(vma, address, page, page_table,
+			   flags & FAULT_FLAG_WRITE, anon);
+		if (!anon && (flags & FAULT_FLAG_WRITE)) {
+			dirty_page = page;
+			get_page(dirty_page);
 		}
-		set_pte_at(mm, address, page_table, entry);
-
-		/* no need to invalidate: a not-present page won't be cached */
-		update_mmu_cache(vma, address, page_table);
 	} else {
 		if (charged)
 			mem_cgroup_uncharge_page(page);
@@ -0,0 +1,533 @@
+/*
+ * mm/pagecache_trace.c - record page cache misses and replay them
+ *
+ * Application launch and boot read their files in an order that the
+ * readahead heuristics cannot predict, so they pay for lots of small
+ * random reads.  This records which ranges of which files had to be
+ * read from disk, for one process or for everybody, and lets userspace
+ * feed such a trace back later.  The replay sorts and merges the
+ * ranges per file and submits them as large readahead requests, so
+ * the data is in the page cache by the time it is needed.
+ *
+ * Interface, in <debugfs>/pagecache_trace/:
+ *
+ *   enable	write 1 to clear the trace and start recording, 0 to stop
+ *   pid	only record misses of this thread group, 0 for all tasks
+ *   trace	the recorded trace, one "<start> <pages> <path>" line per
+ *		range, in the order the misses happened
+ *   replay	write a trace in the same format; it is replayed on close
+ *
+ * "pagecache_trace" on the kernel command line starts recording all
+ * tasks during boot.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/mutex.h>
+#include <linux/hash.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+#include <linux/blkdev.h>
+#include <linux/sort.h>
+#include <linux/pagecache_trace.h>
+
+#define PCT_MAX_ENTRIES		32768
+#define PCT_MAX_FILES		4096
+#define PCT_FILE_HASH_BITS	8
+#define PCT_REPLAY_MAX		(8 << 20)
+
+struct pct_file {
+	struct hlist_node	node;
+	dev_t			dev;
+	unsigned long		ino;
+	unsigned int		idx;
+	char			*path;
+};
+
+/* One contiguous range of pages that had to be read */
+struct pct_entry {
+	unsigned int		file;	/* index into pct_files */
+	unsigned int		nr;
+	pgoff_t			start;
+};
+
+int pagecache_trace_enabled __read_mostly;
+static bool pct_boot __initdata;
+
+static DEFINE_MUTEX(pct_mutex);
+static pid_t pct_pid;
+static struct pct_entry *pct_entries;
+static unsigned int pct_nr_entries;
+static struct pct_file **pct_files;
+static unsigned int pct_nr_files;
+static unsigned long pct_dropped;
+static struct hlist_head pct_file_hash[1 << PCT_FILE_HASH_BITS];
+
+/* Must hold pct_mutex */
+static void pct_free_trace(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < pct_nr_files; i++) {
+		kfree(pct_files[i]->path);
+		kfree(pct_files[i]);
+	}
+	for (i = 0; i < ARRAY_SIZE(pct_file_hash); i++)
+		INIT_HLIST_HEAD(&pct_file_hash[i]);
+
+	vfree(pct_files);
+	vfree(pct_entries);
+	pct_files = NULL;
+	pct_entries = NULL;
+	pct_nr_files = 0;
+	pct_nr_entries = 0;
+	pct_dropped = 0;
+}
+
+/* Must hold pct_mutex */
+static int pct_start(void)
+{
+	pct_free_trace();
+
+	pct_entries = vmalloc(PCT_MAX_ENTRIES * sizeof(*pct_entries));
+	pct_files = vmalloc(PCT_MAX_FILES * sizeof(*pct_files));
+	if (!pct_entries || !pct_files) {
+		pct_free_trace();
+		return -ENOMEM;
+	}
+
+	pagecache_trace_enabled = 1;
+	return 0;
+}
+
+/*
+ * Look up the file in the trace, adding it on its first miss.
+ * Must hold pct_mutex.
+ */
+static struct pct_file *pct_get_file(struct file *filp)
+{
+	struct inode *inode = filp->f_mapping->host;
+	dev_t dev = inode->i_sb->s_dev;
+	struct hlist_head *head;
+	struct hlist_node *pos;
+	struct pct_file *f;
+	char *buf, *path;
+
+	head = &pct_file_hash[hash_long(inode->i_ino ^ dev,
+					PCT_FILE_HASH_BITS)];
+	hlist_for_each_entry(f, pos, head, node)
+		if (f->dev == dev && f->ino == inode->i_ino)
+			return f;
+
+	if (pct_nr_files == PCT_MAX_FILES)
+		return NULL;
+
+	/* We may be called from the readahead of a filesystem */
+	buf = kmalloc(PATH_MAX, GFP_NOFS);
+	if (!buf)
+		return NULL;
+
+	f = NULL;
+	path = d_path(&filp->f_path, buf, PATH_MAX);
+	if (IS_ERR(path))
+		goto out;
+
+	f = kmalloc(sizeof(*f), GFP_NOFS);
+	if (!f)
+		goto out;
+	f->path = kstrdup(path, GFP_NOFS);
+	if (!f->path) {
+		kfree(f);
+		f = NULL;
+		goto out;
+	}
+	f->dev = dev;
+	f->ino = inode->i_ino;
+	f->idx = pct_nr_files;
+	pct_files[pct_nr_files++] = f;
+	hlist_add_head(&f->node, head);
+out:
+	kfree(buf);
+	return f;
+}
+
+/*
+ * Called whenever pages [start, start + nr) of filp had to be read
+ * into the page cache.
+ */
+void __pagecache_trace_record(struct file *filp, pgoff_t start,
+			      unsigned long nr)
+{
+	struct pct_entry *e;
+	struct pct_file *f;
+
+	if (pct_pid && task_tgid_nr(current) != pct_pid)
+		return;
+
+	mutex_lock(&pct_mutex);
+	if (!pagecache_trace_enabled)
+		goto out;
+
+	f = pct_get_file(filp);
+	if (!f) {
+		pct_dropped++;
+		goto out;
+	}
+
+	/* Extend the previous range if this continues it */
+	if (pct_nr_entries) {
+		e = &pct_entries[pct_nr_entries - 1];
+		if (e->file == f->idx && e->start + e->nr == start) {
+			e->nr += nr;
+			goto out;
+		}
+	}
+
+	if (pct_nr_entries == PCT_MAX_ENTRIES) {
+		pct_dropped++;
+		goto out;
+	}
+
+	e = &pct_entries[pct_nr_entries++];
+	e->file = f->idx;
+	e->start = start;
+	e->nr = nr;
+out:
+	mutex_unlock(&pct_mutex);
+}
+
+static int __init pagecache_trace_setup(char *str)
+{
+	pct_boot = true;
+	return 1;
+}
+__setup("pagecache_trace", pagecache_trace_setup);
+
+static int pct_enable_get(void *data, u64 *val)
+{
+	*val = pagecache_trace_enabled;
+	return 0;
+}
+
+static int pct_enable_set(void *data, u64 val)
+{
+	int err = 0;
+
+	mutex_lock(&pct_mutex);
+	if (val)
+		err = pct_start();
+	else
+		pagecache_trace_enabled = 0;
+	mutex_unlock(&pct_mutex);
+
+	return err;
+}
+DEFINE_SIMPLE_ATTRIBUTE(pct_enable_fops, pct_enable_get, pct_enable_set,
+			"%llu\n");
+
+static int pct_pid_get(void *data, u64 *val)
+{
+	*val = pct_pid;
+	return 0;
+}
+
+static int pct_pid_set(void *data, u64 val)
+{
+	pct_pid = val;
+	return 0;
+}
+DEFINE_SIMPLE_ATTRIBUTE(pct_pid_fops, pct_pid_get, pct_pid_set, "%llu\n");
+
+static void *pct_seq_start(struct seq_file *m, loff_t *pos)
+{
+	mutex_lock(&pct_mutex);
+	if (*pos == 0)
+		return SEQ_START_TOKEN;
+	if (*pos > pct_nr_entries)
+		return NULL;
+	return &pct_entries[*pos - 1];
+}
+
+static void *pct_seq_next(struct seq_file *m, void *v, loff_t *pos)
+{
+	++*pos;
+	if (*pos > pct_nr_entries)
+		return NULL;
+	return &pct_entries[*pos - 1];
+}
+
+static void pct_seq_stop(struct seq_file *m, void *v)
+{
+	mutex_unlock(&pct_mutex);
+}
+
+static int pct_seq_show(struct seq_file *m, void *v)
+{
+	struct pct_entry *e = v;
+
+	if (v == SEQ_START_TOKEN) {
+		seq_printf(m, "# entries %u files %u dropped %lu\n",
+			   pct_nr_entries, pct_nr_files, pct_dropped);
+		return 0;
+	}
+
+	seq_printf(m, "%lu %u ", (unsigned long)e->start, e->nr);
+	seq_escape(m, pct_files[e->file]->path, "\n\\");
+	seq_putc(m, '\n');
+	return 0;
+}
+
+static const struct seq_operations pct_seq_ops = {
+	.start	= pct_seq_start,
+	.next	= pct_seq_next,
+	.stop	= pct_seq_stop,
+	.show	= pct_seq_show,
+};
+
+static int pct_trace_open(struct inode *inode, struct file *file)
+{
+	return seq_open(file, &pct_seq_ops);
+}
+
+static const struct file_operations pct_trace_fops = {
+	.open		= pct_trace_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= seq_release,
+};
+
+/* A trace being written to the replay file */
+struct pct_replay {
+	char		*buf;
+	size_t		len;
+	size_t		size;
+};
+
+struct pct_range {
+	const char	*path;
+	unsigned long	start;
+	unsigned long	nr;
+};
+
+static int pct_range_cmp(const void *a, const void *b)
+{
+	const struct pct_range *ra = a, *rb = b;
+	int ret = strcmp(ra->path, rb->path);
+
+	if (ret)
+		return ret;
+	if (ra->start != rb->start)
+		return ra->start < rb->start ? -1 : 1;
+	return 0;
+}
+
+/* Undo the seq_escape() of the trace file, in place */
+static void pct_unescape(char *s)
+{
+	char *d = s;
+
+	while (*s) {
+		if (s[0] == '\\' && s[1] >= '0' && s[1] <= '3' &&
+		    s[2] >= '0' && s[2] <= '7' && s[3] >= '0' && s[3] <= '7') {
+			*d++ = ((s[1] - '0') << 6) | ((s[2] - '0') << 3) |
+			       (s[3] - '0');
+			s += 4;
+		} else {
+			*d++ = *s++;
+		}
+	}
+	*d = '\0';
+}
+
+/* Parse "<start> <pages> <path>" lines, skipping comments and junk */
+static unsigned long pct_parse(char *buf, struct pct_range *ranges,
+			       unsigned long max)
+{
+	unsigned long nr = 0;
+	char *line, *p;
+
+	while ((line = strsep(&buf, "\n")) != NULL && nr < max) {
+		struct pct_range *r = &ranges[nr];
+
+		if (*line == '#' || !*line)
+			continue;
+
+		r->start = simple_strtoul(line, &p, 10);
+		if (*p != ' ')
+			continue;
+		r->nr = simple_strtoul(p + 1, &p, 10);
+		if (*p != ' ' || !r->nr || p[1] != '/')
+			continue;
+
+		pct_unescape(p + 1);
+		r->path = p + 1;
+		nr++;
+	}
+
+	return nr;
+}
+
+/*
+ * Submit readahead for the ranges of one file.  Ranges are sorted by
+ * offset; neighbouring and overlapping ones are merged into a single
+ * request and the whole file is submitted under one plug.
+ */
+static void pct_replay_file(struct pct_range *r, unsigned long nr)
+{
+	struct blk_plug plug;
+	struct file *filp;
+	unsigned long i, start, end;
+
+	filp = filp_open(r->path, O_RDONLY | O_LARGEFILE, 0);
+	if (IS_ERR(filp))
+		return;
+
+	blk_start_plug(&plug);
+	start = r[0].start;
+	end = start + r[0].nr;
+	for (i = 1; i <= nr; i++) {
+		if (i < nr && r[i].start <= end) {
+			end = max(end, r[i].start + r[i].nr);
+			continue;
+		}
+		force_page_cache_readahead(filp->f_mapping, filp,
+					   start, end - start);
+		if (i < nr) {
+			start = r[i].start;
+			end = start + r[i].nr;
+		}
+	}
+	blk_finish_plug(&plug);
+
+	filp_close(filp, NULL);
+}
+
+static void pct_replay(struct pct_replay *rp)
+{
+	struct pct_range *ranges;
+	unsigned long nr, max, i, first;
+
+	/* Every range takes at least "0 1 /\n" */
+	max = rp->len / 6 + 1;
+	ranges = vmalloc(max * sizeof(*ranges));
+	if (!ranges)
+		return;
+
+	nr = pct_parse(rp->buf, ranges, max);
+	sort(ranges, nr, sizeof(*ranges), pct_range_cmp, NULL);
+
+	for (first = 0, i = 1; i <= nr; i++) {
+		if (i < nr && !strcmp(ranges[i].path, ranges[first].path))
+			continue;
+		pct_replay_file(&ranges[first], i - first);
+		first = i;
+		cond_resched();
+	}
+
+	vfree(ranges);
+}
+
+static int pct_replay_open(struct inode *inode, struct file *file)
+{
+	struct pct_replay *rp;
+
+	rp = kzalloc(sizeof(*rp), GFP_KERNEL);
+	if (!rp)
+		return -ENOMEM;
+	file->private_data = rp;
+	return 0;
+}
+
+static ssize_t pct_replay_write(struct file *file, const char __user *ubuf,
+				size_t count, loff_t *ppos)
+{
+	struct pct_replay *rp = file->private_data;
+
+	if (rp->len + count + 1 > PCT_REPLAY_MAX)
+		return -EFBIG;
+
+	if (rp->len + count + 1 > rp->size) {
+		size_t size = max(rp->size * 2, rp->len + count + 1);
+		char *buf;
+
+		size = min_t(size_t, max_t(size_t, size, PAGE_SIZE),
+			     PCT_REPLAY_MAX);
+		buf = vmalloc(size);
+		if (!buf)
+			return -ENOMEM;
+		if (rp->buf) {
+			memcpy(buf, rp->buf, rp->len);
+			vfree(rp->buf);
+		}
+		rp->buf = buf;
+		rp->size = size;
+	}
+
+	if (copy_from_user(rp->buf + rp->len, ubuf, count))
+		return -EFAULT;
+	rp->len += count;
+	rp->buf[rp->len] = '\0';
+
+	return count;
+}
+
+static int pct_replay_release(struct inode *inode, struct file *file)
+{
+	struct pct_replay *rp = file->private_data;
+
+	if (rp->len)
+		pct_replay(rp);
+
+	vfree(rp->buf);
+	kfree(rp);
+	return 0;
+}
+
+static const struct file_operations pct_replay_fops = {
+	.open		= pct_replay_open,
+	.write		= pct_replay_write,
+	.release	= pct_replay_release,
+	.llseek		= noop_llseek,
+};
+
+static int __init pagecache_trace_debugfs(void)
+{
+	struct dentry *dir;
+
+	dir = debugfs_create_dir("pagecache_trace", NULL);
+	if (!dir)
+		return -ENOMEM;
+
+	if (!debugfs_create_file("enable", 0600, dir, NULL,
+				 &pct_enable_fops) ||
+	    !debugfs_create_file("pid", 0600, dir, NULL, &pct_pid_fops) ||
+	    !debugfs_create_file("trace", 0400, dir, NULL,
+				 &pct_trace_fops) ||
+	    !debugfs_create_file("replay", 0200, dir, NULL,
+				 &pct_replay_fops)) {
+		debugfs_remove_recursive(dir);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+static int __init pagecache_trace_init(void)
+{
+	if (pct_boot) {
+		mutex_lock(&pct_mutex);
+		if (pct_start())
+			printk(KERN_WARNING
+			       "pagecache_trace: cannot allocate boot trace\n");
+		mutex_unlock(&pct_mutex);
+	}
+
+	return pagecache_trace_debugfs();
+}
+late_initcall(pagecache_trace_init);
@@ -17,6 +17,7 @@
 #include <linux/task_io_accounting_ops.h>
 #include <linux/pagevec.h>
 #include <linux/pagemap.h>
+#include <linux/pagecache_trace.h>
 
 /*
  * Initialise a struct file's readahead state.  Assumes that the caller has
@@ -158,6 +159,7 @@ __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 	LIST_HEAD(page_pool);
 	int page_idx;
 	int ret = 0;
+	pgoff_t first = 0, last = 0;
 	loff_t isize = i_size_read(inode);
 
 	if (isize == 0)
@@ -187,6 +189,9 @@ __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 		list_add(&page->lru, &page_pool);
 		if (page_idx == nr_to_read - lookahead_size)
 			SetPageReadahead(page);
+		if (!ret)
+			first = page_offset;
+		last = page_offset;
 		ret++;
 	}
 
@@ -195,8 +200,10 @@ __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 	 * uptodate then the caller will launch readpage again, and
 	 * will then handle the error.
 	 */
-	if (ret)
+	if (ret) {
 		read_pages(mapping, filp, &page_pool, ret);
+		pagecache_trace_record(filp, first, last - first + 1);
+	}
 	BUG_ON(!list_empty(&page_pool));
 out:
 	return ret;
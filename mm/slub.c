@@ -1626,8 +1626,12 @@ void init_kmem_cache_cpus(struct kmem_cache *s)
 {
 	int cpu;
 
-	for_each_possible_cpu(cpu)
-		per_cpu_ptr(s->cpu_slab, cpu)->tid = init_tid(cpu);
+	for_each_possible_cpu(cpu) {
+		struct kmem_cache_cpu *c = per_cpu_ptr(s->cpu_slab, cpu);
+
+		c->tid = init_tid(cpu);
+		INIT_LIST_HEAD(&c->partial);
+	}
 }
 /*
  * Remove the cpu slab
@@ -1664,6 +1668,102 @@ static void deactivate_slab(struct kmem_cache *s, struct kmem_cache_cpu *c)
 	unfreeze_slab(s, page, tail);
 }
 
+/*
+ * Move the slabs on the cpu partial list back to the node partial lists.
+ *
+ * The slabs are frozen so frees to them never take the list_lock, which
+ * makes it safe to spin on the slab lock while holding the list_lock here.
+ * The list_lock is only dropped when the next slab belongs to another node.
+ *
+ * Must be called with interrupts disabled.
+ */
+static void unfreeze_partials(struct kmem_cache *s, struct kmem_cache_cpu *c)
+{
+	struct kmem_cache_node *n = NULL;
+	struct page *page, *t;
+	LIST_HEAD(discard);
+
+	if (list_empty(&c->partial))
+		return;
+
+	stat(s, CPU_PARTIAL_DRAIN);
+	list_for_each_entry_safe(page, t, &c->partial, lru) {
+		struct kmem_cache_node *n2 = get_node(s, page_to_nid(page));
+
+		if (n != n2) {
+			if (n)
+				spin_unlock(&n->list_lock);
+			n = n2;
+			spin_lock(&n->list_lock);
+		}
+
+		list_del(&page->lru);
+		slab_lock(page);
+		__ClearPageSlubFrozen(page);
+		if (!page->inuse && n->nr_partial >= s->min_partial) {
+			list_add(&page->lru, &discard);
+		} else {
+			n->nr_partial++;
+			list_add_tail(&page->lru, &n->partial);
+		}
+		slab_unlock(page);
+	}
+	if (n)
+		spin_unlock(&n->list_lock);
+	c->partial_objects = 0;
+
+	list_for_each_entry_safe(page, t, &discard, lru) {
+		list_del(&page->lru);
+		stat(s, FREE_SLAB);
+		discard_slab(s, page);
+	}
+}
+
+/*
+ * Put a slab that just went from full to partial on the cpu partial list.
+ * The slab must already be frozen. If the list then holds more than
+ * s->cpu_partial free objects it is drained to the node lists in one go.
+ *
+ * Must be called with interrupts disabled.
+ */
+static void put_cpu_partial(struct kmem_cache *s, struct page *page)
+{
+	struct kmem_cache_cpu *c = __this_cpu_ptr(s->cpu_slab);
+
+	if (c->partial_objects > s->cpu_partial)
+		unfreeze_partials(s, c);
+
+	list_add(&page->lru, &c->partial);
+	c->partial_objects += page->objects - page->inuse;
+	stat(s, CPU_PARTIAL_FREE);
+}
+
+/*
+ * Take a slab off the cpu partial list to become the new cpu slab.
+ * Returns the slab locked, or NULL if there is none for the node.
+ */
+static struct page *get_cpu_partial(struct kmem_cache *s,
+				struct kmem_cache_cpu *c, int node)
+{
+	struct page *page;
+
+	if (list_empty(&c->partial))
+		return NULL;
+
+	page = list_first_entry(&c->partial, struct page, lru);
+	if (node != NUMA_NO_NODE && page_to_nid(page) != node)
+		return NULL;
+
+	list_del(&page->lru);
+	if (list_empty(&c->partial))
+		c->partial_objects = 0;
+	else
+		c->partial_objects = max(0, c->partial_objects -
+					 (page->objects - page->inuse));
+	slab_lock(page);
+	return page;
+}
+
 static inline void flush_slab(struct kmem_cache *s, struct kmem_cache_cpu *c)
 {
 	stat(s, CPUSLAB_FLUSH);
@@ -1682,6 +1782,9 @@ static inline void __flush_cpu_slab(struct kmem_cache *s, int cpu)
 
 	if (likely(c && c->page))
 		flush_slab(s, c);
+
+	if (c)
+		unfreeze_partials(s, c);
 }
 
 static void flush_cpu_slab(void *d)
@@ -1841,6 +1944,14 @@ another_slab:
 	deactivate_slab(s, c);
 
 new_slab:
+	page = get_cpu_partial(s, c, node);
+	if (page) {
+		stat(s, CPU_PARTIAL_ALLOC);
+		c->node = page_to_nid(page);
+		c->page = page;
+		goto load_freelist;
+	}
+
 	page = get_partial(s, gfpflags, node);
 	if (page) {
 		stat(s, ALLOC_FROM_PARTIAL);
@@ -2058,6 +2169,17 @@ static void __slab_free(struct kmem_cache *s, struct page *page,
 	 * then add it.
 	 */
 	if (unlikely(!prior)) {
+		if (s->cpu_partial && !kmem_cache_debug(s)) {
+			/*
+			 * Keep the slab frozen on this cpu so that neither
+			 * this free nor later ones need the list_lock.
+			 */
+			__SetPageSlubFrozen(page);
+			slab_unlock(page);
+			put_cpu_partial(s, page);
+			local_irq_restore(flags);
+			return;
+		}
 		add_partial(get_node(s, page_to_nid(page)), page, 1);
 		stat(s, FREE_ADD_PARTIAL);
 	}
@@ -2594,6 +2716,23 @@ static int kmem_cache_open(struct kmem_cache *s,
 	 * list to avoid pounding the page allocator excessively.
 	 */
 	set_min_partial(s, ilog2(s->size));
+
+	/*
+	 * The cpu partial lists hold on to free objects per cpu. Bound them
+	 * by object count so that caches with large objects do not pin too
+	 * much memory. Debug caches need every slab on the node lists.
+	 */
+	if (kmem_cache_debug(s))
+		s->cpu_partial = 0;
+	else if (s->size >= PAGE_SIZE)
+		s->cpu_partial = 2;
+	else if (s->size >= 1024)
+		s->cpu_partial = 6;
+	else if (s->size >= 256)
+		s->cpu_partial = 13;
+	else
+		s->cpu_partial = 30;
+
 	s->refcount = 1;
 #ifdef CONFIG_NUMA
 	s->remote_node_defrag_ratio = 1000;
@@ -4140,6 +4279,53 @@ static ssize_t min_partial_store(struct kmem_cache *s, const char *buf,
 }
 SLAB_ATTR(min_partial);
 
+static ssize_t cpu_partial_show(struct kmem_cache *s, char *buf)
+{
+	return sprintf(buf, "%d\n", s->cpu_partial);
+}
+
+static ssize_t cpu_partial_store(struct kmem_cache *s, const char *buf,
+				 size_t length)
+{
+	unsigned long objects;
+	int err;
+
+	err = strict_strtoul(buf, 10, &objects);
+	if (err)
+		return err;
+	if (objects && kmem_cache_debug(s))
+		return -EINVAL;
+
+	s->cpu_partial = objects;
+	flush_all(s);
+	return length;
+}
+SLAB_ATTR(cpu_partial);
+
+static ssize_t slabs_cpu_partial_show(struct kmem_cache *s, char *buf)
+{
+	int objects = 0;
+	int cpu;
+	int len;
+
+	for_each_online_cpu(cpu)
+		objects += per_cpu_ptr(s->cpu_slab, cpu)->partial_objects;
+
+	len = sprintf(buf, "%d", objects);
+
+#ifdef CONFIG_SMP
+	for_each_online_cpu(cpu) {
+		struct kmem_cache_cpu *c = per_cpu_ptr(s->cpu_slab, cpu);
+
+		if (c->partial_objects && len < PAGE_SIZE - 20)
+			len += sprintf(buf + len, " C%d=%d", cpu,
+				       c->partial_objects);
+	}
+#endif
+	return len + sprintf(buf + len, "\n");
+}
+SLAB_ATTR_RO(slabs_cpu_partial);
+
 static ssize_t ctor_show(struct kmem_cache *s, char *buf)
 {
 	if (!s->ctor)
@@ -4486,6 +4672,9 @@ STAT_ATTR(DEACTIVATE_TO_HEAD, deactivate_to_head);
 STAT_ATTR(DEACTIVATE_TO_TAIL, deactivate_to_tail);
 STAT_ATTR(DEACTIVATE_REMOTE_FREES, deactivate_remote_frees);
 STAT_ATTR(ORDER_FALLBACK, order_fallback);
+STAT_ATTR(CPU_PARTIAL_ALLOC, cpu_partial_alloc);
+STAT_ATTR(CPU_PARTIAL_FREE, cpu_partial_free);
+STAT_ATTR(CPU_PARTIAL_DRAIN, cpu_partial_drain);
 #endif
 
 static struct attribute *slab_attrs[] = {
@@ -4494,10 +4683,12 @@ static struct attribute *slab_attrs[] = {
 	&objs_per_slab_attr.attr,
 	&order_attr.attr,
 	&min_partial_attr.attr,
+	&cpu_partial_attr.attr,
 	&objects_attr.attr,
 	&objects_partial_attr.attr,
 	&partial_attr.attr,
 	&cpu_slabs_attr.attr,
+	&slabs_cpu_partial_attr.attr,
 	&ctor_attr.attr,
 	&aliases_attr.attr,
 	&align_attr.attr,
@@ -4543,6 +4734,9 @@ static struct attribute *slab_attrs[] = {
 	&deactivate_to_tail_attr.attr,
 	&deactivate_remote_frees_attr.attr,
 	&order_fallback_attr.attr,
+	&cpu_partial_alloc_attr.attr,
+	&cpu_partial_free_attr.attr,
+	&cpu_partial_drain_attr.attr,
 #endif
 #ifdef CONFIG_FAILSLAB
 	&failslab_attr.attr,
@@ -756,6 +756,11 @@ const char * const vmstat_text[] = {
 
 	"pgrotated",
 
+	"pipe_grow",
+	"splice_gift",
+	"splice_move",
+	"splice_copy",
+
 #ifdef CONFIG_COMPACTION
 	"compact_blocks_moved",
 	"compact_pages_moved",
@@ -1878,7 +1878,7 @@ struct used_address {
 
 static int __sys_sendmsg(struct socket *sock, struct msghdr __user *msg,
 			 struct msghdr *msg_sys, unsigned flags,
-			 struct used_address *used_address)
+			 struct used_address *used_address, int nocmsg)
 {
 	struct compat_msghdr __user *msg_compat =
 	    (struct compat_msghdr __user *)msg;
@@ -1897,6 +1897,9 @@ static int __sys_sendmsg(struct socket *sock, struct msghdr __user *msg,
 	} else if (copy_from_user(msg_sys, msg, sizeof(struct msghdr)))
 		return -EFAULT;
 
+	if (nocmsg && msg_sys->msg_controllen)
+		return -EINVAL;
+
 	/* do not move before msg_sys is valid */
 	err = -EMSGSIZE;
 	if (msg_sys->msg_iovlen > UIO_MAXIOV)
@@ -2007,13 +2010,32 @@ SYSCALL_DEFINE3(sendmsg, int, fd, struct msghdr __user *, msg, unsigned, flags)
 	if (!sock)
 		goto out;
 
-	err = __sys_sendmsg(sock, msg, &msg_sys, flags, NULL);
+	err = __sys_sendmsg(sock, msg, &msg_sys, flags, NULL, 0);
 
 	fput_light(sock->file, fput_needed);
 out:
 	return err;
 }
 
+/*
+ *	sendmsg on a socket file the caller holds, for aio.  The retries run
+ *	from a kernel thread with none of the caller's files, so control
+ *	messages are refused.
+ */
+
+int file_sendmsg(struct file *file, struct msghdr __user *msg, unsigned flags)
+{
+	struct msghdr msg_sys;
+	struct socket *sock;
+	int err;
+
+	sock = sock_from_file(file, &err);
+	if (!sock)
+		return err;
+
+	return __sys_sendmsg(sock, msg, &msg_sys, flags, NULL, 1);
+}
+
 /*
  *	Linux sendmmsg interface
  */
@@ -2045,14 +2067,14 @@ int __sys_sendmmsg(int fd, struct mmsghdr __user *mmsg, unsigned int vlen,
 	while (datagrams < vlen) {
 		if (MSG_CMSG_COMPAT & flags) {
 			err = __sys_sendmsg(sock, (struct msghdr __user *)compat_entry,
-					    &msg_sys, flags, &used_address);
+					    &msg_sys, flags, &used_address, 0);
 			if (err < 0)
 				break;
 			err = __put_user(err, &compat_entry->msg_len);
 			++compat_entry;
 		} else {
 			err = __sys_sendmsg(sock, (struct msghdr __user *)entry,
-					    &msg_sys, flags, &used_address);
+					    &msg_sys, flags, &used_address, 0);
 			if (err < 0)
 				break;
 			err = put_user(err, &entry->msg_len);
@@ -2080,7 +2102,8 @@ SYSCALL_DEFINE4(sendmmsg, int, fd, struct mmsghdr __user *, mmsg,
 }
 
 static int __sys_recvmsg(struct socket *sock, struct msghdr __user *msg,
-			 struct msghdr *msg_sys, unsigned flags, int nosec)
+			 struct msghdr *msg_sys, unsigned flags, int nosec,
+			 int nocmsg)
 {
 	struct compat_msghdr __user *msg_compat =
 	    (struct compat_msghdr __user *)msg;
@@ -2102,6 +2125,9 @@ static int __sys_recvmsg(struct socket *sock, struct msghdr __user *msg,
 	} else if (copy_from_user(msg_sys, msg, sizeof(struct msghdr)))
 		return -EFAULT;
 
+	if (nocmsg && msg_sys->msg_controllen)
+		return -EINVAL;
+
 	err = -EMSGSIZE;
 	if (msg_sys->msg_iovlen > UIO_MAXIOV)
 		goto out;
@@ -2187,13 +2213,31 @@ SYSCALL_DEFINE3(recvmsg, int, fd, struct msghdr __user *, msg,
 	if (!sock)
 		goto out;
 
-	err = __sys_recvmsg(sock, msg, &msg_sys, flags, 0);
+	err = __sys_recvmsg(sock, msg, &msg_sys, flags, 0, 0);
 
 	fput_light(sock->file, fput_needed);
 out:
 	return err;
 }
 
+/*
+ *	recvmsg on a socket file the caller holds, for aio.  No control
+ *	messages, as for file_sendmsg().
+ */
+
+int file_recvmsg(struct file *file, struct msghdr __user *msg, unsigned flags)
+{
+	struct msghdr msg_sys;
+	struct socket *sock;
+	int err;
+
+	sock = sock_from_file(file, &err);
+	if (!sock)
+		return err;
+
+	return __sys_recvmsg(sock, msg, &msg_sys, flags, 0, 1);
+}
+
 /*
  *     Linux recvmmsg interface
  */
@@ -2233,7 +2277,7 @@ int __sys_recvmmsg(int fd, struct mmsghdr __user *mmsg, unsigned int vlen,
 		if (MSG_CMSG_COMPAT & flags) {
 			err = __sys_recvmsg(sock, (struct msghdr __user *)compat_entry,
 					    &msg_sys, flags & ~MSG_WAITFORONE,
-					    datagrams);
+					    datagrams, 0);
 			if (err < 0)
 				break;
 			err = __put_user(err, &compat_entry->msg_len);
@@ -2241,7 +2285,7 @@ int __sys_recvmmsg(int fd, struct mmsghdr __user *mmsg, unsigned int vlen,
 		} else {
 			err = __sys_recvmsg(sock, (struct msghdr __user *)entry,
 					    &msg_sys, flags & ~MSG_WAITFORONE,
-					    datagrams);
+					    datagrams, 0);
 			if (err < 0)
 				break;
 			err = put_user(err, &entry->msg_len);
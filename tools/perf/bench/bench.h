@@ -4,6 +4,18 @@
 extern int bench_sched_messaging(int argc, const char **argv, const char *prefix);
 extern int bench_sched_pipe(int argc, const char **argv, const char *prefix);
 extern int bench_mem_memcpy(int argc, const char **argv, const char *prefix __used);
+extern int bench_mem_fault(int argc, const char **argv, const char *prefix __used);
+extern int bench_mem_tlb(int argc, const char **argv, const char *prefix __used);
+extern int bench_fs_launch(int argc, const char **argv, const char *prefix __used);
+extern int bench_fs_fuse(int argc, const char **argv, const char *prefix __used);
+extern int bench_fs_fsync(int argc, const char **argv, const char *prefix __used);
+extern int bench_fs_read(int argc, const char **argv, const char *prefix __used);
+extern int bench_fs_mount(int argc, const char **argv, const char *prefix __used);
+extern int bench_fs_aio(int argc, const char **argv, const char *prefix __used);
+extern int bench_fs_ring(int argc, const char **argv, const char *prefix __used);
+extern int bench_fs_locks(int argc, const char **argv, const char *prefix __used);
+extern int bench_epoll_wait(int argc, const char **argv, const char *prefix __used);
+extern int bench_pipe_bandwidth(int argc, const char **argv, const char *prefix __used);
 
 #define BENCH_FORMAT_DEFAULT_STR	"default"
 #define BENCH_FORMAT_DEFAULT		0
@@ -14,4 +26,9 @@ extern int bench_mem_memcpy(int argc, const char **argv, const char *prefix __us
 
 extern int bench_format;
 
+/* bench/common.c */
+struct timeval;
+extern void bench_drop_caches(void);
+extern double bench_elapsed(struct timeval *start);
+
 #endif
@@ -0,0 +1,37 @@
+/*
+ * common.c
+ *
+ * Helpers shared by the benchmarks
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "bench.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/time.h>
+
+/* Write back and drop the page cache, dentries and inodes.  Needs root. */
+void bench_drop_caches(void)
+{
+	int fd;
+
+	sync();
+	fd = open("/proc/sys/vm/drop_caches", O_WRONLY);
+	if (fd < 0 || write(fd, "3", 1) != 1)
+		die("cannot drop caches: %s\n", strerror(errno));
+	close(fd);
+}
+
+/* Seconds since start */
+double bench_elapsed(struct timeval *start)
+{
+	struct timeval stop, diff;
+
+	gettimeofday(&stop, NULL);
+	timersub(&stop, start, &diff);
+	return diff.tv_sec + diff.tv_usec / 1000000.0;
+}
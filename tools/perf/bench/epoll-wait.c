@@ -0,0 +1,224 @@
+/*
+ * epoll-wait.c
+ *
+ * wait: Wakeup fan-out of epoll sets sharing a descriptor
+ *
+ * Every worker thread has its own epoll set, all watching the read end of
+ * one pipe, the way event-loop services share a listening socket.  The
+ * main thread writes the pipe a byte at a time and a worker that wakes up
+ * tries to read.  Without EPOLLEXCLUSIVE every event wakes every set and
+ * all but one of the workers find nothing to read; with it only one set
+ * is woken.  Both modes are run and compared.
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/time.h>
+
+#ifndef EPOLLEXCLUSIVE
+#define EPOLLEXCLUSIVE (1u << 28)
+#endif
+
+static int		nr_threads;
+static int		nr_events	= 100000;
+static bool		edge;
+
+static const struct option options[] = {
+	OPT_INTEGER('t', "threads", &nr_threads,
+		    "Specify number of worker threads (default: online cpus)"),
+	OPT_INTEGER('n', "events", &nr_events,
+		    "Specify number of events to deliver"),
+	OPT_BOOLEAN('e', "edge", &edge,
+		    "Use edge triggered mode (EPOLLET)"),
+	OPT_END()
+};
+
+static const char * const bench_epoll_wait_usage[] = {
+	"perf bench epoll wait <options>",
+	NULL
+};
+
+struct worker {
+	pthread_t	thread;
+	int		epfd;
+	unsigned long	wakeups;
+	unsigned long	wasted;
+};
+
+#define STOP_EVENT	(~0ULL)
+
+static int		pipefd[2];
+static int		stopfd[2];
+static int		consumed;
+
+static void *worker_thread(void *arg)
+{
+	struct worker *w = arg;
+	struct epoll_event ev;
+	char buf[4096];
+	int ret, got;
+
+	for (;;) {
+		ret = epoll_wait(w->epfd, &ev, 1, -1);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			die("epoll_wait: %s\n", strerror(errno));
+		}
+		if (ev.data.u64 == STOP_EVENT)
+			break;
+		w->wakeups++;
+
+		/*
+		 * Level triggered takes one event per wakeup, edge
+		 * triggered has to drain the pipe.
+		 */
+		got = 0;
+		do {
+			ret = read(pipefd[0], buf, edge ? sizeof(buf) : 1);
+			if (ret > 0)
+				got += ret;
+			else if (ret < 0 && errno != EAGAIN)
+				die("read: %s\n", strerror(errno));
+		} while (edge && ret > 0);
+
+		if (got)
+			__sync_fetch_and_add(&consumed, got);
+		else
+			w->wasted++;
+	}
+
+	return NULL;
+}
+
+struct result {
+	double		usecs;		/* per event */
+	double		wakeups;	/* per event */
+	double		wasted;		/* wakeups that found nothing, per event */
+};
+
+static void run(unsigned int flags, struct result *res)
+{
+	struct timeval start, stop, diff;
+	struct epoll_event ev;
+	struct worker *workers;
+	unsigned long wakeups = 0, wasted = 0;
+	char c = 0;
+	int i;
+
+	if (pipe(pipefd) || pipe(stopfd))
+		die("pipe: %s\n", strerror(errno));
+	if (fcntl(pipefd[0], F_SETFL, O_NONBLOCK))
+		die("fcntl: %s\n", strerror(errno));
+	consumed = 0;
+
+	workers = calloc(nr_threads, sizeof(*workers));
+	if (!workers)
+		die("not enough memory\n");
+
+	for (i = 0; i < nr_threads; i++) {
+		workers[i].epfd = epoll_create(1);
+		if (workers[i].epfd < 0)
+			die("epoll_create: %s\n", strerror(errno));
+		ev.events = EPOLLIN | flags;
+		ev.data.u64 = i;
+		if (epoll_ctl(workers[i].epfd, EPOLL_CTL_ADD, pipefd[0], &ev))
+			die("epoll_ctl: %s\n", strerror(errno));
+		/* Not exclusive, so that it wakes everybody at the end */
+		ev.events = EPOLLIN;
+		ev.data.u64 = STOP_EVENT;
+		if (epoll_ctl(workers[i].epfd, EPOLL_CTL_ADD, stopfd[0], &ev))
+			die("epoll_ctl: %s\n", strerror(errno));
+		if (pthread_create(&workers[i].thread, NULL, worker_thread,
+				   &workers[i]))
+			die("cannot create worker thread\n");
+	}
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nr_events; i++)
+		if (write(pipefd[1], &c, 1) != 1)
+			die("write: %s\n", strerror(errno));
+	while (__sync_fetch_and_add(&consumed, 0) < nr_events)
+		sched_yield();
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+
+	if (write(stopfd[1], &c, 1) != 1)
+		die("write: %s\n", strerror(errno));
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		wakeups += workers[i].wakeups;
+		wasted += workers[i].wasted;
+		close(workers[i].epfd);
+	}
+	close(pipefd[0]);
+	close(pipefd[1]);
+	close(stopfd[0]);
+	close(stopfd[1]);
+	free(workers);
+
+	res->usecs = (diff.tv_sec * 1000000.0 + diff.tv_usec) / nr_events;
+	res->wakeups = (double)wakeups / nr_events;
+	res->wasted = (double)wasted / nr_events;
+}
+
+int bench_epoll_wait(int argc, const char **argv,
+		     const char *prefix __used)
+{
+	struct result shared, exclusive;
+	unsigned int flags;
+
+	argc = parse_options(argc, argv, options,
+			     bench_epoll_wait_usage, 0);
+
+	if (!nr_threads)
+		nr_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nr_threads <= 0 || nr_events <= 0) {
+		usage_with_options(bench_epoll_wait_usage, options);
+		return 1;
+	}
+
+	flags = edge ? EPOLLET : 0;
+	run(flags, &shared);
+	run(flags | EPOLLEXCLUSIVE, &exclusive);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d threads, one epoll set each, sharing a pipe, "
+		       "%d events%s\n\n", nr_threads, nr_events,
+		       edge ? ", edge triggered" : "");
+		printf(" %14lf usecs/event (shared)\n", shared.usecs);
+		printf(" %14lf wakeups/event, %lf wasted (shared)\n",
+		       shared.wakeups, shared.wasted);
+		printf(" %14lf usecs/event (EPOLLEXCLUSIVE)\n",
+		       exclusive.usecs);
+		printf(" %14lf wakeups/event, %lf wasted (EPOLLEXCLUSIVE)\n",
+		       exclusive.wakeups, exclusive.wasted);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lf\n", exclusive.usecs);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
@@ -0,0 +1,219 @@
+/*
+ * fs-aio.c
+ *
+ * aio: Random buffered read IOPS, synchronous versus AIO
+ *
+ * Random blocks of a file are read from a cold page cache, first one at
+ * a time with pread() and then through io_submit() with several requests
+ * in flight.  Buffered AIO reads only help if io_submit() returns while
+ * the page cache misses are still being read, so the time spent inside
+ * io_submit() is reported as well.  Needs root to drop the page cache.
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <linux/aio_abi.h>
+
+static const char	*file;
+static const char	*block_str	= "4KB";
+static int		nr_ios		= 10000;
+static int		depth		= 32;
+static bool		no_drop;
+
+static const struct option options[] = {
+	OPT_STRING('f', "file", &file, "file",
+		    "Specify the file to read (required)"),
+	OPT_STRING('b', "block", &block_str, "4KB",
+		    "Specify size of each read"),
+	OPT_INTEGER('n', "ios", &nr_ios,
+		    "Specify number of reads per pass"),
+	OPT_INTEGER('d', "depth", &depth,
+		    "Specify number of AIO reads in flight"),
+	OPT_BOOLEAN('N', "no-drop", &no_drop,
+		    "Do not drop the page cache before each pass"),
+	OPT_END()
+};
+
+static const char * const bench_fs_aio_usage[] = {
+	"perf bench fs aio <options>",
+	NULL
+};
+
+static size_t		block;
+static u64		nr_blocks;
+static char		*bufs;
+
+static off_t random_offset(void)
+{
+	return (off_t)(((u64)random() << 31 | random()) % nr_blocks) * block;
+}
+
+/* Read nr_ios random blocks with pread(), return IOPS */
+static double sync_pass(int fd)
+{
+	struct timeval start;
+	int i;
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nr_ios; i++)
+		if (pread(fd, bufs, block, random_offset()) < 0)
+			die("pread: %s\n", strerror(errno));
+
+	return nr_ios / bench_elapsed(&start);
+}
+
+/* Submit iocb at a random offset, return the seconds io_submit() took */
+static double submit_read(aio_context_t ctx, struct iocb *iocb)
+{
+	struct timeval start;
+
+	iocb->aio_offset = random_offset();
+
+	gettimeofday(&start, NULL);
+	if (syscall(__NR_io_submit, ctx, 1, &iocb) != 1)
+		die("io_submit: %s\n", strerror(errno));
+	return bench_elapsed(&start);
+}
+
+/*
+ * Read nr_ios random blocks keeping depth of them in flight, return
+ * IOPS and the usecs spent in io_submit() per read
+ */
+static double aio_pass(int fd, double *submit_usecs)
+{
+	struct timeval start;
+	struct iocb *iocbs;
+	struct io_event *events;
+	aio_context_t ctx = 0;
+	double submit = 0, iops;
+	int submitted = 0, done = 0;
+	int i, n;
+
+	iocbs = calloc(depth, sizeof(*iocbs));
+	events = calloc(depth, sizeof(*events));
+	if (!iocbs || !events)
+		die("not enough memory\n");
+	if (syscall(__NR_io_setup, depth, &ctx))
+		die("io_setup: %s\n", strerror(errno));
+
+	for (i = 0; i < depth; i++) {
+		iocbs[i].aio_lio_opcode = IOCB_CMD_PREAD;
+		iocbs[i].aio_fildes = fd;
+		iocbs[i].aio_buf = (unsigned long)(bufs + i * block);
+		iocbs[i].aio_nbytes = block;
+		iocbs[i].aio_data = i;
+	}
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < depth && submitted < nr_ios; i++, submitted++)
+		submit += submit_read(ctx, &iocbs[i]);
+
+	while (done < nr_ios) {
+		n = syscall(__NR_io_getevents, ctx, 1, depth, events, NULL);
+		if (n < 0)
+			die("io_getevents: %s\n", strerror(errno));
+
+		/* Reuse the slot of every completed read */
+		for (i = 0; i < n; i++) {
+			if ((s64)events[i].res < 0)
+				die("aio read: %s\n",
+				    strerror(-(s64)events[i].res));
+			if (submitted < nr_ios) {
+				submit += submit_read(ctx,
+						&iocbs[events[i].data]);
+				submitted++;
+			}
+		}
+		done += n;
+	}
+	iops = nr_ios / bench_elapsed(&start);
+	*submit_usecs = submit * 1000000.0 / nr_ios;
+
+	syscall(__NR_io_destroy, ctx);
+	free(events);
+	free(iocbs);
+	return iops;
+}
+
+int bench_fs_aio(int argc, const char **argv,
+		 const char *prefix __used)
+{
+	double sync_iops, aio_iops, submit_usecs;
+	struct stat st;
+	int fd;
+
+	argc = parse_options(argc, argv, options,
+			     bench_fs_aio_usage, 0);
+
+	if (!file) {
+		usage_with_options(bench_fs_aio_usage, options);
+		return 1;
+	}
+
+	block = (size_t)perf_atoll((char *)block_str);
+	if ((s64)block <= 0) {
+		fprintf(stderr, "Invalid block size:%s\n", block_str);
+		return 1;
+	}
+	if (nr_ios <= 0 || depth <= 0) {
+		fprintf(stderr, "Invalid number of reads\n");
+		return 1;
+	}
+
+	fd = open(file, O_RDONLY);
+	if (fd < 0)
+		die("cannot open %s: %s\n", file, strerror(errno));
+	if (fstat(fd, &st))
+		die("cannot stat %s: %s\n", file, strerror(errno));
+	nr_blocks = st.st_size / block;
+	if (!nr_blocks)
+		die("%s is smaller than one block\n", file);
+
+	bufs = malloc(depth * block);
+	if (!bufs)
+		die("not enough memory\n");
+
+	if (!no_drop)
+		bench_drop_caches();
+	sync_iops = sync_pass(fd);
+	if (!no_drop)
+		bench_drop_caches();
+	aio_iops = aio_pass(fd, &submit_usecs);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d random %s reads of %s, AIO depth %d\n\n",
+		       nr_ios, block_str, file, depth);
+		printf(" %14lf IOPS (pread)\n", sync_iops);
+		printf(" %14lf IOPS (aio)\n", aio_iops);
+		printf(" %14lf usecs/read in io_submit\n", submit_usecs);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lf\n", aio_iops);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	free(bufs);
+	close(fd);
+	return 0;
+}
@@ -0,0 +1,140 @@
+/*
+ * fs-fsync.c
+ *
+ * fsync: Latency of small writes each followed by fsync
+ *
+ * Mimics a database journal: every transaction writes a record to a
+ * file and syncs it before going on.  Records are appended by default,
+ * so each fsync has to make a size change and a block allocation
+ * durable; --overwrite rewrites the same region instead.
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/time.h>
+#include <sys/types.h>
+
+static const char	*dir		= ".";
+static int		count		= 1000;
+static int		record_size	= 4096;
+static bool		overwrite;
+static bool		datasync;
+
+static const struct option options[] = {
+	OPT_STRING('d', "dir", &dir, "dir",
+		    "Specify directory to create the test file in"),
+	OPT_INTEGER('n', "count", &count,
+		    "Specify number of write+fsync rounds"),
+	OPT_INTEGER('s', "size", &record_size,
+		    "Specify size of each write in bytes"),
+	OPT_BOOLEAN('o', "overwrite", &overwrite,
+		    "Rewrite the start of the file instead of appending"),
+	OPT_BOOLEAN('D', "datasync", &datasync,
+		    "Use fdatasync() instead of fsync()"),
+	OPT_END()
+};
+
+static const char * const bench_fs_fsync_usage[] = {
+	"perf bench fs fsync <options>",
+	NULL
+};
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+int bench_fs_fsync(int argc, const char **argv,
+		   const char *prefix __used)
+{
+	char path[PATH_MAX];
+	double *lat, total = 0.0;
+	char *buf;
+	int fd, i;
+
+	argc = parse_options(argc, argv, options,
+			     bench_fs_fsync_usage, 0);
+
+	if (count <= 0) {
+		fprintf(stderr, "Invalid number of rounds\n");
+		return 1;
+	}
+	if (record_size <= 0) {
+		fprintf(stderr, "Invalid write size\n");
+		return 1;
+	}
+
+	lat = malloc(count * sizeof(*lat));
+	buf = malloc(record_size);
+	if (!lat || !buf)
+		die("not enough memory\n");
+	memset(buf, 'x', record_size);
+
+	snprintf(path, sizeof(path), "%s/perf-bench-fsync.%d", dir, getpid());
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		die("cannot create %s: %s\n", path, strerror(errno));
+	/* Don't count the creation of the file against the first round */
+	if (fsync(fd))
+		die("fsync failed: %s\n", strerror(errno));
+
+	for (i = 0; i < count; i++) {
+		struct timeval start, stop, diff;
+		off_t pos = overwrite ? 0 : (off_t)i * record_size;
+
+		gettimeofday(&start, NULL);
+		if (pwrite(fd, buf, record_size, pos) != record_size)
+			die("write failed: %s\n", strerror(errno));
+		if (datasync ? fdatasync(fd) : fsync(fd))
+			die("fsync failed: %s\n", strerror(errno));
+		gettimeofday(&stop, NULL);
+
+		timersub(&stop, &start, &diff);
+		lat[i] = diff.tv_sec * 1000000.0 + diff.tv_usec;
+		total += lat[i];
+	}
+
+	close(fd);
+	unlink(path);
+	qsort(lat, count, sizeof(*lat), cmp_double);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d %s writes of %d bytes, each followed by %s\n\n",
+		       count, overwrite ? "overwriting" : "appending",
+		       record_size, datasync ? "fdatasync" : "fsync");
+		printf(" %14lf usecs/op (avg)\n", total / count);
+		printf(" %14lf usecs/op (min)\n", lat[0]);
+		printf(" %14lf usecs/op (50%%)\n", lat[count / 2]);
+		printf(" %14lf usecs/op (99%%)\n", lat[count * 99 / 100]);
+		printf(" %14lf usecs/op (max)\n", lat[count - 1]);
+		printf(" %14d ops/sec\n", (int)(count * 1000000.0 / total));
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lf\n", total / count);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	free(buf);
+	free(lat);
+	return 0;
+}
@@ -0,0 +1,540 @@
+/*
+ * fs-fuse.c
+ *
+ * fuse: Sequential read throughput through FUSE, against the raw device
+ *
+ * A minimal FUSE daemon is built in: it mounts a filesystem holding a
+ * single file, "data", whose contents are read from the given backing
+ * file or block device.  The backing device is read once directly and
+ * once through the mount, so the difference is the cost of the FUSE
+ * round trips.  --channels serves the mount with several /dev/fuse
+ * channels (FUSE_DEV_IOC_CLONE), each with its own thread bound to a
+ * cpu, and --splice moves the reply payload from the backing device
+ * into the page cache with splice instead of copying it.  --passthrough
+ * registers the backing file with the kernel and opens with
+ * FOPEN_PASSTHROUGH, so that reads do not reach the daemon at all.  Needs root.
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include "../../../include/linux/fuse.h"
+
+#ifndef BLKGETSIZE64
+#define BLKGETSIZE64		_IOR(0x12, 114, size_t)
+#endif
+#ifndef F_SETPIPE_SZ
+#define F_SETPIPE_SZ		1031
+#endif
+
+/* The largest request the kernel sends: 32 pages of payload */
+#define FUSE_BENCH_MAX_IO	(128 * 1024)
+#define FUSE_BENCH_BUF_SIZE	(FUSE_BENCH_MAX_IO + 4096)
+
+#define FUSE_BENCH_ROOT_ID	1
+#define FUSE_BENCH_DATA_ID	2
+
+static const char	*device;
+static const char	*length_str	= "256MB";
+static const char	*block_str	= "128KB";
+static int		nr_channels	= 1;
+static bool		use_splice;
+static bool		direct_io;
+static bool		passthrough;
+
+static const struct option options[] = {
+	OPT_STRING('d', "device", &device, "path",
+		    "Specify the backing file or block device (required)"),
+	OPT_STRING('l', "length", &length_str, "256MB",
+		    "Specify amount of data to read. "
+		    "available unit: B, MB, GB (upper and lower)"),
+	OPT_STRING('b', "block", &block_str, "128KB",
+		    "Specify size of each read"),
+	OPT_INTEGER('c', "channels", &nr_channels,
+		    "Specify number of /dev/fuse channels and daemon threads"),
+	OPT_BOOLEAN('s', "splice", &use_splice,
+		    "Splice read payload from the backing device"),
+	OPT_BOOLEAN('D', "direct-io", &direct_io,
+		    "Open the file with FOPEN_DIRECT_IO, bypassing the page cache"),
+	OPT_BOOLEAN('p', "passthrough", &passthrough,
+		    "Pass the backing file to the kernel (regular files only)"),
+	OPT_END()
+};
+
+static const char * const bench_fs_fuse_usage[] = {
+	"perf bench fs fuse <options>",
+	NULL
+};
+
+struct channel {
+	int		fd;
+	int		cpu;
+	int		pipe[2];
+	pthread_t	thread;
+	char		*buf;
+};
+
+static int backing_fd;
+static int backing_id;		/* backing_fd registered for passthrough */
+static u64 backing_size;
+
+static void reply(struct channel *ch, u64 unique, int error,
+		  const void *arg, size_t size)
+{
+	struct fuse_out_header oh;
+	struct iovec iov[2];
+
+	oh.len = sizeof(oh) + size;
+	oh.error = error;
+	oh.unique = unique;
+	iov[0].iov_base = &oh;
+	iov[0].iov_len = sizeof(oh);
+	iov[1].iov_base = (void *)arg;
+	iov[1].iov_len = size;
+
+	/* ENOENT: the request was interrupted or aborted meanwhile */
+	if (writev(ch->fd, iov, size ? 2 : 1) < 0 && errno != ENOENT)
+		die("cannot write reply: %s\n", strerror(errno));
+}
+
+static void fill_attr(struct fuse_attr *attr, u64 ino)
+{
+	memset(attr, 0, sizeof(*attr));
+	attr->ino = ino;
+	if (ino == FUSE_BENCH_ROOT_ID) {
+		attr->mode = S_IFDIR | 0755;
+		attr->nlink = 2;
+	} else {
+		attr->mode = S_IFREG | 0444;
+		attr->nlink = 1;
+		attr->size = backing_size;
+		attr->blocks = (backing_size + 511) / 512;
+	}
+	attr->blksize = 4096;
+}
+
+static void do_init(struct channel *ch, struct fuse_in_header *ih)
+{
+	struct fuse_init_in *in = (struct fuse_init_in *)(ih + 1);
+	struct fuse_init_out out;
+
+	memset(&out, 0, sizeof(out));
+	out.major = FUSE_KERNEL_VERSION;
+	out.minor = in->minor < FUSE_KERNEL_MINOR_VERSION ?
+		    in->minor : FUSE_KERNEL_MINOR_VERSION;
+	out.max_readahead = in->max_readahead;
+	out.flags = in->flags & (FUSE_ASYNC_READ | FUSE_BIG_WRITES);
+	if (passthrough) {
+		if (!(in->flags & FUSE_PASSTHROUGH))
+			die("kernel does not support passthrough\n");
+		out.flags |= FUSE_PASSTHROUGH;
+	}
+	out.max_write = FUSE_BENCH_MAX_IO;
+
+	reply(ch, ih->unique, 0, &out, sizeof(out));
+
+	if (passthrough) {
+		__u32 fd = backing_fd;
+
+		backing_id = ioctl(ch->fd, FUSE_DEV_IOC_BACKING_OPEN, &fd);
+		if (backing_id < 0)
+			die("cannot register the backing file: %s\n",
+			    strerror(errno));
+	}
+}
+
+static void do_lookup(struct channel *ch, struct fuse_in_header *ih)
+{
+	const char *name = (const char *)(ih + 1);
+	struct fuse_entry_out out;
+
+	if (ih->nodeid != FUSE_BENCH_ROOT_ID || strcmp(name, "data")) {
+		reply(ch, ih->unique, -ENOENT, NULL, 0);
+		return;
+	}
+
+	memset(&out, 0, sizeof(out));
+	out.nodeid = FUSE_BENCH_DATA_ID;
+	out.generation = 1;
+	out.entry_valid = 3600;
+	out.attr_valid = 3600;
+	fill_attr(&out.attr, FUSE_BENCH_DATA_ID);
+
+	reply(ch, ih->unique, 0, &out, sizeof(out));
+}
+
+static void do_getattr(struct channel *ch, struct fuse_in_header *ih)
+{
+	struct fuse_attr_out out;
+
+	memset(&out, 0, sizeof(out));
+	out.attr_valid = 3600;
+	fill_attr(&out.attr, ih->nodeid);
+
+	reply(ch, ih->unique, 0, &out, sizeof(out));
+}
+
+static void do_open(struct channel *ch, struct fuse_in_header *ih)
+{
+	struct fuse_open_out out;
+
+	memset(&out, 0, sizeof(out));
+	if (direct_io)
+		out.open_flags = FOPEN_DIRECT_IO;
+	if (passthrough) {
+		out.open_flags |= FOPEN_PASSTHROUGH;
+		out.backing_id = backing_id;
+	}
+
+	reply(ch, ih->unique, 0, &out, sizeof(out));
+}
+
+static size_t read_size(struct fuse_read_in *in)
+{
+	if (in->offset >= backing_size)
+		return 0;
+	if (in->size > backing_size - in->offset)
+		return backing_size - in->offset;
+	return in->size;
+}
+
+static void do_read(struct channel *ch, struct fuse_in_header *ih)
+{
+	struct fuse_read_in *in = (struct fuse_read_in *)(ih + 1);
+	size_t size = read_size(in);
+	ssize_t ret;
+
+	ret = pread(backing_fd, ch->buf, size, in->offset);
+	if (ret < 0) {
+		reply(ch, ih->unique, -errno, NULL, 0);
+		return;
+	}
+
+	reply(ch, ih->unique, 0, ch->buf, ret);
+}
+
+/*
+ * Header and payload are assembled in a pipe and spliced to /dev/fuse
+ * as a whole, so the payload pages go from the backing device's page
+ * cache to the FUSE page cache (or the reader's buffer) untouched.
+ */
+static void do_read_splice(struct channel *ch, struct fuse_in_header *ih)
+{
+	struct fuse_read_in *in = (struct fuse_read_in *)(ih + 1);
+	size_t size = read_size(in);
+	struct fuse_out_header oh;
+	loff_t off = in->offset;
+	size_t left = size;
+	ssize_t ret;
+
+	oh.len = sizeof(oh) + size;
+	oh.error = 0;
+	oh.unique = ih->unique;
+	if (write(ch->pipe[1], &oh, sizeof(oh)) != sizeof(oh))
+		die("cannot write to pipe: %s\n", strerror(errno));
+
+	while (left) {
+		ret = splice(backing_fd, &off, ch->pipe[1], NULL, left,
+			     SPLICE_F_MOVE);
+		if (ret <= 0)
+			die("cannot splice from %s: %s\n", device,
+			    ret ? strerror(errno) : "unexpected EOF");
+		left -= ret;
+	}
+
+	left = oh.len;
+	while (left) {
+		ret = splice(ch->pipe[0], NULL, ch->fd, NULL, left,
+			     SPLICE_F_MOVE);
+		if (ret < 0 && errno == ENOENT) {
+			/* Aborted request, throw the payload away */
+			while (left) {
+				ret = read(ch->pipe[0], ch->buf,
+					   left < FUSE_BENCH_BUF_SIZE ?
+					   left : FUSE_BENCH_BUF_SIZE);
+				if (ret <= 0)
+					die("cannot drain pipe\n");
+				left -= ret;
+			}
+			break;
+		}
+		if (ret <= 0)
+			die("cannot splice reply: %s\n", strerror(errno));
+		left -= ret;
+	}
+}
+
+static void *channel_thread(void *arg)
+{
+	struct channel *ch = arg;
+	struct fuse_in_header *ih = (struct fuse_in_header *)ch->buf;
+	cpu_set_t cpus;
+	ssize_t ret;
+
+	CPU_ZERO(&cpus);
+	CPU_SET(ch->cpu, &cpus);
+	if (sched_setaffinity(0, sizeof(cpus), &cpus))
+		fprintf(stderr, "cannot bind channel to cpu %d: %s\n",
+			ch->cpu, strerror(errno));
+
+	for (;;) {
+		ret = read(ch->fd, ch->buf, FUSE_BENCH_BUF_SIZE);
+		if (ret < 0) {
+			if (errno == EINTR || errno == EAGAIN ||
+			    errno == ENOENT)
+				continue;
+			/* ENODEV: unmounted */
+			break;
+		}
+
+		switch (ih->opcode) {
+		case FUSE_INIT:
+			do_init(ch, ih);
+			break;
+		case FUSE_LOOKUP:
+			do_lookup(ch, ih);
+			break;
+		case FUSE_GETATTR:
+			do_getattr(ch, ih);
+			break;
+		case FUSE_OPEN:
+			do_open(ch, ih);
+			break;
+		case FUSE_READ:
+			if (use_splice)
+				do_read_splice(ch, ih);
+			else
+				do_read(ch, ih);
+			break;
+		case FUSE_FLUSH:
+		case FUSE_RELEASE:
+			reply(ch, ih->unique, 0, NULL, 0);
+			break;
+		case FUSE_FORGET:
+		case FUSE_BATCH_FORGET:
+		case FUSE_INTERRUPT:
+			/* no reply */
+			break;
+		default:
+			reply(ch, ih->unique, -ENOSYS, NULL, 0);
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+static void open_backing(void)
+{
+	struct stat st;
+
+	backing_fd = open(device, O_RDONLY);
+	if (backing_fd < 0)
+		die("cannot open %s: %s\n", device, strerror(errno));
+	if (fstat(backing_fd, &st))
+		die("cannot stat %s: %s\n", device, strerror(errno));
+
+	if (passthrough && !S_ISREG(st.st_mode))
+		die("passthrough needs a regular backing file\n");
+
+	if (S_ISBLK(st.st_mode)) {
+		if (ioctl(backing_fd, BLKGETSIZE64, &backing_size))
+			die("cannot get size of %s: %s\n", device,
+			    strerror(errno));
+	} else {
+		backing_size = st.st_size;
+	}
+}
+
+static void start_channels(struct channel *chans, const char *mnt)
+{
+	long nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	char opts[128];
+	int i;
+
+	for (i = 0; i < nr_channels; i++) {
+		struct channel *ch = &chans[i];
+
+		ch->fd = open("/dev/fuse", O_RDWR);
+		if (ch->fd < 0)
+			die("cannot open /dev/fuse: %s\n", strerror(errno));
+
+		if (!i) {
+			snprintf(opts, sizeof(opts),
+				 "fd=%d,rootmode=40000,user_id=0,group_id=0",
+				 ch->fd);
+			if (mount("perf-bench", mnt, "fuse", MS_NOSUID | MS_NODEV,
+				  opts))
+				die("cannot mount fuse: %s\n", strerror(errno));
+		} else {
+			__u32 fd = chans[0].fd;
+
+			if (ioctl(ch->fd, FUSE_DEV_IOC_CLONE, &fd))
+				die("cannot clone /dev/fuse channel: %s\n",
+				    strerror(errno));
+		}
+
+		if (use_splice) {
+			if (pipe(ch->pipe))
+				die("pipe failed: %s\n", strerror(errno));
+			if (fcntl(ch->pipe[0], F_SETPIPE_SZ,
+				  2 * FUSE_BENCH_BUF_SIZE) < 0)
+				die("cannot grow pipe: %s\n", strerror(errno));
+		}
+
+		ch->buf = malloc(FUSE_BENCH_BUF_SIZE);
+		if (!ch->buf)
+			die("not enough memory\n");
+		ch->cpu = i % nr_cpus;
+		if (pthread_create(&ch->thread, NULL, channel_thread, ch))
+			die("cannot create channel thread\n");
+	}
+}
+
+static void stop_channels(struct channel *chans, const char *mnt)
+{
+	int i;
+
+	if (umount2(mnt, 0))
+		die("cannot unmount %s: %s\n", mnt, strerror(errno));
+
+	for (i = 0; i < nr_channels; i++) {
+		pthread_join(chans[i].thread, NULL);
+		close(chans[i].fd);
+		if (use_splice) {
+			close(chans[i].pipe[0]);
+			close(chans[i].pipe[1]);
+		}
+		free(chans[i].buf);
+	}
+}
+
+/* Read length bytes of path from a cold cache, return MB/sec */
+static double read_throughput(const char *path, u64 length, size_t block,
+			      char *buf)
+{
+	struct timeval start, stop, diff;
+	u64 done = 0;
+	ssize_t ret;
+	double secs;
+	int fd;
+
+	bench_drop_caches();
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		die("cannot open %s: %s\n", path, strerror(errno));
+
+	gettimeofday(&start, NULL);
+	while (done < length) {
+		ret = read(fd, buf, block);
+		if (ret < 0)
+			die("cannot read %s: %s\n", path, strerror(errno));
+		if (!ret)
+			break;
+		done += ret;
+	}
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+	close(fd);
+
+	secs = diff.tv_sec + diff.tv_usec / 1000000.0;
+	return (double)done / (1024 * 1024) / secs;
+}
+
+int bench_fs_fuse(int argc, const char **argv,
+		  const char *prefix __used)
+{
+	char mnt[] = "/tmp/perf-bench-fuse.XXXXXX";
+	char path[PATH_MAX];
+	struct channel *chans;
+	double raw, fuse;
+	size_t block;
+	u64 length;
+	char *buf;
+
+	argc = parse_options(argc, argv, options,
+			     bench_fs_fuse_usage, 0);
+
+	if (!device) {
+		usage_with_options(bench_fs_fuse_usage, options);
+		return 1;
+	}
+
+	length = (u64)perf_atoll((char *)length_str);
+	block = (size_t)perf_atoll((char *)block_str);
+	if ((s64)length <= 0 || (s64)block <= 0) {
+		fprintf(stderr, "Invalid length:%s or block size:%s\n",
+			length_str, block_str);
+		return 1;
+	}
+	if (nr_channels <= 0) {
+		fprintf(stderr, "Invalid number of channels\n");
+		return 1;
+	}
+
+	open_backing();
+	if (length > backing_size)
+		length = backing_size;
+
+	buf = malloc(block);
+	chans = zalloc(nr_channels * sizeof(*chans));
+	if (!buf || !chans)
+		die("not enough memory\n");
+
+	if (!mkdtemp(mnt))
+		die("cannot create mount point: %s\n", strerror(errno));
+	start_channels(chans, mnt);
+
+	raw = read_throughput(device, length, block, buf);
+	snprintf(path, sizeof(path), "%s/data", mnt);
+	fuse = read_throughput(path, length, block, buf);
+
+	stop_channels(chans, mnt);
+	rmdir(mnt);
+	free(chans);
+	free(buf);
+	close(backing_fd);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# Reading %s of %s in %s blocks, %d channel%s%s%s%s\n\n",
+		       length_str, device, block_str, nr_channels,
+		       nr_channels > 1 ? "s" : "",
+		       use_splice ? ", splice" : "",
+		       direct_io ? ", direct io" : "",
+		       passthrough ? ", passthrough" : "");
+		printf(" %14lf MB/Sec (raw device)\n", raw);
+		printf(" %14lf MB/Sec (fuse)\n", fuse);
+		printf(" %14lf %% of raw device\n", fuse * 100.0 / raw);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lf\n", fuse);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
@@ -0,0 +1,234 @@
+/*
+ * fs-launch.c
+ *
+ * launch: Cold start time of a command, with and without prefetch replay
+ *
+ * The page cache is dropped before every run, so each launch has to
+ * read its executable, libraries and data from disk.  --record saves
+ * the page cache misses of the first launch with the kernel's
+ * pagecache_trace facility, and --trace replays such a trace before
+ * each launch so that the reads are issued up front as large, sorted
+ * requests.  Comparing the two shows what prefetch replay buys.
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+static const char	*command	= "/bin/true";
+static int		repeat		= 5;
+static const char	*trace_file;
+static const char	*record_file;
+static const char	*debugfs_dir	= "/sys/kernel/debug";
+static bool		no_drop;
+
+static const struct option options[] = {
+	OPT_STRING('c', "command", &command, "command",
+		    "Specify command to launch (run with /bin/sh -c)"),
+	OPT_INTEGER('r', "repeat", &repeat,
+		    "Specify number of launches"),
+	OPT_STRING('t', "trace", &trace_file, "file",
+		    "Replay this page cache trace before each launch"),
+	OPT_STRING('R', "record", &record_file, "file",
+		    "Record the page cache misses of the first launch to file"),
+	OPT_STRING('D', "debugfs", &debugfs_dir, "dir",
+		    "Specify where debugfs is mounted"),
+	OPT_BOOLEAN('n', "no-drop", &no_drop,
+		    "Do not drop the page cache before each launch"),
+	OPT_END()
+};
+
+static const char * const bench_fs_launch_usage[] = {
+	"perf bench fs launch <options>",
+	NULL
+};
+
+static double timeval_msecs(struct timeval *tv)
+{
+	return tv->tv_sec * 1000.0 + tv->tv_usec / 1000.0;
+}
+
+static void write_file(const char *path, const char *str)
+{
+	int fd = open(path, O_WRONLY);
+
+	if (fd < 0)
+		die("cannot open %s: %s\n", path, strerror(errno));
+	if (write(fd, str, strlen(str)) != (ssize_t)strlen(str))
+		die("cannot write %s: %s\n", path, strerror(errno));
+	close(fd);
+}
+
+static void copy_file(const char *from, const char *to, int flags)
+{
+	char buf[BUFSIZ];
+	int in, out;
+	ssize_t n;
+
+	in = open(from, O_RDONLY);
+	if (in < 0)
+		die("cannot open %s: %s\n", from, strerror(errno));
+	out = open(to, O_WRONLY | flags, 0644);
+	if (out < 0)
+		die("cannot open %s: %s\n", to, strerror(errno));
+
+	while ((n = read(in, buf, sizeof(buf))) > 0)
+		if (write(out, buf, n) != n)
+			die("cannot write %s: %s\n", to, strerror(errno));
+	if (n < 0)
+		die("cannot read %s: %s\n", from, strerror(errno));
+
+	close(in);
+	/* Closing the replay file is what starts the replay */
+	if (close(out))
+		die("cannot close %s: %s\n", to, strerror(errno));
+}
+
+static void trace_path(char *buf, size_t size, const char *name)
+{
+	snprintf(buf, size, "%s/pagecache_trace/%s", debugfs_dir, name);
+}
+
+/* Launch the command once and return its run time in msecs */
+static double launch(bool record)
+{
+	struct timeval start, stop, diff;
+	char path[PATH_MAX], pid_str[32];
+	int sync_pipe[2];
+	int status;
+	pid_t pid;
+
+	if (record && pipe(sync_pipe))
+		die("pipe failed: %s\n", strerror(errno));
+
+	gettimeofday(&start, NULL);
+
+	pid = fork();
+	if (pid < 0)
+		die("fork failed: %s\n", strerror(errno));
+
+	if (!pid) {
+		char c;
+
+		/* Wait for the parent to point the tracer at us */
+		if (record) {
+			close(sync_pipe[1]);
+			if (read(sync_pipe[0], &c, 1) != 1)
+				exit(127);
+			close(sync_pipe[0]);
+		}
+		execl("/bin/sh", "sh", "-c", command, NULL);
+		exit(127);
+	}
+
+	if (record) {
+		close(sync_pipe[0]);
+		snprintf(pid_str, sizeof(pid_str), "%d", pid);
+		trace_path(path, sizeof(path), "pid");
+		write_file(path, pid_str);
+		trace_path(path, sizeof(path), "enable");
+		write_file(path, "1");
+		if (write(sync_pipe[1], "", 1) != 1)
+			die("write failed: %s\n", strerror(errno));
+		close(sync_pipe[1]);
+	}
+
+	if (waitpid(pid, &status, 0) < 0)
+		die("waitpid failed: %s\n", strerror(errno));
+
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+
+	if (record) {
+		trace_path(path, sizeof(path), "enable");
+		write_file(path, "0");
+		trace_path(path, sizeof(path), "trace");
+		copy_file(path, record_file, O_CREAT | O_TRUNC);
+	}
+
+	if (!WIFEXITED(status) || WEXITSTATUS(status))
+		fprintf(stderr, "warning: '%s' did not exit cleanly\n",
+			command);
+
+	return timeval_msecs(&diff);
+}
+
+int bench_fs_launch(int argc, const char **argv,
+		    const char *prefix __used)
+{
+	double total = 0.0, min = 0.0, max = 0.0;
+	double replay_total = 0.0;
+	char replay_path[PATH_MAX];
+	int i;
+
+	argc = parse_options(argc, argv, options,
+			     bench_fs_launch_usage, 0);
+
+	if (repeat <= 0) {
+		fprintf(stderr, "Invalid number of launches\n");
+		return 1;
+	}
+
+	trace_path(replay_path, sizeof(replay_path), "replay");
+
+	for (i = 0; i < repeat; i++) {
+		struct timeval start, stop, diff;
+		double t;
+
+		if (!no_drop)
+			bench_drop_caches();
+
+		if (trace_file) {
+			gettimeofday(&start, NULL);
+			copy_file(trace_file, replay_path, 0);
+			gettimeofday(&stop, NULL);
+			timersub(&stop, &start, &diff);
+			replay_total += timeval_msecs(&diff);
+		}
+
+		t = launch(record_file && i == 0);
+		total += t;
+		if (!i || t < min)
+			min = t;
+		if (!i || t > max)
+			max = t;
+	}
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d %s launches of '%s'%s\n\n", repeat,
+		       no_drop ? "warm" : "cold", command,
+		       trace_file ? ", with prefetch replay" : "");
+		printf(" %14lf msecs/launch (avg)\n", total / repeat);
+		printf(" %14lf msecs/launch (min)\n", min);
+		printf(" %14lf msecs/launch (max)\n", max);
+		if (trace_file)
+			printf(" %14lf msecs/replay (avg)\n",
+			       replay_total / repeat);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lf\n", total / repeat);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
@@ -0,0 +1,204 @@
+/*
+ * fs-locks.c
+ *
+ * locks: Throughput of file locks taken by many processes at once
+ *
+ * Every process takes and drops a lock in a loop, first with fcntl()
+ * F_SETLKW and then with flock().  By default each process locks a file
+ * of its own, so that the locks never conflict and any slowdown as the
+ * processes are added comes from locking state shared between unrelated
+ * files.  With -s all of them lock one file, a byte range each for
+ * fcntl() and shared for flock(), so that they only share the inode.
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+static int		nr_procs;
+static int		nr_ops		= 100000;
+static const char	*dir		= "/tmp";
+static bool		shared;
+
+static const struct option options[] = {
+	OPT_INTEGER('p', "procs", &nr_procs,
+		    "Specify number of processes (default: online cpus)"),
+	OPT_INTEGER('n', "ops", &nr_ops,
+		    "Specify number of lock/unlock pairs per process"),
+	OPT_STRING('d', "dir", &dir, "dir",
+		    "Specify the directory of the lock files"),
+	OPT_BOOLEAN('s', "shared", &shared,
+		    "Lock one shared file instead of a file per process"),
+	OPT_END()
+};
+
+static const char * const bench_fs_locks_usage[] = {
+	"perf bench fs locks <options>",
+	NULL
+};
+
+enum mode {
+	MODE_FCNTL,
+	MODE_FLOCK,
+};
+
+static const char * const mode_names[] = {
+	"fcntl",
+	"flock",
+};
+
+static pid_t		bench_pid;	/* names the lock files */
+
+static void lock_path(char *path, size_t size, int i)
+{
+	snprintf(path, size, "%s/perf-locks.%d.%d", dir, bench_pid,
+		 shared ? 0 : i);
+}
+
+static void worker(int i, enum mode mode, int start_fd)
+{
+	char path[PATH_MAX];
+	struct flock fl;
+	char c;
+	int fd, n;
+
+	lock_path(path, sizeof(path), i);
+	fd = open(path, O_RDWR);
+	if (fd < 0)
+		die("cannot open %s: %s\n", path, strerror(errno));
+
+	memset(&fl, 0, sizeof(fl));
+	fl.l_whence = SEEK_SET;
+	fl.l_start = shared ? i : 0;
+	fl.l_len = 1;
+
+	/* Wait for everybody to be ready */
+	if (read(start_fd, &c, 1) < 0)
+		die("read: %s\n", strerror(errno));
+
+	for (n = 0; n < nr_ops; n++) {
+		if (mode == MODE_FCNTL) {
+			fl.l_type = F_WRLCK;
+			if (fcntl(fd, F_SETLKW, &fl))
+				die("fcntl: %s\n", strerror(errno));
+			fl.l_type = F_UNLCK;
+			if (fcntl(fd, F_SETLK, &fl))
+				die("fcntl: %s\n", strerror(errno));
+		} else {
+			if (flock(fd, shared ? LOCK_SH : LOCK_EX))
+				die("flock: %s\n", strerror(errno));
+			if (flock(fd, LOCK_UN))
+				die("flock: %s\n", strerror(errno));
+		}
+	}
+	exit(0);
+}
+
+/* Run one pass and return the lock/unlock pairs per second */
+static double run(enum mode mode)
+{
+	struct timeval start, stop, diff;
+	int startfd[2], status, i;
+	pid_t *pids;
+
+	pids = calloc(nr_procs, sizeof(*pids));
+	if (!pids)
+		die("not enough memory\n");
+	if (pipe(startfd))
+		die("pipe: %s\n", strerror(errno));
+
+	for (i = 0; i < nr_procs; i++) {
+		pids[i] = fork();
+		if (pids[i] < 0)
+			die("fork: %s\n", strerror(errno));
+		if (!pids[i]) {
+			close(startfd[1]);
+			worker(i, mode, startfd[0]);
+		}
+	}
+	close(startfd[0]);
+
+	/* Closing the pipe lets all of them go at once */
+	gettimeofday(&start, NULL);
+	close(startfd[1]);
+	for (i = 0; i < nr_procs; i++)
+		if (waitpid(pids[i], &status, 0) != pids[i] ||
+		    !WIFEXITED(status) || WEXITSTATUS(status))
+			die("worker %d failed\n", i);
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+
+	free(pids);
+	return (double)nr_procs * nr_ops /
+		(diff.tv_sec + diff.tv_usec / 1000000.0);
+}
+
+int bench_fs_locks(int argc, const char **argv,
+		   const char *prefix __used)
+{
+	char path[PATH_MAX];
+	double ops[MODE_FLOCK + 1];
+	int nr_files, i, fd;
+
+	argc = parse_options(argc, argv, options,
+			     bench_fs_locks_usage, 0);
+
+	if (!nr_procs)
+		nr_procs = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nr_procs <= 0 || nr_ops <= 0) {
+		usage_with_options(bench_fs_locks_usage, options);
+		return 1;
+	}
+
+	bench_pid = getpid();
+	nr_files = shared ? 1 : nr_procs;
+	for (i = 0; i < nr_files; i++) {
+		lock_path(path, sizeof(path), i);
+		fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0)
+			die("cannot create %s: %s\n", path, strerror(errno));
+		close(fd);
+	}
+
+	for (i = MODE_FCNTL; i <= MODE_FLOCK; i++)
+		ops[i] = run(i);
+
+	for (i = 0; i < nr_files; i++) {
+		lock_path(path, sizeof(path), i);
+		unlink(path);
+	}
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d processes, %d lock/unlock pairs each, %s in %s\n\n",
+		       nr_procs, nr_ops, shared ? "one shared file" :
+		       "a file each", dir);
+		for (i = MODE_FCNTL; i <= MODE_FLOCK; i++)
+			printf(" %14lf ops/sec (%s)\n", ops[i], mode_names[i]);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lf\n", ops[MODE_FCNTL]);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
@@ -0,0 +1,222 @@
+/*
+ * fs-mount.c
+ *
+ * mount: Mount time of a yaffs2 partition
+ *
+ * The partition is erased and filled with files, then mounted three ways:
+ * from a clean checkpoint, with a full scan (no-checkpoint-read) and from a
+ * stale checkpoint after more files were written behind it, which only
+ * replays the blocks written since the checkpoint was taken.  Needs root
+ * and a scratch MTD partition, everything on it is lost.
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/mount.h>
+#include <sys/time.h>
+#include <mtd/mtd-user.h>
+
+static const char	*mtd_dev;
+static const char	*block_dev;
+static const char	*dir;
+static int		nr_files	= 200;
+static const char	*size_str	= "64KB";
+static int		nr_after	= 20;
+
+static const struct option options[] = {
+	OPT_STRING('m', "mtd", &mtd_dev, "dev",
+		    "Specify the MTD char device to erase, e.g. /dev/mtd3 (required)"),
+	OPT_STRING('b', "blockdev", &block_dev, "dev",
+		    "Specify the device to mount, e.g. /dev/mtdblock3 (required)"),
+	OPT_STRING('d', "dir", &dir, "dir",
+		    "Specify the mount point (required)"),
+	OPT_INTEGER('n', "files", &nr_files,
+		    "Specify number of files written before the checkpoint"),
+	OPT_STRING('s', "size", &size_str, "64KB",
+		    "Specify size of each file"),
+	OPT_INTEGER('a', "after", &nr_after,
+		    "Specify number of files written after the checkpoint"),
+	OPT_END()
+};
+
+static const char * const bench_fs_mount_usage[] = {
+	"perf bench fs mount <options>",
+	NULL
+};
+
+static size_t		file_size;
+static char		*file_buf;
+
+static void erase_mtd(void)
+{
+	struct mtd_info_user info;
+	struct erase_info_user ei;
+	int fd;
+
+	fd = open(mtd_dev, O_RDWR);
+	if (fd < 0)
+		die("cannot open %s: %s\n", mtd_dev, strerror(errno));
+	if (ioctl(fd, MEMGETINFO, &info))
+		die("%s is not an MTD device: %s\n", mtd_dev, strerror(errno));
+
+	ei.length = info.erasesize;
+	for (ei.start = 0; ei.start < info.size; ei.start += info.erasesize) {
+		loff_t offs = ei.start;
+
+		/* Bad blocks stay bad */
+		if (ioctl(fd, MEMGETBADBLOCK, &offs) > 0)
+			continue;
+		if (ioctl(fd, MEMERASE, &ei))
+			die("cannot erase %s at %u: %s\n", mtd_dev, ei.start,
+			    strerror(errno));
+	}
+	close(fd);
+}
+
+static void do_mount(const char *opts)
+{
+	if (mount(block_dev, dir, "yaffs2", 0, opts))
+		die("cannot mount %s on %s: %s\n", block_dev, dir,
+		    strerror(errno));
+}
+
+static void do_umount(void)
+{
+	if (umount(dir))
+		die("cannot unmount %s: %s\n", dir, strerror(errno));
+}
+
+static void write_files(int first, int nr)
+{
+	char path[PATH_MAX];
+	int i, fd;
+
+	for (i = first; i < first + nr; i++) {
+		snprintf(path, sizeof(path), "%s/f%06d", dir, i);
+		fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0)
+			die("cannot create %s: %s\n", path, strerror(errno));
+		if (write(fd, file_buf, file_size) != (ssize_t)file_size)
+			die("cannot write %s: %s\n", path, strerror(errno));
+		close(fd);
+	}
+	sync();
+}
+
+/* Mount with opts and return how long it took in msecs */
+static double timed_mount(const char *opts)
+{
+	struct timeval start, stop, diff;
+
+	gettimeofday(&start, NULL);
+	do_mount(opts);
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+
+	return diff.tv_sec * 1000.0 + diff.tv_usec / 1000.0;
+}
+
+/* Blocks replayed by the last mount, -1 if /proc/yaffs doesn't say */
+static int replayed_blocks(void)
+{
+	char line[256];
+	FILE *f;
+	int n = -1;
+
+	f = fopen("/proc/yaffs", "r");
+	if (!f)
+		return -1;
+	while (fgets(line, sizeof(line), f))
+		if (sscanf(line, "n_replayed_blocks..... %d", &n) == 1)
+			break;
+	fclose(f);
+	return n;
+}
+
+int bench_fs_mount(int argc, const char **argv,
+		   const char *prefix __used)
+{
+	double clean, scan, replay;
+	int replayed;
+
+	argc = parse_options(argc, argv, options,
+			     bench_fs_mount_usage, 0);
+
+	if (!mtd_dev || !block_dev || !dir) {
+		usage_with_options(bench_fs_mount_usage, options);
+		return 1;
+	}
+
+	file_size = (size_t)perf_atoll((char *)size_str);
+	if ((s64)file_size <= 0) {
+		fprintf(stderr, "Invalid file size:%s\n", size_str);
+		return 1;
+	}
+	if (nr_files < 0 || nr_after <= 0) {
+		fprintf(stderr, "Invalid number of files\n");
+		return 1;
+	}
+
+	file_buf = malloc(file_size);
+	if (!file_buf)
+		die("not enough memory\n");
+	memset(file_buf, 0x5a, file_size);
+
+	/* Fill the partition, the unmount writes a checkpoint */
+	erase_mtd();
+	do_mount(NULL);
+	write_files(0, nr_files);
+	do_umount();
+
+	clean = timed_mount(NULL);
+	do_umount();
+
+	scan = timed_mount("no-checkpoint-read");
+	do_umount();
+
+	/* Write behind the checkpoint so that it goes stale */
+	do_mount("no-checkpoint-write");
+	write_files(nr_files, nr_after);
+	do_umount();
+
+	replay = timed_mount(NULL);
+	replayed = replayed_blocks();
+	do_umount();
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# Mounting %s on %s, %d + %d files of %s\n\n",
+		       block_dev, dir, nr_files, nr_after, size_str);
+		printf(" %14lf msecs (checkpoint)\n", clean);
+		printf(" %14lf msecs (full scan)\n", scan);
+		printf(" %14lf msecs (checkpoint replay", replay);
+		if (replayed >= 0)
+			printf(", %d blocks", replayed);
+		printf(")\n");
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lf\n", replay);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	free(file_buf);
+	return 0;
+}
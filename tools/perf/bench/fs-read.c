@@ -0,0 +1,196 @@
+/*
+ * fs-read.c
+ *
+ * read: Parallel cold read throughput of a directory tree
+ *
+ * Every regular file under the given directory is read from a cold page
+ * cache, once by a single thread and once by several threads that take
+ * files off a shared queue.  On a compressed read-only filesystem such as
+ * squashfs the ratio of the two shows how well decompression scales over
+ * the cpus, the way concurrent app launches read a system image.
+ * Needs root to drop the page cache.
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+static const char	*dir;
+static const char	*block_str	= "128KB";
+static int		nr_threads;
+static bool		no_drop;
+
+static const struct option options[] = {
+	OPT_STRING('d', "dir", &dir, "dir",
+		    "Specify the directory tree to read (required)"),
+	OPT_STRING('b', "block", &block_str, "128KB",
+		    "Specify size of each read"),
+	OPT_INTEGER('t', "threads", &nr_threads,
+		    "Specify number of reader threads (default: online cpus)"),
+	OPT_BOOLEAN('n', "no-drop", &no_drop,
+		    "Do not drop the page cache before each pass"),
+	OPT_END()
+};
+
+static const char * const bench_fs_read_usage[] = {
+	"perf bench fs read <options>",
+	NULL
+};
+
+static char		**files;
+static int		nr_files, max_files;
+static u64		total_bytes;
+static size_t		block;
+static int		next_file;
+
+static int add_file(const char *path, const struct stat *st,
+		    int type, struct FTW *ftw __used)
+{
+	if (type != FTW_F || !S_ISREG(st->st_mode) || !st->st_size)
+		return 0;
+
+	if (nr_files == max_files) {
+		max_files = max_files ? max_files * 2 : 1024;
+		files = realloc(files, max_files * sizeof(*files));
+		if (!files)
+			die("not enough memory\n");
+	}
+	files[nr_files] = strdup(path);
+	if (!files[nr_files])
+		die("not enough memory\n");
+	nr_files++;
+	total_bytes += st->st_size;
+	return 0;
+}
+
+static void *reader_thread(void *arg __used)
+{
+	char *buf = malloc(block);
+	int i, fd;
+
+	if (!buf)
+		die("not enough memory\n");
+
+	while ((i = __sync_fetch_and_add(&next_file, 1)) < nr_files) {
+		fd = open(files[i], O_RDONLY);
+		if (fd < 0)
+			die("cannot open %s: %s\n", files[i], strerror(errno));
+		for (;;) {
+			ssize_t ret = read(fd, buf, block);
+
+			if (ret < 0)
+				die("cannot read %s: %s\n", files[i],
+				    strerror(errno));
+			if (!ret)
+				break;
+		}
+		close(fd);
+	}
+
+	free(buf);
+	return NULL;
+}
+
+/* Read every file with nr readers, return MB/sec */
+static double read_pass(int nr)
+{
+	struct timeval start, stop, diff;
+	pthread_t *threads;
+	double secs;
+	int i;
+
+	threads = malloc(nr * sizeof(*threads));
+	if (!threads)
+		die("not enough memory\n");
+
+	if (!no_drop)
+		bench_drop_caches();
+	next_file = 0;
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nr; i++)
+		if (pthread_create(&threads[i], NULL, reader_thread, NULL))
+			die("cannot create reader thread\n");
+	for (i = 0; i < nr; i++)
+		pthread_join(threads[i], NULL);
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+	free(threads);
+
+	secs = diff.tv_sec + diff.tv_usec / 1000000.0;
+	return (double)total_bytes / (1024 * 1024) / secs;
+}
+
+int bench_fs_read(int argc, const char **argv,
+		  const char *prefix __used)
+{
+	double single, parallel;
+	int i;
+
+	argc = parse_options(argc, argv, options,
+			     bench_fs_read_usage, 0);
+
+	if (!dir) {
+		usage_with_options(bench_fs_read_usage, options);
+		return 1;
+	}
+
+	block = (size_t)perf_atoll((char *)block_str);
+	if ((s64)block <= 0) {
+		fprintf(stderr, "Invalid block size:%s\n", block_str);
+		return 1;
+	}
+	if (!nr_threads)
+		nr_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nr_threads <= 0) {
+		fprintf(stderr, "Invalid number of threads\n");
+		return 1;
+	}
+
+	if (nftw(dir, add_file, 64, FTW_PHYS))
+		die("cannot walk %s: %s\n", dir, strerror(errno));
+	if (!nr_files)
+		die("no regular files under %s\n", dir);
+
+	single = read_pass(1);
+	parallel = read_pass(nr_threads);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# Reading %d files, %.1lf MB under %s in %s blocks\n\n",
+		       nr_files, (double)total_bytes / (1024 * 1024), dir,
+		       block_str);
+		printf(" %14lf MB/Sec (1 thread)\n", single);
+		printf(" %14lf MB/Sec (%d threads)\n", parallel, nr_threads);
+		printf(" %14lf x speedup\n", parallel / single);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lf\n", parallel);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	for (i = 0; i < nr_files; i++)
+		free(files[i]);
+	free(files);
+	return 0;
+}
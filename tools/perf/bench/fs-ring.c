@@ -0,0 +1,281 @@
+/*
+ * fs-ring.c
+ *
+ * ring: Syscalls per I/O of pread, io_submit and the submission ring
+ *
+ * Blocks of a file are read in batches three ways: one pread() per block,
+ * one io_submit() and one io_getevents() per batch, and through the
+ * submission ring of io_ring_setup() with one io_ring_enter() per batch,
+ * reaping the completions straight from the mapped completion ring.  The
+ * file is read once beforehand so that the page cache is warm and the
+ * cost of getting in and out of the kernel is what gets measured.
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+#include "../../../include/linux/aio_abi.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+
+static const char	*file;
+static const char	*block_str	= "4KB";
+static int		nr_ios		= 100000;
+static int		batch		= 32;
+
+static const struct option options[] = {
+	OPT_STRING('f', "file", &file, "file",
+		    "Specify the file to read (required)"),
+	OPT_STRING('b', "block", &block_str, "4KB",
+		    "Specify size of each read"),
+	OPT_INTEGER('n', "ios", &nr_ios,
+		    "Specify number of reads per pass"),
+	OPT_INTEGER('B', "batch", &batch,
+		    "Specify number of reads submitted per syscall"),
+	OPT_END()
+};
+
+static const char * const bench_fs_ring_usage[] = {
+	"perf bench fs ring <options>",
+	NULL
+};
+
+/* Layout of the completion ring at the context id, struct aio_ring */
+struct cq_ring {
+	unsigned	id;
+	unsigned	nr;
+	unsigned	head;
+	unsigned	tail;
+	unsigned	magic;
+	unsigned	compat_features;
+	unsigned	incompat_features;
+	unsigned	header_length;
+	struct io_event	events[0];
+};
+
+struct result {
+	double		usecs;		/* per read */
+	double		syscalls;	/* per read */
+};
+
+static size_t		block;
+static u64		nr_blocks;
+static char		*bufs;
+static int		fd;
+
+/* Offset of the i-th read, walking the file over and over */
+static u64 offset_of(int i)
+{
+	return (i % nr_blocks) * block;
+}
+
+static void pread_pass(struct result *res)
+{
+	struct timeval start;
+	int i;
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nr_ios; i++)
+		if (pread(fd, bufs, block, offset_of(i)) < 0)
+			die("pread: %s\n", strerror(errno));
+
+	res->usecs = bench_elapsed(&start) * 1000000.0 / nr_ios;
+	res->syscalls = 1;
+}
+
+static void prep_iocb(struct iocb *iocb, int slot, int i)
+{
+	memset(iocb, 0, sizeof(*iocb));
+	iocb->aio_lio_opcode = IOCB_CMD_PREAD;
+	iocb->aio_fildes = fd;
+	iocb->aio_buf = (unsigned long)(bufs + slot * block);
+	iocb->aio_nbytes = block;
+	iocb->aio_offset = offset_of(i);
+	iocb->aio_data = i;
+}
+
+static void check_event(struct io_event *ev)
+{
+	if ((s64)ev->res < 0)
+		die("aio read: %s\n", strerror(-(s64)ev->res));
+}
+
+static void aio_pass(struct result *res)
+{
+	struct timeval start;
+	struct iocb *iocbs, **iocbpp;
+	struct io_event *events;
+	aio_context_t ctx = 0;
+	unsigned long syscalls = 0;
+	int i, j, k, n, done;
+
+	iocbs = calloc(batch, sizeof(*iocbs));
+	iocbpp = calloc(batch, sizeof(*iocbpp));
+	events = calloc(batch, sizeof(*events));
+	if (!iocbs || !iocbpp || !events)
+		die("not enough memory\n");
+	if (syscall(__NR_io_setup, batch, &ctx))
+		die("io_setup: %s\n", strerror(errno));
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nr_ios; i += n) {
+		n = min(batch, nr_ios - i);
+		for (j = 0; j < n; j++) {
+			prep_iocb(&iocbs[j], j, i + j);
+			iocbpp[j] = &iocbs[j];
+		}
+		if (syscall(__NR_io_submit, ctx, n, iocbpp) != n)
+			die("io_submit: %s\n", strerror(errno));
+		syscalls++;
+
+		for (done = 0; done < n; done += j) {
+			j = syscall(__NR_io_getevents, ctx, n - done, n,
+				    events, NULL);
+			if (j < 0)
+				die("io_getevents: %s\n", strerror(errno));
+			syscalls++;
+			for (k = 0; k < j; k++)
+				check_event(&events[k]);
+		}
+	}
+	res->usecs = bench_elapsed(&start) * 1000000.0 / nr_ios;
+	res->syscalls = (double)syscalls / nr_ios;
+
+	syscall(__NR_io_destroy, ctx);
+	free(events);
+	free(iocbpp);
+	free(iocbs);
+}
+
+static void ring_pass(struct result *res)
+{
+	struct timeval start;
+	struct io_ring_params p;
+	struct aio_sq_ring *sq;
+	struct cq_ring *cq;
+	unsigned long syscalls = 0;
+	unsigned head;
+	int i, j, n, ret, done;
+
+	memset(&p, 0, sizeof(p));
+	if (syscall(__NR_io_ring_setup, batch, &p))
+		die("io_ring_setup: %s\n", strerror(errno));
+	sq = (struct aio_sq_ring *)(unsigned long)p.sq_ring;
+	cq = (struct cq_ring *)(unsigned long)p.ctx;
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nr_ios; i += n) {
+		n = min(batch, nr_ios - i);
+		for (j = 0; j < n; j++)
+			prep_iocb(&sq->iocbs[(sq->tail + j) % sq->nr], j,
+				  i + j);
+		/* Publish the iocbs before the tail that covers them */
+		__sync_synchronize();
+		sq->tail += n;
+
+		ret = syscall(__NR_io_ring_enter, p.ctx, n, n, 0);
+		if (ret != n)
+			die("io_ring_enter: %s\n",
+			    ret < 0 ? strerror(errno) : "short submit");
+		syscalls++;
+
+		/* Reap the completions without a syscall */
+		for (done = 0; done < n; done++) {
+			head = cq->head;
+			if (head == cq->tail)
+				die("completion ring short of events\n");
+			__sync_synchronize();
+			check_event(&cq->events[head]);
+			cq->head = (head + 1) % cq->nr;
+		}
+	}
+	res->usecs = bench_elapsed(&start) * 1000000.0 / nr_ios;
+	res->syscalls = (double)syscalls / nr_ios;
+
+	syscall(__NR_io_destroy, p.ctx);
+}
+
+int bench_fs_ring(int argc, const char **argv,
+		  const char *prefix __used)
+{
+	struct result preads, aio, ring;
+	struct stat st;
+	int i;
+
+	argc = parse_options(argc, argv, options,
+			     bench_fs_ring_usage, 0);
+
+	if (!file) {
+		usage_with_options(bench_fs_ring_usage, options);
+		return 1;
+	}
+
+	block = (size_t)perf_atoll((char *)block_str);
+	if ((s64)block <= 0) {
+		fprintf(stderr, "Invalid block size:%s\n", block_str);
+		return 1;
+	}
+	if (nr_ios <= 0 || batch <= 0) {
+		fprintf(stderr, "Invalid number of reads\n");
+		return 1;
+	}
+
+	fd = open(file, O_RDONLY);
+	if (fd < 0)
+		die("cannot open %s: %s\n", file, strerror(errno));
+	if (fstat(fd, &st))
+		die("cannot stat %s: %s\n", file, strerror(errno));
+	nr_blocks = st.st_size / block;
+	if (!nr_blocks)
+		die("%s is smaller than one block\n", file);
+
+	bufs = malloc(batch * block);
+	if (!bufs)
+		die("not enough memory\n");
+
+	/* Warm the page cache */
+	for (i = 0; (u64)i < nr_blocks && i < nr_ios; i++)
+		if (pread(fd, bufs, block, offset_of(i)) < 0)
+			die("pread: %s\n", strerror(errno));
+
+	pread_pass(&preads);
+	aio_pass(&aio);
+	ring_pass(&ring);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d reads of %s from %s, %d per batch\n\n",
+		       nr_ios, block_str, file, batch);
+		printf(" %14lf usecs/read, %lf syscalls/read (pread)\n",
+		       preads.usecs, preads.syscalls);
+		printf(" %14lf usecs/read, %lf syscalls/read (io_submit)\n",
+		       aio.usecs, aio.syscalls);
+		printf(" %14lf usecs/read, %lf syscalls/read (ring)\n",
+		       ring.usecs, ring.syscalls);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lf\n", ring.usecs);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	free(bufs);
+	close(fd);
+	return 0;
+}
@@ -0,0 +1,281 @@
+/*
+ * mem-fault.c
+ *
+ * fault: Page faults from many threads racing against mmap()/munmap()
+ *
+ * A number of threads repeatedly fault in (and zap again) their own
+ * private region of a shared address space, while one more thread
+ * keeps changing the address space layout with mmap(), mprotect()
+ * and munmap().  Every layout change takes mmap_sem for write, so
+ * the fault rate reported here is a measure of how long faulting
+ * threads are kept waiting on mmap_sem.
+ *
+ * With -e the threads all fault on the same file, which yet another
+ * thread keeps dropping from the page cache.  The faults then have to
+ * read the pages back in and wait on each other's page locks, which is
+ * where a fault gives up mmap_sem and is retried.
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/types.h>
+
+static int		nr_threads	= 4;
+static const char	*length_str	= "4MB";
+static int		runtime		= 5;
+static bool		use_file;
+static bool		no_mapper;
+static bool		evict;
+static const char	*dir		= "/var/tmp";
+
+static const struct option options[] = {
+	OPT_INTEGER('t', "threads", &nr_threads,
+		    "Specify number of faulting threads"),
+	OPT_STRING('l', "length", &length_str, "4MB",
+		    "Specify length of memory faulted by each thread. "
+		    "available unit: B, MB, GB (upper and lower)"),
+	OPT_INTEGER('r', "runtime", &runtime,
+		    "Specify runtime in seconds"),
+	OPT_BOOLEAN('f', "file", &use_file,
+		    "Fault on a private file mapping instead of anonymous memory"),
+	OPT_BOOLEAN('n', "no-mapper", &no_mapper,
+		    "Do not run the concurrent mmap()/munmap() thread"),
+	OPT_BOOLEAN('e', "evict", &evict,
+		    "Keep dropping the file from the page cache (implies -f)"),
+	OPT_STRING('d', "dir", &dir, "dir",
+		    "Specify the directory of the file for -f"),
+	OPT_END()
+};
+
+static const char * const bench_mem_fault_usage[] = {
+	"perf bench mem fault <options>",
+	NULL
+};
+
+struct fault_worker {
+	pthread_t	thread;
+	char		*region;
+	unsigned long	nr_faults;
+};
+
+static volatile int	done;
+static size_t		length;
+static long		page_size;
+static int		file_fd = -1;
+
+static void *fault_thread(void *arg)
+{
+	struct fault_worker *w = arg;
+	volatile char *p;
+	char c = 0;
+
+	while (!done) {
+		for (p = w->region; p < w->region + length; p += page_size) {
+			if (use_file)
+				c += *p;
+			else
+				*p = c;
+		}
+		w->nr_faults += length / page_size;
+
+		if (madvise(w->region, length, MADV_DONTNEED))
+			die("madvise failed: %s\n", strerror(errno));
+	}
+
+	return NULL;
+}
+
+static void *mapper_thread(void *arg)
+{
+	unsigned long *nr_ops = arg;
+	void *p;
+
+	while (!done) {
+		p = mmap(NULL, page_size, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED)
+			die("mmap failed: %s\n", strerror(errno));
+		if (mprotect(p, page_size, PROT_READ))
+			die("mprotect failed: %s\n", strerror(errno));
+		if (munmap(p, page_size))
+			die("munmap failed: %s\n", strerror(errno));
+		(*nr_ops)++;
+	}
+
+	return NULL;
+}
+
+static void *evict_thread(void *arg)
+{
+	unsigned long *nr_ops = arg;
+	int ret;
+
+	while (!done) {
+		ret = posix_fadvise(file_fd, 0, length, POSIX_FADV_DONTNEED);
+		if (ret)
+			die("posix_fadvise failed: %s\n", strerror(ret));
+		(*nr_ops)++;
+	}
+
+	return NULL;
+}
+
+static char *map_region(void)
+{
+	void *p;
+
+	if (use_file)
+		p = mmap(NULL, length, PROT_READ, MAP_PRIVATE, file_fd, 0);
+	else
+		p = mmap(NULL, length, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+		die("mmap failed: %s\n", strerror(errno));
+
+	return p;
+}
+
+static void open_backing_file(void)
+{
+	char path[PATH_MAX];
+	char *buf;
+	size_t done_len;
+
+	snprintf(path, sizeof(path), "%s/perf-bench-fault-XXXXXX", dir);
+	file_fd = mkstemp(path);
+	if (file_fd < 0)
+		die("mkstemp failed: %s\n", strerror(errno));
+	unlink(path);
+
+	/* Populate the file so that the faults are page cache hits */
+	buf = zalloc(page_size);
+	if (!buf)
+		die("memory allocation failed\n");
+	for (done_len = 0; done_len < length; done_len += page_size)
+		if (write(file_fd, buf, page_size) != page_size)
+			die("write failed: %s\n", strerror(errno));
+	free(buf);
+
+	/* Dirty pages could not be dropped */
+	if (fsync(file_fd))
+		die("fsync failed: %s\n", strerror(errno));
+}
+
+int bench_mem_fault(int argc, const char **argv,
+		    const char *prefix __used)
+{
+	struct fault_worker *workers;
+	pthread_t mapper, evictor;
+	unsigned long nr_faults = 0, nr_map_ops = 0, nr_evict_ops = 0;
+	struct timeval start, stop, diff;
+	double secs;
+	int i;
+
+	argc = parse_options(argc, argv, options,
+			     bench_mem_fault_usage, 0);
+
+	page_size = sysconf(_SC_PAGESIZE);
+	length = (size_t)perf_atoll((char *)length_str);
+	if ((s64)length < page_size) {
+		fprintf(stderr, "Invalid length:%s\n", length_str);
+		return 1;
+	}
+	length &= ~(page_size - 1);
+
+	if (nr_threads <= 0 || runtime <= 0) {
+		fprintf(stderr, "Invalid number of threads or runtime\n");
+		return 1;
+	}
+
+	if (evict)
+		use_file = true;
+	if (use_file)
+		open_backing_file();
+
+	workers = zalloc(nr_threads * sizeof(*workers));
+	if (!workers)
+		die("memory allocation failed\n");
+
+	for (i = 0; i < nr_threads; i++)
+		workers[i].region = map_region();
+
+	gettimeofday(&start, NULL);
+
+	for (i = 0; i < nr_threads; i++)
+		if (pthread_create(&workers[i].thread, NULL,
+				   fault_thread, &workers[i]))
+			die("pthread_create failed\n");
+	if (!no_mapper && pthread_create(&mapper, NULL,
+					 mapper_thread, &nr_map_ops))
+		die("pthread_create failed\n");
+	if (evict && pthread_create(&evictor, NULL,
+				    evict_thread, &nr_evict_ops))
+		die("pthread_create failed\n");
+
+	sleep(runtime);
+	done = 1;
+
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		nr_faults += workers[i].nr_faults;
+		munmap(workers[i].region, length);
+	}
+	if (!no_mapper)
+		pthread_join(mapper, NULL);
+	if (evict)
+		pthread_join(evictor, NULL);
+
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+	secs = (double)diff.tv_sec + (double)diff.tv_usec / 1000000.0;
+
+	free(workers);
+	if (file_fd >= 0)
+		close(file_fd);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d threads faulting on %s %s memory%s%s\n\n",
+		       nr_threads, length_str, use_file ? "file" : "anonymous",
+		       no_mapper ? "" : ", one thread doing mmap/munmap",
+		       evict ? ", one thread dropping it from the page cache" :
+		       "");
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec, (unsigned long)(diff.tv_usec / 1000));
+		printf(" %14lf faults/sec\n", (double)nr_faults / secs);
+		printf(" %14lf faults/sec/thread\n",
+		       (double)nr_faults / secs / nr_threads);
+		if (!no_mapper)
+			printf(" %14lf mmap+munmap ops/sec\n",
+			       (double)nr_map_ops / secs);
+		if (evict)
+			printf(" %14lf page cache drops/sec\n",
+			       (double)nr_evict_ops / secs);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lf\n", (double)nr_faults / secs);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
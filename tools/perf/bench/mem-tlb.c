@@ -0,0 +1,175 @@
+/*
+ * mem-tlb.c
+ *
+ * tlb: Random access over a large anonymous buffer
+ *
+ * Every access lands on a different page in an order the prefetchers
+ * cannot follow, so with a buffer much larger than the TLB reach the
+ * cost per access is dominated by TLB misses and page table walks.
+ * Running it with --huge and --no-huge shows what transparent huge
+ * pages buy for heaps of that size.
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+
+#ifndef MADV_HUGEPAGE
+#define MADV_HUGEPAGE	14
+#endif
+#ifndef MADV_NOHUGEPAGE
+#define MADV_NOHUGEPAGE	15
+#endif
+
+static const char	*length_str	= "64MB";
+static int		loops		= 10000000;
+static bool		use_huge;
+static bool		no_huge;
+
+static const struct option options[] = {
+	OPT_STRING('l', "length", &length_str, "64MB",
+		    "Specify length of the buffer. "
+		    "available unit: B, MB, GB (upper and lower)"),
+	OPT_INTEGER('n', "loop", &loops,
+		    "Specify number of accesses"),
+	OPT_BOOLEAN('H', "huge", &use_huge,
+		    "Ask for transparent huge pages with MADV_HUGEPAGE"),
+	OPT_BOOLEAN('N', "no-huge", &no_huge,
+		    "Forbid transparent huge pages with MADV_NOHUGEPAGE"),
+	OPT_END()
+};
+
+static const char * const bench_mem_tlb_usage[] = {
+	"perf bench mem tlb <options>",
+	NULL
+};
+
+/*
+ * Size of a huge page, which the buffer is aligned to so that the kernel
+ * can back it with huge pmds.  Falls back to 2MB, the x86 pmd size, if
+ * /proc/meminfo doesn't tell.
+ */
+static unsigned long huge_page_size(void)
+{
+	unsigned long kb = 0;
+	char line[128];
+	FILE *fp;
+
+	fp = fopen("/proc/meminfo", "r");
+	if (fp) {
+		while (fgets(line, sizeof(line), fp))
+			if (sscanf(line, "Hugepagesize: %lu kB", &kb) == 1)
+				break;
+		fclose(fp);
+	}
+
+	return kb ? kb << 10 : 2UL << 20;
+}
+
+static char *alloc_buffer(void **map, size_t *map_len, size_t length)
+{
+	unsigned long addr, huge_align = huge_page_size();
+	char *p;
+
+	/* Over-allocate so that the buffer can be huge page aligned */
+	*map_len = length + huge_align;
+	p = mmap(NULL, *map_len, PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+		die("mmap failed: %s\n", strerror(errno));
+	*map = p;
+
+	addr = ((unsigned long)p + huge_align - 1) & ~(huge_align - 1);
+
+	if (use_huge && madvise((void *)addr, length, MADV_HUGEPAGE))
+		fprintf(stderr, "MADV_HUGEPAGE failed: %s\n", strerror(errno));
+	if (no_huge && madvise((void *)addr, length, MADV_NOHUGEPAGE))
+		fprintf(stderr, "MADV_NOHUGEPAGE failed: %s\n", strerror(errno));
+
+	return (char *)addr;
+}
+
+int bench_mem_tlb(int argc, const char **argv,
+		  const char *prefix __used)
+{
+	struct timeval start, stop, diff;
+	unsigned long nr_pages, idx, seed = 1;
+	unsigned long long result_usec;
+	volatile char *buf;
+	size_t length, map_len;
+	void *map;
+	long page_size;
+	volatile char __used sink;
+	int i;
+
+	argc = parse_options(argc, argv, options,
+			     bench_mem_tlb_usage, 0);
+
+	if (use_huge && no_huge) {
+		fprintf(stderr, "--huge and --no-huge are exclusive\n");
+		return 1;
+	}
+
+	page_size = sysconf(_SC_PAGESIZE);
+	length = (size_t)perf_atoll((char *)length_str);
+	if ((s64)length < page_size || loops <= 0) {
+		fprintf(stderr, "Invalid length:%s or loop count\n",
+			length_str);
+		return 1;
+	}
+	nr_pages = length / page_size;
+
+	buf = alloc_buffer(&map, &map_len, length);
+
+	/* Fault everything in first, only the steady state is measured */
+	memset((char *)buf, 1, length);
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < loops; i++) {
+		/* simple LCG: cheap, and defeats the hardware prefetchers */
+		seed = seed * 1103515245 + 12345;
+		idx = (seed >> 8) % nr_pages;
+		sink = buf[idx * page_size + (seed & (page_size - 1))];
+	}
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+
+	munmap(map, map_len);
+
+	result_usec = diff.tv_sec * 1000000ULL + diff.tv_usec;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d random accesses over %s of anonymous memory%s\n\n",
+		       loops, length_str,
+		       use_huge ? " (MADV_HUGEPAGE)" :
+		       no_huge ? " (MADV_NOHUGEPAGE)" : "");
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec, (unsigned long)(diff.tv_usec / 1000));
+		printf(" %14lf nsecs/access\n",
+		       (double)result_usec * 1000.0 / (double)loops);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lf\n", (double)result_usec * 1000.0 / (double)loops);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
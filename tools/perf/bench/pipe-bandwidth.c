@@ -0,0 +1,282 @@
+/*
+ * pipe-bandwidth.c
+ *
+ * bandwidth: Throughput of a pipe between two processes
+ *
+ * A child produces the data, filling a buffer chunk by chunk, and pushes
+ * it through a pipe to its parent.  With write() and read() every byte is
+ * copied twice.  With a file to splice to (-f), the data also goes through
+ * vmsplice() and splice(), first copying into the file's page cache and
+ * then gifting the pages with SPLICE_F_GIFT | SPLICE_F_MOVE so that they
+ * are moved there instead.  The size the pipe grew to and the splice
+ * counters of /proc/vmstat are reported along with the bandwidth.
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+
+#ifndef F_GETPIPE_SZ
+#define F_GETPIPE_SZ	1032
+#endif
+
+static const char	*size_str	= "64KB";
+static const char	*total_str	= "256MB";
+static const char	*file;
+
+static const struct option options[] = {
+	OPT_STRING('s', "size", &size_str, "64KB",
+		    "Specify size of each write or vmsplice"),
+	OPT_STRING('t', "total", &total_str, "256MB",
+		    "Specify amount of data per pass"),
+	OPT_STRING('f', "file", &file, "file",
+		    "Specify a scratch file to splice to, enables the splice passes"),
+	OPT_END()
+};
+
+static const char * const bench_pipe_bandwidth_usage[] = {
+	"perf bench pipe bandwidth <options>",
+	NULL
+};
+
+enum mode {
+	MODE_WRITE,		/* write() to read() */
+	MODE_VMSPLICE,		/* vmsplice() to splice() to file */
+	MODE_GIFT,		/* the same with the pages gifted and moved */
+};
+
+static const char * const mode_names[] = {
+	"write/read",
+	"vmsplice/splice",
+	"vmsplice gift/splice move",
+};
+
+struct result {
+	double		mbps;
+	int		pipe_size;	/* bytes at the end of the pass */
+	u64		grow, gift, move, copy;	/* /proc/vmstat deltas */
+};
+
+static size_t		chunk;
+static u64		total;
+static int		out_fd = -1;
+
+/* Counter name of /proc/vmstat, 0 if it isn't there */
+static u64 vmstat(const char *name)
+{
+	char key[64];
+	unsigned long long val;
+	u64 ret = 0;
+	FILE *f;
+
+	f = fopen("/proc/vmstat", "r");
+	if (!f)
+		return 0;
+	while (fscanf(f, "%63s %llu", key, &val) == 2)
+		if (!strcmp(key, name)) {
+			ret = val;
+			break;
+		}
+	fclose(f);
+	return ret;
+}
+
+static void producer(int fd, enum mode mode)
+{
+	unsigned int flags = 0;
+	struct iovec iov;
+	size_t left;
+	u64 done;
+	ssize_t n;
+	char *buf;
+
+	/* Page aligned and mapped only here, so that it can be gifted */
+	buf = mmap(NULL, chunk, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (buf == MAP_FAILED)
+		die("mmap: %s\n", strerror(errno));
+
+	if (mode == MODE_GIFT)
+		flags = SPLICE_F_GIFT | SPLICE_F_MOVE;
+
+	for (done = 0; done < total; done += chunk) {
+		/* Produce the data, faulting the gifted pages back in */
+		memset(buf, (int)(done / chunk), chunk);
+
+		for (left = chunk; left; left -= n) {
+			iov.iov_base = buf + chunk - left;
+			iov.iov_len = left;
+			if (mode == MODE_WRITE)
+				n = write(fd, iov.iov_base, iov.iov_len);
+			else
+				n = vmsplice(fd, &iov, 1, flags);
+			if (n < 0)
+				die("%s: %s\n", mode == MODE_WRITE ?
+				    "write" : "vmsplice", strerror(errno));
+		}
+	}
+	exit(0);
+}
+
+static u64 consumer(int fd, enum mode mode)
+{
+	unsigned int flags = 0;
+	u64 done = 0;
+	ssize_t n;
+	char *buf;
+
+	if (mode == MODE_WRITE) {
+		buf = malloc(chunk);
+		if (!buf)
+			die("not enough memory\n");
+		while ((n = read(fd, buf, chunk)) > 0)
+			done += n;
+		free(buf);
+	} else {
+		if (mode == MODE_GIFT)
+			flags = SPLICE_F_MOVE;
+		while ((n = splice(fd, NULL, out_fd, NULL, chunk, flags)) > 0)
+			done += n;
+	}
+	if (n < 0)
+		die("%s: %s\n", mode == MODE_WRITE ? "read" : "splice",
+		    strerror(errno));
+
+	return done;
+}
+
+static void run(enum mode mode, struct result *res)
+{
+	struct timeval start, stop, diff;
+	u64 grow, gift, move, copy, done;
+	int pipefd[2], status;
+	pid_t pid;
+
+	if (out_fd >= 0 && (ftruncate(out_fd, 0) ||
+			    lseek(out_fd, 0, SEEK_SET)))
+		die("cannot truncate %s: %s\n", file, strerror(errno));
+	if (pipe(pipefd))
+		die("pipe: %s\n", strerror(errno));
+
+	grow = vmstat("pipe_grow");
+	gift = vmstat("splice_gift");
+	move = vmstat("splice_move");
+	copy = vmstat("splice_copy");
+
+	gettimeofday(&start, NULL);
+	pid = fork();
+	if (pid < 0)
+		die("fork: %s\n", strerror(errno));
+	if (!pid) {
+		close(pipefd[0]);
+		producer(pipefd[1], mode);
+	}
+	close(pipefd[1]);
+
+	done = consumer(pipefd[0], mode);
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+
+	res->pipe_size = fcntl(pipefd[0], F_GETPIPE_SZ);
+	close(pipefd[0]);
+	if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+	    WEXITSTATUS(status))
+		die("producer failed\n");
+	if (done != total)
+		die("short transfer: %llu of %llu bytes\n",
+		    (unsigned long long)done, (unsigned long long)total);
+
+	res->mbps = total / (diff.tv_sec + diff.tv_usec / 1000000.0) /
+		    (1024 * 1024);
+	res->grow = vmstat("pipe_grow") - grow;
+	res->gift = vmstat("splice_gift") - gift;
+	res->move = vmstat("splice_move") - move;
+	res->copy = vmstat("splice_copy") - copy;
+}
+
+static void print_result(enum mode mode, struct result *res)
+{
+	printf(" %14lf MB/sec (%s)\n", res->mbps, mode_names[mode]);
+	printf("   pipe grew %llu times to %d bytes",
+	       (unsigned long long)res->grow, res->pipe_size);
+	if (mode != MODE_WRITE)
+		printf(", pages gifted %llu, moved %llu, copied %llu",
+		       (unsigned long long)res->gift,
+		       (unsigned long long)res->move,
+		       (unsigned long long)res->copy);
+	printf("\n");
+}
+
+int bench_pipe_bandwidth(int argc, const char **argv,
+			 const char *prefix __used)
+{
+	struct result results[MODE_GIFT + 1];
+	int nr_modes = 1, i;
+
+	argc = parse_options(argc, argv, options,
+			     bench_pipe_bandwidth_usage, 0);
+
+	chunk = (size_t)perf_atoll((char *)size_str);
+	if ((s64)chunk <= 0 || chunk % getpagesize()) {
+		fprintf(stderr,
+			"Invalid size:%s, must be a multiple of the page size\n",
+			size_str);
+		return 1;
+	}
+	total = perf_atoll((char *)total_str);
+	if ((s64)total <= 0 || total % chunk) {
+		fprintf(stderr, "Invalid total:%s, must be a multiple of the size\n",
+			total_str);
+		return 1;
+	}
+
+	if (file) {
+		out_fd = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (out_fd < 0)
+			die("cannot open %s: %s\n", file, strerror(errno));
+		nr_modes = MODE_GIFT + 1;
+	}
+
+	for (i = 0; i < nr_modes; i++)
+		run(i, &results[i]);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %s through a pipe in chunks of %s%s%s\n\n",
+		       total_str, size_str, file ? ", spliced to " : "",
+		       file ? file : "");
+		for (i = 0; i < nr_modes; i++)
+			print_result(i, &results[i]);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lf\n", results[nr_modes - 1].mbps);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	if (out_fd >= 0) {
+		if (ftruncate(out_fd, 0))
+			die("cannot truncate %s: %s\n", file, strerror(errno));
+		close(out_fd);
+	}
+	return 0;
+}
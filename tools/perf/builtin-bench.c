@@ -13,6 +13,8 @@
  * Available subsystem list:
  *  sched ... scheduler and IPC mechanism
  *  mem   ... memory access performance
+ *  fs    ... file system and page cache performance
+ *  epoll ... epoll wakeup scalability
  *
  */
 
@@ -52,6 +54,63 @@ static struct bench_suite mem_suites[] = {
 	{ "memcpy",
 	  "Simple memory copy in various ways",
 	  bench_mem_memcpy },
+	{ "fault",
+	  "Page faults from many threads racing against mmap/munmap",
+	  bench_mem_fault },
+	{ "tlb",
+	  "Random access over a large buffer, with or without huge pages",
+	  bench_mem_tlb },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL             }
+};
+
+static struct bench_suite fs_suites[] = {
+	{ "launch",
+	  "Cold start time of a command, with or without prefetch replay",
+	  bench_fs_launch },
+	{ "fuse",
+	  "Sequential read throughput through FUSE, against the raw device",
+	  bench_fs_fuse },
+	{ "fsync",
+	  "Latency of small writes each followed by fsync",
+	  bench_fs_fsync },
+	{ "read",
+	  "Parallel cold read throughput of a directory tree",
+	  bench_fs_read },
+	{ "mount",
+	  "Mount time of a yaffs2 partition, from checkpoint, scan and replay",
+	  bench_fs_mount },
+	{ "aio",
+	  "Random buffered read IOPS, pread versus AIO",
+	  bench_fs_aio },
+	{ "ring",
+	  "Syscalls per read of pread, io_submit and the submission ring",
+	  bench_fs_ring },
+	{ "locks",
+	  "Throughput of fcntl and flock locks taken by many processes",
+	  bench_fs_locks },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL             }
+};
+
+static struct bench_suite epoll_suites[] = {
+	{ "wait",
+	  "Wakeup fan-out of epoll sets sharing a descriptor, with and without EPOLLEXCLUSIVE",
+	  bench_epoll_wait },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL             }
+};
+
+static struct bench_suite pipe_suites[] = {
+	{ "bandwidth",
+	  "Pipe throughput with write/read, vmsplice/splice and page gifting",
+	  bench_pipe_bandwidth },
 	suite_all,
 	{ NULL,
 	  NULL,
@@ -71,6 +130,15 @@ static struct bench_subsys subsystems[] = {
 	{ "mem",
 	  "memory access performance",
 	  mem_suites },
+	{ "fs",
+	  "file system and page cache performance",
+	  fs_suites },
+	{ "epoll",
+	  "epoll wakeup scalability",
+	  epoll_suites },
+	{ "pipe",
+	  "pipe and splice throughput",
+	  pipe_suites },
 	{ "all",		/* sentinel: easy for help */
 	  "test all subsystem (pseudo subsystem)",
 	  NULL },
@@ -39,6 +39,8 @@ struct slabinfo {
 	unsigned long cpuslab_flush, deactivate_full, deactivate_empty;
 	unsigned long deactivate_to_head, deactivate_to_tail;
 	unsigned long deactivate_remote_frees, order_fallback;
+	unsigned long cpu_partial_alloc, cpu_partial_free, cpu_partial_drain;
+	int cpu_partial, objects_cpu_partial;
 	int numa[MAX_NODES];
 	int numa_partial[MAX_NODES];
 } slabinfo[MAX_SLABS];
@@ -451,6 +453,10 @@ static void slab_stats(struct slabinfo *s)
 		s->alloc_from_partial, s->free_remove_partial,
 		s->alloc_from_partial * 100 / total_alloc,
 		s->free_remove_partial * 100 / total_free);
+	printf("Cpu partial list     %8lu %8lu %3lu %3lu\n",
+		s->cpu_partial_alloc, s->cpu_partial_free,
+		s->cpu_partial_alloc * 100 / total_alloc,
+		s->cpu_partial_free * 100 / total_free);
 
 	printf("RemoteObj/SlabFrozen %8lu %8lu %3lu %3lu\n",
 		s->deactivate_remote_frees, s->free_frozen,
@@ -465,6 +471,16 @@ static void slab_stats(struct slabinfo *s)
 	if (s->alloc_refill)
 		printf("Refill %8lu\n", s->alloc_refill);
 
+	if (s->cpu_partial_alloc + s->alloc_from_partial)
+		printf("Cpu partial hits %8lu/%lu %3lu%% (limit %d objects, "
+			"%d now held, %lu drains)\n",
+			s->cpu_partial_alloc,
+			s->cpu_partial_alloc + s->alloc_from_partial,
+			s->cpu_partial_alloc * 100 /
+				(s->cpu_partial_alloc + s->alloc_from_partial),
+			s->cpu_partial, s->objects_cpu_partial,
+			s->cpu_partial_drain);
+
 	total = s->deactivate_full + s->deactivate_empty +
 			s->deactivate_to_head + s->deactivate_to_tail;
 
@@ -1190,6 +1206,11 @@ static void read_slab_dir(void)
 			slab->deactivate_to_tail = get_obj("deactivate_to_tail");
 			slab->deactivate_remote_frees = get_obj("deactivate_remote_frees");
 			slab->order_fallback = get_obj("order_fallback");
+			slab->cpu_partial = get_obj("cpu_partial");
+			slab->objects_cpu_partial = get_obj("slabs_cpu_partial");
+			slab->cpu_partial_alloc = get_obj("cpu_partial_alloc");
+			slab->cpu_partial_free = get_obj("cpu_partial_free");
+			slab->cpu_partial_drain = get_obj("cpu_partial_drain");
 			chdir("..");
 			if (slab->name[0] == ':')
 				alias_targets++;